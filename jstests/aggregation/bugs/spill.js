@@ -0,0 +1,52 @@
+// $sort and $group spill to disk when the command allows it
+
+var t = db.agg_spill;
+t.drop();
+
+for ( var i = 0; i < 2000; i++ ) {
+    t.insert( { _id : i , k : i % 97 , v : i , s : "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } );
+}
+db.getLastError();
+
+function agg( pipeline , allowDiskUse ) {
+    var cmd = { aggregate : t.getName() , pipeline : pipeline };
+    if ( allowDiskUse )
+        cmd.allowDiskUse = true;
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res );
+    return res.result;
+}
+
+var old = db.adminCommand( { getParameter : 1 , aggregationSpillBytes : 1 } ).aggregationSpillBytes;
+// small enough that both stages write many runs
+assert.commandWorked( db.adminCommand( { setParameter : 1 , aggregationSpillBytes : 16 * 1024 } ) );
+
+try {
+    var sortPipeline = [ { $sort : { k : 1 , v : -1 } } ];
+    assert.eq( agg( sortPipeline , false ) , agg( sortPipeline , true ) , "sort" );
+
+    var groupPipeline = [ { $group : { _id : "$k" ,
+                                       n : { $sum : 1 } ,
+                                       avg : { $avg : "$v" } ,
+                                       first : { $first : "$v" } ,
+                                       last : { $last : "$v" } ,
+                                       vals : { $push : "$v" } ,
+                                       set : { $addToSet : { $mod : [ "$v" , 3 ] } } } } ,
+                          { $sort : { _id : 1 } } ];
+    var inMemory = agg( groupPipeline , false );
+    var spilled = agg( groupPipeline , true );
+    assert.eq( 97 , spilled.length , "group count" );
+    for ( var j = 0; j < inMemory.length; j++ ) {
+        inMemory[j].set.sort();
+        spilled[j].set.sort();
+    }
+    assert.eq( inMemory , spilled , "group" );
+}
+finally {
+    assert.commandWorked( db.adminCommand( { setParameter : 1 , aggregationSpillBytes : old } ) );
+}
+
+// allowDiskUse must be a boolean
+var res = db.runCommand( { aggregate : t.getName() , pipeline : [] , allowDiskUse : 1 } );
+assert.commandFailed( res );
+assert.eq( 16736 , res.code );
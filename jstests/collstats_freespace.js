@@ -0,0 +1,47 @@
+// collStats reports the free space of a collection, and deleted records next to each other are
+// merged into one
+
+t = db.collstats_freespace;
+t.drop();
+
+big = new Array( 1000 ).join( "x" );
+for ( i = 0; i < 1000; i++ )
+    t.insert( { _id : i , s : big } );
+db.getLastError();
+
+res = t.stats();
+assert( res.freeSpace , "A" );
+assert.eq( 19 , res.freeSpace.perBucket.length , "B" );
+startRecords = res.freeSpace.records;
+
+// every other document leaves a hole that nothing next to it can fill
+t.remove( { _id : { $mod : [ 2 , 0 ] } } );
+db.getLastError();
+res = t.stats();
+assert.lte( startRecords + 450 , res.freeSpace.records , "C" );
+assert.lt( 0 , res.freeSpace.fragmentation , "D" );
+assert.lte( res.freeSpace.fragmentation , 1 , "E" );
+holes = res.freeSpace.records;
+coalesced = res.freeSpace.coalesced;
+
+// removing the rest merges the holes with the records between them
+t.remove( {} );
+db.getLastError();
+res = t.stats();
+assert.gt( holes , res.freeSpace.records , "F" );
+assert.lte( coalesced + 500 , res.freeSpace.coalesced , "G" );
+assert.lte( res.freeSpace.largest , res.freeSpace.bytes , "H" );
+
+// new documents reuse the freed space rather than growing the collection
+storageSize = res.storageSize;
+for ( i = 0; i < 1000; i++ )
+    t.insert( { _id : i , s : big } );
+db.getLastError();
+assert.eq( storageSize , t.stats().storageSize , "I" );
+
+// the deleted lists can be walked when the in-memory index isn't built
+res = db.runCommand( { collStats : t.getName() , freeSpace : true } );
+assert.commandWorked( res , "J" );
+assert( res.freeSpace , "K" );
+
+t.drop();
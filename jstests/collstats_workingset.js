@@ -0,0 +1,28 @@
+// collStats { workingSet : true } estimates how much of a collection is in RAM
+
+t = db.collstats_workingset;
+t.drop();
+
+for ( i = 0; i < 1000; i++ )
+    t.insert( { _id : i , s : "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } );
+db.getLastError();
+
+// scan it so it is resident
+assert.eq( 1000 , t.find().itcount() , "A" );
+
+res = db.runCommand( { collStats : t.getName() , workingSet : true } );
+assert.commandWorked( res , "B" );
+assert( res.workingSet , "C" );
+
+ws = res.workingSet;
+if ( ws.info != "not supported" ) {
+    assert.lt( 0 , ws.sampledPages , "D" );
+    assert.lte( ws.residentPages , ws.sampledPages , "E" );
+    assert.lte( 0 , ws.residentRatio , "F" );
+    assert.lte( ws.residentRatio , 1 , "G" );
+    assert.lte( ws.estimatedResidentSize , res.storageSize , "H" );
+}
+assert.lte( 0 , ws.faultYields , "I" );
+
+// no workingSet unless asked for
+assert.isnull( db.runCommand( { collStats : t.getName() } ).workingSet , "J" );
@@ -0,0 +1,50 @@
+// compact { online : true } moves records out of the last extents into free space before them and
+// frees the emptied extents, in short steps that leave the collection usable
+
+t = db.compact_online;
+t.drop();
+
+big = new Array( 2000 ).join( "x" );
+for ( i = 0; i < 4000; i++ )
+    t.insert( { _id : i , a : i % 100 , s : big } );
+t.ensureIndex( { a : 1 } );
+db.getLastError();
+
+before = t.stats();
+assert.lt( 2 , before.numExtents , "A" );
+
+// free most of the space in the first extents
+t.remove( { _id : { $lt : 3000 } } );
+db.getLastError();
+
+assert.commandFailed( db.runCommand( { compact : t.getName() , online : true , maxMBPerSec : -1 } ) ,
+                      "B" );
+
+res = db.runCommand( { compact : t.getName() , online : true , maxMBPerSec : 100 } );
+printjson( res );
+assert.commandWorked( res , "C" );
+assert( res.online , "D" );
+assert.lt( 0 , res.extentsFreed , "E" );
+assert.lt( 0 , res.recordsMoved , "F" );
+assert( res.stopped , "G" );
+
+after = t.stats();
+assert.eq( before.numExtents - res.extentsFreed , after.numExtents , "H" );
+assert.gt( before.storageSize , after.storageSize , "I" );
+
+// the documents and their index entries survive the moves
+assert.eq( 1000 , t.count() , "J" );
+assert.eq( 1000 , t.find().itcount() , "K" );
+assert.eq( 10 , t.find( { a : 7 } ).hint( { a : 1 } ).itcount() , "L" );
+assert.eq( 1000 , t.find().hint( { _id : 1 } ).itcount() , "M" );
+for ( i = 3000; i < 4000; i += 97 )
+    assert.eq( big , t.findOne( { _id : i } ).s , "N " + i );
+assert( t.validate( true ).valid , "O" );
+
+// the collection takes writes again afterwards
+for ( i = 0; i < 1000; i++ )
+    t.insert( { _id : i , a : i % 100 , s : big } );
+assert.eq( null , db.getLastError() , "P" );
+assert.eq( 2000 , t.count() , "Q" );
+
+t.drop();
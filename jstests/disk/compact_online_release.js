@@ -0,0 +1,76 @@
+// compact { online : true } gives the datafiles it leaves wholly free at the end of the database
+// back to the filesystem, and the free space held by a compaction cut short isn't lost
+
+port = allocatePorts( 1 )[ 0 ];
+var baseName = "jstests_disk_compact_online_release";
+var dbpath = "/data/db/" + baseName;
+var m = startMongod( "--noprealloc", "--smallfiles", "--port", port, "--dbpath", dbpath );
+db = m.getDB( "test" );
+
+var MB = 1024 * 1024;
+var t = db[ baseName ];
+// no index, so that all the extents in the last datafile are the collection's
+db.createCollection( baseName, { autoIndexId : false } );
+
+function hasFile( n ) {
+    return listFiles( dbpath ).some( function( f ) { return f.name.match( "/test\\." + n + "$" ); } );
+}
+
+// fill test.0 and test.1 (16MB and 32MB), and start on test.2 (64MB)
+var big = new Array( 16 * 1024 ).join( "x" );
+var n = 0;
+while ( db.stats().fileSize < 112 * MB ) {
+    for ( var i = 0; i < 100; i++ )
+        t.insert( { _id : n++ , s : big } );
+    assert.eq( null , db.getLastError() , "A" );
+}
+assert( hasFile( 2 ) , "B" );
+
+// free the first half; the records in test.2 fit in it
+t.remove( { _id : { $lt : n / 2 } } );
+db.getLastError();
+
+var res = db.runCommand( { compact : baseName , online : true } );
+printjson( res );
+assert.commandWorked( res , "C" );
+assert.lt( 0 , res.extentsFreed , "D" );
+assert.eq( 64 * MB , res.bytesReleased , "E" );
+assert.eq( 48 * MB , db.stats().fileSize , "F" );
+assert( !hasFile( 2 ) , "G" );
+
+assert.eq( n - n / 2 , t.count() , "H" );
+assert.eq( n - n / 2 , t.find().itcount() , "I" );
+assert( t.validate( true ).valid , "J" );
+
+// the database grows again as needed
+for ( var i = 0; i < 2000; i++ )
+    t.insert( { _id : n++ , s : big } );
+assert.eq( null , db.getLastError() , "K" );
+assert( hasFile( 2 ) , "L" );
+
+// a collection renamed while it is drained gets the held free space back on its next write
+t.remove( { _id : { $lt : n / 2 } } );
+db.getLastError();
+assert.commandWorked( db.adminCommand( { setParameter : 1 , compactOnlineStepMillis : 1 } ) );
+function drainsLogged() {
+    return db.adminCommand( { getLog : "global" } ).log.filter( function( line ) {
+        return line.match( /compact online draining extent/ );
+    } ).length;
+}
+var drains = drainsLogged();
+var join = startParallelShell( "db.getSiblingDB( 'test' ).runCommand( { compact : '" + baseName +
+                               "' , online : true , maxMBPerSec : 1 } );" , port );
+assert.soon( function() { return drainsLogged() > drains; } , "compaction didn't start draining" );
+assert.commandWorked( db.adminCommand( { renameCollection : t.getFullName() ,
+                                         to : t.getFullName() + "_renamed" } ) , "M" );
+join();
+
+var renamed = db[ baseName + "_renamed" ];
+renamed.insert( { _id : -1 } );
+assert.eq( null , db.getLastError() , "N" );
+assert( db.adminCommand( { getLog : "global" } ).log.some( function( line ) {
+    return line.match( /putting back the free space held by an interrupted compact online/ );
+} ) , "O" );
+assert( renamed.validate( true ).valid , "P" );
+
+stopMongod( port );
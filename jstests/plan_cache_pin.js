@@ -0,0 +1,75 @@
+// The query plan cache can be listed and pinned, and index changes evict only the plans they
+// affect.
+
+t = db.jstests_plan_cache_pin;
+t.drop();
+
+t.ensureIndex( { a:1 } );
+t.ensureIndex( { b:1 } );
+for( i = 0; i < 300; ++i ) {
+    t.save( { a:i, b:i % 3, c:i } );
+}
+
+q = { a:{ $gt:100 }, b:1 };
+
+function shape() {
+    var res = db.runCommand( { planCacheList:t.getName() } );
+    assert.commandWorked( res );
+    for( var i in res.shapes ) {
+        var s = res.shapes[ i ];
+        if ( friendlyEqual( s.query, { a:"LowerBound", b:"Equality" } ) ) {
+            return s;
+        }
+    }
+    return null;
+}
+
+// A plan race records a winner and its statistics.
+assert.eq( 66, t.find( q ).itcount() );
+s = shape();
+assert( s );
+assert( !s.pinned );
+assert.eq( 1, s.recorded );
+assert.eq( 1, s.plans.length );
+assert.eq( 1, s.plans[ 0 ].runs );
+assert( s.plans[ 0 ].nscanned > 0 );
+
+// An index on an unrelated field keeps the plan, one on a queried field evicts it.
+t.ensureIndex( { c:1 } );
+assert( shape() );
+t.ensureIndex( { b:1, c:1 } );
+assert.isnull( shape() );
+
+// A pinned plan is used for every query of its shape.
+assert.commandWorked( db.runCommand( { planCachePin:t.getName(), query:q, index:{ b:1 } } ) );
+assert.eq( "BtreeCursor b_1", t.find( q ).explain().cursor );
+assert.eq( "BasicCursor",
+           t.find( { a:{ $gt:50 }, b:2 } ).hint( { $natural:1 } ).explain().cursor );
+assert( shape().pinned );
+
+// Writes, new indexes and index changes leave it pinned.
+for( i = 300; i < 1000; ++i ) {
+    t.save( { a:i, b:i % 3, c:i } );
+}
+t.ensureIndex( { a:1, b:1 } );
+assert.eq( "BtreeCursor b_1", t.find( { a:{ $gt:5 }, b:0 } ).explain().cursor );
+assert.eq( 299, t.find( q ).itcount() );
+assert( shape().pinned );
+
+// Pinning an index that doesn't exist fails.
+assert.commandFailed( db.runCommand( { planCachePin:t.getName(), query:q, index:{ d:1 } } ) );
+
+// Clearing the shape unpins it.
+assert.commandWorked( db.runCommand( { planCacheClear:t.getName(), query:q } ) );
+assert.isnull( shape() );
+
+// So does dropping its index.
+assert.commandWorked( db.runCommand( { planCachePin:t.getName(), query:q, index:{ b:1 } } ) );
+assert( shape().pinned );
+t.dropIndex( { b:1 } );
+assert.isnull( shape() );
+
+// Clearing the collection's cache forgets every shape.
+assert.commandWorked( db.runCommand( { planCachePin:t.getName(), query:q, index:{ a:1 } } ) );
+assert.commandWorked( db.runCommand( { planCacheClear:t.getName() } ) );
+assert.eq( [], db.runCommand( { planCacheList:t.getName() } ).shapes );
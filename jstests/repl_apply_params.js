@@ -0,0 +1,22 @@
+// the oplog applier's pool sizes and batch limits can be changed at runtime, within bounds
+
+old = db.adminCommand( { getParameter : 1 , replWriterThreadCount : 1 , replBatchLimitOperations : 1 } );
+assert.commandWorked( old , "A" );
+
+res = db.adminCommand( { setParameter : 1 , replWriterThreadCount : 4 } );
+assert.commandWorked( res , "B" );
+assert.eq( old.replWriterThreadCount , res.was , "C" );
+
+assert.commandFailed( db.adminCommand( { setParameter : 1 , replWriterThreadCount : 0 } ) , "D" );
+assert.commandFailed( db.adminCommand( { setParameter : 1 , replBatchLimitOperations : 0 } ) , "E" );
+assert.commandFailed( db.adminCommand( { setParameter : 1 , replBatchLimitBytes : 1024 } ) , "F" );
+
+assert.commandWorked( db.adminCommand( { setParameter : 1 ,
+                                         replWriterThreadCount : old.replWriterThreadCount } ) , "G" );
+assert.commandWorked( db.adminCommand( { setParameter : 1 ,
+                                         replBatchLimitOperations : old.replBatchLimitOperations } ) , "H" );
+
+// apply lag histogram is reported alongside the other apply metrics
+apply = db.serverStatus().metrics.repl.apply;
+assert( apply.lag , "I" );
+assert.lte( 0 , apply.lag.lt1s , "J" );
@@ -0,0 +1,22 @@
+// serverStatus reports the reply buffers allocated, and how much of them the replies used.
+
+t = db.jstests_reply_buffers;
+t.drop();
+
+for( i = 0; i < 200; ++i ) {
+    t.save( { a:i, s:"a short string value" } );
+}
+
+function replyBuffers() {
+    return db.serverStatus().metrics.replyBuffers;
+}
+
+before = replyBuffers();
+for( i = 0; i < 20; ++i ) {
+    assert.eq( 200, t.find().itcount() );
+}
+after = replyBuffers();
+
+assert( after.allocations - before.allocations >= 20 );
+assert( after.usedBytes > before.usedBytes );
+assert( after.usedBytes <= after.allocatedBytes );
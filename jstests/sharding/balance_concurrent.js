@@ -0,0 +1,47 @@
+// Balancer runs migrations for several collections at once, with distinct
+// donor and recipient shards, and reports its throughput in serverStatus.
+
+s = new ShardingTest( "balance_concurrent" , 4 , 0 , 1 , { chunksize : 1 } );
+s.config.settings.update( { _id: "balancer" }, { $set : { stopped: true } } , true );
+s.adminCommand( { enablesharding : "test" } );
+
+big = ""
+while ( big.length < 10000 )
+    big += "eliot"
+
+db = s.getDB( "test" );
+colls = [ "a" , "b" ];
+colls.forEach( function( name ) {
+    s.adminCommand( { shardcollection : "test." + name , key : { x : 1 } } );
+    for ( i = 0; i < 10; i++ )
+        s.adminCommand( { split : "test." + name , middle : { x : i * 10 } } );
+    for ( i = 0; i < 100; i++ )
+        db[name].insert( { x : i , big : big } );
+    db.getLastError();
+} );
+
+// per-collection imbalance on the one primary shard, so each round has two candidates
+s.config.settings.update( { _id: "balancer" }, { $set : { stopped: false } } );
+
+assert.soon( function() {
+    var a = s.chunkDiff( "a" , "test" );
+    var b = s.chunkDiff( "b" , "test" );
+    print( "diffs: " + a + " " + b );
+    return a < 2 && b < 2;
+} , "balance didn't happen" , 1000 * 60 * 5 , 2000 );
+
+s.config.settings.update( { _id: "balancer" }, { $set : { stopped: true } } );
+
+var status = s.s.getDB( "admin" ).serverStatus().balancer;
+printjson( status );
+assert( status , "no balancer section in serverStatus" );
+assert.gt( status.migrations.succeeded , 0 );
+assert.eq( status.migrations.succeeded , status.migrations.chunksMovedLastHour );
+assert.gt( status.migrations.bytesMovedLastHour , 0 );
+assert.gt( status.migrations.bytesPerSecond , 0 );
+
+colls.forEach( function( name ) {
+    assert.eq( 100 , db[name].count() , "lost documents in " + name );
+} );
+
+s.stop();
@@ -0,0 +1,96 @@
+//
+// Continue-on-error bulk inserts through mongos go to all shards at once, and report every
+// error by the indexes of the documents it may apply to
+//
+
+var st = new ShardingTest({ shards : 2, mongos : 1, verbose : 0 });
+st.stopBalancer();
+
+var mongos = st.s;
+var admin = mongos.getDB( "admin" );
+var config = mongos.getDB( "config" );
+var shards = config.shards.find().toArray();
+var coll = mongos.getCollection( "test.bulk_unordered" );
+
+printjson( admin.runCommand({ enableSharding : coll.getDB() + "" }) );
+printjson( admin.runCommand({ movePrimary : coll.getDB() + "", to : shards[0]._id }) );
+printjson( coll.ensureIndex({ ukey : 1 }, { unique : true }) );
+printjson( admin.runCommand({ shardCollection : coll + "", key : { ukey : 1 } }) );
+printjson( admin.runCommand({ split : coll + "", middle : { ukey : 0 } }) );
+printjson( admin.runCommand({ moveChunk : coll + "",
+                              find : { ukey : 0 },
+                              to : shards[1]._id,
+                              _waitForDelete : true }) );
+
+var resetColl = function() {
+    coll.remove({});
+    assert.eq( null, coll.getDB().getLastError() );
+}
+
+jsTest.log( "Interleaved documents for both shards, no errors..." );
+
+resetColl();
+var N = 5000;
+var inserts = [];
+for ( var i = 0; i < N; i++ ) {
+    inserts.push({ ukey : ( i % 2 == 0 ? i : -i - 1 ), x : i });
+}
+
+coll.insert( inserts, 1 );
+assert.eq( null, coll.getDB().getLastError() );
+assert.eq( N, coll.find().itcount() );
+assert.eq( N / 2, coll.find({ ukey : { $gte : 0 } }).itcount() );
+
+jsTest.log( "Errors from both shards and from mongos..." );
+
+resetColl();
+var inserts = [{ ukey : 1 },
+               { ukey : -1 },
+               { ukey : 1 },      // 2: dup on the positive shard
+               { hello : "world" }, // 3: no shard key
+               { ukey : -2 },
+               { ukey : -1 },     // 5: dup on the negative shard
+               { ukey : 2 }];
+
+coll.insert( inserts, 1 );
+var gle = coll.getDB().getLastErrorObj();
+printjson( gle );
+assert.neq( null, gle.err );
+assert.eq( 4, coll.find().itcount() );
+
+// the last error is the positive shard's, whose batch ends at index 6
+assert( /dup key/.test( gle.err ), "last error should be a duplicate key" );
+assert.eq( 3, gle.writeErrors.length );
+
+assert.eq( 8011, gle.writeErrors[0].code );
+assert.eq( 3, gle.writeErrors[0].index );
+
+// the negative shard's batch holds documents 1, 4 and 5
+assert.eq( 11000, gle.writeErrors[1].code );
+assert.eq( 3, gle.writeErrors[1].n );
+assert.eq( [ 1, 4, 5 ], gle.writeErrors[1].indexes );
+
+// the positive shard's batch holds documents 0, 2 and 6
+assert.eq( 11000, gle.writeErrors[2].code );
+assert.eq( [ 0, 2, 6 ], gle.writeErrors[2].indexes );
+
+jsTest.log( "The same inserts without continue-on-error stop at the first error..." );
+
+resetColl();
+coll.insert( inserts );
+var err = coll.getDB().getLastError();
+assert.neq( null, err );
+assert.eq( 2, coll.find().itcount() );
+
+jsTest.log( "Pipelined inserts can be turned off..." );
+
+assert.commandWorked( admin.runCommand({ setParameter : 1, pipelineUnorderedInserts : false }) );
+resetColl();
+coll.insert( inserts, 1 );
+var gle = coll.getDB().getLastErrorObj();
+assert.neq( null, gle.err );
+assert.eq( undefined, gle.writeErrors );
+assert.eq( 4, coll.find().itcount() );
+assert.commandWorked( admin.runCommand({ setParameter : 1, pipelineUnorderedInserts : true }) );
+
+st.stop();
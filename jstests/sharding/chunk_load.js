@@ -0,0 +1,58 @@
+//
+// Each mongos counts the ops it routes to each chunk.  The load aware balancer collects the counts
+// of every mongos with chunkLoad, and tells restarted counts by serverID and counterId.
+//
+
+var st = new ShardingTest({ shards : 2, mongos : 2, verbose : 0 });
+
+st.stopBalancer();
+
+var admin = st.s0.getDB("admin");
+var coll0 = st.s0.getCollection("test.foo");
+var coll1 = st.s1.getCollection("test.foo");
+
+assert.commandWorked(admin.runCommand({ enableSharding : "test" }));
+assert.commandWorked(admin.runCommand({ shardCollection : "test.foo", key : { _id : 1 } }));
+assert.commandWorked(admin.runCommand({ split : "test.foo", middle : { _id : 0 } }));
+
+var low = tojson({ _id : MinKey });
+var high = tojson({ _id : 0 });
+
+function chunkLoad(mongos) {
+    var res = mongos.getDB("admin").runCommand({ chunkLoad : "test.foo" });
+    assert.commandWorked(res);
+    var load = { serverID : res.serverID, chunks : {} };
+    res.chunks.forEach(function(chunk) { load.chunks[tojson(chunk.min)] = chunk; });
+    return load;
+}
+
+// Writes count, and so do reads of a single shard key value.
+for (var i = 0; i < 10; i++) {
+    coll0.insert({ _id : -1 - i });
+}
+assert.eq(null, coll0.getDB().getLastError());
+assert.neq(null, coll0.findOne({ _id : -1 }));
+
+coll1.update({ _id : 1 }, { $set : { a : 1 } }, true);
+assert.eq(null, coll1.getDB().getLastError());
+assert.neq(null, coll1.findOne({ _id : 1 }));
+
+// Each mongos counts only what it routed.
+var load0 = chunkLoad(st.s0);
+var load1 = chunkLoad(st.s1);
+assert.neq(load0.serverID, load1.serverID);
+assert.eq(11, load0.chunks[low].ops);
+assert.eq(0, load0.chunks[high].ops);
+assert.eq(0, load1.chunks[low].ops);
+assert.eq(2, load1.chunks[high].ops);
+assert.lt(0, load0.chunks[low].bytes);
+
+// A chunk loaded again counts from 0 under a new counterId.
+assert.commandWorked(admin.runCommand({ flushRouterConfig : 1 }));
+assert.neq(null, coll0.findOne({ _id : -1 }));
+var reloaded = chunkLoad(st.s0);
+assert.eq(load0.serverID, reloaded.serverID);
+assert.neq(load0.chunks[low].counterId, reloaded.chunks[low].counterId);
+assert.eq(1, reloaded.chunks[low].ops);
+
+st.stop();
@@ -0,0 +1,62 @@
+//
+// compact { online : true } moves records, and a chunk migration copies the records of the chunk by
+// their DiskLocs.  Compaction stops while a chunk of the collection is migrating off the shard, so
+// that no document is lost.
+//
+
+var st = new ShardingTest({ shards : 2, mongos : 1, verbose : 0 });
+
+st.stopBalancer();
+
+var admin = st.s.getDB("admin");
+var coll = st.s.getCollection("test.compact_migrate");
+
+assert.commandWorked(admin.runCommand({ enableSharding : "test" }));
+assert.commandWorked(admin.runCommand({ shardCollection : coll.getFullName(), key : { _id : 1 } }));
+
+var from = st.getServer("test");
+var to = st.getOther(from);
+var toName = st.s.getDB("config").shards.findOne({ host : to.name })._id;
+
+var big = new Array(2000).join("x");
+for (var i = 0; i < 4000; i++) {
+    coll.insert({ _id : i, s : big });
+}
+assert.eq(null, coll.getDB().getLastError());
+
+// Leave free space at the front of the collection, so compaction has records to move.
+coll.remove({ _id : { $lt : 2000 } });
+assert.eq(null, coll.getDB().getLastError());
+
+// With the recipient locked, the migration stays in its clone phase.
+to.getDB("admin").fsyncLock();
+
+var join = startParallelShell("assert.commandWorked(db.adminCommand({ moveChunk : '" +
+                              coll.getFullName() + "', find : { _id : 0 }, to : '" + toName +
+                              "' }));",
+                              st.s.port);
+
+var res;
+assert.soon(function() {
+    res = from.getDB("test").runCommand({ compact : "compact_migrate", online : true });
+    assert.commandWorked(res);
+    return res.stopped == "chunk migration in progress";
+}, "compact online did not stop for the migration");
+assert.eq(0, res.recordsMoved);
+
+to.getDB("admin").fsyncUnlock();
+join();
+
+// Every document made it to the recipient.
+assert.eq(2000, coll.find().itcount());
+assert.eq(2000, to.getDB("test").compact_migrate.count());
+for (var i = 2000; i < 4000; i += 97) {
+    assert.eq(big, coll.findOne({ _id : i }).s, "missing " + i);
+}
+
+// And compaction runs again afterwards.
+res = from.getDB("test").runCommand({ compact : "compact_migrate", online : true });
+assert.commandWorked(res);
+assert.neq("chunk migration in progress", res.stopped);
+
+st.stop();
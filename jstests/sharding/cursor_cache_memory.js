@@ -0,0 +1,73 @@
+// The cursors mongos keeps open are killed least recently used first once the shard batches they
+// hold exceed cursorCacheMaxBytes
+
+s = new ShardingTest( "cursor_cache_memory" , 2 , 0 , 1 )
+s.stopBalancer()
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+
+var big = new Array( 1024 ).join( "x" );
+N = 2000
+for ( i=0; i<N; i++ ){
+    db.foo.insert( { _id : i , s : big } );
+}
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { _id : N / 2 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { _id : N / 2 } ,
+                  to : s.getOther( s.getServer( "test" ) ).name } );
+
+var admin = s.s.getDB( "admin" );
+
+function info(){
+    var x = db.runCommand( { cursorInfo : 1 } );
+    printjson( x );
+    return x;
+}
+
+// every cursor holds the first batches of both shards
+var first = db.foo.find();
+first.next();
+var one = info();
+assert.eq( 1 , one.sharded );
+assert.lt( 0 , one.bytesBuffered );
+assert.eq( 0 , one.pinned );
+
+assert.commandWorked( admin.runCommand( { setParameter : 1 ,
+                                          cursorCacheMaxBytes : one.bytesBuffered * 3 } ) );
+
+var cursors = [];
+for ( i=0; i<5; i++ ){
+    var c = db.foo.find();
+    c.next();
+    cursors.push( c );
+}
+
+var after = info();
+assert.gte( after.maxBytes , after.bytesBuffered , "over budget" );
+assert.lt( 0 , after.evictedForMemory , "nothing evicted" );
+assert.gt( 6 , after.sharded );
+
+// the least recently used cursor went first, the last one opened is intact
+assert.throws( function(){ first.itcount(); } , null , "first cursor should be gone" );
+assert.eq( N - 1 , cursors[4].itcount() );
+
+// no limit
+assert.commandWorked( admin.runCommand( { setParameter : 1 , cursorCacheMaxBytes : 0 } ) );
+var before = info().evictedForMemory;
+cursors = [];
+for ( i=0; i<5; i++ ){
+    var c = db.foo.find();
+    c.next();
+    cursors.push( c );
+}
+assert.eq( before , info().evictedForMemory );
+for ( i=0; i<5; i++ )
+    assert.eq( N - 1 , cursors[i].itcount() );
+
+assert.eq( 0 , info().sharded );
+
+s.stop()
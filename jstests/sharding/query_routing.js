@@ -0,0 +1,78 @@
+// Queries on a prefix of a compound shard key, and $in on a hashed shard key, go only to the
+// shards they need, and mongos counts how it routed them
+
+var st = new ShardingTest({ shards : 3, mongos : 1 });
+st.stopBalancer();
+
+var mongos = st.s;
+var admin = mongos.getDB( "admin" );
+var shards = mongos.getDB( "config" ).shards.find().sort({ _id : 1 }).toArray();
+
+assert.commandWorked( admin.runCommand({ enableSharding : "test" }) );
+printjson( admin.runCommand({ movePrimary : "test", to : shards[0]._id }) );
+
+function routing() {
+    return admin.serverStatus().metrics.routing;
+}
+
+function numShards( explain ) {
+    return explain.shards ? Object.keySet( explain.shards ).length : 1;
+}
+
+jsTest.log( "Compound shard key prefixes..." );
+
+var coll = mongos.getCollection( "test.compound" );
+assert.commandWorked( admin.runCommand({ shardCollection : coll + "", key : { a : 1, b : 1 } }) );
+for ( var i = 0; i < 3; i++ ) {
+    if ( i > 0 )
+        assert.commandWorked( admin.runCommand({ split : coll + "", middle : { a : i, b : 0 } }) );
+    assert.commandWorked( admin.runCommand({ moveChunk : coll + "",
+                                             find : { a : i, b : 0 },
+                                             to : shards[i]._id }) );
+}
+for ( var a = 0; a < 3; a++ ) {
+    for ( var b = -5; b < 5; b++ )
+        coll.insert({ a : a, b : b });
+}
+assert.eq( null, coll.getDB().getLastError() );
+
+var before = routing();
+
+// a = 1 spans { a : 1, b : MinKey } to { a : 1, b : MaxKey }, on shards 0 and 1
+assert.eq( 10, coll.find({ a : 1 }).itcount() );
+assert.eq( 2, numShards( coll.find({ a : 1 }).explain() ) );
+assert.eq( 5, coll.find({ a : 2, b : { $gte : 0 } }).itcount() );
+assert.eq( 1, numShards( coll.find({ a : 2, b : { $gte : 0 } }).explain() ) );
+
+// points in both fields multiply
+assert.eq( 4, coll.find({ a : { $in : [ 1, 2 ] }, b : { $in : [ 3, 4 ] } }).itcount() );
+assert.eq( 2, numShards( coll.find({ a : { $in : [ 1, 2 ] }, b : { $in : [ 3, 4 ] } }).explain() ) );
+
+// no shard key
+assert.eq( 30, coll.find({ b : { $gte : -5 } }).itcount() );
+
+var after = routing();
+printjson( before );
+printjson( after );
+assert.lt( before.targeted, after.targeted );
+assert.lt( before.partial, after.partial );
+assert.lt( before.broadcast, after.broadcast );
+assert.lt( before.cacheHits, after.cacheHits );
+
+jsTest.log( "Hashed shard key $in..." );
+
+var hashed = mongos.getCollection( "test.hashed" );
+assert.commandWorked( admin.runCommand({ shardCollection : hashed + "",
+                                         key : { x : "hashed" },
+                                         numInitialChunks : 30 }) );
+for ( var x = 0; x < 100; x++ )
+    hashed.insert({ x : x });
+assert.eq( null, hashed.getDB().getLastError() );
+
+assert.eq( 1, hashed.find({ x : 7 }).itcount() );
+assert.eq( 1, numShards( hashed.find({ x : 7 }).explain() ) );
+assert.eq( 2, hashed.find({ x : { $in : [ 7, 8 ] } }).itcount() );
+assert.gte( 2, numShards( hashed.find({ x : { $in : [ 7, 8 ] } }).explain() ) );
+assert.eq( 3, numShards( hashed.find({ x : { $gt : 7 } }).explain() ) );
+
+st.stop();
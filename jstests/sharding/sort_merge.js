@@ -0,0 +1,97 @@
+// Sorted and unsorted queries merged across shards, with batches small enough that every
+// shard cursor prefetches many getMores
+
+s = new ShardingTest( "sort_merge" , 3 , 0 , 1 )
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.data" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+
+N = 3000
+
+for ( i=0; i<N; i++ ){
+    db.data.insert( { _id : i , x : ( i * 7919 ) % N , s : "" + ( i % 97 ) } )
+}
+db.getLastError();
+
+// spread the chunks so that every shard holds keys from all over the range
+for ( i=1; i<12; i++ ){
+    s.adminCommand( { split : "test.data" , middle : { _id : i * N / 12 } } )
+    s.adminCommand( { movechunk : "test.data" , find : { _id : i * N / 12 } ,
+                      to : s._shardNames[ i % 3 ] } )
+}
+
+printjson( db.data.stats() );
+for ( i=0; i<3; i++ )
+    assert.lt( 0 , s._connections[i].getDB( "test" ).data.count() , "shard " + i + " is empty" );
+
+function checkSorted( cursor , key , dir , msg ){
+    var n = 0;
+    var last = null;
+    while ( cursor.hasNext() ){
+        var o = cursor.next();
+        if ( last != null )
+            assert.lte( 0 , dir * ( o[key] - last ) , msg + " out of order at " + n );
+        last = o[key];
+        n++;
+    }
+    assert.eq( N , n , msg + " count" );
+}
+
+checkSorted( db.data.find().sort( { x : 1 } ).batchSize( 7 ) , "x" , 1 , "x asc" );
+checkSorted( db.data.find().sort( { x : -1 } ).batchSize( 13 ) , "x" , -1 , "x desc" );
+checkSorted( db.data.find().sort( { _id : 1 } ).batchSize( 5 ) , "_id" , 1 , "_id asc" );
+checkSorted( db.data.find().sort( { x : 1 } ) , "x" , 1 , "x default batch" );
+
+// equal sort keys from several shards
+var seen = {};
+var c = db.data.find().sort( { s : 1 } ).batchSize( 11 );
+var last = null;
+var n = 0;
+while ( c.hasNext() ){
+    var o = c.next();
+    if ( last != null )
+        assert.lte( last , o.s , "s out of order at " + n );
+    assert( ! seen[o._id] , "duplicate " + o._id );
+    seen[o._id] = true;
+    last = o.s;
+    n++;
+}
+assert.eq( N , n , "s count" );
+
+// unsorted, each document once
+seen = {};
+n = 0;
+c = db.data.find().batchSize( 9 );
+while ( c.hasNext() ){
+    var o = c.next();
+    assert( ! seen[o._id] , "duplicate unsorted " + o._id );
+    seen[o._id] = true;
+    n++;
+}
+assert.eq( N , n , "unsorted count" );
+
+// skip and limit still apply to the merged stream
+var a = db.data.find().sort( { x : 1 } ).skip( 100 ).limit( 50 ).batchSize( 7 ).toArray();
+assert.eq( 50 , a.length , "limit" );
+for ( i=0; i<a.length; i++ )
+    assert.eq( 100 + i , a[i].x , "skip/limit " + i );
+
+// abandoning cursors with getMores outstanding leaves mongos working
+for ( i=0; i<20; i++ ){
+    c = db.data.find().sort( { x : 1 } ).batchSize( 3 );
+    c.next(); c.next(); c.next(); c.next();
+}
+assert.eq( N , db.data.find().sort( { x : 1 } ).itcount() , "after abandoned" );
+
+// a cursor idle between getMores doesn't hold pooled connections to the shards
+c = db.data.find().sort( { x : 1 } ).batchSize( 3 );
+for ( i=0; i<7; i++ )
+    c.next();
+assert.soon( function(){
+    return s.s.getDB( "admin" ).runCommand( { connPoolStats : 1 } ).totalInUse == 0;
+} , "idle cursor holds connections" );
+assert.eq( 7 , c.next().x , "after idle" );
+
+s.stop()
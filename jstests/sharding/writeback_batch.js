@@ -0,0 +1,58 @@
+//
+// Writebacks queued faster than mongos replays them are taken in batches, coalesced and
+// replayed without losing or reordering any writes
+//
+
+var st = new ShardingTest({ shards : 1,
+                            mongos : 2,
+                            verbose : 1,
+                            other : { separateConfig : true,
+                                      mongosOptions : { noAutoSplit : "" } } });
+
+st.stopBalancer();
+
+var mongosA = st.s0;
+var mongosB = st.s1;
+
+var collA = mongosA.getCollection( jsTestName() + ".coll" );
+collA.insert({ _id : -1 });
+assert.eq( null, collA.getDB().getLastError() );
+
+// mongosB sees the collection unsharded
+var collB = mongosB.getCollection( "" + collA );
+assert.eq( 1, collB.find().itcount() );
+
+printjson( mongosA.getDB( "admin" ).runCommand({ enableSharding : collA.getDB() + "" }) );
+printjson( mongosA.getDB( "admin" ).runCommand({ shardCollection : collA + "",
+                                                 key : { _id : 1 } }) );
+
+// mongod learns the sharded version from mongosA
+collA.findOne();
+
+jsTest.log( "Stale inserts from mongosB..." );
+
+var N = 1000;
+for ( var i = 0; i < N; i++ ) {
+    collB.insert({ _id : i, x : i });
+}
+// a duplicate, which mustn't stop the writes coalesced around it
+collB.insert({ _id : 0, x : "dup" });
+collB.insert({ _id : N });
+
+// the duplicate's error may be reported with the insert it was coalesced into
+printjson( collB.getDB().getLastErrorObj() );
+
+assert.eq( N + 2, collA.find().itcount() );
+assert.eq( 0, collA.find({ x : "dup" }).itcount() );
+
+var wbStatus = mongosB.getDB( "admin" ).serverStatus().metrics.writeBacks;
+printjson( wbStatus );
+assert.lt( 0, wbStatus.replayed );
+
+var shardStatus = st.shard0.getDB( "admin" ).serverStatus().metrics.writeBacks;
+printjson( shardStatus );
+assert.lt( 0, shardStatus.queued );
+assert.eq( 0, shardStatus.queueFull );
+assert.eq( 0, shardStatus.bytesQueued );
+
+st.stop();
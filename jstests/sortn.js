@@ -0,0 +1,41 @@
+// An in memory sort of mixed type and compound keys matches the order of an index.
+
+t = db.jstests_sortn;
+t.drop();
+
+var values = [ MinKey, MaxKey, null, NaN, -Infinity, -1e300, -1, -0, 0, NumberLong( 0 ), 0.5, 3,
+               NumberLong( "9007199254740993" ), Infinity, "", "a", "a\u0000b", "ab", "b", {},
+               { a : 1 }, { a : 1, b : 1 }, { b : 0 }, { a : { b : "x" } },
+               ObjectId( "000000000000000000000001" ), false, true, new Date( -5 ),
+               new Date( 5 ), /a/, /a/i, /ab/ ];
+
+for( var i = 0; i < values.length; ++i ) {
+    for( var j = 0; j < 3; ++j ) {
+        t.save( { _id : i * 3 + j, x : values[ i ], y : values[ ( i * 7 + j ) % values.length ] } );
+    }
+}
+
+function ids( cursor ) {
+    return cursor.toArray().map( function( o ) { return o._id; } );
+}
+
+// _id breaks ties, so that there is one right order
+var sorts = [ { x : 1, y : 1, _id : 1 }, { x : -1, y : 1, _id : 1 }, { x : 1, y : -1, _id : -1 },
+              { y : -1, _id : 1 } ];
+var limits = [ 0, 5, 50 ];
+var unindexed = [];
+sorts.forEach( function( sort ) {
+    limits.forEach( function( limit ) {
+        unindexed.push( ids( t.find( {}, { _id : 1 } ).sort( sort ).limit( limit ) ) );
+    } );
+} );
+
+var k = 0;
+sorts.forEach( function( sort ) {
+    t.ensureIndex( sort );
+    limits.forEach( function( limit ) {
+        var indexed = ids( t.find( {}, { _id : 1 } ).sort( sort ).hint( sort ).limit( limit ) );
+        assert.eq( unindexed[ k ], indexed, tojson( sort ) + " limit " + limit );
+        ++k;
+    } );
+} );
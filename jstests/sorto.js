@@ -0,0 +1,56 @@
+// An in memory sort holds only the projected documents.  Once those outgrow the memory limit, it
+// spills to disk rather than failing if scanAndOrderMaxDiskBytes allows, as long as the results
+// returned fit in a reply.
+
+t = db.jstests_sorto;
+t.drop();
+
+big = new Array( 1000000 ).toString();
+for( i = 0; i < 40; ++i ) {
+    t.save( { a:( i * 7 ) % 40, big:big } );
+}
+
+function spills() {
+    return db.serverStatus().metrics.operation.scanAndOrderSpills;
+}
+
+// Projected results are small enough to sort in memory and return.
+before = spills();
+res = t.find( {}, { _id:0, a:1 } ).sort( { a:1 } ).toArray();
+assert.eq( 40, res.length );
+for( i = 0; i < 40; ++i ) {
+    assert.eq( i, res[ i ].a );
+}
+assert.eq( before, spills() );
+
+// So are a few whole documents past a skip, kept in a heap without spilling.
+before = spills();
+res = t.find().sort( { a:-1 } ).skip( 5 ).limit( 3 ).toArray();
+assert.eq( [ 34, 33, 32 ], res.map( function( o ) { return o.a; } ) );
+assert.eq( before, spills() );
+
+// All the whole documents are not.
+assert.throws( function() { t.find().sort( { a:1 } ).itcount(); } );
+assert( db.getLastError().match( /too much data for sort\(\) with no index/ ) );
+
+// Whole documents past a skip are buffered, not kept in a heap, under a lower
+// scanAndOrderTopKMaxLimit.  They outgrow memory, and spill only once disk use is enabled.
+topKMaxLimit = db.adminCommand( { setParameter:1, scanAndOrderTopKMaxLimit:1 } ).was;
+function skipped() {
+    return t.find().sort( { a:1 } ).skip( 30 ).limit( 5 ).toArray();
+}
+assert.throws( skipped );
+assert.commandWorked( db.adminCommand( { setParameter:1,
+                                         scanAndOrderMaxDiskBytes:256 * 1024 * 1024 } ) );
+before = spills();
+assert.eq( [ 30, 31, 32, 33, 34 ], skipped().map( function( o ) { return o.a; } ) );
+assert.lt( before, spills() );
+
+// But no further than scanAndOrderMaxDiskBytes.
+assert.commandWorked( db.adminCommand( { setParameter:1, scanAndOrderMaxDiskBytes:1024 * 1024 } ) );
+assert.throws( skipped );
+
+assert.commandWorked( db.adminCommand( { setParameter:1, scanAndOrderMaxDiskBytes:0 } ) );
+assert.commandWorked( db.adminCommand( { setParameter:1, scanAndOrderTopKMaxLimit:topKMaxLimit } ) );
+
+t.drop();
@@ -0,0 +1,154 @@
+// bson_field_index.cpp
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/bson/bson_field_index.h"
+
+#include <cstring>
+
+namespace mongo {
+
+    BSONFieldIndex::BSONFieldIndex( const BSONObj& obj ) :
+        _obj( obj ),
+        _scanned( false ),
+        _indexing( false ),
+        _next( obj.objdata() + 4 ),
+        _size( 0 ),
+        _mask( InlineSlots - 1 ),
+        _slots( _inline ) {
+        // the slots are cleared only once a second lookup needs them
+    }
+
+    unsigned BSONFieldIndex::hashName( const char* name, size_t len ) {
+        // FNV-1a
+        unsigned h = 2166136261U;
+        for( size_t i = 0; i < len; ++i ) {
+            h ^= (unsigned char)name[ i ];
+            h *= 16777619U;
+        }
+        return h;
+    }
+
+    BSONElement BSONFieldIndex::find( const StringData& name, unsigned hash ) const {
+        for( unsigned i = hash & _mask; _slots[ i ].elem; i = ( i + 1 ) & _mask ) {
+            if ( _slots[ i ].hash == hash && name == StringData( _slots[ i ].elem + 1 ) )
+                return BSONElement( _slots[ i ].elem );
+        }
+        return BSONElement();
+    }
+
+    void BSONFieldIndex::insert( const char* elem, unsigned hash ) {
+        if ( ( _size + 1 ) * 2 > _mask + 1 ) {
+            // keep the table at most half full
+            unsigned slots = ( _mask + 1 ) * 2;
+            boost::scoped_array<Slot> heap( new Slot[ slots ] );
+            memset( heap.get(), 0, slots * sizeof( Slot ) );
+            Slot* old = _slots;
+            unsigned oldSlots = _mask + 1;
+            _mask = slots - 1;
+            _slots = heap.get();
+            for( unsigned i = 0; i < oldSlots; ++i ) {
+                if ( !old[ i ].elem )
+                    continue;
+                unsigned j = old[ i ].hash & _mask;
+                while( _slots[ j ].elem )
+                    j = ( j + 1 ) & _mask;
+                _slots[ j ] = old[ i ];
+            }
+            _heap.swap( heap );
+        }
+        unsigned i = hash & _mask;
+        while( _slots[ i ].elem )
+            i = ( i + 1 ) & _mask;
+        _slots[ i ].elem = elem;
+        _slots[ i ].hash = hash;
+        ++_size;
+    }
+
+    BSONElement BSONFieldIndex::getField( const StringData& name ) {
+        if ( !_indexing ) {
+            if ( !_scanned ) {
+                _scanned = true;
+                return _obj.getField( name );
+            }
+            _indexing = true;
+            memset( _inline, 0, sizeof( _inline ) );
+        }
+
+        unsigned hash = hashName( name.rawData(), name.size() );
+        BSONElement e = find( name, hash );
+        if ( !e.eoo() )
+            return e;
+
+        while( _next ) {
+            BSONElement x( _next );
+            if ( x.eoo() ) {
+                _next = 0;
+                break;
+            }
+            _next += x.size();
+            StringData fieldName( x.fieldName(), x.fieldNameSize() - 1 );
+            unsigned h = hashName( fieldName.rawData(), fieldName.size() );
+            // the first of fields with the same name is the one found
+            if ( find( fieldName, h ).eoo() )
+                insert( x.rawdata(), h );
+            if ( h == hash && fieldName == name )
+                return x;
+        }
+        return BSONElement();
+    }
+
+    BSONElement BSONFieldIndex::getFieldDotted( const StringData& name ) {
+        BSONElement e = getField( name );
+        if ( e.eoo() ) {
+            size_t p = name.find( '.' );
+            if ( p != string::npos ) {
+                BSONElement sub = getField( name.substr( 0, p ) );
+                BSONType t = sub.type();
+                BSONObj subObj = t == Object || t == Array ? sub.embeddedObject() : BSONObj();
+                return subObj.isEmpty() ?
+                        BSONElement() :
+                        subObj.getFieldDotted( name.substr( p + 1 ).toString() );
+            }
+        }
+        return e;
+    }
+
+    BSONElement BSONFieldIndex::getFieldDottedOrArray( const char*& name ) {
+        const char* p = strchr( name, '.' );
+
+        BSONElement sub;
+
+        if ( p ) {
+            sub = getField( StringData( name, p - name ) );
+            name = p + 1;
+        }
+        else {
+            sub = getField( name );
+            name = name + strlen( name );
+        }
+
+        if ( sub.eoo() )
+            return BSONElement();
+        else if ( sub.type() == Array || name[0] == '\0' )
+            return sub;
+        else if ( sub.type() == Object )
+            return sub.embeddedObject().getFieldDottedOrArray( name );
+        else
+            return BSONElement();
+    }
+
+}
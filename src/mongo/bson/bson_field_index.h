@@ -0,0 +1,82 @@
+// bson_field_index.h
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * Looks up several fields of one BSONObj by name without scanning the object from its
+     * start for each of them, as BSONObj::getField() does.
+     *
+     * The first lookup scans like getField().  From the second on, the elements passed while
+     * scanning are entered in a hash table of their offsets, so a later lookup finds a field
+     * already passed with one probe, and only resumes the scan, where the last one stopped,
+     * for a field further on.  All lookups together thus scan the object at most twice, however
+     * wide it is.  The table is held inline for objects of up to 16 fields, and allocated for
+     * wider ones.
+     *
+     * Lookups find the element getField() would, the first of fields with the same name.  The
+     * object must not change while the index is used.
+     */
+    class BSONFieldIndex : boost::noncopyable {
+    public:
+        explicit BSONFieldIndex( const BSONObj& obj );
+
+        const BSONObj& obj() const { return _obj; }
+
+        /** @return as obj().getField( name ) */
+        BSONElement getField( const StringData& name );
+
+        /** @return as obj().getFieldDotted( name ) */
+        BSONElement getFieldDotted( const StringData& name );
+
+        /** @return as obj().getFieldDottedOrArray( name ), advancing name as it does */
+        BSONElement getFieldDottedOrArray( const char*& name );
+
+    private:
+        struct Slot {
+            const char* elem; // 0 if empty
+            unsigned hash;
+        };
+
+        static const unsigned InlineSlots = 32;
+
+        static unsigned hashName( const char* name, size_t len );
+
+        /** @return the element entered for name, or eoo */
+        BSONElement find( const StringData& name, unsigned hash ) const;
+
+        void insert( const char* elem, unsigned hash );
+
+        BSONObj _obj;
+        bool _scanned;     // whether a lookup was made yet
+        bool _indexing;    // whether a second one was, so the slots are in use
+        const char* _next; // the first element not entered, 0 once all are
+        unsigned _size;
+        unsigned _mask;    // slots - 1, a power of two less one
+        Slot* _slots;
+        Slot _inline[ InlineSlots ];
+        boost::scoped_array<Slot> _heap;
+    };
+
+}
@@ -213,4 +213,26 @@ namespace {
         ASSERT_NOT_OK(validateBSON(x.objdata(), x.objsize() / 2));
     }
 
+    TEST(BSONValidateFast, FieldNameLengths) {
+        // names shorter and longer than the block the end of a name is first searched in
+        BSONObjBuilder b;
+        for ( int len = 0; len < 40; len++ ) {
+            b.append( string( len, 'a' + len % 26 ), len );
+        }
+        BSONObj x = b.obj();
+        ASSERT_OK( validateBSON( x.objdata(), x.objsize() ) );
+        for ( int len = 5; len < x.objsize(); len++ ) {
+            ASSERT_NOT_OK( validateBSON( x.objdata(), len ) );
+        }
+    }
+
+    TEST(BSONValidateFast, DeeplyNested) {
+        BSONObj x = BSON( "a" << 1 );
+        for ( int i = 0; i < 100; i++ ) {
+            x = BSON( "a" << x << "b" << BSON_ARRAY( i ) );
+        }
+        ASSERT_OK( validateBSON( x.objdata(), x.objsize() ) );
+        ASSERT_NOT_OK( validateBSON( x.objdata(), x.objsize() - 1 ) );
+    }
+
 }
@@ -0,0 +1,184 @@
+// key_string.cpp
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/bson/key_string.h"
+
+#include "mongo/platform/float_utils.h"
+
+namespace mongo {
+
+    namespace {
+
+        // Ends a key or an embedded object.  Fields start with their canonical type + 2, which
+        // is neither 0 nor, inverted, 0xff; so a key that runs out of fields orders before one
+        // that doesn't, whatever the direction of the next field.
+        const char End = 0;
+
+        const long long MaxExactLong = 1LL << 53;
+
+        void appendBigEndian( std::string& out, unsigned long long v, int bytes ) {
+            for ( int shift = 8 * ( bytes - 1 ); shift >= 0; shift -= 8 )
+                out.push_back( (char)( v >> shift ) );
+        }
+
+        /**
+         * Orders like woCompare orders numbers: by value, with NaNs equal to each other and
+         * before every other number, and -0 equal to 0.
+         */
+        void appendDouble( std::string& out, double d ) {
+            if ( isNaN( d ) ) {
+                // below the encoding of -infinity, 0x000fffffffffffff
+                appendBigEndian( out, 0, 8 );
+                return;
+            }
+            if ( d == 0 )
+                d = 0;
+
+            unsigned long long bits;
+            memcpy( &bits, &d, sizeof( bits ) );
+            const unsigned long long sign = 1ULL << 63;
+            appendBigEndian( out, ( bits & sign ) ? ~bits : bits | sign, 8 );
+        }
+
+        /**
+         * Appends the n bytes at s with each zero escaped as 0x00 0xff, then 0x00 0x00.  Orders
+         * as the bytes do, a string before those it is a prefix of, which is how woCompare
+         * orders strings (holding zeros or not).
+         */
+        void appendEscaped( std::string& out, const char* s, int n ) {
+            for ( int i = 0; i < n; i++ ) {
+                out.push_back( s[i] );
+                if ( s[i] == 0 )
+                    out.push_back( (char) 0xff );
+            }
+            out.push_back( 0 );
+            out.push_back( 0 );
+        }
+
+        bool appendObject( std::string& out, const BSONObj& obj );
+
+        /** the comparisons are those of BSONElement::woCompare and compareElementValues() */
+        bool appendElement( std::string& out, const BSONElement& e, bool considerFieldName ) {
+            out.push_back( (char)( e.canonicalType() + 2 ) );
+            if ( considerFieldName )
+                out.append( e.fieldName(), e.fieldNameSize() );
+
+            switch ( e.type() ) {
+            case EOO:
+            case Undefined:
+            case jstNULL:
+            case MinKey:
+            case MaxKey:
+                return true;
+            case NumberDouble:
+                appendDouble( out, e._numberDouble() );
+                return true;
+            case NumberInt:
+                appendDouble( out, e._numberInt() );
+                return true;
+            case NumberLong: {
+                long long v = e._numberLong();
+                if ( v > MaxExactLong || v < -MaxExactLong )
+                    return false;
+                appendDouble( out, (double) v );
+                return true;
+            }
+            case String:
+            case Symbol:
+            case Code:
+                appendEscaped( out, e.valuestr(), e.valuestrsize() - 1 );
+                return true;
+            case Object:
+            case Array:
+                return appendObject( out, e.embeddedObject() );
+            case BinData:
+                // by length, then subtype and data
+                appendBigEndian( out, e.objsize(), 4 );
+                out.append( e.value() + 4, e.objsize() + 1 );
+                return true;
+            case jstOID:
+                out.append( e.value(), 12 );
+                return true;
+            case Bool:
+                if ( (unsigned char) *e.value() > 1 )
+                    return false;
+                out.push_back( *e.value() );
+                return true;
+            case Date:
+                appendBigEndian( out, e.date().millis ^ ( 1ULL << 63 ), 8 );
+                return true;
+            case RegEx:
+                out.append( e.regex(), strlen( e.regex() ) + 1 );
+                out.append( e.regexFlags(), strlen( e.regexFlags() ) + 1 );
+                return true;
+            case DBRef:
+                appendBigEndian( out, e.valuesize(), 4 );
+                out.append( e.value(), e.valuesize() );
+                return true;
+            case Timestamp:
+            case CodeWScope:
+            default:
+                return false;
+            }
+        }
+
+        /** as embedded objects compare, with their field names */
+        bool appendObject( std::string& out, const BSONObj& obj ) {
+            BSONObjIterator i( obj );
+            while ( i.more() ) {
+                if ( ! appendElement( out, i.next(), true ) )
+                    return false;
+            }
+            out.push_back( End );
+            return true;
+        }
+
+    }
+
+    KeyString::KeyString( const BSONObj& key, const Ordering& o, bool considerFieldNames ) {
+        _bytes.reserve( key.objsize() + 8 );
+        _exact = encode( key, o, considerFieldNames, _bytes );
+        if ( ! _exact )
+            _bytes.clear();
+    }
+
+    KeyString::KeyString( const BSONObj& key ) {
+        _bytes.reserve( key.objsize() + 8 );
+        _exact = encode( key, Ordering::make( BSONObj() ), true, _bytes );
+        if ( ! _exact )
+            _bytes.clear();
+    }
+
+    bool KeyString::encode( const BSONObj& key, const Ordering& o, bool considerFieldNames,
+                            std::string& out ) {
+        unsigned mask = 1;
+        BSONObjIterator i( key );
+        while ( i.more() ) {
+            size_t start = out.size();
+            if ( ! appendElement( out, i.next(), considerFieldNames ) )
+                return false;
+            if ( o.descending( mask ) ) {
+                for ( size_t j = start; j < out.size(); j++ )
+                    out[j] = ~out[j];
+            }
+            mask <<= 1;
+        }
+        out.push_back( End );
+        return true;
+    }
+
+}
@@ -0,0 +1,84 @@
+// key_string.h
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * A BSON key encoded so that keys compare with memcmp() exactly as woCompare() compares
+     * them: for keys a and b encoded with the same Ordering,
+     *
+     *     KeyString( a, o ).compare( KeyString( b, o ) )
+     *
+     * has the sign of a.woCompare( b, o, considerFieldNames ).  Each field is encoded as its
+     * canonical type, its field name if those are considered, and a byte-comparable form of its
+     * value; the bytes of a descending field are inverted.
+     *
+     * A few values have no exact encoding: Timestamps (which woCompare orders differently
+     * against Dates depending on the side they are on), NumberLongs beyond 2^53 in magnitude
+     * (which compare exactly with each other but through doubles with other numbers),
+     * CodeWScope, and malformed Bools.  A key holding one of these is not exact(), and must
+     * be compared with woCompare() instead; since exact keys compare as woCompare() does, a
+     * comparator may mix the two ways freely.
+     */
+    class KeyString {
+    public:
+        KeyString() : _exact( false ) { }
+
+        /** encodes key for comparisons as by key.woCompare( r, o, considerFieldNames ) */
+        KeyString( const BSONObj& key, const Ordering& o, bool considerFieldNames = false );
+
+        /** encodes key for comparisons as by key.woCompare( r ) */
+        explicit KeyString( const BSONObj& key );
+
+        /** @return false if the key couldn't be encoded, in which case bytes() is empty */
+        bool exact() const { return _exact; }
+
+        const std::string& bytes() const { return _bytes; }
+
+        /** @return <0, 0, >0 as this key orders before, with or after r; both must be exact */
+        int compare( const KeyString& r ) const {
+            dassert( _exact && r._exact );
+            size_t n = std::min( _bytes.size(), r._bytes.size() );
+            int c = memcmp( _bytes.data(), r._bytes.data(), n );
+            if ( c )
+                return c;
+            // encodings are never proper prefixes of each other, so this is for equal keys
+            return _bytes.size() == r._bytes.size() ? 0 : _bytes.size() < r._bytes.size() ? -1 : 1;
+        }
+
+        /**
+         * Appends the encoding of key to out.
+         * @return false if key holds a value without an exact encoding, leaving what follows
+         * out's original contents unspecified.
+         */
+        static bool encode( const BSONObj& key, const Ordering& o, bool considerFieldNames,
+                            std::string& out );
+
+    private:
+        std::string _bytes;
+        bool _exact;
+    };
+
+}
@@ -26,8 +26,24 @@
 
 namespace mongo {
 
+    int connPoolMaxInUseConnsPerHost = 0;
+    int connPoolWaitTimeoutMS = 20000;
+    int connPoolMinConnsPerHost = 0;
+    int connPoolValidateIdleSecs = 60;
+
     // ------ PoolForHost ------
 
+    void PoolForHost::_initStats() {
+        _inUse = 0;
+        _nextWaiter = 0;
+        _waits = 0;
+        _waitTimeouts = 0;
+        for ( int i = 0; i < WaitBuckets; i++ )
+            _waitHistogram[i] = 0;
+        _createdAtLastTick = 0;
+        _createdPerSecond = 0;
+    }
+
     PoolForHost::~PoolForHost() {
         clear();
     }
@@ -122,6 +138,33 @@ namespace mongo {
         }
     }
 
+    void PoolForHost::takeUncheckedConnections( time_t now, int idleSecs,
+                                                vector<StoredConnection>& unchecked ) {
+        vector<StoredConnection> all;
+        while ( ! _pool.empty() ) {
+            StoredConnection c = _pool.top();
+            _pool.pop();
+
+            if ( c.needsCheck( now, idleSecs ) )
+                unchecked.push_back( c );
+            else
+                all.push_back( c );
+        }
+
+        // push back in reverse so the most recently used stay on top
+        for ( vector<StoredConnection>::reverse_iterator i = all.rbegin(); i != all.rend(); ++i ) {
+            _pool.push( *i );
+        }
+    }
+
+    bool PoolForHost::putBack( const StoredConnection& sc ) {
+        if ( _pool.size() >= _maxPerHost ||
+                isBadSocketCreationTime( sc.conn->getSockCreationMicroSec() ) )
+            return false;
+        _pool.push( sc );
+        return true;
+    }
+
     void PoolForHost::getStaleConnections( vector<DBClientBase*>& stale ) {
         time_t now = time(0);
 
@@ -145,6 +188,7 @@ namespace mongo {
     PoolForHost::StoredConnection::StoredConnection( DBClientBase * c ) {
         conn = c;
         when = time(0);
+        checked = when;
     }
 
     bool PoolForHost::StoredConnection::ok( time_t now ) {
@@ -152,12 +196,64 @@ namespace mongo {
         return ( now - when ) < 1800;
     }
 
+    bool PoolForHost::StoredConnection::needsCheck( time_t now, int secs ) const {
+        return ( now - max( when, checked ) ) >= secs;
+    }
+
     void PoolForHost::createdOne( DBClientBase * base) {
         if ( _created == 0 )
             _type = base->type();
         _created++;
     }
 
+    unsigned long long PoolForHost::enqueueWaiter() {
+        unsigned long long ticket = _nextWaiter++;
+        _waiters.push_back( ticket );
+        return ticket;
+    }
+
+    bool PoolForHost::isFirstWaiter( unsigned long long ticket ) const {
+        return ! _waiters.empty() && _waiters.front() == ticket;
+    }
+
+    void PoolForHost::dequeueWaiter( unsigned long long ticket ) {
+        _waiters.remove( ticket );
+    }
+
+    void PoolForHost::recordWait( long long micros, bool timedOut ) {
+        _waits++;
+        if ( timedOut )
+            _waitTimeouts++;
+
+        int bucket = 0;
+        for ( long long limit = 1000; bucket < WaitBuckets - 1 && micros >= limit; limit *= 10 )
+            bucket++;
+        _waitHistogram[bucket]++;
+    }
+
+    void PoolForHost::tick( double secs ) {
+        if ( secs > 0 )
+            _createdPerSecond = ( _created - _createdAtLastTick ) / secs;
+        _createdAtLastTick = _created;
+    }
+
+    void PoolForHost::appendInfo( BSONObjBuilder& b ) const {
+        b.append( "available" , numAvailable() );
+        b.append( "inUse" , _inUse );
+        b.appendNumber( "created" , numCreated() );
+        b.append( "createdPerSecond" , _createdPerSecond );
+        b.append( "waiting" , (int)_waiters.size() );
+        b.appendNumber( "waits" , _waits );
+        b.appendNumber( "waitTimeouts" , _waitTimeouts );
+
+        static const char* const bucketNames[WaitBuckets] =
+            { "lt1ms", "lt10ms", "lt100ms", "lt1s", "ge1s" };
+        BSONObjBuilder histogram( b.subobjStart( "waitTime" ) );
+        for ( int i = 0; i < WaitBuckets; i++ )
+            histogram.appendNumber( bucketNames[i] , _waitHistogram[i] );
+        histogram.done();
+    }
+
     void PoolForHost::initializeHostName(const std::string& hostName) {
         if (_hostName.empty()) {
             _hostName = hostName;
@@ -181,9 +277,58 @@ namespace mongo {
         scoped_lock L(_mutex);
         PoolForHost& p = _pools[PoolKey(ident,socketTimeout)];
         p.initializeHostName(ident);
+        _waitForSlot( L , p , ident );
+
+        // the slot is taken whether or not there is an idle connection to fill it, so a caller
+        // that goes on to connect must give it back with _abandonSlot if that fails
+        p.markHandedOut();
         return p.get( this , socketTimeout );
     }
 
+    void DBConnectionPool::_waitForSlot( scoped_lock& lk, PoolForHost& p, const string& ident ) {
+        if ( connPoolMaxInUseConnsPerHost <= 0 ||
+                ( p.numInUse() < connPoolMaxInUseConnsPerHost && ! p.hasWaiters() ) )
+            return;
+
+        Timer t;
+        unsigned long long ticket = p.enqueueWaiter();
+
+        while ( ! p.isFirstWaiter( ticket ) ||
+                ( connPoolMaxInUseConnsPerHost > 0 &&
+                  p.numInUse() >= connPoolMaxInUseConnsPerHost ) ) {
+
+            int timeout = connPoolWaitTimeoutMS;
+            if ( timeout <= 0 ) {
+                _slotFreed.wait( lk.boost() );
+                continue;
+            }
+
+            long long remaining = timeout - t.millis();
+            if ( remaining <= 0 ) {
+                p.dequeueWaiter( ticket );
+                p.recordWait( t.micros() , true );
+                _slotFreed.notify_all();
+                uasserted( 16746 , str::stream() << _name << ": timed out after " << t.millis()
+                                                 << "ms waiting for a connection to " << ident
+                                                 << ", " << p.numInUse() << " in use" );
+            }
+
+            _slotFreed.timed_wait( lk.boost() , boost::posix_time::milliseconds( remaining ) );
+        }
+
+        p.dequeueWaiter( ticket );
+        p.recordWait( t.micros() , false );
+
+        // the next waiter may fit as well
+        _slotFreed.notify_all();
+    }
+
+    void DBConnectionPool::_abandonSlot( const string& ident, double socketTimeout ) {
+        scoped_lock L(_mutex);
+        _pools[PoolKey(ident,socketTimeout)].markReturned();
+        _slotFreed.notify_all();
+    }
+
     DBClientBase* DBConnectionPool::_finishCreate( const string& host , double socketTimeout , DBClientBase* conn ) {
         {
             scoped_lock L(_mutex);
@@ -198,6 +343,7 @@ namespace mongo {
         }
         catch ( std::exception & ) {
             delete conn;
+            _abandonSlot( host , socketTimeout );
             throw;
         }
 
@@ -212,6 +358,7 @@ namespace mongo {
             }
             catch ( std::exception& ) {
                 delete c;
+                _abandonSlot( url.toString() , socketTimeout );
                 throw;
             }
             return c;
@@ -219,12 +366,18 @@ namespace mongo {
 
         string errmsg;
         c = url.connect( errmsg, socketTimeout );
-        uassert( 13328 ,  _name + ": connect failed " + url.toString() + " : " + errmsg , c );
+        if ( ! c ) {
+            _abandonSlot( url.toString() , socketTimeout );
+            uasserted( 13328 ,  _name + ": connect failed " + url.toString() + " : " + errmsg );
+        }
 
         return _finishCreate( url.toString() , socketTimeout , c );
     }
 
     DBClientBase* DBConnectionPool::get(const string& host, double socketTimeout) {
+        string errmsg;
+        ConnectionString cs = ConnectionString::parse( host , errmsg );
+
         DBClientBase * c = _get( host , socketTimeout );
         if ( c ) {
             try {
@@ -232,24 +385,37 @@ namespace mongo {
             }
             catch ( std::exception& ) {
                 delete c;
+                _abandonSlot( host , socketTimeout );
                 throw;
             }
             return c;
         }
 
-        string errmsg;
-        ConnectionString cs = ConnectionString::parse( host , errmsg );
-        uassert( 13071 , (string)"invalid hostname [" + host + "]" + errmsg , cs.isValid() );
+        if ( ! cs.isValid() ) {
+            _abandonSlot( host , socketTimeout );
+            uasserted( 13071 , (string)"invalid hostname [" + host + "]" + errmsg );
+        }
 
         c = cs.connect( errmsg, socketTimeout );
-        if ( ! c )
+        if ( ! c ) {
+            _abandonSlot( host , socketTimeout );
             throw SocketException( SocketException::CONNECT_ERROR , host , 11002 , str::stream() << _name << " error: " << errmsg );
+        }
         return _finishCreate( host , socketTimeout , c );
     }
 
     void DBConnectionPool::release(const string& host, DBClientBase *c) {
         scoped_lock L(_mutex);
-        _pools[PoolKey(host,c->getSoTimeout())].done(this,c);
+        PoolForHost& p = _pools[PoolKey(host,c->getSoTimeout())];
+        p.markReturned();
+        p.done(this,c);
+        _slotFreed.notify_all();
+    }
+
+    void DBConnectionPool::decrementEgress(const string& host, DBClientBase* c) {
+        scoped_lock L(_mutex);
+        _pools[PoolKey(host,c->getSoTimeout())].markReturned();
+        _slotFreed.notify_all();
     }
 
 
@@ -319,6 +485,8 @@ namespace mongo {
     void DBConnectionPool::appendInfo( BSONObjBuilder& b ) {
 
         int avail = 0;
+        int inUse = 0;
+        int waiting = 0;
         long long created = 0;
 
 
@@ -336,12 +504,14 @@ namespace mongo {
                 string s = str::stream() << i->first.ident << "::" << i->first.timeout;
 
                 BSONObjBuilder temp( bb.subobjStart( s ) );
-                temp.append( "available" , i->second.numAvailable() );
-                temp.appendNumber( "created" , i->second.numCreated() );
+                i->second.appendInfo( temp );
                 temp.done();
 
                 avail += i->second.numAvailable();
+                inUse += i->second.numInUse();
                 created += i->second.numCreated();
+                if ( i->second.hasWaiters() )
+                    waiting++;
 
                 long long& x = createdByType[i->second.type()];
                 x += i->second.numCreated();
@@ -368,7 +538,7 @@ namespace mongo {
         setBuilder.done();
 
         {
-            BSONObjBuilder temp( bb.subobjStart( "createdByType" ) );
+            BSONObjBuilder temp( b.subobjStart( "createdByType" ) );
             for ( map<ConnectionString::ConnectionType,long long>::iterator i=createdByType.begin(); i!=createdByType.end(); ++i ) {
                 temp.appendNumber( ConnectionString::typeToString( i->first ) , i->second );
             }
@@ -376,6 +546,8 @@ namespace mongo {
         }
 
         b.append( "totalAvailable" , avail );
+        b.append( "totalInUse" , inUse );
+        b.append( "hostsWithWaiters" , waiting );
         b.appendNumber( "totalCreated" , created );
     }
 
@@ -456,6 +628,145 @@ namespace mongo {
                 // we don't care if there was a socket error
             }
         }
+
+        {
+            scoped_lock lk( _mutex );
+            double secs = _sinceTick.micros() / 1000000.0;
+            _sinceTick.reset();
+            for ( PoolMap::iterator i=_pools.begin(); i!=_pools.end(); ++i ) {
+                i->second.tick( secs );
+            }
+        }
+
+        if ( inShutdown() )
+            return;
+
+        _validateIdle();
+        _prewarm();
+    }
+
+    void DBConnectionPool::_validateIdle() {
+        int idleSecs = connPoolValidateIdleSecs;
+        if ( idleSecs <= 0 )
+            return;
+
+        typedef vector< pair<PoolKey, PoolForHost::StoredConnection> > Unchecked;
+        Unchecked unchecked;
+        {
+            scoped_lock lk( _mutex );
+            time_t now = time(0);
+            for ( PoolMap::iterator i=_pools.begin(); i!=_pools.end(); ++i ) {
+                vector<PoolForHost::StoredConnection> conns;
+                i->second.takeUncheckedConnections( now , idleSecs , conns );
+                for ( size_t j=0; j<conns.size(); j++ )
+                    unchecked.push_back( make_pair( i->first , conns[j] ) );
+            }
+        }
+
+        if ( unchecked.empty() )
+            return;
+
+        // the checks run without the lock, so callers aren't held up by a host that is down
+        vector<bool> alive( unchecked.size() , false );
+        for ( size_t i=0; i<unchecked.size(); i++ ) {
+            DBClientBase* conn = unchecked[i].second.conn;
+            try {
+                bool isMaster;
+                conn->isMaster( isMaster );
+                alive[i] = ! conn->isFailed();
+            }
+            catch ( const DBException& e ) {
+                LOG(1) << "Exception thrown when checking idle pooled connection to "
+                       << conn->getServerAddress() << ": " << causedBy(e) << endl;
+            }
+        }
+
+        vector<DBClientBase*> toDelete;
+        {
+            scoped_lock lk( _mutex );
+            time_t now = time(0);
+            for ( size_t i=0; i<unchecked.size(); i++ ) {
+                PoolForHost& p = _pools[unchecked[i].first];
+                PoolForHost::StoredConnection& sc = unchecked[i].second;
+                if ( ! alive[i] ) {
+                    p.reportBadConnectionAt( sc.conn->getSockCreationMicroSec() );
+                    toDelete.push_back( sc.conn );
+                    continue;
+                }
+                sc.checked = now;
+                if ( ! p.putBack( sc ) )
+                    toDelete.push_back( sc.conn );
+            }
+        }
+
+        for ( size_t i=0; i<toDelete.size(); i++ ) {
+            try {
+                onDestroy( toDelete[i] );
+                delete toDelete[i];
+            }
+            catch ( ... ) {
+            }
+        }
+    }
+
+    void DBConnectionPool::_prewarm() {
+        int minConns = connPoolMinConnsPerHost;
+        if ( minConns <= 0 )
+            return;
+
+        // only hosts the pool has already connected to are kept warm
+        vector< pair<PoolKey, int> > wanted;
+        {
+            scoped_lock lk( _mutex );
+            for ( PoolMap::iterator i=_pools.begin(); i!=_pools.end(); ++i ) {
+                const PoolForHost& p = i->second;
+                int have = p.numAvailable() + p.numInUse();
+                if ( p.numCreated() > 0 && have < minConns )
+                    wanted.push_back( make_pair( i->first , minConns - have ) );
+            }
+        }
+
+        for ( size_t i=0; i<wanted.size() && ! inShutdown(); i++ ) {
+            const PoolKey& key = wanted[i].first;
+
+            string errmsg;
+            ConnectionString cs = ConnectionString::parse( key.ident , errmsg );
+            if ( ! cs.isValid() )
+                continue;
+
+            for ( int n=0; n<wanted[i].second; n++ ) {
+                DBClientBase* c = cs.connect( errmsg , key.timeout );
+                if ( ! c ) {
+                    LOG(1) << _name << ": couldn't open connection ahead of demand to "
+                           << key.ident << ": " << errmsg << endl;
+                    break;
+                }
+
+                try {
+                    onCreate( c );
+                }
+                catch ( const std::exception& e ) {
+                    LOG(1) << _name << ": connection opened ahead of demand to " << key.ident
+                           << " failed setup: " << e.what() << endl;
+                    delete c;
+                    break;
+                }
+
+                bool kept;
+                {
+                    scoped_lock lk( _mutex );
+                    PoolForHost& p = _pools[key];
+                    p.createdOne( c );
+                    kept = p.putBack( PoolForHost::StoredConnection( c ) );
+                }
+
+                if ( ! kept ) {
+                    onDestroy( c );
+                    delete c;
+                    break;
+                }
+            }
+        }
     }
 
     // ------ ScopedDbConnection ------
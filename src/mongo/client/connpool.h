@@ -22,32 +22,81 @@
 #include "mongo/util/background.h"
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/platform/cstdint.h"
+#include "mongo/util/timer.h"
 
 namespace mongo {
 
     class Shard;
     class DBConnectionPool;
 
+    // Limits shared by every DBConnectionPool.  mongod and mongos export them as server
+    // parameters; 0 turns each one off.
+
+    /** connections to one host that may be handed out at once before callers queue for one */
+    extern int connPoolMaxInUseConnsPerHost;
+    /** how long a queued caller waits for a connection before giving up */
+    extern int connPoolWaitTimeoutMS;
+    /** connections the background task keeps open to each host the pool has used */
+    extern int connPoolMinConnsPerHost;
+    /** idle connections unused for this long are checked by the background task */
+    extern int connPoolValidateIdleSecs;
+
     /**
      * not thread safe
      * thread safety is handled by DBConnectionPool
      */
     class PoolForHost {
     public:
+        struct StoredConnection {
+            StoredConnection( DBClientBase * c );
+
+            bool ok( time_t now );
+
+            /** @return true if idle and unchecked for at least secs */
+            bool needsCheck( time_t now, int secs ) const;
+
+            DBClientBase* conn;
+            time_t when;
+            time_t checked;
+        };
+
         PoolForHost()
-            : _created(0), _minValidCreationTimeMicroSec(0) {}
+            : _created(0), _minValidCreationTimeMicroSec(0) {
+            _initStats();
+        }
 
         PoolForHost( const PoolForHost& other ) {
             verify(other._pool.size() == 0);
             _created = other._created;
             _minValidCreationTimeMicroSec = other._minValidCreationTimeMicroSec;
             verify( _created == 0 );
+            _initStats();
         }
 
         ~PoolForHost();
 
         int numAvailable() const { return (int)_pool.size(); }
 
+        /** connections handed out and not yet released or killed */
+        int numInUse() const { return _inUse; }
+        void markHandedOut() { _inUse++; }
+        void markReturned() { if ( _inUse > 0 ) _inUse--; }
+
+        //
+        // the FIFO of callers waiting for the number in use to drop below the maximum
+        //
+
+        unsigned long long enqueueWaiter();
+        bool isFirstWaiter( unsigned long long ticket ) const;
+        void dequeueWaiter( unsigned long long ticket );
+        bool hasWaiters() const { return ! _waiters.empty(); }
+        void recordWait( long long micros, bool timedOut );
+
+        /** updates the creation rate, given the seconds since the last call */
+        void tick( double secs );
+
+        void appendInfo( BSONObjBuilder& b ) const;
+
         void createdOne( DBClientBase * base );
         long long numCreated() const { return _created; }
 
@@ -67,6 +116,16 @@ namespace mongo {
         
         void getStaleConnections( vector<DBClientBase*>& stale );
 
+        /** removes the connections due for a check, so they can be checked without the lock */
+        void takeUncheckedConnections( time_t now, int idleSecs,
+                                       vector<StoredConnection>& unchecked );
+
+        /**
+         * Returns a connection that passed its check, or adds one opened ahead of demand.
+         * @return false if it doesn't fit in the pool, and the caller should destroy it
+         */
+        bool putBack( const StoredConnection& sc );
+
         /**
          * Sets the lower bound for creation times that can be considered as
          *     good connections.
@@ -88,14 +147,7 @@ namespace mongo {
         static unsigned getMaxPerHost() { return _maxPerHost; }
     private:
 
-        struct StoredConnection {
-            StoredConnection( DBClientBase * c );
-
-            bool ok( time_t now );
-
-            DBClientBase* conn;
-            time_t when;
-        };
+        void _initStats();
 
         std::string _hostName;
         std::stack<StoredConnection> _pool;
@@ -104,6 +156,18 @@ namespace mongo {
         uint64_t _minValidCreationTimeMicroSec;
         ConnectionString::ConnectionType _type;
 
+        int _inUse;
+        std::list<unsigned long long> _waiters;
+        unsigned long long _nextWaiter;
+
+        enum { WaitBuckets = 5 }; // < 1ms, < 10ms, < 100ms, < 1s, longer
+        long long _waits;
+        long long _waitTimeouts;
+        long long _waitHistogram[WaitBuckets];
+
+        int64_t _createdAtLastTick;
+        double _createdPerSecond;
+
         static unsigned _maxPerHost;
     };
 
@@ -151,6 +215,12 @@ namespace mongo {
 
         void release(const string& host, DBClientBase *c);
 
+        /**
+         * Called instead of release() for a connection handed out by this pool that the caller
+         * destroys itself, so that it no longer counts as in use.
+         */
+        void decrementEgress(const string& host, DBClientBase* c);
+
         void addHook( DBConnectionHook * hook ); // we take ownership
         void appendInfo( BSONObjBuilder& b );
 
@@ -187,6 +257,15 @@ namespace mongo {
         DBClientBase* _get( const string& ident , double socketTimeout );
 
         DBClientBase* _finishCreate( const string& ident , double socketTimeout, DBClientBase* conn );
+
+        /** blocks, in FIFO order, until p has fewer than the maximum number in use */
+        void _waitForSlot( scoped_lock& lk, PoolForHost& p, const string& ident );
+
+        /** gives back the slot taken by a _get that failed to produce a connection */
+        void _abandonSlot( const string& ident, double socketTimeout );
+
+        void _validateIdle();
+        void _prewarm();
         
         struct PoolKey {
             PoolKey( const std::string& i , double t ) : ident( i ) , timeout( t ) {}
@@ -205,6 +284,11 @@ namespace mongo {
         
         PoolMap _pools;
 
+        // signaled whenever a connection stops being in use, or a waiter leaves the queue
+        boost::condition _slotFreed;
+
+        Timer _sinceTick;
+
         // pointers owned by me, right now they leak on shutdown
         // _hooks itself also leaks because it creates a shutdown race condition
         list<DBConnectionHook*> * _hooks; 
@@ -309,6 +393,8 @@ namespace mongo {
             a bad state.  Destructor will do this too, but it is verbose.
         */
         void kill() {
+            if ( _conn )
+                pool.decrementEgress(_host, _conn);
             delete _conn;
             _conn = 0;
         }
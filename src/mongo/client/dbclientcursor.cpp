@@ -116,6 +116,16 @@ namespace mongo {
         return ok;
     }
 
+    void DBClientCursor::_assembleGetMore( Message& toSend ) {
+        BufBuilder b;
+        b.appendNum(opts);
+        b.appendStr(ns);
+        b.appendNum(nextBatchSize());
+        b.appendNum(cursorId);
+
+        toSend.setData(dbGetMore, b.buf(), b.len());
+    }
+
     void DBClientCursor::requestMore() {
         verify( cursorId && batch.pos == batch.nReturned );
 
@@ -123,16 +133,36 @@ namespace mongo {
             nToReturn -= batch.nReturned;
             verify(nToReturn > 0);
         }
-        BufBuilder b;
-        b.appendNum(opts);
-        b.appendStr(ns);
-        b.appendNum(nextBatchSize());
-        b.appendNum(cursorId);
+        if ( _lazyMoreReply.get() ) {
+            // collectLazyMore() already received it
+            this->batch.m = _lazyMoreReply;
+            dataReceived();
+            return;
+        }
 
-        Message toSend;
-        toSend.setData(dbGetMore, b.buf(), b.len());
         auto_ptr<Message> response(new Message());
 
+        if ( _lazyMoreConn ) {
+            // requestMoreLazy() already sent the getMore
+            scoped_ptr<ScopedDbConnection> conn( _lazyMoreConn );
+            _lazyMoreConn = 0;
+
+            Timer t;
+            if ( ! conn->get()->recv( *response ) )
+                uasserted( 10278 , str::stream() << "dbclient error communicating with server: " << conn->getHost() );
+            _adaptBatchSize( t.micros() );
+
+            _client = conn->get();
+            this->batch.m = response;
+            dataReceived();
+            _client = 0;
+            conn->done();
+            return;
+        }
+
+        Message toSend;
+        _assembleGetMore( toSend );
+
         if ( _client ) {
             _client->call( toSend, *response );
             this->batch.m = response;
@@ -151,6 +181,77 @@ namespace mongo {
         }
     }
 
+    bool DBClientCursor::requestMoreLazy() {
+        if ( _lazyMoreConn || _lazyMoreReply.get() )
+            return true;
+
+        if ( ! cursorId || _client || _scopedHost.empty() ||
+             ( opts & ( QueryOption_CursorTailable | QueryOption_Exhaust ) ) )
+            return false;
+
+        // the batch being read counts against the limit once it's done
+        int limitLeft = nToReturn;
+        if ( haveLimit ) {
+            limitLeft -= batch.nReturned;
+            if ( limitLeft <= 0 )
+                return false;
+        }
+
+        auto_ptr<ScopedDbConnection> conn(
+                ScopedDbConnection::getScopedDbConnection( _scopedHost ) );
+        if ( conn->get()->type() != ConnectionString::MASTER ) {
+            conn->done();
+            return false;
+        }
+
+        Message toSend;
+        int n = nToReturn;
+        nToReturn = limitLeft;
+        _assembleGetMore( toSend );
+        nToReturn = n;
+
+        conn->get()->say( toSend );
+        _lazyMoreConn = conn.release();
+        return true;
+    }
+
+    void DBClientCursor::collectLazyMore() {
+        if ( ! _lazyMoreConn )
+            return;
+        scoped_ptr<ScopedDbConnection> conn( _lazyMoreConn );
+        _lazyMoreConn = 0;
+
+        auto_ptr<Message> response( new Message() );
+        Timer t;
+        if ( ! conn->get()->recv( *response ) )
+            uasserted( 10278 , str::stream() << "dbclient error communicating with server: " << conn->getHost() );
+        _adaptBatchSize( t.micros() );
+
+        // checked on its connection now, as dataReceived() would have
+        QueryResult *qr = (QueryResult *) response->singleData();
+        bool retry;
+        string host;
+        conn->get()->checkResponse( qr->data(), qr->nReturned, &retry, &host );
+
+        conn->done();
+        _lazyMoreReply = response;
+    }
+
+    void DBClientCursor::_adaptBatchSize( long long waitMicros ) {
+        // only a requested batch size can be changed, the server picks the others
+        if ( _baseBatchSize <= 0 )
+            return;
+
+        // Waiting means the reader drains batches faster than the server fills them, so ask
+        // for more per round trip; otherwise go back toward the size asked for.
+        const long long waitedMicros = 1000;
+        const int maxGrowth = 16;
+        if ( waitMicros >= waitedMicros )
+            batchSize = min( batchSize * 2, _baseBatchSize * maxGrowth );
+        else
+            batchSize = max( batchSize / 2, _baseBatchSize );
+    }
+
     /** with QueryOption_Exhaust, the server just blasts data at us (marked at end with cursorid==0). */
     void DBClientCursor::exhaustReceiveMore() {
         verify( cursorId && batch.pos == batch.nReturned );
@@ -191,7 +292,9 @@ namespace mongo {
         batch.pos = 0;
         batch.data = qr->data();
 
-        _client->checkResponse( batch.data, batch.nReturned, &retry, &host ); // watches for "not master"
+        // watches for "not master"; a reply collectLazyMore() received was checked by it
+        if ( _client )
+            _client->checkResponse( batch.data, batch.nReturned, &retry, &host );
 
         if( qr->resultFlags() & ResultFlag_ShardConfigStale ) {
             BSONObj error;
@@ -315,6 +418,18 @@ namespace mongo {
 
         DESTRUCTOR_GUARD (
 
+        if ( _lazyMoreConn ) {
+            // the reply must be read before the connection can be used again
+            scoped_ptr<ScopedDbConnection> conn( _lazyMoreConn );
+            _lazyMoreConn = 0;
+
+            Message response;
+            if ( conn->get()->recv( response ) )
+                conn->done();
+            else
+                conn->kill();
+        }
+
         if ( cursorId && _ownCursor && ! inShutdown() ) {
             BufBuilder b;
             b.appendNum( (int)0 ); // reserved
@@ -29,6 +29,7 @@
 namespace mongo {
 
     class AScopedConnection;
+    class ScopedDbConnection;
 
     /** for mock purposes only -- do not create variants of DBClientCursor, nor hang code here 
         @see DBClientMockCursor
@@ -57,6 +58,12 @@ namespace mongo {
         int objsLeftInBatch() const { _assertIfNull(); return _putBack.size() + batch.nReturned - batch.pos; }
         bool moreInCurrentBatch() { return objsLeftInBatch() > 0; }
 
+        /** @return the bytes of the batches held by the cursor */
+        int bufferedBytes() const {
+            return ( batch.m->empty() ? 0 : batch.m->size() ) +
+                   ( _lazyMoreReply.get() ? _lazyMoreReply->size() : 0 );
+        }
+
         /** next
            @return next object in the result cursor.
            on an error at the remote server, you will get back:
@@ -144,7 +151,9 @@ namespace mongo {
             resultFlags(0),
             cursorId(),
             _ownCursor( true ),
-            wasError( false ) {
+            wasError( false ),
+            _lazyMoreConn( 0 ),
+            _baseBatchSize( batchSize ) {
             _finishConsInit();
         }
 
@@ -160,7 +169,9 @@ namespace mongo {
             resultFlags(0),
             cursorId(_cursorId),
             _ownCursor(true),
-            wasError(false) {
+            wasError(false),
+            _lazyMoreConn( 0 ),
+            _baseBatchSize( 0 ) {
             _finishConsInit();
         }
 
@@ -199,6 +210,25 @@ namespace mongo {
         void initLazy( bool isRetry = false );
         bool initLazyFinish( bool& retry );
 
+        /**
+         * Sends the getMore for the next batch now, so that the server prepares it while this
+         * batch is read; the more() which needs it then only has to receive it.  Only cursors
+         * which have been attach()ed prefetch, and not tailable or exhaust ones.
+         *
+         * While a prefetched batch is awaited, a cursor with a batch size grows it if the
+         * reader had to wait for the batch, and shrinks it back if it didn't.
+         *
+         * @return true if a getMore was sent or is already outstanding
+         */
+        bool requestMoreLazy();
+
+        /**
+         * Receives the reply to an outstanding requestMoreLazy() getMore, keeping it until this
+         * batch is read, and returns the connection to the pool.  For a cursor about to be left
+         * idle, so that it doesn't hold a pooled connection meanwhile.
+         */
+        void collectLazyMore();
+
         class Batch : boost::noncopyable { 
             friend class DBClientCursor;
             auto_ptr<Message> m;
@@ -235,10 +265,18 @@ namespace mongo {
         string _lazyHost;
         bool wasError;
 
+        // holds the connection a requestMoreLazy() getMore was sent on, until it's received
+        ScopedDbConnection* _lazyMoreConn;
+        // the reply collectLazyMore() received, until the batch before it is read
+        auto_ptr<Message> _lazyMoreReply;
+        int _baseBatchSize;
+
         void dataReceived() { bool retry; string lazyHost; dataReceived( retry, lazyHost ); }
         void dataReceived( bool& retry, string& lazyHost );
         void requestMore();
         void exhaustReceiveMore(); // for exhaust
+        void _assembleGetMore( Message& toSend );
+        void _adaptBatchSize( long long waitMicros );
 
         // Don't call from a virtual function
         void _assertIfNull() const { uassert(13348, "connection died", this); }
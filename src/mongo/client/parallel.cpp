@@ -309,15 +309,15 @@ namespace mongo {
 
     // --------  FilteringClientCursor -----------
     FilteringClientCursor::FilteringClientCursor( const BSONObj filter )
-        : _matcher( filter ) , _pcmData( NULL ), _done( true ) {
+        : _matcher( filter ) , _pcmData( NULL ), _done( true ), _prefetch( false ) {
     }
 
     FilteringClientCursor::FilteringClientCursor( auto_ptr<DBClientCursor> cursor , const BSONObj filter )
-        : _matcher( filter ) , _cursor( cursor ) , _pcmData( NULL ), _done( cursor.get() == 0 ) {
+        : _matcher( filter ) , _cursor( cursor ) , _pcmData( NULL ), _done( cursor.get() == 0 ), _prefetch( false ) {
     }
 
     FilteringClientCursor::FilteringClientCursor( DBClientCursor* cursor , const BSONObj filter )
-        : _matcher( filter ) , _cursor( cursor ) , _pcmData( NULL ), _done( cursor == 0 ) {
+        : _matcher( filter ) , _cursor( cursor ) , _pcmData( NULL ), _done( cursor == 0 ), _prefetch( false ) {
     }
 
 
@@ -356,9 +356,10 @@ namespace mongo {
         verify( ! _next.isEmpty() );
         verify( ! _done );
 
+        // the next document is found by the next more() or peek(), so that we don't wait
+        // on the server for it until it's wanted
         BSONObj ret = _next;
         _next = BSONObj();
-        _advance();
         return ret;
     }
 
@@ -368,6 +369,14 @@ namespace mongo {
         return _next;
     }
 
+    bool FilteringClientCursor::moreBuffered() {
+        if ( ! _next.isEmpty() )
+            return true;
+
+        // anything buffered may not match, but then finding out costs little
+        return ! _done && _cursor.get() && _cursor->moreInCurrentBatch();
+    }
+
     void FilteringClientCursor::_advance() {
         verify( _next.isEmpty() );
         if ( ! _cursor.get() || _done )
@@ -375,6 +384,11 @@ namespace mongo {
 
         while ( _cursor->more() ) {
             _next = _cursor->next();
+
+            // once the request is out, the server fills the next batch while we read this one
+            if ( _prefetch )
+                _prefetch = _cursor->requestMoreLazy();
+
             if ( _matcher.matches( _next ) ) {
                 if ( ! _cursor->moreInCurrentBatch() )
                     _next = _next.getOwned();
@@ -477,6 +491,7 @@ namespace mongo {
         _numServers = _servers.size();
         _lastFrom = 0;
         _cursors = 0;
+        _mergeStarted = false;
 
         if( ! _qSpec.isEmpty() ){
 
@@ -1258,6 +1273,7 @@ namespace mongo {
             PCMData& mdata = i->second;
 
             _cursors[ index ].reset( mdata.pcState->cursor.get(), &mdata );
+            _cursors[ index ].setPrefetch( true );
             _servers.insert( ServerAndQuery( i->first.getConnString(), BSONObj() ) );
 
             index++;
@@ -1493,6 +1509,7 @@ namespace mongo {
                 try {
                     _cursors[i].raw()->attach( conns[i].get() ); // this calls done on conn
                     _checkCursor( _cursors[i].raw() );
+                    _cursors[i].setPrefetch( true );
 
                     finishedQueries++;
                 }
@@ -1581,6 +1598,22 @@ namespace mongo {
         _cursorMap.clear();
     }
 
+    long long ParallelSortClusteredCursor::bufferedBytes() {
+        long long bytes = 0;
+        for ( int i=0; _cursors && i<_numServers; i++ ) {
+            if ( _cursors[i].raw() )
+                bytes += _cursors[i].raw()->bufferedBytes();
+        }
+        return bytes;
+    }
+
+    void ParallelSortClusteredCursor::collectPrefetched() {
+        for ( int i=0; _cursors && i<_numServers; i++ ) {
+            if ( _cursors[i].raw() )
+                _cursors[i].raw()->collectLazyMore();
+        }
+    }
+
     bool ParallelSortClusteredCursor::more() {
 
         if ( _needToSkip > 0 ) {
@@ -1595,6 +1628,12 @@ namespace mongo {
             _needToSkip = n;
         }
 
+        if ( ! _sortKey.isEmpty() ) {
+            if ( ! _mergeStarted )
+                _startMerge();
+            return ! _mergeHeap.empty();
+        }
+
         for ( int i=0; i<_numServers; i++ ) {
             if ( _cursors[i].more() )
                 return true;
@@ -1603,8 +1642,47 @@ namespace mongo {
     }
 
     BSONObj ParallelSortClusteredCursor::next() {
-        BSONObj best = BSONObj();
-        int bestFrom = -1;
+
+        if ( ! _sortKey.isEmpty() ) {
+            if ( ! _mergeStarted )
+                _startMerge();
+
+            uassert( 10019 ,  "no more elements" , ! _mergeHeap.empty() );
+
+            int from = _mergeHeap[0];
+            BSONObj best = _cursors[from].next();
+            if( _cursors[from].rawMData() )
+                _cursors[from].rawMData()->pcState->count++;
+
+            // best stays valid: the last document of a batch is owned, so more() can't free it
+            if ( _cursors[from].more() ) {
+                _siftDown( 0 );
+            }
+            else {
+                _cursorDone( from );
+                _mergeHeap[0] = _mergeHeap.back();
+                _mergeHeap.pop_back();
+                if ( ! _mergeHeap.empty() )
+                    _siftDown( 0 );
+            }
+
+            _lastFrom = from;
+            return best;
+        }
+
+        // Any order will do, so take from the next cursor in turn which has documents buffered,
+        // and only wait on a shard when none has.
+        for( int j = 0; j < _numServers; j++ ){
+            int i = ( j + _lastFrom + 1 ) % _numServers;
+            if ( ! _cursors[i].moreBuffered() || ! _cursors[i].more() )
+                continue;
+
+            _lastFrom = i;
+            BSONObj best = _cursors[i].next();
+            if( _cursors[i].rawMData() )
+                _cursors[i].rawMData()->pcState->count++;
+            return best;
+        }
 
         for( int j = 0; j < _numServers; j++ ){
 
@@ -1614,37 +1692,61 @@ namespace mongo {
             int i = ( j + _lastFrom + 1 ) % _numServers;
 
             if ( ! _cursors[i].more() ){
-                if( _cursors[i].rawMData() )
-                    _cursors[i].rawMData()->pcState->done = true;
+                _cursorDone( i );
                 continue;
             }
 
-            BSONObj me = _cursors[i].peek();
+            _lastFrom = i;
+            BSONObj best = _cursors[i].next();
+            if( _cursors[i].rawMData() )
+                _cursors[i].rawMData()->pcState->count++;
+            return best;
+        }
 
-            if ( best.isEmpty() ) {
-                best = me;
-                bestFrom = i;
-                if( _sortKey.isEmpty() ) break;
-                continue;
-            }
+        uasserted( 10019 ,  "no more elements" );
+    }
 
-            int comp = best.woSortOrder( me , _sortKey , true );
-            if ( comp < 0 )
-                continue;
+    void ParallelSortClusteredCursor::_startMerge() {
+        verify( ! _mergeStarted );
+        _mergeStarted = true;
 
-            best = me;
-            bestFrom = i;
+        for ( int i = 0; i < _numServers; i++ ) {
+            if ( _cursors[i].more() )
+                _mergeHeap.push_back( i );
+            else
+                _cursorDone( i );
         }
 
-        _lastFrom = bestFrom;
+        for ( size_t pos = _mergeHeap.size() / 2; pos-- > 0; )
+            _siftDown( pos );
+    }
 
-        uassert( 10019 ,  "no more elements" , ! best.isEmpty() );
-        _cursors[bestFrom].next();
+    void ParallelSortClusteredCursor::_cursorDone( int i ) {
+        if( _cursors[i].rawMData() )
+            _cursors[i].rawMData()->pcState->done = true;
+    }
 
-        if( _cursors[bestFrom].rawMData() )
-            _cursors[bestFrom].rawMData()->pcState->count++;
+    bool ParallelSortClusteredCursor::_mergeBefore( int a, int b ) {
+        int comp = _cursors[a].peek().woSortOrder( _cursors[b].peek() , _sortKey , true );
+        return comp < 0 || ( comp == 0 && a < b );
+    }
 
-        return best;
+    void ParallelSortClusteredCursor::_siftDown( size_t pos ) {
+        // each cursor's next document sorts no later than its children's
+        size_t n = _mergeHeap.size();
+        int cursor = _mergeHeap[pos];
+        while ( true ) {
+            size_t child = 2 * pos + 1;
+            if ( child >= n )
+                break;
+            if ( child + 1 < n && _mergeBefore( _mergeHeap[child + 1], _mergeHeap[child] ) )
+                child++;
+            if ( ! _mergeBefore( _mergeHeap[child], cursor ) )
+                break;
+            _mergeHeap[pos] = _mergeHeap[child];
+            pos = child;
+        }
+        _mergeHeap[pos] = cursor;
     }
 
     void ParallelSortClusteredCursor::_explain( map< string,list<BSONObj> >& out ) {
@@ -90,6 +90,15 @@ namespace mongo {
 
         virtual void explain(BSONObjBuilder& b) = 0;
 
+        /** @return the bytes of the shard batches the cursor holds */
+        virtual long long bufferedBytes() { return 0; }
+
+        /**
+         * Receives the shard batches requested ahead of their use, returning their connections
+         * to the pool; for a cursor about to be left idle.
+         */
+        virtual void collectPrefetched() { }
+
     protected:
 
         virtual void _init() = 0;
@@ -139,6 +148,12 @@ namespace mongo {
 
         BSONObj peek();
 
+        /** true if more() can be answered without waiting on the server */
+        bool moreBuffered();
+
+        /** have the cursor fetch each batch while the one before it is read */
+        void setPrefetch( bool prefetch ) { _prefetch = prefetch; }
+
         DBClientCursor* raw() { return _cursor.get(); }
         ParallelConnectionMetadata* rawMData(){ return _pcmData; }
 
@@ -157,6 +172,7 @@ namespace mongo {
 
         BSONObj _next;
         bool _done;
+        bool _prefetch;
     };
 
 
@@ -343,6 +359,8 @@ namespace mongo {
         virtual bool more();
         virtual BSONObj next();
         virtual string type() const { return "ParallelSort"; }
+        virtual long long bufferedBytes();
+        virtual void collectPrefetched();
 
         void fullInit();
         void startInit();
@@ -371,6 +389,12 @@ namespace mongo {
         virtual void _explain( map< string,list<BSONObj> >& out );
 
         void _markStaleNS( const NamespaceString& staleNS, const StaleConfigException& e, bool& forceReload, bool& fullReload );
+
+        // merging
+        void _startMerge();
+        void _cursorDone( int i );
+        bool _mergeBefore( int a, int b );
+        void _siftDown( size_t pos );
         void _handleStaleNS( const NamespaceString& staleNS, bool forceReload, bool fullReload );
 
         set<Shard> _qShards;
@@ -392,6 +416,11 @@ namespace mongo {
         FilteringClientCursor * _cursors;
         int _needToSkip;
 
+        // When sorting, the cursors with documents left, as a heap with the cursor whose next
+        // document sorts first at the top.  Set up by the first more() or next().
+        vector<int> _mergeHeap;
+        bool _mergeStarted;
+
     private:
         /**
          * Setups the shard version of the connection. When using a replica
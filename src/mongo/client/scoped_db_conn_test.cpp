@@ -418,4 +418,38 @@ namespace mongo_test {
 
         conn1Again->done();
     }
+
+    TEST_F(DummyServerFixture, WaitForConnInUseTimesOut) {
+        const int oldMax = mongo::connPoolMaxInUseConnsPerHost;
+        const int oldTimeout = mongo::connPoolWaitTimeoutMS;
+        mongo::connPoolMaxInUseConnsPerHost = 2;
+        mongo::connPoolWaitTimeoutMS = 100;
+
+        scoped_ptr<ScopedDbConnection> conn1(
+                ScopedDbConnection::getScopedDbConnection(TARGET_HOST));
+        scoped_ptr<ScopedDbConnection> conn2(
+                ScopedDbConnection::getScopedDbConnection(TARGET_HOST));
+
+        ASSERT_THROWS(ScopedDbConnection::getScopedDbConnection(TARGET_HOST),
+                      mongo::UserException);
+
+        // a connection given back or killed frees its slot
+        conn1->done();
+        scoped_ptr<ScopedDbConnection> conn3(
+                ScopedDbConnection::getScopedDbConnection(TARGET_HOST));
+        conn2->kill();
+        scoped_ptr<ScopedDbConnection> conn4(
+                ScopedDbConnection::getScopedDbConnection(TARGET_HOST));
+
+        mongo::BSONObjBuilder stats;
+        mongo::pool.appendInfo(stats);
+        mongo::BSONObj info = stats.obj();
+        ASSERT_EQUALS(2, info["totalInUse"].numberInt());
+
+        conn3->done();
+        conn4->done();
+
+        mongo::connPoolMaxInUseConnsPerHost = oldMax;
+        mongo::connPoolWaitTimeoutMS = oldTimeout;
+    }
 }
@@ -160,6 +160,8 @@ namespace {
         dbAdminRoleActions.addAction(ActionType::ensureIndex);
         dbAdminRoleActions.addAction(ActionType::indexRead);
         dbAdminRoleActions.addAction(ActionType::indexStats);
+        dbAdminRoleActions.addAction(ActionType::planCacheRead);
+        dbAdminRoleActions.addAction(ActionType::planCacheWrite);
         dbAdminRoleActions.addAction(ActionType::profileEnable);
         dbAdminRoleActions.addAction(ActionType::profileRead);
         dbAdminRoleActions.addAction(ActionType::reIndex);
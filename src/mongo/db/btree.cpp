@@ -39,6 +39,7 @@ namespace mongo {
 
     BOOST_STATIC_ASSERT( Record::HeaderSize == 16 );
     BOOST_STATIC_ASSERT( Record::HeaderSize + BtreeData_V1::BucketSize == 8192 );
+    BOOST_STATIC_ASSERT( sizeof( BtreeData_V2::_KeyNode ) == sizeof( BtreeData_V1::_KeyNode ) + 4 );
 
     NOINLINE_DECL void checkFailed(unsigned line) {
         static time_t last;
@@ -201,7 +202,7 @@ namespace mongo {
             wassert( foo >= 0 && this->n < Size() );
             foo = this->emptySize;
             wassert( foo >= 0 && this->emptySize < V::BucketSize );
-            wassert( this->topSize >= this->n && this->topSize <= V::BucketSize );
+            wassert( ( V::SharesKeyData || this->topSize >= this->n ) && this->topSize <= V::BucketSize );
         }
 
         // this is very slow so don't do often
@@ -331,18 +332,38 @@ namespace mongo {
         // weirdly, we also put the rightmost down pointer in nextchild, even when bucket isn't full.
         this->nextChild = kn.prevChildBucket;
 
+        // data shared with the key before it stays allocated
+        bool shared = V::SharesKeyData && this->n > 1 && k(this->n-2).keyDataOfs() == k(this->n-1).keyDataOfs();
+
         this->n--;
         // This is risky because the key we are returning points to this unalloc'ed memory,
         // and we are assuming that the last key points to the last allocated
         // bson region.
         this->emptySize += sizeof(_KeyNode);
-        _unalloc(keysize);
+        if ( !shared )
+            _unalloc(keysize);
+    }
+
+    template< class V >
+    short BucketBasics<V>::sharedKeyDataOfs(int keypos, const Key& key) const {
+        if ( !V::SharesKeyData )
+            return -1;
+        int size = key.dataSize();
+        for ( int i = keypos - 1; i <= keypos; i++ ) {
+            if ( i < 0 || i >= this->n )
+                continue;
+            Key other = keyNode(i).key;
+            if ( other.dataSize() == size && memcmp(other.data(), key.data(), size) == 0 )
+                return k(i).keyDataOfs();
+        }
+        return -1;
     }
 
     /** add a key.  must be > all existing.  be careful to set next ptr right. */
     template< class V >
     bool BucketBasics<V>::_pushBack(const DiskLoc recordLoc, const Key& key, const Ordering &order, const DiskLoc prevChild) {
-        int bytesNeeded = key.dataSize() + sizeof(_KeyNode);
+        short sharedOfs = sharedKeyDataOfs(this->n, key);
+        int bytesNeeded = ( sharedOfs >= 0 ? 0 : key.dataSize() ) + sizeof(_KeyNode);
         if ( bytesNeeded > this->emptySize )
             return false;
         verify( bytesNeeded <= this->emptySize );
@@ -360,6 +381,11 @@ namespace mongo {
         _KeyNode& kn = k(this->n++);
         kn.prevChildBucket = prevChild;
         kn.recordLoc = recordLoc;
+        kn.setKeyPrefix( key );
+        if ( sharedOfs >= 0 ) {
+            kn.setKeyDataOfs( sharedOfs );
+            return true;
+        }
         kn.setKeyDataOfs( (short) _alloc(key.dataSize()) );
         short ofs = kn.keyDataOfs();
         char *p = dataAt(ofs);
@@ -380,9 +406,13 @@ namespace mongo {
     bool BucketBasics<V>::basicInsert(const DiskLoc thisLoc, int &keypos, const DiskLoc recordLoc, const Key& key, const Ordering &order) const {
         check( this->n < 1024 );
         check( keypos >= 0 && keypos <= this->n );
-        int bytesNeeded = key.dataSize() + sizeof(_KeyNode);
+        short sharedOfs = sharedKeyDataOfs(keypos, key);
+        int bytesNeeded = ( sharedOfs >= 0 ? 0 : key.dataSize() ) + sizeof(_KeyNode);
         if ( bytesNeeded > this->emptySize ) {
             _pack(thisLoc, order, keypos);
+            // packing moves the data of the keys around keypos
+            sharedOfs = sharedKeyDataOfs(keypos, key);
+            bytesNeeded = ( sharedOfs >= 0 ? 0 : key.dataSize() ) + sizeof(_KeyNode);
             if ( bytesNeeded > this->emptySize )
                 return false;
         }
@@ -412,6 +442,11 @@ namespace mongo {
         _KeyNode& kn = b->k(keypos);
         kn.prevChildBucket.Null();
         kn.recordLoc = recordLoc;
+        kn.setKeyPrefix( key );
+        if ( sharedOfs >= 0 ) {
+            kn.setKeyDataOfs( sharedOfs );
+            return true;
+        }
         kn.setKeyDataOfs((short) b->_alloc(key.dataSize()) );
         char *p = b->dataAt(kn.keyDataOfs());
         getDur().declareWriteIntent(p, key.dataSize());
@@ -431,7 +466,10 @@ namespace mongo {
     template< class V >
     int BucketBasics<V>::packedDataSize( int refPos ) const {
         if ( this->flags & Packed ) {
-            return V::BucketSize - this->emptySize - headerSize();
+            if ( !V::SharesKeyData ) {
+                return V::BucketSize - this->emptySize - headerSize();
+            }
+            return unsharedTopSize() + this->n * sizeof( _KeyNode );
         }
         int size = 0;
         for( int j = 0; j < this->n; ++j ) {
@@ -443,6 +481,18 @@ namespace mongo {
         return size;
     }
 
+    template< class V >
+    int BucketBasics<V>::unsharedTopSize() const {
+        if ( !V::SharesKeyData ) {
+            return this->topSize;
+        }
+        int size = 0;
+        for( int j = 0; j < this->n; ++j ) {
+            size += keyNode( j ).key.dataSize();
+        }
+        return size;
+    }
+
     /**
      * when we delete things we just leave empty space until the node is
      * full and then we repack it.
@@ -475,6 +525,8 @@ namespace mongo {
         int ofs = tdz;
         this->topSize = 0;
         int i = 0;
+        short lastOfsOld = -1;
+        int lastSize = 0;
         for ( int j = 0; j < this->n; j++ ) {
             if( mayDropKey( j, refPos ) ) {
                 continue; // key is unused and has no children - drop it
@@ -487,10 +539,19 @@ namespace mongo {
             }
             short ofsold = k(i).keyDataOfs();
             int sz = keyNode(i).key.dataSize();
-            ofs -= sz;
-            this->topSize += sz;
-            memcpy(temp+ofs, dataAt(ofsold), sz);
-            k(i).setKeyDataOfsSavingUse( ofs );
+            if ( V::SharesKeyData && i > 0 && sz == lastSize &&
+                 ( ofsold == lastOfsOld || memcmp(dataAt(ofsold), dataAt(lastOfsOld), sz) == 0 ) ) {
+                // the same data as the key kept before it: share that key's copy
+                k(i).setKeyDataOfsSavingUse( ofs );
+            }
+            else {
+                ofs -= sz;
+                this->topSize += sz;
+                memcpy(temp+ofs, dataAt(ofsold), sz);
+                k(i).setKeyDataOfsSavingUse( ofs );
+            }
+            lastOfsOld = ofsold;
+            lastSize = sz;
             ++i;
         }
         if ( refPos == this->n ) {
@@ -548,7 +609,7 @@ namespace mongo {
         // when splitting a btree node, if the new key is greater than all the other keys, we should not do an even split, but a 90/10 split.
         // see SERVER-983
         // TODO I think we only want to do the 90% split on the rhs node of the tree.
-        int rightSizeLimit = ( this->topSize + sizeof( _KeyNode ) * this->n ) / ( keypos == this->n ? 10 : 2 );
+        int rightSizeLimit = ( unsharedTopSize() + sizeof( _KeyNode ) * this->n ) / ( keypos == this->n ? 10 : 2 );
         for( int i = this->n - 1; i > -1; --i ) {
             rightSize += keyNode( i ).key.dataSize() + sizeof( _KeyNode );
             if ( rightSize > rightSizeLimit ) {
@@ -582,6 +643,7 @@ namespace mongo {
         _KeyNode &kn = k( i );
         kn.recordLoc = recordLoc;
         kn.prevChildBucket = prevChildBucket;
+        kn.setKeyPrefix( key );
         short ofs = (short) _alloc( key.dataSize() );
         kn.setKeyDataOfs( ofs );
         char *p = dataAt( ofs );
@@ -755,9 +817,19 @@ namespace mongo {
         if( guessIncreasing ) {
             m = h;
         }
+        unsigned prefix = _KeyNode::prefixOf( key );
+        bool firstDescending = order.descending( 1 );
         while ( l <= h ) {
             KeyNode M = this->keyNode(m);
-            int x = key.woCompare(M.key, order);
+            // keys with different prefixes are ordered by them
+            int x = -k(m).comparePrefix( prefix );
+            if ( x != 0 ) {
+                if ( firstDescending )
+                    x = -x;
+            }
+            else {
+                x = key.woCompare(M.key, order);
+            }
             if ( x == 0 ) {
                 if( assertIfDup ) {
                     if( k(m).isUnused() ) {
@@ -986,7 +1058,7 @@ namespace mongo {
         const BtreeBucket *r = BTREE(this->childForPos( leftIndex + 1 ));
 
         int KNS = sizeof( _KeyNode );
-        int rightSizeLimit = ( l->topSize + l->n * KNS + keyNode( leftIndex ).key.dataSize() + KNS + r->topSize + r->n * KNS ) / 2;
+        int rightSizeLimit = ( l->unsharedTopSize() + l->n * KNS + keyNode( leftIndex ).key.dataSize() + KNS + r->unsharedTopSize() + r->n * KNS ) / 2;
         // This constraint should be ensured by only calling this function
         // if we go below the low water mark.
         verify( rightSizeLimit < BtreeBucket<V>::bodySize() );
@@ -1535,6 +1607,14 @@ namespace mongo {
     template< class V >
     bool BtreeBucket<V>::customFind( int l, int h, const BSONObj &keyBegin, int keyBeginLen, bool afterKey, const vector< const BSONElement * > &keyEnd, const vector< bool > &keyEndInclusive, const Ordering &order, int direction, DiskLoc &thisLoc, int &keyOfs, pair< DiskLoc, int > &bestParent ) {
         const BtreeBucket<V> * bucket = BTREE(thisLoc);
+        // unless the search key's first field is beyond all keys (afterKey with no keyBegin
+        // fields), keys whose prefixes differ from its prefix are ordered by them
+        bool usePrefix = keyBeginLen > 0 || !afterKey;
+        unsigned prefix = 0;
+        if ( usePrefix ) {
+            prefix = _KeyNode::prefixOf( keyBeginLen > 0 ? keyBegin.firstElement() : *keyEnd[ 0 ] );
+        }
+        bool firstDescending = order.descending( 1 );
         while( 1 ) {
             if ( l + 1 == h ) {
                 keyOfs = ( direction > 0 ) ? h : l;
@@ -1549,7 +1629,14 @@ namespace mongo {
                 }
             }
             int m = l + ( h - l ) / 2;
-            int cmp = customBSONCmp( bucket->keyNode( m ).key.toBson(), keyBegin, keyBeginLen, afterKey, keyEnd, keyEndInclusive, order, direction );
+            int cmp = usePrefix ? bucket->k( m ).comparePrefix( prefix ) : 0;
+            if ( cmp != 0 ) {
+                if ( firstDescending )
+                    cmp = -cmp;
+            }
+            else {
+                cmp = customBSONCmp( bucket->keyNode( m ).key.toBson(), keyBegin, keyBeginLen, afterKey, keyEnd, keyEndInclusive, order, direction );
+            }
             if ( cmp < 0 ) {
                 l = m;
             }
@@ -1949,10 +2036,13 @@ namespace mongo {
 
     template class BucketBasics<V0>;
     template class BucketBasics<V1>;
+    template class BucketBasics<V2>;
     template class BtreeBucket<V0>;
     template class BtreeBucket<V1>;
+    template class BtreeBucket<V2>;
     template struct __KeyNode<DiskLoc>;
     template struct __KeyNode<DiskLoc56Bit>;
+    template struct __KeyNodeV2<DiskLoc56Bit>;
 
     struct BTUnitTest : public StartupTest {
         void run() {
@@ -122,6 +122,29 @@ namespace mongo {
         int isUsed() const {
             return !isUnused();
         }
+
+        /** V0 and V1 keys have no prefix, see __KeyNodeV2. */
+        template< class K > void setKeyPrefix( const K& key ) { }
+        int comparePrefix( unsigned prefix ) const { return 0; }
+        template< class K > static unsigned prefixOf( const K& key ) { return 0; }
+    };
+
+    /**
+     * The _KeyNode of version 2 buckets adds the normalized prefix of its key's first field, so
+     * that a binary search within a bucket can order most keys without reading them.  See
+     * KeyV1::normalizedPrefix().
+     */
+    template< class Loc >
+    struct __KeyNodeV2 : public __KeyNode<Loc> {
+        unsigned keyPrefix;
+
+        void setKeyPrefix( const KeyV1& key ) { keyPrefix = key.normalizedPrefix(); }
+        /** @return <0, 0 or >0 as the key's prefix is below, equal to or above prefix */
+        int comparePrefix( unsigned prefix ) const {
+            return keyPrefix < prefix ? -1 : ( keyPrefix == prefix ? 0 : 1 );
+        }
+        static unsigned prefixOf( const KeyV1& key ) { return key.normalizedPrefix(); }
+        static unsigned prefixOf( const BSONElement& e ) { return KeyV1::normalizedPrefix( e ); }
     };
 
     /**
@@ -178,6 +201,7 @@ namespace mongo {
         typedef KeyBson Key;
         typedef KeyBson KeyOwned;
         enum { BucketSize = 8192 };
+        enum { SharesKeyData = 0 };
 
         // largest key size we allow.  note we very much need to support bigger keys (somehow) in the future.
         static const int KeyMax = OldBucketSize / 10;
@@ -265,6 +289,7 @@ namespace mongo {
         typedef KeyV1 Key;
         typedef KeyV1Owned KeyOwned;
         enum { BucketSize = 8192-16 }; // leave room for Record header
+        enum { SharesKeyData = 0 };
         // largest key size we allow.  note we very much need to support bigger keys (somehow) in the future.
         static const int KeyMax = 1024;
         // A sentinel value sometimes used to identify a deallocated bucket.
@@ -292,8 +317,24 @@ namespace mongo {
         void _init() { }
     };
 
+    /**
+     * Version 2 buckets have the layout of version 1 buckets, with two changes that make a
+     * search within a bucket cheaper and fit more keys in it:
+     *  - every _KeyNode holds a 4 byte normalized prefix of its key's first field, which
+     *    decides most of the comparisons of a binary search without reading the key;
+     *  - adjacent keys with identical data, such as the duplicates of a non unique index,
+     *    share one copy of that data.
+     * Version 2 indexes are only built on request, with ensureIndex( ..., { v : 2 } ).
+     */
+    class BtreeData_V2 : public BtreeData_V1 {
+    public:
+        typedef __KeyNodeV2<Loc> _KeyNode;
+        enum { SharesKeyData = 1 };
+    };
+
     typedef BtreeData_V0 V0;
     typedef BtreeData_V1 V1;
+    typedef BtreeData_V2 V2;
 
     /**
      * This class adds functionality to BtreeData for managing a single bucket.
@@ -498,8 +539,19 @@ namespace mongo {
         /** Pack when already writable */
         void _packReadyForMod(const Ordering &order, int &refPos);
 
-        /** @return the size the bucket's body would have if we were to call pack() */
+        /**
+         * @return the size the bucket's body would have if we were to call pack().  Shared key
+         * data is counted for each key sharing it, as keys moved to another bucket may not share
+         * it there.
+         */
         int packedDataSize( int refPos ) const;
+        /** @return topSize of a packed bucket, counting shared key data for each key sharing it */
+        int unsharedTopSize() const;
+        /**
+         * @return the offset of data identical to key's held by a neighbor of keypos, the
+         * position key is to be inserted at, or -1 if there is none or keys can't share data.
+         */
+        short sharedKeyDataOfs( int keypos, const Key& key ) const;
         void setNotPacked() { this->flags &= ~Packed; }
         void setPacked() { this->flags |= Packed; }
         /**
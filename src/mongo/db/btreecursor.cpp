@@ -23,6 +23,7 @@
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/util/processinfo.h"
 
 namespace mongo {
 
@@ -55,6 +56,36 @@ namespace mongo {
             return currKeyNode().recordLoc;
         }
 
+        virtual long long willNeedAhead( long long bytes ) {
+            if ( bucket.isNull() )
+                return 0;
+            const BtreeBucket<V> *b = bucket.btree<V>();
+            const int n = b->getN();
+            if ( keyOfs < 0 || keyOfs >= n )
+                return 0;
+            const long long pageSize = ProcessInfo::getPageSize();
+            long long advised = 0;
+            int i = keyOfs;
+            while ( advised < bytes ) {
+                if ( b->k(i).isUsed() ) {
+                    const KeyNode kn = b->keyNode(i);
+                    BSONObj key = kn.key.toBson();
+                    if ( pastEnd( key ) )
+                        break;
+                    if ( !_bounds || _bounds->matchesKey( key ) )
+                        advised += Record::willNeed( kn.recordLoc, pageSize );
+                }
+                // the keys of a child bucket come before the next key in this one
+                int next = i + _direction;
+                if ( next < 0 || next >= n )
+                    break;
+                if ( !b->k( _direction > 0 ? next : i ).prevChildBucket.isNull() )
+                    break;
+                i = next;
+            }
+            return advised;
+        }
+
         virtual BSONObj keyAt(int ofs) const { 
             verify( !bucket.isNull() );
             const BtreeBucket<V> *b = bucket.btree<V>();
@@ -188,6 +219,7 @@ namespace mongo {
 
     template class BtreeCursorImpl<V0>;
     template class BtreeCursorImpl<V1>;
+    template class BtreeCursorImpl<V2>;
 
     BtreeCursor* BtreeCursor::make( NamespaceDetails * nsd , int idxNo , const IndexDetails& indexDetails ) {
         int v = indexDetails.version();
@@ -195,6 +227,9 @@ namespace mongo {
         if( v == 1 ) 
             return new BtreeCursorImpl<V1>( nsd , idxNo , indexDetails );
         
+        if( v == 2 ) 
+            return new BtreeCursorImpl<V2>( nsd , idxNo , indexDetails );
+        
         if( v == 0 ) 
             return new BtreeCursorImpl<V0>( nsd , idxNo , indexDetails );
 
@@ -345,12 +380,15 @@ namespace mongo {
     void BtreeCursor::checkEnd() {
         if ( bucket.isNull() )
             return;
-        if ( !endKey.isEmpty() ) {
-            int cmp = sgn( endKey.woCompare( currKey(), _order ) );
-            if ( ( cmp != 0 && cmp != _direction ) ||
-                    ( cmp == 0 && !_endKeyInclusive ) )
-                bucket = DiskLoc();
-        }
+        if ( pastEnd( currKey() ) )
+            bucket = DiskLoc();
+    }
+
+    bool BtreeCursor::pastEnd( const BSONObj& key ) const {
+        if ( endKey.isEmpty() )
+            return false;
+        int cmp = sgn( endKey.woCompare( key, _order ) );
+        return ( cmp != 0 && cmp != _direction ) || ( cmp == 0 && !_endKeyInclusive );
     }
 
     void BtreeCursor::advanceTo( const BSONObj &keyBegin, int keyBeginLen, bool afterKey, const vector< const BSONElement * > &keyEnd, const vector< bool > &keyEndInclusive) {
@@ -118,6 +118,11 @@ namespace mongo {
         }
 
         virtual DiskLoc currLoc() = 0;
+        /**
+         * Advises the records of the keys following this one in its bucket, in bounds.  Keys in
+         * other buckets are not looked at, as those buckets may not be in memory.
+         */
+        virtual long long willNeedAhead( long long bytes ) = 0;
         virtual DiskLoc refLoc()   { return currLoc(); }
         virtual Record* _current() { return currLoc().rec(); }
         virtual BSONObj current()  { return BSONObj::make(_current()); }
@@ -181,6 +186,9 @@ namespace mongo {
 
         void checkEnd();
 
+        /** @return true if key is beyond endKey. */
+        bool pastEnd( const BSONObj& key ) const;
+
         /** selective audits on construction */
         void audit();
 
@@ -533,6 +533,10 @@ namespace mongo {
                 if ( yielded ) {
                     *yielded = true;   
                 }
+                // have the OS bring in the records the cursor reads next while we wait on
+                // this one, rather than fault on them one at a time
+                long long readAhead = _c->willNeedAhead( faultReadAheadBytes );
+                NamespaceDetailsTransient::get( _ns.c_str() ).noteFaultYield( readAhead );
                 bool res = yield( suggestYieldMicros() , rec );
                 if ( res )
                     _yieldSometimesTracker.resetLastTime();
@@ -811,8 +815,8 @@ namespace mongo {
                     log() << " connections:" << Listener::globalTicketHolder.used();
                     if (theReplSet) {
                         log() << " replication threads:" << 
-                            ReplSetImpl::replWriterThreadCount + 
-                            ReplSetImpl::replPrefetcherThreadCount;
+                            theReplSet->getWriterPool().nThreads() + 
+                            theReplSet->getPrefetchPool().nThreads();
                     }
                     last = now;
                     mlast = m;
@@ -230,6 +230,20 @@ namespace mongo {
 
     } poolFlushCmd;
 
+    // the limits on DBConnectionPool, defined with it in the client library
+    ExportedServerParameter<int> _connPoolMaxInUseConnsPerHost(
+            ServerParameterSet::getGlobal(), "connPoolMaxInUseConnsPerHost",
+            &connPoolMaxInUseConnsPerHost, true, true );
+    ExportedServerParameter<int> _connPoolWaitTimeoutMS(
+            ServerParameterSet::getGlobal(), "connPoolWaitTimeoutMS",
+            &connPoolWaitTimeoutMS, true, true );
+    ExportedServerParameter<int> _connPoolMinConnsPerHost(
+            ServerParameterSet::getGlobal(), "connPoolMinConnsPerHost",
+            &connPoolMinConnsPerHost, true, true );
+    ExportedServerParameter<int> _connPoolValidateIdleSecs(
+            ServerParameterSet::getGlobal(), "connPoolValidateIdleSecs",
+            &connPoolValidateIdleSecs, true, true );
+
     class PoolStats : public Command {
     public:
         PoolStats() : Command( "connPoolStats" ) {}
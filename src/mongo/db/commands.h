@@ -126,6 +126,11 @@ namespace mongo {
          */
         virtual bool maintenanceMode() const { return false; }
 
+        /* As maintenanceMode(), for the invocation cmdObj; overridden by commands whose options
+           decide it.
+         */
+        virtual bool maintenanceModeFor( const BSONObj& cmdObj ) const { return maintenanceMode(); }
+
         /* Return true if command should be permitted when a replica set secondary is in "recovering"
            (unreadable) state.
          */
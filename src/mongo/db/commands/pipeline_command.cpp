@@ -18,6 +18,8 @@
 
 #include <vector>
 
+#include <boost/filesystem/path.hpp>
+
 #include "mongo/db/auth/action_set.h"
 #include "mongo/db/auth/action_type.h"
 #include "mongo/db/auth/privilege.h"
@@ -58,6 +60,7 @@ namespace mongo {
 
             intrusive_ptr<ExpressionContext> pCtx =
                 ExpressionContext::create(&InterruptStatusMongod::status);
+            pCtx->setTempDir(tempDir());
 
             /* try to parse the command; if this fails, then we didn't run */
             intrusive_ptr<Pipeline> pPipeline = Pipeline::parseCommand(errmsg, cmdObj, pCtx);
@@ -94,6 +97,11 @@ namespace mongo {
         }
 
     private:
+        /* where $sort and $group spill when the command allows disk use */
+        static string tempDir() {
+            return (boost::filesystem::path(dbpath) / "_tmp").string();
+        }
+
         /*
           Execute the pipeline for the explain.  This is common to both the
           locked and unlocked code path.  However, the results are different.
@@ -141,6 +149,7 @@ namespace mongo {
             /* on the shard servers, create the local pipeline */
             intrusive_ptr<ExpressionContext> pShardCtx(
                 ExpressionContext::create(&InterruptStatusMongod::status));
+            pShardCtx->setTempDir(tempDir());
             intrusive_ptr<Pipeline> pShardPipeline(
                 Pipeline::parseCommand(errmsg, shardBson, pShardCtx));
             if (!pShardPipeline.get()) {
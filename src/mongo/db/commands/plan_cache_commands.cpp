@@ -0,0 +1,181 @@
+/**
+ * planCacheList, planCachePin and planCacheClear commands
+ */
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/pch.h"
+
+#include <string>
+#include <vector>
+
+#include "mongo/db/auth/action_set.h"
+#include "mongo/db/auth/action_type.h"
+#include "mongo/db/auth/privilege.h"
+#include "mongo/db/commands.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/db/namespace_details-inl.h"
+#include "mongo/db/plan_cache.h"
+#include "mongo/db/queryoptimizer.h"
+
+namespace mongo {
+
+    /** Base for the commands on the query plan cache of the collection they name. */
+    class PlanCacheCmd : public Command {
+    public:
+        PlanCacheCmd( const char* name, const ActionType& action ) :
+            Command( name ),
+            _action( action ) {
+        }
+
+        virtual bool slaveOk() const { return true; }
+
+        virtual LockType locktype() const { return READ; }
+
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(_action);
+            out->push_back(Privilege(parseNs(dbname, cmdObj), actions));
+        }
+
+        bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg,
+                 BSONObjBuilder& result, bool fromRepl) {
+            string ns = parseNs(dbname, cmdObj);
+            NamespaceDetails* d = nsdetails(ns);
+            if ( !d ) {
+                errmsg = "ns not found";
+                return false;
+            }
+            return runOn( ns, d, cmdObj, errmsg, result );
+        }
+
+    protected:
+        virtual bool runOn( const string& ns, NamespaceDetails* d, const BSONObj& cmdObj,
+                            string& errmsg, BSONObjBuilder& result ) = 0;
+
+        /** reads the query and sort of cmdObj, both optional objects */
+        static bool parseShape( const BSONObj& cmdObj, BSONObj& query, BSONObj& sort,
+                                string& errmsg ) {
+            BSONElement q = cmdObj["query"];
+            BSONElement s = cmdObj["sort"];
+            if ( ( !q.eoo() && q.type() != Object ) || ( !s.eoo() && s.type() != Object ) ) {
+                errmsg = "query and sort must be objects";
+                return false;
+            }
+            query = q.eoo() ? BSONObj() : q.embeddedObject();
+            sort = s.eoo() ? BSONObj() : s.embeddedObject();
+            return true;
+        }
+
+    private:
+        ActionType _action;
+    };
+
+    class PlanCacheListCmd : public PlanCacheCmd {
+    public:
+        PlanCacheListCmd() : PlanCacheCmd( "planCacheList", ActionType::planCacheRead ) { }
+
+        virtual void help( stringstream& h ) const {
+            h << "lists the query shapes in the query plan cache of a collection, with the plan "
+              << "recorded or pinned for each and the statistics of the plans run for it. "
+              << "{planCacheList: 'collection'}";
+        }
+
+    protected:
+        bool runOn( const string& ns, NamespaceDetails* d, const BSONObj& cmdObj, string& errmsg,
+                    BSONObjBuilder& result ) {
+            SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            BSONArrayBuilder shapes( result.subarrayStart( "shapes" ) );
+            NamespaceDetailsTransient::get_inlock( ns ).planCache().append( shapes );
+            shapes.done();
+            return true;
+        }
+    } planCacheListCmd;
+
+    class PlanCachePinCmd : public PlanCacheCmd {
+    public:
+        PlanCachePinCmd() : PlanCacheCmd( "planCachePin", ActionType::planCacheWrite ) { }
+
+        virtual void help( stringstream& h ) const {
+            h << "pins the plan for a query shape to an index, which is then used for every "
+              << "query of that shape without racing other plans until the shape is cleared or "
+              << "the index dropped. "
+              << "{planCachePin: 'collection', query: {...}, sort: {...}, "
+              << "index: <key pattern> | {$natural: 1}}";
+        }
+
+    protected:
+        bool runOn( const string& ns, NamespaceDetails* d, const BSONObj& cmdObj, string& errmsg,
+                    BSONObjBuilder& result ) {
+            BSONObj query;
+            BSONObj sort;
+            if ( !parseShape( cmdObj, query, sort, errmsg ) )
+                return false;
+
+            BSONElement index = cmdObj["index"];
+            if ( index.type() != Object || index.embeddedObject().isEmpty() ) {
+                errmsg = "index must be a key pattern or {$natural: 1}";
+                return false;
+            }
+            BSONObj indexKey = index.embeddedObject();
+            if ( str::equals( indexKey.firstElementFieldName(), "$natural" ) ) {
+                indexKey = BSON( "$natural" << 1 );
+            }
+            else if ( d->findIndexByKeyPattern( indexKey ) < 0 ) {
+                errmsg = "index not found";
+                return false;
+            }
+
+            FieldRangeSetPair frsp( ns.c_str(), query );
+            QueryUtilIndexed::pinIndexForPatterns( frsp, sort, indexKey );
+            result.append( "pattern", frsp.getSingleKeyFRS().pattern( sort ).toBSON() );
+            return true;
+        }
+    } planCachePinCmd;
+
+    class PlanCacheClearCmd : public PlanCacheCmd {
+    public:
+        PlanCacheClearCmd() : PlanCacheCmd( "planCacheClear", ActionType::planCacheWrite ) { }
+
+        virtual void help( stringstream& h ) const {
+            h << "forgets the plans, pinned ones included, recorded in the query plan cache of a "
+              << "collection: for one query shape if a query or sort is given, else for all. "
+              << "{planCacheClear: 'collection', [query: {...}], [sort: {...}]}";
+        }
+
+    protected:
+        bool runOn( const string& ns, NamespaceDetails* d, const BSONObj& cmdObj, string& errmsg,
+                    BSONObjBuilder& result ) {
+            if ( cmdObj["query"].eoo() && cmdObj["sort"].eoo() ) {
+                SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+                NamespaceDetailsTransient::get_inlock( ns ).planCache().clear( true );
+                return true;
+            }
+
+            BSONObj query;
+            BSONObj sort;
+            if ( !parseShape( cmdObj, query, sort, errmsg ) )
+                return false;
+            FieldRangeSetPair frsp( ns.c_str(), query );
+            QueryUtilIndexed::removePlansForPatterns( frsp, sort );
+            return true;
+        }
+    } planCacheClearCmd;
+
+}
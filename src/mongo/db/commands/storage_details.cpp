@@ -24,6 +24,7 @@
 #include "mongo/db/auth/privilege.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/db.h"
+#include "mongo/db/free_record_index.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/namespace_details.h"
@@ -304,7 +305,9 @@ namespace {
               << "{characteristicField: dotted_path} enables collection of a field to make "
               << "it possible to identify which kind of record belong to each slice/extent. "
               << "{showRecords: true} enables a dump of all records and deleted records "
-              << "encountered. Example: "
+              << "encountered. Analyzing the disk storage of a whole non-capped collection also "
+              << "reports its free space: {freeSpace: {records, bytes, largest, fragmentation, "
+              << "perBucket}}. Example: "
               << "{storageDetails: 'collectionName', analyze: 'diskStorage', granularity: 1 << 20}";
         }
 
@@ -742,6 +745,12 @@ namespace {
                 extentBuilder.doneFast();
             }
             extentsArrayBuilder.doneFast();
+
+            if (subCommand == SUBCMD_DISK_STORAGE && !nsd->isCapped()) {
+                BSONObjBuilder freeSpaceBuilder(outputBuilder.subobjStart("freeSpace"));
+                FreeRecordIndex::appendListStats(nsd, freeSpaceBuilder);
+                freeSpaceBuilder.doneFast();
+            }
         }
         if (!success) return false;
         result.appendElements(outputBuilder.obj());
@@ -32,12 +32,15 @@
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/curop-inl.h"
 #include "mongo/db/extsort.h"
+#include "mongo/db/free_record_index.h"
 #include "mongo/db/index.h"
 #include "mongo/db/index_update.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/db/sort_phase_one.h"
+#include "mongo/s/d_logic.h"
 #include "mongo/util/concurrency/task.h"
 #include "mongo/util/timer.h"
 #include "mongo/util/touch_pages.h"
@@ -57,6 +60,17 @@ namespace mongo {
         return ~0;
     }
 
+    /** @return the length to allocate for a record of lenWHdr bytes with headers */
+    static unsigned paddedLength(unsigned lenWHdr, double pf, int pb) {
+        unsigned lenWPadding = static_cast<unsigned>(pf*lenWHdr);
+        lenWPadding += pb;
+        lenWPadding = lenWPadding & quantizeMask(lenWPadding);
+        if( lenWPadding < lenWHdr || lenWPadding > BSONObjMaxUserSize / 2 ) { 
+            lenWPadding = lenWHdr;
+        }
+        return lenWPadding;
+    }
+
     /** @return number of skipped (invalid) documents */
     unsigned compactExtent(const char *ns, NamespaceDetails *d, const DiskLoc diskloc, int n,
                 const scoped_array<IndexSpec> &indexSpecs,
@@ -108,15 +122,7 @@ namespace mongo {
                         oldObjSizeWithPadding += recOld->netLength();
 
                         unsigned lenWHdr = sz + Record::HeaderSize;
-                        unsigned lenWPadding = lenWHdr;
-                        {
-                            lenWPadding = static_cast<unsigned>(pf*lenWPadding);
-                            lenWPadding += pb;
-                            lenWPadding = lenWPadding & quantizeMask(lenWPadding);
-                            if( lenWPadding < lenWHdr || lenWPadding > BSONObjMaxUserSize / 2 ) { 
-                                lenWPadding = lenWHdr;
-                            }
-                        }
+                        unsigned lenWPadding = paddedLength(lenWHdr, pf, pb);
                         DiskLoc loc = allocateSpaceForANewRecord(ns, d, lenWPadding, false);
                         uassert(14024, "compact error out of space during compaction", !loc.isNull());
                         Record *recNew = loc.rec();
@@ -243,6 +249,10 @@ namespace mongo {
         for( int i = 0; i < Buckets; i++ ) { 
             d->deletedList[i].writing().Null();
         }
+        if( !d->drainingExtent().isNull() ) {
+            // an interrupted compact online; the records it held are orphaned with the rest
+            d->stopDraining(ns, false);
+        }
 
 
 
@@ -310,10 +320,318 @@ namespace mongo {
         return true;
     }
 
+    /** the namespaces being compacted, so that compactions of one namespace don't overlap */
+    class CompactionRegistration : boost::noncopyable {
+    public:
+        CompactionRegistration(const string& ns) : _ns(ns) {
+            scoped_lock lk(_mutex);
+            uassert(16749, str::stream() << "a compaction of " << ns << " is already running",
+                    _running.insert(ns).second);
+        }
+        ~CompactionRegistration() {
+            scoped_lock lk(_mutex);
+            _running.erase(_ns);
+        }
+        static bool running(const string& ns) {
+            scoped_lock lk(_mutex);
+            return _running.count(ns) > 0;
+        }
+    private:
+        const string _ns;
+        static mongo::mutex _mutex;
+        static set<string> _running;
+    };
+    mongo::mutex CompactionRegistration::_mutex("CompactionRegistration");
+    set<string> CompactionRegistration::_running;
+
+    bool isBeingCompacted(const string& ns) {
+        return CompactionRegistration::running(ns);
+    }
+
+    // how long an online compaction holds the write lock at a time
+    MONGO_EXPORT_SERVER_PARAMETER(compactOnlineStepMillis, int, 10);
+
+    /**
+     * Online compaction empties the last extent of a collection by moving its records into the
+     * free space of the extents before it, frees the extent, and repeats, until the free space
+     * left before the last extent can't hold its records.
+     *
+     * The write lock is taken for a step of at most compactOnlineStepMillis at a time.  While an
+     * extent is drained its free space is held out of the deleted lists (see
+     * NamespaceDetails::startDraining), so that records moved or inserted meanwhile land
+     * elsewhere.  A record is moved like an update that outgrows its space: it is copied,
+     * indexed at its new location, then deleted from its old one, so that queries running
+     * alongside may see it twice or not at all, as they may for such updates.
+     */
+    class OnlineCompaction {
+    public:
+        OnlineCompaction(const string& ns, bool validate, double pf, int pb, double maxMBPerSec) :
+            _ns(ns), _validate(validate), _pf(pf), _pb(pb), _maxMBPerSec(maxMBPerSec),
+            _recordsMoved(0), _bytesMoved(0), _extentsFreed(0), _bytesFreed(0),
+            _holding(true), _heldBytes(-1) {
+        }
+
+        void run(BSONObjBuilder& result) {
+            int numExtents = 0;
+            {
+                Lock::DBWrite lk(_ns);
+                Client::Context ctx(_ns);
+                NamespaceDetails *d = nsdetails(_ns);
+                massert(13660, str::stream() << "namespace " << _ns << " does not exist", d);
+                d->storageSize(&numExtents);
+            }
+            ProgressMeterHolder pm(cc().curop()->setMessage("compact online",
+                                                            "Online Compaction Progress",
+                                                            numExtents > 1 ? numExtents - 1 : 0));
+            Timer t;
+            while( _stopReason.empty() ) {
+                bool freed;
+                {
+                    Lock::DBWrite lk(_ns);
+                    Client::Context ctx(_ns);
+                    try {
+                        freed = step();
+                        getDur().commitIfNeeded();
+                        killCurrentOp.checkForInterrupt(false);
+                    }
+                    catch(...) {
+                        abort();
+                        throw;
+                    }
+                }
+                if( freed )
+                    pm.hit();
+
+                // leave the lock to others between steps, and keep to the requested rate
+                long long waitMillis = 1;
+                if( _maxMBPerSec > 0 ) {
+                    long long dueMillis =
+                            static_cast<long long>(_bytesMoved / (_maxMBPerSec * 1024 * 1024) * 1000);
+                    waitMillis = std::max(waitMillis, dueMillis - t.millis());
+                }
+                sleepmillis(waitMillis);
+            }
+            pm.finished();
+
+            result.append("online", true);
+            result.appendNumber("recordsMoved", _recordsMoved);
+            result.appendNumber("bytesMoved", _bytesMoved);
+            result.appendNumber("extentsFreed", _extentsFreed);
+            result.appendNumber("bytesFreed", _bytesFreed);
+            result.append("stopped", _stopReason);
+        }
+
+    private:
+        /**
+         * Moves the records of the extent being drained, starting to drain the last extent if
+         * none is, for up to compactOnlineStepMillis.
+         * @return true if an extent was emptied and freed
+         */
+        bool step() {
+            NamespaceDetails *d = nsdetails(_ns);
+            if( !d ) {
+                _stopReason = "collection dropped";
+                return false;
+            }
+            if( BackgroundOperation::inProgForNs(_ns.c_str()) ) {
+                abort();
+                _stopReason = "background operation in progress";
+                return false;
+            }
+            if( isMigratingFrom(_ns) ) {
+                abort();
+                _stopReason = "chunk migration in progress";
+                return false;
+            }
+            if( d->drainingExtent().isNull() && !startDraining(d) )
+                return false;
+
+            DiskLoc extLoc = d->drainingExtent();
+            Extent *e = extLoc.ext();
+            Timer t;
+            if( _holding && !holdFreeSpace(d, extLoc, t) )
+                return false;
+            for( DiskLoc L = e->firstRecord; !L.isNull(); ) {
+                if( t.millis() >= compactOnlineStepMillis )
+                    return false;
+                Record *rec = L.rec();
+                DiskLoc next = rec->nextInExtent(L);
+                if( !move(d, extLoc, rec, L) ) {
+                    abort();
+                    return false;
+                }
+                L = next;
+            }
+
+            // the extent is empty: unlink and free it, and with it the free records held in it
+            DiskLoc prev = e->xprev;
+            DiskLoc next = e->xnext;
+            if( prev.isNull() )
+                getDur().writingDiskLoc(d->firstExtent) = next;
+            else
+                getDur().writingDiskLoc(prev.ext()->xnext) = next;
+            if( next.isNull() )
+                getDur().writingDiskLoc(d->lastExtent) = prev;
+            else
+                getDur().writingDiskLoc(next.ext()->xprev) = prev;
+            int length = e->length;
+            d->stopDraining(_ns.c_str(), false);
+            getDur().writing(e)->markEmpty();
+            freeExtents(extLoc, extLoc);
+
+            _holding = true;
+            _heldBytes = -1;
+            _extentsFreed++;
+            _bytesFreed += length;
+            log() << "compact online freed extent " << extLoc.toString() << " of " << _ns
+                  << " (" << length / 1000000.0 << "MB)" << endl;
+            return true;
+        }
+
+        /**
+         * Starts draining the last extent.
+         * @return false, setting _stopReason, if there is no extent to drain
+         */
+        bool startDraining(NamespaceDetails *d) {
+            if( d->firstExtent == d->lastExtent ) {
+                _stopReason = "one extent left";
+                return false;
+            }
+            d->startDraining(d->lastExtent);
+            _holding = true;
+            _heldBytes = 0;
+            log() << "compact online draining extent " << d->lastExtent.toString() << " of "
+                  << _ns << endl;
+            return true;
+        }
+
+        /**
+         * Takes the free records of the extent being drained off the deleted lists, until the
+         * step's time is up.  A drain found in progress, left by an earlier compaction, is
+         * carried on this way too.  Once all are held, checks that the free space left can take
+         * the records still in the extent.
+         * @return false if the step should end, setting _stopReason if the drain was abandoned
+         */
+        bool holdFreeSpace(NamespaceDetails *d, const DiskLoc& extLoc, const Timer& t) {
+            FreeRecordIndex& freeRecords = NamespaceDetailsTransient::get(_ns.c_str()).freeRecords();
+            if( !freeRecords.use(d) ) {
+                abort();
+                _stopReason = "too many free records to index (see freeRecordIndexMaxRecords)";
+                return false;
+            }
+            Extent *e = extLoc.ext();
+            bool done;
+            do {
+                if( t.millis() >= compactOnlineStepMillis )
+                    return false;
+                vector<DiskLoc> free;
+                done = freeRecords.removeExtent(d, extLoc, e->length, 100, free);
+                for( vector<DiskLoc>::iterator i = free.begin(); i != free.end(); ++i ) {
+                    DeletedRecord *r = i->drec();
+                    if( _heldBytes >= 0 )
+                        _heldBytes += r->lengthWithHeaders();
+                    verify(d->holdDrainedRec(r, *i));
+                }
+            } while( !done );
+            _holding = false;
+
+            // what the extent's records take now stands for what they'll need moved; unknown
+            // for a drain begun before, whose free records were partly held already
+            if( _heldBytes >= 0 &&
+                e->length - Extent::HeaderSize() - _heldBytes > freeRecords.bytes() ) {
+                abort();
+                _stopReason = "not enough free space before the last extent";
+                return false;
+            }
+            return true;
+        }
+
+        /** @return false, setting _stopReason, if the record at L couldn't be moved */
+        bool move(NamespaceDetails *d, const DiskLoc& extLoc, Record *rec, const DiskLoc& L) {
+            BSONObj obj = BSONObj::make(rec);
+            if( _validate && !obj.valid() ) {
+                _stopReason = str::stream() << "invalid object at " << L.toString();
+                return false;
+            }
+            int sz = obj.objsize();
+            DiskLoc loc = d->alloc(_ns.c_str(), paddedLength(sz + Record::HeaderSize, _pf, _pb));
+            if( loc.isNull() ) {
+                _stopReason = "not enough free space before the last extent";
+                return false;
+            }
+            verify( DiskLoc(loc.a(), loc.rec()->extentOfs()) != extLoc );
+
+            Record *recNew = (Record *) getDur().writingPtr(loc.rec(), sz + Record::HeaderSize);
+            addRecordToRecListInExtent(recNew, loc);
+            memcpy(recNew->data(), obj.objdata(), sz);
+            {
+                NamespaceDetails::Stats *s = getDur().writing(&d->stats);
+                s->datasize += recNew->netLength();
+                s->nrecords++;
+            }
+            indexMovedRecord(_ns.c_str(), d, BSONObj::make(recNew), loc);
+            theDataFileMgr.deleteRecord(d, _ns.c_str(), rec, L, false, true);
+
+            _recordsMoved++;
+            _bytesMoved += sz;
+            return true;
+        }
+
+        /** ends draining, returning the held free space to the deleted lists */
+        void abort() {
+            _holding = true;
+            _heldBytes = -1;
+            NamespaceDetails *d = nsdetails(_ns);
+            if( !d || d->drainingExtent().isNull() )
+                return;
+            d->stopDraining(_ns.c_str(), true);
+        }
+
+        const string _ns;
+        const bool _validate;
+        const double _pf;
+        const int _pb;
+        const double _maxMBPerSec;
+        long long _recordsMoved;
+        long long _bytesMoved;
+        long long _extentsFreed;
+        long long _bytesFreed;
+        bool _holding;          // the free records of the extent being drained may not all be held
+        long long _heldBytes;   // the bytes held since draining began, -1 if not all are known
+        string _stopReason;
+    };
+
+    void compactOnline(const string& ns, bool validate, BSONObjBuilder& result, double pf, int pb,
+                       double maxMBPerSec) {
+        massert( 14028, "bad ns", NamespaceString::normal(ns.c_str()) );
+        massert( 14027, "can't compact a system namespace", !str::contains(ns, ".system.") );
+        CompactionRegistration registration(ns);
+        log() << "compact online " << ns << " begin" << endl;
+        OnlineCompaction(ns, validate, pf, pb, maxMBPerSec).run(result);
+
+        // give datafiles left wholly free at the end of the database back to the filesystem.
+        // That syncs the journal under the global lock, so look for one first.
+        bool anyFree;
+        {
+            Lock::DBWrite lk(ns);
+            Client::Context ctx(ns);
+            anyFree = firstFreeDataFile() < cc().database()->numFiles();
+        }
+        long long released = 0;
+        if( anyFree ) {
+            Lock::GlobalWrite lk;
+            Client::Context ctx(ns);
+            released = releaseFreeDataFiles();
+        }
+        result.appendNumber("bytesReleased", released);
+        log() << "compact online " << ns << " end" << endl;
+    }
+
     bool compact(const string& ns, string &errmsg, bool validate, BSONObjBuilder& result, double pf, int pb) {
         massert( 14028, "bad ns", NamespaceString::normal(ns.c_str()) );
         massert( 14027, "can't compact a system namespace", !str::contains(ns, ".system.") ); // items in system.indexes cannot be moved there are pointers to those disklocs in NamespaceDetails
 
+        CompactionRegistration registration(ns);
         bool ok;
         {
             Lock::DBWrite lk(ns);
@@ -346,6 +664,9 @@ namespace mongo {
         virtual bool adminOnly() const { return false; }
         virtual bool slaveOk() const { return true; }
         virtual bool maintenanceMode() const { return true; }
+        virtual bool maintenanceModeFor( const BSONObj& cmdObj ) const {
+            return !cmdObj["online"].trueValue();
+        }
         virtual bool logTheOp() { return false; }
         virtual void addRequiredPrivileges(const std::string& dbname,
                                            const BSONObj& cmdObj,
@@ -358,9 +679,11 @@ namespace mongo {
             help << "compact collection\n"
                 "warning: this operation blocks the server and is slow. you can cancel with cancelOp()\n"
                 "{ compact : <collection_name>, [force:<bool>], [validate:<bool>],\n"
-                "  [paddingFactor:<num>], [paddingBytes:<num>] }\n"
+                "  [paddingFactor:<num>], [paddingBytes:<num>], [online:<bool>], [maxMBPerSec:<num>] }\n"
                 "  force - allows to run on a replica set primary\n"
-                "  validate - check records are noncorrupt before adding to newly compacting extents. slower but safer (defaults to true in this version)\n";
+                "  validate - check records are noncorrupt before adding to newly compacting extents. slower but safer (defaults to true in this version)\n"
+                "  online - move records out of the last extents into free space before them in short steps, without blocking the server, and free the emptied extents, removing datafiles left wholly free at the end of the database (which briefly takes the global lock)\n"
+                "  maxMBPerSec - for online, the most data to move per second (default unlimited)\n";
         }
         virtual bool requiresAuth() { return true; }
         CompactCmd() : Command("compact") { }
@@ -372,7 +695,8 @@ namespace mongo {
                 return false;
             }
 
-            if( isCurrentlyAReplSetPrimary() && !cmdObj["force"].trueValue() ) { 
+            bool online = cmdObj["online"].trueValue();
+            if( !online && isCurrentlyAReplSetPrimary() && !cmdObj["force"].trueValue() ) { 
                 errmsg = "will not run compact on an active replica set primary as this is a slow blocking operation. use force:true to force";
                 return false;
             }
@@ -416,6 +740,15 @@ namespace mongo {
             }
 
             bool validate = !cmdObj.hasElement("validate") || cmdObj["validate"].trueValue(); // default is true at the moment
+            if( online ) {
+                double maxMBPerSec = cmdObj["maxMBPerSec"].numberDouble();
+                if( maxMBPerSec < 0 ) {
+                    errmsg = "maxMBPerSec must not be negative";
+                    return false;
+                }
+                compactOnline(ns, validate, result, pf, pb, maxMBPerSec);
+                return true;
+            }
             bool ok = compact(ns, errmsg, validate, result, pf, pb);
             return ok;
         }
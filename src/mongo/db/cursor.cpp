@@ -40,6 +40,13 @@ namespace mongo {
         return ok();
     }
 
+    long long BasicCursor::willNeedAhead( long long bytes ) {
+        // a forward scan reads the records following this one on disk next
+        if ( s != forward() )
+            return 0;
+        return Record::willNeed( curr, bytes );
+    }
+
     /* these will be used outside of mutexes - really functors - thus the const */
     class Forward : public AdvanceStrategy {
         virtual DiskLoc next( const DiskLoc &prev ) const {
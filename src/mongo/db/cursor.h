@@ -139,6 +139,14 @@ namespace mongo {
 
         virtual bool supportYields() = 0;
 
+        /**
+         * While we wait on a page fault on currLoc(), asks the OS to start reading in, up to
+         * bytes, the records this cursor returns next.  Looks only at structures which are
+         * already in memory, so it does not fault itself.  Must be db locked.
+         * @return number of bytes advised
+         */
+        virtual long long willNeedAhead( long long bytes ) { return 0; }
+
         /** Called before a ClientCursor yield. */
         virtual void prepareToYield() { noteLocation(); }
         
@@ -261,6 +269,7 @@ namespace mongo {
         virtual bool modifiedKeys() const { return false; }
         virtual bool supportGetMore() { return true; }
         virtual bool supportYields() { return true; }
+        virtual long long willNeedAhead( long long bytes );
         virtual CoveredIndexMatcher *matcher() const { return _matcher.get(); }
         virtual void setMatcher( shared_ptr< CoveredIndexMatcher > matcher ) { _matcher = matcher; }
         virtual const Projection::KeyOnly *keyFieldsOnly() const { return _keyFieldsOnly.get(); }
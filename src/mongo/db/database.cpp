@@ -24,13 +24,22 @@
 
 #include "mongo/db/auth/auth_index_d.h"
 #include "mongo/db/clientcursor.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/databaseholder.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/introspect.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/file_allocator.h"
 
 namespace mongo {
 
+    // upper bound on the number of empty files kept ahead of a growing database
+    MONGO_EXPORT_SERVER_PARAMETER(preallocDataFilesAhead, int, 3);
+
+    // files added within this window count towards a database's growth rate
+    static const unsigned long long GrowthWindowMillis = 60 * 1000;
+
     void assertDbAtLeastReadLocked(const Database *db) { 
         if( db ) { 
             Lock::assertAtLeastReadLocked(db->name);
@@ -298,7 +307,7 @@ namespace mongo {
             string fullNameString = fullName.string();
             p = new MongoDataFile(n);
             int minSize = 0;
-            if ( n != 0 && _files[ n - 1 ] )
+            if ( n != 0 && n - 1 < (int) _files.size() && _files[ n - 1 ] )
                 minSize = _files[ n - 1 ]->getHeader()->fileLength;
             if ( sizeNeeded + DataFileHeader::HeaderSize > minSize )
                 minSize = sizeNeeded + DataFileHeader::HeaderSize;
@@ -321,11 +330,58 @@ namespace mongo {
         assertDbWriteLocked(this);
         int n = (int) _files.size();
         MongoDataFile *ret = getFile( n, sizeNeeded );
+        _recentFileAdds.push_back( curTimeMillis64() );
         if ( preallocateNextFile )
-            preallocateAFile();
+            preallocateFiles( filesToPreallocate() );
         return ret;
     }
 
+    long long Database::removeFilesFrom( int n ) {
+        verify( Lock::isW() );
+        verify( n > 0 );
+        // a file still being preallocated would be left behind
+        FileAllocator::get()->waitUntilFinished();
+
+        int end = n;
+        while ( exists( end ) )
+            end++;
+        long long bytes = 0;
+        for ( int i = end - 1; i >= n; i-- ) {
+            if ( i < (int) _files.size() ) {
+                delete _files[i];
+                _files.pop_back();
+            }
+            boost::filesystem::path p = fileName( i );
+            bytes += boost::filesystem::file_size( p );
+            boost::filesystem::remove( p );
+            log() << "removed " << p.string() << endl;
+        }
+        return bytes;
+    }
+
+    int Database::filesToPreallocate() {
+        unsigned long long now = curTimeMillis64();
+        while ( !_recentFileAdds.empty() && now - _recentFileAdds.front() > GrowthWindowMillis )
+            _recentFileAdds.pop_front();
+
+        int maxAhead = max( preallocDataFilesAhead, 1 );
+        while ( (int) _recentFileAdds.size() > maxAhead )
+            _recentFileAdds.pop_front();
+
+        int n = max( (int) _recentFileAdds.size(), 1 );
+        if ( cmdLine.quota ) {
+            // no point reserving space the quota won't let us use
+            n = min( n, max( cmdLine.quotaFiles - numFiles() + 1, 1 ) );
+        }
+        return n;
+    }
+
+    void Database::preallocateFiles( int n ) {
+        int first = numFiles();
+        for ( int i = 0; i < n && first + i < DiskLoc::MaxFiles; i++ )
+            getFile( first + i, 0, true );
+    }
+
     bool fileIndexExceedsQuota( const char *ns, int fileIndex, bool enforceQuota ) {
         return
             cmdLine.quota &&
@@ -488,4 +544,17 @@ namespace mongo {
         return db;
     }
 
+    class FileAllocatorServerStatus : public ServerStatusSection {
+    public:
+        FileAllocatorServerStatus() : ServerStatusSection( "fileAllocator" ){}
+        virtual bool includeByDefault() const { return true; }
+
+        BSONObj generateSection(const BSONElement& configElement) const {
+            BSONObjBuilder b;
+            FileAllocator::get()->appendStats( b );
+            b.append( "preallocDataFilesAhead", preallocDataFilesAhead );
+            return b.obj();
+        }
+    } fileAllocatorServerStatus;
+
 } // namespace mongo
@@ -83,7 +83,13 @@ namespace mongo {
          * makes sure we have an extra file at the end that is empty
          * safe to call this multiple times - the implementation will only preallocate one file
          */
-        void preallocateAFile() { getFile( numFiles() , 0, true ); }
+        void preallocateAFile() { preallocateFiles( 1 ); }
+
+        /**
+         * makes sure the next n files after the newest are allocated or being allocated
+         * safe to call this multiple times
+         */
+        void preallocateFiles( int n );
 
         MongoDataFile* suitableFile( const char *ns, int sizeNeeded, bool preallocate, bool enforceQuota );
 
@@ -91,6 +97,13 @@ namespace mongo {
 
         MongoDataFile* newestFile();
 
+        /**
+         * closes and deletes the files numbered n and up, and those preallocated after them.
+         * nothing may refer to them any longer.  requires the global write lock.
+         * @return the bytes deleted
+         */
+        long long removeFilesFrom( int n );
+
         /**
          * @return true if success.  false if bad level or error creating profile ns
          */
@@ -145,8 +158,17 @@ namespace mongo {
         int getProfilingLevel() const { return _profile; }
 
     private:
+        /**
+         * @return how many empty files to keep ahead of the newest one: one more for each
+         * file added recently, up to the preallocDataFilesAhead server parameter
+         */
+        int filesToPreallocate();
+
         RecordStats _recordStats;
         int _profile; // 0=off.
+
+        // times (millis) at which addAFile() was recently called, oldest first
+        std::deque<unsigned long long> _recentFileAdds;
     };
 
 } // namespace mongo
@@ -44,6 +44,7 @@
 #include "mongo/db/repl.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/restapi.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/db/stats/counters.h"
 #include "mongo/db/stats/snapshots.h"
 #include "mongo/db/ttl.h"
@@ -545,6 +546,9 @@ namespace mongo {
 #endif // __linux__
     }
 
+    // data files of different databases are allocated in parallel, this many at a time
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(fileAllocatorThreads, int, 4);
+
     void _initAndListen(int listenPort ) {
 
         Client::initThread("initandlisten");
@@ -595,7 +599,7 @@ namespace mongo {
         acquirePathLock(forceRepair);
         boost::filesystem::remove_all( dbpath + "/_tmp/" );
 
-        FileAllocator::get()->start();
+        FileAllocator::get()->start( fileAllocatorThreads );
 
         MONGO_ASSERT_ON_EXCEPTION_WITH_MSG( clearTmpFiles(), "clear tmp files" );
 
@@ -67,6 +67,7 @@
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/db.h"
 #include "mongo/db/dur_stats.h"
+#include "mongo/db/free_record_index.h"
 #include "mongo/db/index_update.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/introspect.h"
@@ -80,6 +81,7 @@
 #include "mongo/db/repl.h"
 #include "mongo/db/repl_block.h"
 #include "mongo/db/replutil.h"
+#include "mongo/db/sort_phase_one.h"
 #include "mongo/db/stats/timer_stats.h"
 #include "mongo/s/d_writeback.h"
 #include "mongo/s/stale_exception.h"  // for SendStaleConfigException
@@ -803,18 +805,77 @@ namespace mongo {
             }
 
 
+            // Extract the keys of every foreground index in a single scan of the collection, before
+            // the indexes are dropped.  The rebuilds below then only sort and load.  The sorters
+            // are all filled at once, so they share the memory of a single one.
+            int nIndexes = all.size();
+            int nForeground = 0;
+            for ( list<BSONObj>::iterator i=all.begin(); i!=all.end(); i++ ) {
+                if ( ! i->getBoolField( "background" ) )
+                    nForeground++;
+            }
+            long maxRunBytes = BSONObjExternalSorter::DefaultMaxFileSize / max( nForeground, 1 );
+            long long maxRunObjects =
+                    BSONObjExternalSorter::DefaultMaxRunObjects / max( nForeground, 1 );
+            scoped_array<IndexSpec> indexSpecs( new IndexSpec[nIndexes] );
+            scoped_array<SortPhaseOne> phase1( new SortPhaseOne[nIndexes] );
+            vector<int> precalced; // positions in 'all' of the indexes with keys in 'phase1'
+            {
+                int idxNo = 0;
+                for ( list<BSONObj>::iterator i=all.begin(); i!=all.end(); i++, idxNo++ ) {
+                    if ( i->getBoolField( "background" ) )
+                        continue;
+                    int n = precalced.size();
+                    indexSpecs[n].reset( *i );
+                    // The rebuilt index gets the default version, since "v" was removed above.
+                    phase1[n].sorter.reset
+                            ( new BSONObjExternalSorter( IndexInterface::defaultVersion(),
+                                                         i->getObjectField( "key" ),
+                                                         maxRunBytes ) );
+                    // sizes the run array, which bounds the objects of a run
+                    phase1[n].sorter->hintNumObjects( min( d->stats.nrecords,
+                                                           maxRunObjects ) );
+                    precalced.push_back( idxNo );
+                }
+            }
+            if ( ! precalced.empty() ) {
+                ProgressMeterHolder pm( cc().curop()->setMessage( "reIndex: extracting keys",
+                                                                  "Index Rebuild Key Extraction Progress",
+                                                                  d->stats.nrecords,
+                                                                  10 ) );
+                addKeysToPhaseOnes( toDeleteNs.c_str(), indexSpecs.get(), phase1.get(),
+                                    precalced.size(), pm.get(), false );
+                pm.finished();
+            }
+
             bool ok = dropIndexes( d, toDeleteNs.c_str(), "*" , errmsg, result, true );
             if ( ! ok ) {
                 errmsg = "dropIndexes failed";
                 return false;
             }
 
-            for ( list<BSONObj>::iterator i=all.begin(); i!=all.end(); i++ ) {
+            size_t nextPrecalced = 0;
+            int idxNo = 0;
+            for ( list<BSONObj>::iterator i=all.begin(); i!=all.end(); i++, idxNo++ ) {
                 BSONObj o = *i;
                 LOG(1) << "reIndex ns: " << toDeleteNs << " index: " << o << endl;
                 string systemIndexesNs =
                         Namespace( toDeleteNs.c_str() ).getSisterNS( "system.indexes" );
-                theDataFileMgr.insertWithObjMod( systemIndexesNs.c_str(), o, false, true );
+
+                SortPhaseOne* keys = NULL;
+                if ( nextPrecalced < precalced.size() && precalced[nextPrecalced] == idxNo )
+                    keys = &phase1[nextPrecalced++];
+
+                scoped_lock precalcLock( theDataFileMgr._precalcedMutex );
+                try {
+                    theDataFileMgr.setPrecalced( keys );
+                    theDataFileMgr.insertWithObjMod( systemIndexesNs.c_str(), o, false, true );
+                }
+                catch (...) {
+                    theDataFileMgr.setPrecalced( NULL );
+                    throw;
+                }
+                theDataFileMgr.setPrecalced( NULL );
             }
 
             result.append( "nIndexes" , (int)all.size() );
@@ -1234,7 +1295,8 @@ namespace mongo {
         virtual LockType locktype() const { return READ; }
         virtual void help( stringstream &help ) const {
             help << "{ collStats:\"blog.posts\" , scale : 1 } scale divides sizes e.g. for KB use 1024\n"
-                    "    avgObjSize - in bytes";
+                    "    avgObjSize - in bytes\n"
+                    "    workingSet : true - estimate how much of the collection is in RAM (samples pages)";
         }
         virtual void addRequiredPrivileges(const std::string& dbname,
                                            const BSONObj& cmdObj,
@@ -1299,6 +1361,30 @@ namespace mongo {
             if ( verbose )
                 result.appendArray( "extents" , extents.arr() );
 
+            if ( !nsd->isCapped() ) {
+                // free space comes from the in-memory index when it is current; walking the
+                // deleted lists instead touches every free record, so that's left to request
+                FreeRecordIndex& freeRecords =
+                        NamespaceDetailsTransient::get( ns.c_str() ).freeRecords();
+                if ( freeRecords.current( nsd ) ) {
+                    BSONObjBuilder fs( result.subobjStart( "freeSpace" ) );
+                    freeRecords.appendStats( fs );
+                    fs.done();
+                }
+                else if ( jsobj["freeSpace"].trueValue() ) {
+                    BSONObjBuilder fs( result.subobjStart( "freeSpace" ) );
+                    FreeRecordIndex::appendListStats( nsd, fs );
+                    fs.done();
+                }
+            }
+
+            if ( jsobj["workingSet"].trueValue() ) {
+                BSONObjBuilder ws( result.subobjStart( "workingSet" ) );
+                Record::appendResidencyEstimate( nsd, scale, ws );
+                NamespaceDetailsTransient::get( ns.c_str() ).appendWorkingSetStats( ws );
+                ws.done();
+            }
+
             return true;
         }
     } cmdCollectionStats;
@@ -2010,7 +2096,7 @@ namespace mongo {
         if ( c->adminOnly() )
             LOG( 2 ) << "command: " << cmdObj << endl;
 
-        if (c->maintenanceMode() && theReplSet && theReplSet->isSecondary()) {
+        if (c->maintenanceModeFor(cmdObj) && theReplSet && theReplSet->isSecondary()) {
             theReplSet->setMaintenanceMode(true);
         }
 
@@ -2061,7 +2147,7 @@ namespace mongo {
             }
         }
 
-        if (c->maintenanceMode() && theReplSet) {
+        if (c->maintenanceModeFor(cmdObj) && theReplSet) {
             theReplSet->setMaintenanceMode(false);
         }
 
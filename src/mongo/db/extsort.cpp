@@ -33,44 +33,106 @@
 
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/namespace-inl.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/concurrency/thread_pool.h"
 #include "mongo/util/file.h"
+#include "mongo/util/processinfo.h"
 
 namespace mongo {
 
-    HLMutex BSONObjExternalSorter::_extSortMutex("s");
-    IndexInterface *BSONObjExternalSorter::extSortIdxInterface;
-    Ordering BSONObjExternalSorter::extSortOrder( Ordering::make(BSONObj()) );
-    bool BSONObjExternalSorter::extSortMayInterrupt( false );
-    unsigned long long BSONObjExternalSorter::_compares = 0;
+    MONGO_EXPORT_SERVER_PARAMETER(externalSortThreads, int, 0);
+
     unsigned long long BSONObjExternalSorter::_uniqueNumber = 0;
     static SimpleMutex _uniqueNumberMutex( "uniqueNumberMutex" );
 
+    // below this many keys an in memory sort isn't worth splitting across threads
+    static const int ParallelSortMinKeys = 100000;
+
+    static const unsigned FileIteratorBufferSize = 1024 * 1024;
+
+    static int sortThreadCount() {
+        int n = externalSortThreads;
+        if ( n <= 0 )
+            n = ProcessInfo().getNumCores();
+        return max( 1, min( n, 64 ) );
+    }
+
+    static SimpleMutex _sortPoolMutex( "extSortPool" );
+    static threadpool::ThreadPool *_sortPool = 0;
+
+    /** the pool only grows, so lowering externalSortThreads takes effect on restart */
+    static threadpool::ThreadPool& sortPool() {
+        SimpleMutex::scoped_lock lk( _sortPoolMutex );
+        if ( ! _sortPool )
+            _sortPool = new threadpool::ThreadPool( sortThreadCount() );
+        else
+            _sortPool->growTo( sortThreadCount() );
+        return *_sortPool;
+    }
+
     /*static*/
     int BSONObjExternalSorter::_compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order) { 
-        _compares++;
         int x = i.keyCompare(l.first, r.first, order);
         if ( x )
             return x;
         return l.second.compare( r.second );
     }
 
-    /*static*/
-    int BSONObjExternalSorter::extSortComp( const void *lv, const void *rv ) {
-        DEV RARELY {
-            _extSortMutex.dassertLocked(); // must be as we use a global var
+    void BSONObjExternalSorter::RunTasks::schedule( const boost::function<void()>& task ) {
+        {
+            scoped_lock lk( _m );
+            _pending++;
         }
-#ifndef __sunos__
-        // Some solaris gnu qsort implementations do not support callback exceptions.
-        RARELY killCurrentOp.checkForInterrupt(!extSortMayInterrupt);
-#endif
-        Data * l = (Data*)lv;
-        Data * r = (Data*)rv;
-        return _compare(*extSortIdxInterface, *l, *r, extSortOrder);
-    };
+        sortPool().schedule( boost::bind( &RunTasks::_run, this, task ) );
+    }
+
+    void BSONObjExternalSorter::RunTasks::_run( boost::function<void()> task ) {
+        string error;
+        try {
+            task();
+        }
+        catch ( DBException& e ) {
+            error = e.toString();
+        }
+        catch ( std::exception& e ) {
+            error = e.what();
+        }
+
+        scoped_lock lk( _m );
+        if ( ! error.empty() && _error.empty() )
+            _error = error;
+        _pending--;
+        _done.notify_all();
+    }
+
+    static void checkForInterrupt( bool mayInterrupt ) {
+        // keys are also added from key extraction threads, which have no operation to kill
+        if ( haveClient() )
+            killCurrentOp.checkForInterrupt( !mayInterrupt );
+    }
+
+    void BSONObjExternalSorter::RunTasks::waitUntilAtMost( int n, bool mayInterrupt ) {
+        while ( 1 ) {
+            checkForInterrupt( mayInterrupt );
+            scoped_lock lk( _m );
+            if ( _pending > n )
+                _done.timed_wait( lk.boost(), boost::posix_time::milliseconds( 100 ) );
+            if ( _pending <= n ) {
+                uassert( 16742, "external sort failed: " + _error, _error.empty() );
+                return;
+            }
+        }
+    }
+
+    void BSONObjExternalSorter::RunTasks::drain() {
+        scoped_lock lk( _m );
+        while ( _pending > 0 )
+            _done.wait( lk.boost() );
+    }
 
     BSONObjExternalSorter::BSONObjExternalSorter( IndexInterface &i, const BSONObj & order , long maxFileSize )
         : _idxi(i), _order( order.getOwned() ) , _maxFilesize( maxFileSize ) ,
-          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0) {
+          _arraySize(DefaultMaxRunObjects), _cur(0), _curSizeSoFar(0), _sorted(0) {
 
         stringstream rootpath;
         rootpath << dbpath;
@@ -89,10 +151,11 @@ namespace mongo {
         LOG(1) << "external sort root: " << _root.string() << endl;
 
         create_directories( _root );
-        _compares = 0;
     }
 
     BSONObjExternalSorter::~BSONObjExternalSorter() {
+        // runs still being sorted or written use _cur's data and files under _root
+        _runTasks.drain();
         if ( _cur ) {
             delete _cur;
             _cur = 0;
@@ -101,14 +164,46 @@ namespace mongo {
         wassert( removed == 1 + _files.size() );
     }
 
+    /*static*/
+    void BSONObjExternalSorter::_sortRange( Data* begin, Data* end, MyCmp cmp ) {
+        std::sort( begin, end, cmp );
+    }
+
+    /*static*/
+    void BSONObjExternalSorter::_mergeRanges( Data* begin, Data* middle, Data* end, MyCmp cmp ) {
+        std::inplace_merge( begin, middle, end, cmp );
+    }
+
     void BSONObjExternalSorter::_sortInMem( bool mayInterrupt ) {
-        // extSortComp needs to use glpbals
-        // qsort_r only seems available on bsd, which is what i really want to use
-        HLMutex::scoped_lock lk(_extSortMutex);
-        extSortIdxInterface = &_idxi;
-        extSortOrder = Ordering::make(_order);
-        extSortMayInterrupt = mayInterrupt;
-        _cur->sort( BSONObjExternalSorter::extSortComp );
+        MyCmp cmp( _idxi, _order );
+        Data* data = _cur->data();
+        int n = _cur->size();
+
+        int nParts = n < ParallelSortMinKeys ? 1 : sortThreadCount();
+        if ( nParts == 1 ) {
+            checkForInterrupt( mayInterrupt );
+            _sortRange( data, data + n, cmp );
+            return;
+        }
+
+        // sort equal slices on the pool, then merge neighbouring slices a level at a time
+        vector<Data*> bounds;
+        for ( int i = 0; i <= nParts; i++ )
+            bounds.push_back( data + (long long)n * i / nParts );
+
+        for ( int i = 0; i < nParts; i++ )
+            _runTasks.schedule( boost::bind( &BSONObjExternalSorter::_sortRange,
+                                             bounds[i], bounds[i+1], cmp ) );
+        _runTasks.waitUntilAtMost( 0, mayInterrupt );
+
+        for ( int width = 1; width < nParts; width *= 2 ) {
+            for ( int i = 0; i + width < nParts; i += 2 * width ) {
+                _runTasks.schedule( boost::bind( &BSONObjExternalSorter::_mergeRanges,
+                                                 bounds[i], bounds[i+width],
+                                                 bounds[min(i + 2 * width, nParts)], cmp ) );
+            }
+            _runTasks.waitUntilAtMost( 0, mayInterrupt );
+        }
     }
 
     void BSONObjExternalSorter::sort( bool mayInterrupt ) {
@@ -118,7 +213,7 @@ namespace mongo {
 
         if ( _cur && _files.size() == 0 ) {
             _sortInMem( mayInterrupt );
-            LOG(1) << "\t\t not using file.  size:" << _curSizeSoFar << " _compares:" << _compares << endl;
+            LOG(1) << "\t\t not using file.  size:" << _curSizeSoFar << endl;
             return;
         }
 
@@ -126,14 +221,12 @@ namespace mongo {
             finishMap( mayInterrupt );
         }
 
+        _runTasks.waitUntilAtMost( 0, mayInterrupt );
+
         if ( _cur ) {
             delete _cur;
             _cur = 0;
         }
-
-        if ( _files.size() == 0 )
-            return;
-
     }
 
     void BSONObjExternalSorter::add( const BSONObj& o, const DiskLoc& loc, bool mayInterrupt ) {
@@ -164,11 +257,25 @@ namespace mongo {
         if ( _cur->size() == 0 )
             return;
 
-        _sortInMem( mayInterrupt );
+        // one run is sorted and written on the pool while the next one fills, so memory stays
+        // at twice the run size however many runs there are
+        _runTasks.waitUntilAtMost( 0, mayInterrupt );
 
         stringstream ss;
         ss << _root.string() << "/file." << _files.size();
         string file = ss.str();
+        _files.push_back( file );
+
+        InMemory* run = _cur;
+        _cur = 0;
+        _runTasks.schedule( boost::bind( &BSONObjExternalSorter::_writeRun,
+                                         run, MyCmp( _idxi, _order ), file ) );
+    }
+
+    /*static*/
+    void BSONObjExternalSorter::_writeRun( InMemory* run, MyCmp cmp, string file ) {
+        scoped_ptr<InMemory> owned( run );
+        _sortRange( run->data(), run->data() + run->size(), cmp );
 
         // todo: it may make sense to fadvise that this not be cached so that building the index doesn't 
         //       eject other things the db is using from the file system cache.  while we will soon be reading 
@@ -180,17 +287,15 @@ namespace mongo {
         assertStreamGood( 10051 ,  (string)"couldn't open file: " + file , out );
 
         int num = 0;
-        for ( InMemory::iterator i=_cur->begin(); i != _cur->end(); ++i ) {
-            Data p = *i;
+        for ( InMemory::iterator i=run->begin(); i != run->end(); ++i ) {
+            Data& p = *i;
             out.write( p.first.objdata() , p.first.objsize() );
             out.write( (char*)(&p.second) , sizeof( DiskLoc ) );
             num++;
         }
 
-        _cur->clear();
-
-        _files.push_back( file );
         out.close();
+        massert( 16743, "writing external sort file failed: " + file, ! out.fail() );
 
         LOG(2) << "Added file: " << file << " with " << num << "objects for external sort" << endl;
     }
@@ -198,12 +303,15 @@ namespace mongo {
     // ---------------------------------
 
     BSONObjExternalSorter::Iterator::Iterator( BSONObjExternalSorter * sorter ) :
-        _cmp( sorter->_idxi, sorter->_order ) , _in( 0 ) {
+        _heapCmp( MyCmp( sorter->_idxi, sorter->_order ) ) , _in( 0 ) {
 
         for ( list<string>::iterator i=sorter->_files.begin(); i!=sorter->_files.end(); i++ ) {
-            _files.push_back( new FileIterator( *i ) );
-            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+            FileIterator* f = new FileIterator( *i );
+            _files.push_back( f );
+            if ( f->more() )
+                _heap.push_back( HeapEntry( f->next(), _files.size() - 1 ) );
         }
+        std::make_heap( _heap.begin(), _heap.end(), _heapCmp );
 
         if ( _files.size() == 0 && sorter->_cur ) {
             _in = sorter->_cur;
@@ -222,13 +330,7 @@ namespace mongo {
         if ( _in )
             return _it != _in->end();
 
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            if ( (*i)->more() )
-                return true;
-        for ( vector< pair<Data,bool> >::iterator i=_stash.begin(); i!=_stash.end(); i++ )
-            if ( i->second )
-                return true;
-        return false;
+        return ! _heap.empty();
     }
 
     BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::next() {
@@ -239,34 +341,27 @@ namespace mongo {
             return d;
         }
 
-        Data best;
-        int slot = -1;
-
-        for ( unsigned i=0; i<_stash.size(); i++ ) {
-
-            if ( ! _stash[i].second ) {
-                if ( _files[i]->more() )
-                    _stash[i] = pair<Data,bool>( _files[i]->next() , true );
-                else
-                    continue;
-            }
-
-            if ( slot == -1 || _cmp( best , _stash[i].first ) == 0 ) {
-                best = _stash[i].first;
-                slot = i;
-            }
+        verify( ! _heap.empty() );
+        std::pop_heap( _heap.begin(), _heap.end(), _heapCmp );
+        HeapEntry& head = _heap.back();
+        Data best = head.first;
 
+        FileIterator* f = _files[head.second];
+        if ( f->more() ) {
+            head.first = f->next();
+            std::push_heap( _heap.begin(), _heap.end(), _heapCmp );
+        }
+        else {
+            _heap.pop_back();
         }
-
-        verify( slot >= 0 );
-        _stash[slot].second = false;
 
         return best;
     }
 
     // -----------------------------------
 
-    BSONObjExternalSorter::FileIterator::FileIterator( const std::string& file ) {
+    BSONObjExternalSorter::FileIterator::FileIterator( const std::string& file ) :
+        _buf( new char[FileIteratorBufferSize] ), _bufSize( 0 ), _bufPos( 0 ), _fileOfs( 0 ) {
 #ifdef _WIN32
         _file = ::_open( file.c_str(), _O_BINARY | _O_RDWR | _O_CREAT , _S_IREAD | _S_IWRITE );
 #else
@@ -304,23 +399,48 @@ namespace mongo {
     }
 
 
-    bool BSONObjExternalSorter::FileIterator::_read( char* buf, long long count ) {
-        long long total = 0;
-        while ( total < count ) {
+    bool BSONObjExternalSorter::FileIterator::_fill() {
+        unsigned want = (unsigned)min( (unsigned long long)FileIteratorBufferSize, _length - _fileOfs );
+        unsigned total = 0;
+        while ( total < want ) {
 #ifdef _WIN32
-            long long now = ::_read( _file, buf, count );
+            long long now = ::_read( _file, _buf.get() + total, want - total );
 #else
-            long long now = ::read( _file, buf, count );
+            long long now = ::read( _file, _buf.get() + total, want - total );
 #endif
             if ( now < 0 ) {
                 log() << "read failed for BSONObjExternalSorter " << errnoWithDescription() << endl;
                 return false;
             }
             if ( now == 0 ) {
-                return false;
+                break;
             }
             total += now;
-            buf += now;
+        }
+        if ( total == 0 )
+            return false;
+
+        _fileOfs += total;
+        _bufSize = total;
+        _bufPos = 0;
+
+#ifdef POSIX_FADV_WILLNEED
+        // have the kernel fetch the next window while this one is merged
+        if ( _fileOfs < _length )
+            posix_fadvise( _file, _fileOfs, FileIteratorBufferSize, POSIX_FADV_WILLNEED );
+#endif
+        return true;
+    }
+
+    bool BSONObjExternalSorter::FileIterator::_read( char* buf, long long count ) {
+        while ( count > 0 ) {
+            if ( _bufPos == _bufSize && ! _fill() )
+                return false;
+            unsigned n = (unsigned)min( count, (long long)( _bufSize - _bufPos ) );
+            memcpy( buf, _buf.get() + _bufPos, n );
+            _bufPos += n;
+            buf += n;
+            count -= n;
         }
         return true;
     }
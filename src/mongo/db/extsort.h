@@ -28,39 +28,41 @@
 
 namespace mongo {
 
+    /** threads shared by all external sorts for sorting and writing out runs.  settable with
+        setParameter; 0 means one per core. */
+    extern int externalSortThreads;
+
     /**
        for external (disk) sorting by BSONObj and attaching a value
      */
     class BSONObjExternalSorter : boost::noncopyable {
     public:
-        BSONObjExternalSorter( IndexInterface &i, const BSONObj & order = BSONObj() , long maxFileSize = 1024 * 1024 * 100 );
+        /** the default bytes of a run, and its most objects */
+        static const long DefaultMaxFileSize = 1024 * 1024 * 100;
+        static const int DefaultMaxRunObjects = 1000000;
+
+        BSONObjExternalSorter( IndexInterface &i, const BSONObj & order = BSONObj() , long maxFileSize = DefaultMaxFileSize );
         ~BSONObjExternalSorter();
         typedef pair<BSONObj,DiskLoc> Data;
         /** @return the IndexInterface used to perform key comparisons. */
         const IndexInterface& getIndexInterface() const { return _idxi; }
  
     private:
-        static HLMutex _extSortMutex;
         IndexInterface& _idxi;
 
         static int _compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order);
 
         class MyCmp {
         public:
-            MyCmp( IndexInterface& i, BSONObj order = BSONObj() ) : _i(i), _order( Ordering::make(order) ) {}
+            MyCmp( IndexInterface& i, BSONObj order = BSONObj() ) : _i(&i), _order( Ordering::make(order) ) {}
             bool operator()( const Data &l, const Data &r ) const {
-                return _compare(_i, l, r, _order) < 0;
+                return _compare(*_i, l, r, _order) < 0;
             };
         private:
-            IndexInterface& _i;
-            const Ordering _order;
+            IndexInterface* _i; // a pointer so that std::sort can copy and assign us
+            Ordering _order;
         };
 
-        static IndexInterface *extSortIdxInterface;
-        static Ordering extSortOrder;
-        static bool extSortMayInterrupt;
-        static int extSortComp( const void *lv, const void *rv );
-
         class FileIterator : boost::noncopyable {
         public:
             FileIterator( const std::string& file );
@@ -69,10 +71,38 @@ namespace mongo {
             Data next();
         private:
             bool _read( char* buf, long long count );
+            bool _fill();
 
             int _file;
             unsigned long long _length;
             unsigned long long _readSoFar;
+
+            // runs are read through a buffer, and the kernel is asked to read ahead of it
+            boost::scoped_array<char> _buf;
+            unsigned _bufSize;
+            unsigned _bufPos;
+            unsigned long long _fileOfs;
+        };
+
+        /**
+           runs being sorted and written out by the shared sort pool.  add() hands off a full
+           run and carries on filling the next one; sort() waits for all of them.
+         */
+        class RunTasks : boost::noncopyable {
+        public:
+            RunTasks() : _m("extSortRunTasks"), _pending(0) {}
+            void schedule( const boost::function<void()>& task );
+            /** wait until no more than 'n' tasks are outstanding, and rethrow any failure */
+            void waitUntilAtMost( int n, bool mayInterrupt );
+            /** wait for everything outstanding, ignoring failures; for cleanup */
+            void drain();
+        private:
+            void _run( boost::function<void()> task );
+
+            mongo::mutex _m;
+            boost::condition _done;
+            int _pending;
+            string _error;
         };
 
     public:
@@ -88,9 +118,22 @@ namespace mongo {
             Data next();
 
         private:
-            MyCmp _cmp;
+            typedef pair<Data,unsigned> HeapEntry; // the head of a run, and which run
+
+            /** orders the heap so that its front is the smallest head */
+            class HeapCmp {
+            public:
+                HeapCmp( const MyCmp& cmp ) : _cmp(cmp) {}
+                bool operator()( const HeapEntry& l, const HeapEntry& r ) const {
+                    return _cmp( r.first, l.first );
+                }
+            private:
+                MyCmp _cmp;
+            };
+
+            HeapCmp _heapCmp;
             vector<FileIterator*> _files;
-            vector< pair<Data,bool> > _stash;
+            vector<HeapEntry> _heap;
 
             InMemory * _in;
             InMemory::iterator _it;
@@ -122,6 +165,10 @@ namespace mongo {
 
         void _sortInMem( bool mayInterrupt );
 
+        static void _sortRange( Data* begin, Data* end, MyCmp cmp );
+        static void _mergeRanges( Data* begin, Data* middle, Data* end, MyCmp cmp );
+        static void _writeRun( InMemory* run, MyCmp cmp, string file );
+
         void sort( const std::string& file );
         void finishMap( bool mayInterrupt );
 
@@ -136,7 +183,8 @@ namespace mongo {
         list<string> _files;
         bool _sorted;
 
-        static unsigned long long _compares;
+        RunTasks _runTasks;
+
         static unsigned long long _uniqueNumber;
     };
 }
@@ -0,0 +1,295 @@
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/free_record_index.h"
+
+#include "mongo/base/counter.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/dur.h"
+#include "mongo/db/kill_current_op.h"
+#include "mongo/db/pdfile.h"
+#include "mongo/db/server_parameters.h"
+
+namespace mongo {
+
+    // 0 turns the index off, leaving allocation to the deletedList chains
+    MONGO_EXPORT_SERVER_PARAMETER( freeRecordIndexMaxRecords, int, 200000 );
+
+    static Counter64 freeSpaceAllocs;
+    static ServerStatusMetricField<Counter64> displayFreeSpaceAllocs( "record.freeSpace.allocs",
+                                                                      &freeSpaceAllocs );
+    static Counter64 freeSpaceCoalesced;
+    static ServerStatusMetricField<Counter64> displayFreeSpaceCoalesced(
+            "record.freeSpace.coalesced", &freeSpaceCoalesced );
+    static Counter64 freeSpaceLoads;
+    static ServerStatusMetricField<Counter64> displayFreeSpaceLoads( "record.freeSpace.loads",
+                                                                     &freeSpaceLoads );
+
+    FreeRecordIndex::FreeRecordIndex() :
+        _owner( 0 ),
+        _bytes( 0 ),
+        _coalesced( 0 ),
+        _loaded( false ),
+        _disabledAt( -1 ) {
+        for ( int i = 0; i < Buckets; i++ )
+            _counts[i] = 0;
+    }
+
+    void FreeRecordIndex::_clear() {
+        _locs.clear();
+        _bySize.clear();
+        _bytes = 0;
+        for ( int i = 0; i < Buckets; i++ ) {
+            _counts[i] = 0;
+            _heads[i].Null();
+        }
+        _loaded = false;
+    }
+
+    bool FreeRecordIndex::_matches( const NamespaceDetails* d ) const {
+        if ( _owner != d )
+            return false;
+        for ( int i = 0; i < Buckets; i++ ) {
+            if ( _heads[i] != d->deletedList[i] )
+                return false;
+        }
+        return true;
+    }
+
+    bool FreeRecordIndex::use( NamespaceDetails* d ) {
+        dassert( !d->isCapped() );
+        int maxRecords = freeRecordIndexMaxRecords;
+
+        if ( _loaded ) {
+            if ( maxRecords > 0 && _matches( d ) )
+                return true;
+            _clear();
+        }
+        if ( maxRecords <= 0 )
+            return false;
+
+        if ( _disabledAt >= 0 ) {
+            // too many free records last time; try again once the chains have been emptied
+            // (compact) or the limit has changed
+            bool emptied = true;
+            for ( int i = 0; i < Buckets; i++ )
+                emptied = emptied && d->deletedList[i].isNull();
+            if ( _owner == d && _disabledAt == maxRecords && !emptied )
+                return false;
+            _disabledAt = -1;
+        }
+
+        _owner = d;
+        if ( !_load( d ) ) {
+            _clear();
+            _disabledAt = maxRecords;
+            return false;
+        }
+        return true;
+    }
+
+    bool FreeRecordIndex::_load( NamespaceDetails* d ) {
+        freeSpaceLoads.increment();
+        size_t maxRecords = freeRecordIndexMaxRecords;
+        for ( int b = 0; b < Buckets; b++ ) {
+            DiskLoc prev;
+            for ( DiskLoc cur = d->deletedList[b]; !cur.isNull(); ) {
+                if ( _locs.size() >= maxRecords )
+                    return false;
+                DeletedRecord* r = cur.drec();
+                Entry e;
+                e.len = r->lengthWithHeaders();
+                e.bucket = b;
+                e.prev = prev;
+                if ( !_locs.insert( make_pair( cur, e ) ).second ) {
+                    // a cycle in the chain; leave the chains to the old allocator
+                    warning() << "deleted record " << cur.toString() << " is linked twice, "
+                              << "not indexing free space" << endl;
+                    return false;
+                }
+                _bySize.insert( make_pair( e.len, cur ) );
+                _bytes += e.len;
+                _counts[b]++;
+                prev = cur;
+                cur = r->nextDeleted();
+            }
+            _heads[b] = d->deletedList[b];
+        }
+        _loaded = true;
+        return true;
+    }
+
+    void FreeRecordIndex::_unlink( NamespaceDetails* d, Locs::iterator i ) {
+        DiskLoc loc = i->first;
+        Entry e = i->second;
+        DiskLoc next = loc.drec()->nextDeleted();
+
+        if ( e.prev.isNull() ) {
+            verify( d->deletedList[e.bucket] == loc );
+            getDur().writingDiskLoc( d->deletedList[e.bucket] ) = next;
+            _heads[e.bucket] = next;
+        }
+        else {
+            getDur().writingDiskLoc( e.prev.drec()->nextDeleted() ) = next;
+        }
+        if ( !next.isNull() ) {
+            Locs::iterator n = _locs.find( next );
+            verify( n != _locs.end() );
+            n->second.prev = e.prev;
+        }
+
+        _bySize.erase( make_pair( e.len, loc ) );
+        _bytes -= e.len;
+        _counts[e.bucket]--;
+        _locs.erase( i );
+    }
+
+    void FreeRecordIndex::_push( NamespaceDetails* d, DiskLoc loc, int len ) {
+        int b = NamespaceDetails::bucket( len );
+        DiskLoc oldHead = d->deletedList[b];
+        getDur().writingDiskLoc( d->deletedList[b] ) = loc;
+        getDur().writingDiskLoc( loc.drec()->nextDeleted() ) = oldHead;
+        _heads[b] = loc;
+
+        if ( !oldHead.isNull() ) {
+            Locs::iterator h = _locs.find( oldHead );
+            verify( h != _locs.end() );
+            h->second.prev = loc;
+        }
+
+        Entry e;
+        e.len = len;
+        e.bucket = b;
+        verify( _locs.insert( make_pair( loc, e ) ).second );
+        _bySize.insert( make_pair( len, loc ) );
+        _bytes += len;
+        _counts[b]++;
+    }
+
+    DiskLoc FreeRecordIndex::alloc( NamespaceDetails* d, int len, bool peekOnly ) {
+        dassert( _loaded && _matches( d ) );
+        BySize::iterator i = _bySize.lower_bound( make_pair( len, DiskLoc() ) );
+        if ( i == _bySize.end() )
+            return DiskLoc();
+
+        DiskLoc loc = i->second;
+        if ( !peekOnly ) {
+            _unlink( d, _locs.find( loc ) );
+            DeletedRecord* r = loc.drec();
+            r->nextDeleted().writing().setInvalid(); // defensive.
+            verify( r->extentOfs() < loc.getOfs() );
+            freeSpaceAllocs.increment();
+        }
+        return loc;
+    }
+
+    void FreeRecordIndex::add( NamespaceDetails* d, DiskLoc loc ) {
+        dassert( _loaded && _matches( d ) );
+        DeletedRecord* r = loc.drec();
+        int len = r->lengthWithHeaders();
+        int extentOfs = r->extentOfs();
+        int merged = 0;
+
+        Locs::iterator right = _locs.find( DiskLoc( loc.a(), loc.getOfs() + len ) );
+        if ( right != _locs.end() && right->first.drec()->extentOfs() == extentOfs ) {
+            len += right->second.len;
+            _unlink( d, right );
+            merged++;
+        }
+
+        Locs::iterator left = _locs.lower_bound( loc );
+        if ( left != _locs.begin() ) {
+            --left;
+            if ( left->first.a() == loc.a() &&
+                 left->first.getOfs() + left->second.len == loc.getOfs() &&
+                 left->first.drec()->extentOfs() == extentOfs ) {
+                loc = left->first;
+                len += left->second.len;
+                _unlink( d, left );
+                merged++;
+            }
+        }
+
+        if ( merged ) {
+            getDur().writingInt( loc.drec()->lengthWithHeaders() ) = len;
+            _coalesced += merged;
+            freeSpaceCoalesced.increment( merged );
+        }
+        _push( d, loc, len );
+    }
+
+    bool FreeRecordIndex::removeExtent( NamespaceDetails* d, const DiskLoc& extentLoc, int length,
+                                        size_t maxRecords, vector<DiskLoc>& removed ) {
+        dassert( _loaded && _matches( d ) );
+        DiskLoc end( extentLoc.a(), extentLoc.getOfs() + length );
+        Locs::iterator i = _locs.lower_bound( extentLoc );
+        for ( size_t n = 0; i != _locs.end() && i->first < end; n++ ) {
+            if ( n == maxRecords )
+                return false;
+            Locs::iterator next = i;
+            ++next;
+            removed.push_back( i->first );
+            _unlink( d, i );
+            i = next;
+        }
+        return true;
+    }
+
+    namespace {
+        void appendFreeSpace( BSONObjBuilder& b, long long records, long long bytes,
+                              long long largest, const int* counts ) {
+            b.appendNumber( "records", records );
+            b.appendNumber( "bytes", bytes );
+            b.appendNumber( "largest", largest );
+            // the share of free bytes that a single record of their total size couldn't use
+            b.append( "fragmentation",
+                      bytes ? 1.0 - double( largest ) / double( bytes ) : 0.0 );
+            BSONArrayBuilder perBucket( b.subarrayStart( "perBucket" ) );
+            for ( int i = 0; i < Buckets; i++ )
+                perBucket.append( counts[i] );
+            perBucket.done();
+        }
+    }
+
+    void FreeRecordIndex::appendStats( BSONObjBuilder& b ) const {
+        long long largest = _bySize.empty() ? 0 : _bySize.rbegin()->first;
+        appendFreeSpace( b, _locs.size(), _bytes, largest, _counts );
+        b.appendNumber( "coalesced", _coalesced );
+    }
+
+    void FreeRecordIndex::appendListStats( const NamespaceDetails* d, BSONObjBuilder& b ) {
+        long long records = 0;
+        long long bytes = 0;
+        long long largest = 0;
+        int counts[Buckets];
+        for ( int i = 0; i < Buckets; i++ ) {
+            counts[i] = 0;
+            for ( DiskLoc dl = d->deletedList[i]; !dl.isNull(); ) {
+                killCurrentOp.checkForInterrupt();
+                DeletedRecord* r = dl.drec();
+                records++;
+                counts[i]++;
+                bytes += r->lengthWithHeaders();
+                largest = std::max( largest, (long long) r->lengthWithHeaders() );
+                dl = r->nextDeleted();
+            }
+        }
+        appendFreeSpace( b, records, bytes, largest, counts );
+    }
+
+}
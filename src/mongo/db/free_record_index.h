@@ -0,0 +1,115 @@
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/namespace_details.h"
+
+namespace mongo {
+
+    /**
+     * An in-memory index of the free (deleted) records of a non-capped collection, kept in step
+     * with its on-disk deletedList chains.
+     *
+     * The chains stay the durable record of free space, in their existing format; the index only
+     * mirrors them so that allocation can pick the smallest free record that fits without
+     * walking the chains, and so that a record being freed can be merged with the free records
+     * physically before and after it in its extent.  Every change is made to the chains (through
+     * getDur()) and to the index together.
+     *
+     * The index is built by walking the chains the first time the collection allocates or frees
+     * a record, and remembers the head of every chain.  Code that changes the chains behind its
+     * back (compact, the clean command) changes the heads, so use() rebuilds the index when they
+     * no longer match.  A collection with more free records than the freeRecordIndexMaxRecords
+     * server parameter isn't indexed, and keeps allocating from the chains directly.
+     *
+     * Lives in the collection's NamespaceDetailsTransient; changed under the database write lock.
+     */
+    class FreeRecordIndex : boost::noncopyable {
+    public:
+        FreeRecordIndex();
+
+        /**
+         * Brings the index up to date with d's chains, building it if needed.
+         * @return false if the chains must be used directly instead
+         */
+        bool use( NamespaceDetails* d );
+
+        /**
+         * @return the smallest free record of at least len bytes (the lowest addressed one among
+         * equals) or a null DiskLoc if there is none.  Unless peekOnly, the record is unlinked
+         * from its chain.  Requires use( d ).
+         */
+        DiskLoc alloc( NamespaceDetails* d, int len, bool peekOnly );
+
+        /**
+         * Frees the record at loc, whose lengthWithHeaders and extentOfs are set, merging it with
+         * its free neighbours in the same extent.  Requires use( d ).
+         */
+        void add( NamespaceDetails* d, DiskLoc loc );
+
+        /**
+         * Unlinks up to maxRecords of the free records in the length bytes at extentLoc, adding
+         * their locations to removed.  Requires use( d ).
+         * @return true if none is left
+         */
+        bool removeExtent( NamespaceDetails* d, const DiskLoc& extentLoc, int length,
+                           size_t maxRecords, vector<DiskLoc>& removed );
+
+        /** @return the bytes, headers included, of the free records */
+        long long bytes() const { return _bytes; }
+
+        /** @return true if the index is built and matches d's chains */
+        bool current( const NamespaceDetails* d ) const { return _loaded && _matches( d ); }
+
+        /** appends the free space statistics of the index; reads nothing from disk */
+        void appendStats( BSONObjBuilder& b ) const;
+
+        /** appends the statistics of appendStats() but coalesced, computed by walking d's chains */
+        static void appendListStats( const NamespaceDetails* d, BSONObjBuilder& b );
+
+    private:
+        struct Entry {
+            int len;
+            int bucket;   // the chain holding the record
+            DiskLoc prev; // the record before it in its chain, null if it's the head
+        };
+        typedef map<DiskLoc, Entry> Locs;
+        typedef set< pair<int, DiskLoc> > BySize;
+
+        void _clear();
+        bool _load( NamespaceDetails* d );
+        bool _matches( const NamespaceDetails* d ) const;
+
+        /** removes the record at i from its chain and from the index */
+        void _unlink( NamespaceDetails* d, Locs::iterator i );
+
+        /** pushes the free record at loc onto the head of the chain for len */
+        void _push( NamespaceDetails* d, DiskLoc loc, int len );
+
+        const NamespaceDetails* _owner;
+        DiskLoc _heads[Buckets];
+        Locs _locs;
+        BySize _bySize;
+        long long _bytes;
+        long long _coalesced;
+        int _counts[Buckets];
+        bool _loaded;
+        int _disabledAt; // freeRecordIndexMaxRecords when the index was last found too large
+    };
+
+}
@@ -143,10 +143,16 @@ namespace mongo {
         return l.woCompare(r, ordering, /*considerfieldname*/false);
     }
 
+    template <>
+    int IndexInterfaceImpl< V2 >::keyCompare(const BSONObj& l, const BSONObj& r, const Ordering &ordering) { 
+        return l.woCompare(r, ordering, /*considerfieldname*/false);
+    }
+
     IndexInterfaceImpl<V0> iii_v0;
     IndexInterfaceImpl<V1> iii_v1;
+    IndexInterfaceImpl<V2> iii_v2;
 
-    IndexInterface *IndexDetails::iis[] = { &iii_v0, &iii_v1 };
+    IndexInterface *IndexDetails::iis[] = { &iii_v0, &iii_v1, &iii_v2 };
 
     int removeFromSysIndexes(const char *ns, const char *idxName) {
         string system_indexes = cc().database()->name + ".system.indexes";
@@ -202,7 +208,7 @@ namespace mongo {
             string pns = parentNS(); // note we need a copy, as parentNS() won't work after the drop() below
 
             // clean up parent namespace index cache
-            NamespaceDetailsTransient::get( pns.c_str() ).deletedIndex();
+            NamespaceDetailsTransient::get( pns.c_str() ).deletedIndex( keyPattern() );
 
             string name = indexName();
 
@@ -382,7 +388,7 @@ namespace mongo {
                 // note (one day) we may be able to fresh build less versions than we can use
                 // isASupportedIndexVersionNumber() is what we can use
                 uassert(14803, str::stream() << "this version of mongod cannot build new indexes of version number " << vv, 
-                    vv == 0 || vv == 1);
+                    vv == 0 || vv == 1 || vv == 2);
                 v = (int) vv;
             }
             // idea is to put things we use a lot earlier
@@ -216,6 +216,15 @@ namespace mongo {
         }
     }
 
+    void indexMovedRecord(const char *ns, NamespaceDetails *d, BSONObj obj, DiskLoc loc) {
+        int n = d->getTotalIndexCount();
+        for ( int i = 0; i < n; i++ ) {
+            // the keys are still in the indexes for the old location, so unique indexes must
+            // take them again
+            addKeysToIndex(ns, d, i, obj, loc, /*dupsAllowed*/true);
+        }
+    }
+
     void addKeysToPhaseOne( const char* ns,
                             const IndexDetails& idx,
                             const BSONObj& order,
@@ -240,6 +249,26 @@ namespace mongo {
         }
     }
 
+    void addKeysToPhaseOnes( const char* ns,
+                             const IndexSpec* specs,
+                             SortPhaseOne* phaseOnes,
+                             int nIndexes,
+                             ProgressMeter* progressMeter,
+                             bool mayInterrupt ) {
+        verify( nIndexes > 0 );
+        shared_ptr<Cursor> cursor = theDataFileMgr.findAll( ns );
+        while ( cursor->ok() ) {
+            RARELY killCurrentOp.checkForInterrupt( !mayInterrupt );
+            BSONObj o = cursor->current();
+            DiskLoc loc = cursor->currLoc();
+            for ( int i = 0; i < nIndexes; i++ ) {
+                phaseOnes[i].addKeys( specs[i], o, loc, mayInterrupt );
+            }
+            cursor->advance();
+            progressMeter->hit();
+        }
+    }
+
     template< class V >
     void buildBottomUpPhases2And3( bool dupsAllowed,
                                    IndexDetails& idx,
@@ -391,6 +420,17 @@ namespace mongo {
                                          pm,
                                          t,
                                          mayInterrupt);
+        else if( idx.version() == 2 ) 
+            buildBottomUpPhases2And3<V2>(dupsAllowed,
+                                         idx,
+                                         sorter,
+                                         dropDups,
+                                         dupsToDrop,
+                                         op,
+                                         phase1,
+                                         pm,
+                                         t,
+                                         mayInterrupt);
         else
             verify(false);
 
@@ -513,8 +553,8 @@ namespace mongo {
             uassert( 13130 , "can't start bg index b/c in recursive lock (db.eval?)" , !Lock::nested() );
             bgJobsInProgress.insert(d);
         }
-        void done(const char *ns) {
-            NamespaceDetailsTransient::get(ns).addedIndex(); // clear query optimizer cache
+        void done(const char *ns, const BSONObj& keyPattern) {
+            NamespaceDetailsTransient::get(ns).addedIndex(keyPattern); // clear query optimizer cache
             Lock::assertWriteLocked(ns);
         }
 
@@ -523,6 +563,7 @@ namespace mongo {
 
         unsigned long long go(string ns, NamespaceDetails *d, IndexDetails& idx) {
             unsigned long long n = 0;
+            BSONObj keyPattern = idx.keyPattern().getOwned();
 
             prep(ns.c_str(), d);
             try {
@@ -532,14 +573,14 @@ namespace mongo {
             }
             catch(...) {
                 if( cc().database() && nsdetails(ns) == d ) {
-                    done(ns.c_str());
+                    done(ns.c_str(), keyPattern);
                 }
                 else {
                     log() << "ERROR: db gone during bg index?" << endl;
                 }
                 throw;
             }
-            done(ns.c_str());
+            done(ns.c_str(), keyPattern);
             return n;
         }
     };
@@ -42,6 +42,10 @@ namespace mongo {
     void indexRecordUsingTwoSteps(const char *ns, NamespaceDetails *d, BSONObj obj,
                                          DiskLoc loc, bool shouldBeUnlocked);
 
+    // add index keys for a record copied to loc, before the record it was copied from is
+    // deleted (and unindexed)
+    void indexMovedRecord(const char *ns, NamespaceDetails *d, BSONObj obj, DiskLoc loc);
+
     // Given an object, populate "inserter" with information necessary to update indexes.
     void fetchIndexInserters(BSONObjSet & /*out*/keys,
                              IndexInterface::IndexInserter &inserter,
@@ -63,6 +67,7 @@ namespace mongo {
 
     class BSONObjExternalSorter;
     class CurOp;
+    class IndexSpec;
     class ProgressMeter;
     class ProgressMeterHolder;
     struct SortPhaseOne;
@@ -77,6 +82,17 @@ namespace mongo {
                             ProgressMeter* progressMeter,
                             bool mayInterrupt );
 
+    /**
+     * Extract keys for several indexes from one scan of @param 'ns'.  Every entry of
+     * @param 'phaseOnes' must already have a sorter.
+     */
+    void addKeysToPhaseOnes( const char* ns,
+                             const IndexSpec* specs,
+                             SortPhaseOne* phaseOnes,
+                             int nIndexes,
+                             ProgressMeter* progressMeter,
+                             bool mayInterrupt );
+
     /** Popuate the index @param 'idx' using the keys contained in @param 'sorter'. */
     template< class V >
     void buildBottomUpPhases2And3( bool dupsAllowed,
@@ -23,6 +23,7 @@
 #include "../util/stringutils.h"
 #include "mongo/util/mongoutils/str.h"
 #include "../util/text.h"
+#include "mongo/bson/bson_field_index.h"
 #include "mongo/db/queryutil.h"
 
 namespace mongo {
@@ -169,12 +170,13 @@ namespace mongo {
             BSONElement arrElt;
             unsigned arrIdx = ~0;
             int numNotFound = 0;
+            BSONFieldIndex objFields( obj );
             
             for( unsigned i = 0; i < fieldNames.size(); ++i ) {
                 if ( *fieldNames[ i ] == '\0' )
                     continue;
                 
-                BSONElement e = obj.getFieldDottedOrArray( fieldNames[ i ] );
+                BSONElement e = objFields.getFieldDottedOrArray( fieldNames[ i ] );
                 
                 if ( e.eoo() ) {
                     e = _spec._nullElt; // no matching field
@@ -301,9 +303,9 @@ namespace mongo {
         /**
          * @param arrayNestedArray - set if the returned element is an array nested directly within arr.
          */
-        BSONElement extractNextElement( const BSONObj &obj, const BSONObj &arr, const char *&field, bool &arrayNestedArray ) const {
+        BSONElement extractNextElement( BSONFieldIndex &objFields, const BSONObj &arr, const char *&field, bool &arrayNestedArray ) const {
             string firstField = mongoutils::str::before( field, '.' );
-            bool haveObjField = !obj.getField( firstField ).eoo();
+            bool haveObjField = !objFields.getField( firstField ).eoo();
             BSONElement arrField = arr.getField( firstField );
             bool haveArrField = !arrField.eoo();
 
@@ -317,7 +319,7 @@ namespace mongo {
 
             arrayNestedArray = false;
 			if ( haveObjField ) {
-                return obj.getFieldDottedOrArray( field );
+                return objFields.getFieldDottedOrArray( field );
             }
             else if ( haveArrField ) {
                 if ( arrField.type() == Array ) {
@@ -352,6 +354,7 @@ namespace mongo {
             BSONElement arrElt;
             set<unsigned> arrIdxs;
             bool mayExpandArrayUnembedded = true;
+            BSONFieldIndex objFields( obj );
             for( unsigned i = 0; i < fieldNames.size(); ++i ) {
                 if ( *fieldNames[ i ] == '\0' ) {
                     continue;
@@ -359,7 +362,7 @@ namespace mongo {
                 
                 bool arrayNestedArray;
                 // Extract element matching fieldName[ i ] from object xor array.
-                BSONElement e = extractNextElement( obj, array, fieldNames[ i ], arrayNestedArray );
+                BSONElement e = extractNextElement( objFields, array, fieldNames[ i ], arrayNestedArray );
                 
                 if ( e.eoo() ) {
                     // if field not present, set to null
@@ -423,7 +426,8 @@ namespace mongo {
                 g.getKeys( obj, keys );
                 break;
             }
-            case 1: {
+            case 1:
+            case 2: {
                 KeyGeneratorV1 g( *this );
                 g.getKeys( obj, keys );
                 break;
@@ -26,6 +26,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/static_assert.hpp>
 
+#include "mongo/bson/bson_field_index.h"
 #include "mongo/bson/bson_validate.h"
 #include "mongo/bson/oid.h"
 #include "mongo/bson/util/atomic_int.h"
@@ -712,12 +713,13 @@ namespace mongo {
 
     BSONObj BSONObj::extractFields(const BSONObj& pattern , bool fillWithNull ) const {
         BSONObjBuilder b(32); // scanandorder.h can make a zillion of these, so we start the allocation very small
+        BSONFieldIndex fields( *this );
         BSONObjIterator i(pattern);
         while ( i.moreWithEOO() ) {
             BSONElement e = i.next();
             if ( e.eoo() )
                 break;
-            BSONElement x = getFieldDotted(e.fieldName());
+            BSONElement x = fields.getFieldDotted(e.fieldName());
             if ( ! x.eoo() )
                 b.appendAs( x, e.fieldName() );
             else if ( fillWithNull )
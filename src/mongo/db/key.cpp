@@ -604,6 +604,97 @@ namespace mongo {
         return p - _keyData;
     }
 
+    // normalized prefixes: [canonical type + 1][24 bits of value]
+
+    static unsigned typePrefix(BSONType t, unsigned value = 0) {
+        dassert( value <= 0xffffff );
+        return ((unsigned) (canonicalizeBSONType(t) + 1) << 24) | value;
+    }
+
+    /** the top bits of the order preserving unsigned form of d; NaN, below every number, is 0 */
+    static unsigned doublePrefix(double d) {
+        if( isNaN(d) )
+            return typePrefix(NumberDouble);
+        if( d == 0 )
+            d = 0; // -0 equals 0
+        unsigned long long bits;
+        memcpy(&bits, &d, sizeof(bits));
+        const unsigned long long sign = 1ULL << 63;
+        bits = (bits & sign) ? ~bits : bits | sign;
+        return typePrefix(NumberDouble, (unsigned) (bits >> 40));
+    }
+
+    /** Dates compare signed and Timestamps, of the same canonical type, unsigned.  A Date and a
+        Timestamp compare either way depending on which is on the left, so the prefixes of the
+        two can only agree with both where the Timestamp fits in a signed value. */
+    static unsigned datePrefix(long long millis) {
+        return typePrefix(Date, (unsigned) (((unsigned long long) millis ^ (1ULL << 63)) >> 40));
+    }
+
+    static unsigned timestampPrefix(unsigned long long t) {
+        if( t >> 63 )
+            return typePrefix(Timestamp, 0xffffff);
+        return datePrefix((long long) t);
+    }
+
+    /** the first three bytes of a memcmp ordered value, zero padded */
+    static unsigned bytesPrefix(BSONType t, const unsigned char *p, int len) {
+        unsigned v = 0;
+        for( int i = 0; i < 3; i++ )
+            v = (v << 8) | (i < len ? p[i] : 0);
+        return typePrefix(t, v);
+    }
+
+    unsigned KeyV1::normalizedPrefix(const BSONElement& e) {
+        switch( e.type() ) {
+        case NumberDouble:
+        case NumberInt:
+        case NumberLong:
+            return doublePrefix(e.number());
+        case String:
+        case Symbol:
+            return bytesPrefix(String, (const unsigned char *) e.valuestr(), e.valuestrsize() - 1);
+        case jstOID:
+            return bytesPrefix(jstOID, (const unsigned char *) e.value(), sizeof(OID));
+        case Bool:
+            return typePrefix(Bool, e.boolean() ? 1 : 0);
+        case Date:
+            return datePrefix((long long) e.date().millis);
+        case Timestamp:
+            return timestampPrefix(e.date().millis);
+        default:
+            // ordered by type alone
+            return typePrefix(e.type());
+        }
+    }
+
+    unsigned KeyV1::normalizedPrefix() const {
+        if( !isCompactFormat() )
+            return normalizedPrefix(bson().firstElement());
+
+        const unsigned char *p = _keyData + 1;
+        switch( *_keyData & cCANONTYPEMASK ) {
+            case cminkey: return typePrefix(MinKey);
+            case cnull:   return typePrefix(jstNULL);
+            case cfalse:  return typePrefix(Bool, 0);
+            case ctrue:   return typePrefix(Bool, 1);
+            case cmaxkey: return typePrefix(MaxKey);
+            case cbindata: return typePrefix(BinData);
+            case cstring: return bytesPrefix(String, p + 1, *p);
+            case coid:    return bytesPrefix(jstOID, p, sizeof(OID));
+            case cdouble: return doublePrefix((reinterpret_cast< const PackedDouble* >(p))->d);
+            case cdate:
+                {
+                    long long millis;
+                    memcpy(&millis, p, sizeof(millis));
+                    return datePrefix(millis);
+                }
+            default:
+                verify(false);
+        }
+        return 0;
+    }
+
     bool KeyV1::woEqual(const KeyV1& right) const {
         const unsigned char *l = _keyData;
         const unsigned char *r = right._keyData;
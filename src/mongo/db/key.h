@@ -82,6 +82,18 @@ namespace mongo {
         /** @return size of data() */
         int dataSize() const;
 
+        /** @return the normalized prefix of the key's first field, see normalizedPrefix( e ) */
+        unsigned normalizedPrefix() const;
+
+        /**
+         * @return a fixed width prefix of e's value for ordering keys without comparing them: the
+         * canonical type of e in the top byte, and in the low three bytes the start of an order
+         * preserving encoding of its value.  If e compares below f, normalizedPrefix( e ) <=
+         * normalizedPrefix( f ); so keys whose first fields have different prefixes are ordered
+         * by the prefixes alone.  Used by version 2 btree buckets.
+         */
+        static unsigned normalizedPrefix( const BSONElement& e );
+
         /** only used by geo, which always has bson keys */
         BSONElement _firstElement() const { return bson().firstElement(); }
         bool isCompactFormat() const { return *_keyData != IsBSON; }
@@ -115,6 +115,17 @@ namespace mongo {
 
     typedef vector<pair<BSONObj,BSONObj> >::const_iterator BoundListIter;
 
+    // past this many intervals, fields after the first with several are bounded by min and max
+    static const unsigned MAX_COMPOUND_INTERVALS = 4096;
+
+    static bool allPoints( const BoundList& bounds ) {
+        for ( BoundListIter i = bounds.begin(); i != bounds.end(); ++i ) {
+            if ( ! ( i->first == i->second ) )
+                return false;
+        }
+        return true;
+    }
+
     BoundList KeyPattern::keyBounds( const FieldRangeSet& queryConstraints ) const {
         // To construct our bounds we will generate intervals based on constraints for
         // the first field, then compound intervals based on constraints for the first
@@ -129,8 +140,9 @@ namespace mongo {
         builders.push_back( make_pair( shared_ptr<BSONObjBuilder>( new BSONObjBuilder() ),
                                        shared_ptr<BSONObjBuilder>( new BSONObjBuilder() ) ) );
         BSONObjIterator i( _pattern );
-        // until equalityOnly is false, we are just dealing with equality (no range or $in queries).
-        bool equalityOnly = true;
+        // until pointsOnly is false, every field has been constrained to points (equalities or
+        // $in), and the intervals are the cross product of those points
+        bool pointsOnly = true;
         while( i.more() ) {
             BSONElement e = i.next();
 
@@ -140,7 +152,9 @@ namespace mongo {
             const vector<FieldInterval> &oldIntervals = fr.intervals();
             BoundList fieldBounds = _transformFieldBounds( oldIntervals , e );
 
-            if ( equalityOnly ) {
+            if ( pointsOnly &&
+                 ( builders.size() == 1 ||
+                   builders.size() * fieldBounds.size() <= MAX_COMPOUND_INTERVALS ) ) {
                 if ( fieldBounds.size() == 1 &&
                      ( fieldBounds.front().first == fieldBounds.front().second ) ){
                     // this field is only a single point-interval
@@ -151,10 +165,10 @@ namespace mongo {
                     }
                 }
                 else {
-                    // This clause is the first to generate more than a single point.
-                    // We only execute this clause once. After that, we simplify the bound
+                    // Each interval so far is extended by each of this field's.  Once a field
+                    // has a range, or there are too many intervals, we simplify the bound
                     // extensions to prevent combinatorial explosion.
-                    equalityOnly = false;
+                    pointsOnly = allPoints( fieldBounds );
 
                     BoundBuilders newBuilders;
                     BoundBuilders::const_iterator i;
@@ -179,8 +193,9 @@ namespace mongo {
                 }
             }
             else {
-                // if we've already generated a range or multiple point-intervals
+                // if we've already generated a range or too many point-intervals
                 // just extend what we've generated with min/max bounds for this field
+                pointsOnly = false;
                 BoundBuilders::const_iterator j;
                 for( j = builders.begin(); j != builders.end(); ++j ) {
                     j->first->appendElements( fieldBounds.front().first );
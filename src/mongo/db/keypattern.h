@@ -150,11 +150,18 @@ namespace mongo {
          * If this KeyPattern is { a : "hashed }
          * FieldRangeSet( {a : 5 } --> returns [ ({ a : hash(5) }, {a : hash(5) }) ]
          *
+         * If this KeyPattern is { a : 1 , b : 1 }, points in consecutive fields multiply
+         * FieldRangeSet( { a : {$in : [1,2]} , b : {$in : [3,5]} } )
+         *        --> returns [({a : 1 , b : 3} , {a : 1 , b : 3}]),
+         *                    [({a : 1 , b : 5} , {a : 1 , b : 5}]), ...
+         *
          * The bounds returned by this function may be a superset of those defined
-         * by the constraints.  For instance, if this KeyPattern is {a : 1}
-         * FieldRanget( { a : {$in : [1,2]} , b : {$in : [3,4,5]} } )
-         *        --> returns [({a : 1 , b : 3} , {a : 1 , b : 5}]),
-         *                    [({a : 2 , b : 3} , {a : 2 , b : 5}])
+         * by the constraints.  Fields after the first one with a range, or after the
+         * intervals would number more than a few thousand, are bounded by their min and max.
+         * For instance, if this KeyPattern is { a : 1 , b : 1 , c : 1 }
+         * FieldRangeSet( { a : {$in : [1,2]} , b : {$gt : 0} , c : {$in : [3,4,5]} } )
+         *        --> returns [({a : 1 , b : 0 , c : 3} , {a : 1 , b : MaxKey , c : 5}]),
+         *                    [({a : 2 , b : 0 , c : 3} , {a : 2 , b : MaxKey , c : 5}])
          *
          * The queryConstraints should be defined for all the fields in this keypattern
          * (i.e. the value of frsp->matchPossibleForSingleKeyFRS(_pattern) should be true,
@@ -79,6 +79,8 @@ namespace mongo {
             b.appendBool( "updatedExisting", updatedExisting == True );
         if ( upsertedId.isSet() )
             b.append( "upserted" , upsertedId );
+        if ( ! writeErrors.isEmpty() )
+            b.appendArray( "writeErrors" , writeErrors );
 
         b.appendNumber( "n", nObjects );
 
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include "mongo/bson/bsonobj.h"
 #include "mongo/bson/oid.h"
 
 namespace mongo {
@@ -34,6 +35,7 @@ namespace mongo {
         int nPrev;
         bool valid;
         bool disabled;
+        BSONObj writeErrors; // array of the errors of a bulk write, by document index
         void writeback( OID& oid ) {
             reset( true );
             writebackId = oid;
@@ -44,6 +46,11 @@ namespace mongo {
             code = _code;
             msg = _msg;
         }
+        /** like raiseError, for the last of the errors in a bulk write */
+        void raiseWriteErrors( int _code , const char *_msg , const BSONObj& _writeErrors ) {
+            raiseError( _code , _msg );
+            writeErrors = _writeErrors;
+        }
         void recordUpdate( bool _updateObjects , long long _nObjects , OID _upsertedId ) {
             reset( true );
             nObjects = _nObjects;
@@ -69,6 +76,7 @@ namespace mongo {
             valid = _valid;
             disabled = false;
             upsertedId.clear();
+            writeErrors = BSONObj();
         }
 
         /**
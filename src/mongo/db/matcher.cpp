@@ -29,6 +29,9 @@
 #include "client.h"
 
 #include "pdfile.h"
+#include "mongo/bson/bson_field_index.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/stringutils.h"
 
 namespace {
     inline pcrecpp::RE_Options flags2options(const char* flags) {
@@ -534,16 +537,19 @@ namespace mongo {
     /* _jsobj          - the query pattern
     */
     Matcher::Matcher(const BSONObj &jsobj, bool nested) :
-        _where(0), _jsobj(jsobj), _haveSize(), _all(), _hasArray(0), _haveNeg(), _atomic(false) {
+        _where(0), _jsobj(jsobj), _haveSize(), _all(), _hasArray(0), _haveNeg(), _atomic(false),
+        _compiled(false) {
 
         BSONObjIterator i(_jsobj);
         while ( i.more() ) {
             parseMatchExpressionElement( i.next(), nested );
         }
+        compile();
     }
 
     Matcher::Matcher( const Matcher &docMatcher, const BSONObj &key ) :
-        _where(0), _constrainIndexKey( key ), _haveSize(), _all(), _hasArray(0), _haveNeg(), _atomic(false) {
+        _where(0), _constrainIndexKey( key ), _haveSize(), _all(), _hasArray(0), _haveNeg(), _atomic(false),
+        _compiled(false) {
         // Filter out match components that will provide an incorrect result
         // given a key from a single key index.
         for( vector< ElementMatcher >::const_iterator i = docMatcher._basics.begin(); i != docMatcher._basics.end(); ++i ) {
@@ -596,6 +602,7 @@ namespace mongo {
         for( list< shared_ptr< Matcher > >::const_iterator i = docMatcher._orMatchers.begin(); i != docMatcher._orMatchers.end(); ++i ) {
             _orMatchers.push_back( shared_ptr< Matcher >( new Matcher( **i, key ) ) );
         }
+        compile();
     }
 
     inline bool regexMatches(const RegexMatcher& rm, const BSONElement& e) {
@@ -898,6 +905,234 @@ namespace mongo {
         return -1;
     }
 
+    /**
+     * @return false if the result cmp of matchesDotted() for the criterion bm (-1 mismatch,
+     * 0 missing element, 1 match) fails the query.
+     */
+    static bool basicMatches( const ElementMatcher& bm, int cmp ) {
+        const BSONElement& m = bm._toMatch;
+        if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
+            // If missing, match cmp is opposite of $exists spec.
+            cmp = -retExistsFound(bm);
+        }
+        if ( bm._isNot )
+            cmp = -cmp;
+        if ( cmp < 0 )
+            return false;
+        if ( cmp == 0 ) {
+            /* missing is ok iff we were looking for null */
+            if ( m.type() == jstNULL || m.type() == Undefined ||
+                ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
+                if ( bm.negativeCompareOp() ^ bm._isNot ) {
+                    return false;
+                }
+            }
+            else {
+                if ( !bm._isNot ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // whether matchers compile their criteria for matches()
+    MONGO_EXPORT_SERVER_PARAMETER( compileMatchers, bool, true );
+
+    Matcher::MatchStep Matcher::compileStep( const ElementMatcher& em ) const {
+        MatchStep s;
+        s.owner = this;
+        s.em = &em;
+        s.keyPosition = -1;
+        s.op = em.negativeCompareOp() ? em.inverseOfNegativeCompareOp() : em._compareOp;
+
+        const BSONElement& m = em._toMatch;
+        if ( _constrainIndexKey.isEmpty() ) {
+            splitStringDelim( m.fieldName(), &s.path, '.' );
+        }
+        else {
+            BSONObjIterator i( _constrainIndexKey );
+            for( int j = 0; i.more(); ++j ) {
+                if ( str::equals( i.next().fieldName(), m.fieldName() ) ) {
+                    s.keyPosition = j;
+                    break;
+                }
+            }
+        }
+
+        switch( s.op ) {
+        case BSONObj::Equality:
+        case BSONObj::LT:
+        case BSONObj::LTE:
+        case BSONObj::GT:
+        case BSONObj::GTE:
+            s.kernel = m.isNumber() ? MatchStep::Numeric :
+                       m.type() == mongo::String ? MatchStep::String : MatchStep::Generic;
+            if ( s.op != BSONObj::Equality )
+                s.rank = 3;
+            else
+                s.rank = s.kernel == MatchStep::Generic ? 1 : 0;
+            break;
+        case BSONObj::opIN:
+            s.kernel = MatchStep::Generic;
+            s.rank = 2;
+            break;
+        case BSONObj::opMOD:
+        case BSONObj::opTYPE:
+            s.kernel = MatchStep::Generic;
+            s.rank = 4;
+            break;
+        case BSONObj::opEXISTS:
+            s.kernel = MatchStep::Exists;
+            s.rank = 4;
+            break;
+        default:
+            // $all, $size and $elemMatch look at arrays as a whole
+            s.kernel = MatchStep::Interpreted;
+            s.rank = 6;
+        }
+        if ( s.keyPosition < 0 && s.path.empty() )
+            s.kernel = MatchStep::Interpreted;
+        if ( em.negativeCompareOp() && s.rank < 5 )
+            s.rank = 5;
+        return s;
+    }
+
+    void Matcher::compile() {
+        if ( !compileMatchers )
+            return;
+        for( vector<ElementMatcher>::const_iterator i = _basics.begin(); i != _basics.end(); ++i ) {
+            _program.push_back( compileStep( *i ) );
+        }
+        for( list< shared_ptr< Matcher > >::const_iterator i = _andMatchers.begin();
+            i != _andMatchers.end(); ++i ) {
+            if ( (*i)->flattenable() ) {
+                _program.insert( _program.end(), (*i)->_program.begin(), (*i)->_program.end() );
+            }
+            else {
+                _residualAndMatchers.push_back( *i );
+            }
+        }
+        std::stable_sort( _program.begin(), _program.end() );
+        _compiled = true;
+    }
+
+    bool Matcher::flattenable() const {
+        return _compiled && !_where && _regexs.empty() && _geo.empty() &&
+               _residualAndMatchers.empty() && _orMatchers.empty() && _norMatchers.empty();
+    }
+
+    /** compares numbers as compareElementValues() does */
+    static int compareNumbers( const BSONElement& l, const BSONElement& r ) {
+        if ( l.type() == NumberInt && r.type() == NumberInt ) {
+            int L = l._numberInt();
+            int R = r._numberInt();
+            return L < R ? -1 : L == R ? 0 : 1;
+        }
+        if ( l.type() == NumberLong && r.type() == NumberLong ) {
+            long long L = l._numberLong();
+            long long R = r._numberLong();
+            return L < R ? -1 : L == R ? 0 : 1;
+        }
+        double left = l.number();
+        double right = r.number();
+        if ( left < right )
+            return -1;
+        if ( left == right )
+            return 0;
+        if ( isNaN( left ) )
+            return isNaN( right ) ? 0 : -1;
+        return 1;
+    }
+
+    /** compares strings and symbols as compareElementValues() does */
+    static int compareStrings( const BSONElement& l, const BSONElement& r ) {
+        int lsz = l.valuestrsize();
+        int rsz = r.valuestrsize();
+        int res = memcmp( l.valuestr(), r.valuestr(), std::min( lsz, rsz ) );
+        return res ? res : lsz - rsz;
+    }
+
+    int Matcher::matchesStep( const MatchStep& s, BSONFieldIndex& fields,
+                              MatchDetails* details ) const {
+        int cmp = matchesStepOp( s, fields, details );
+        if ( !s.em->negativeCompareOp() )
+            return cmp;
+        // as inverseMatch()
+        if ( s.em->negativeCompareOpContainsNull() )
+            return ( cmp <= 0 ) ? 1 : 0;
+        return -cmp;
+    }
+
+    int Matcher::matchesStepOp( const MatchStep& s, BSONFieldIndex& fields,
+                                MatchDetails* details ) const {
+        const BSONObj& obj = fields.obj();
+        const ElementMatcher& em = *s.em;
+        const BSONElement& m = em._toMatch;
+        if ( s.kernel == MatchStep::Interpreted )
+            return s.owner->matchesDotted( m.fieldName(), m, obj, s.op, em, false, details );
+
+        BSONElement e;
+        if ( s.keyPosition >= 0 ) {
+            BSONObjIterator i( obj );
+            for( int j = 0; j < s.keyPosition && i.more(); ++j )
+                i.next();
+            if ( i.more() )
+                e = i.next();
+        }
+        else {
+            BSONObj o = obj;
+            for( size_t i = 0; ; ++i ) {
+                e = i == 0 ? fields.getField( s.path[ i ] ) : o.getField( s.path[ i ] );
+                if ( i + 1 == s.path.size() )
+                    break;
+                if ( e.type() == Object )
+                    o = e.embeddedObject();
+                else if ( e.type() == Array )
+                    return s.owner->matchesDotted( m.fieldName(), m, obj, s.op, em, false,
+                                                   details );
+                else
+                    return 0;
+            }
+        }
+        if ( e.type() == Array || ( s.keyPosition >= 0 && e.eoo() ) )
+            return s.owner->matchesDotted( m.fieldName(), m, obj, s.op, em, false, details );
+
+        bool match;
+        switch( s.kernel ) {
+        case MatchStep::Exists:
+            return e.eoo() ? 0 : retExistsFound( em );
+        case MatchStep::Numeric:
+        case MatchStep::String: {
+            int c;
+            if ( s.kernel == MatchStep::Numeric ) {
+                if ( !e.isNumber() )
+                    return e.eoo() ? 0 : -1;
+                c = compareNumbers( e, m );
+            }
+            else {
+                if ( e.type() != mongo::String && e.type() != Symbol )
+                    return e.eoo() ? 0 : -1;
+                c = compareStrings( e, m );
+            }
+            if ( s.op == BSONObj::Equality ) {
+                match = c == 0;
+            }
+            else {
+                if ( c < -1 ) c = -1;
+                if ( c > 1 ) c = 1;
+                match = s.op & ( 1 << ( c + 1 ) );
+            }
+            break;
+        }
+        default:
+            match = s.owner->valuesMatch( e, m, s.op, em );
+        }
+        if ( match )
+            return 1;
+        return e.eoo() ? 0 : -1;
+    }
+
     extern int dump;
 
     /* See if an object matches the query.
@@ -914,33 +1149,24 @@ namespace mongo {
         /* assuming there is usually only one thing to match.  if more this
            could be slow sometimes. */
 
+        // the order the criteria are checked in decides which elemMatchKey is reported
+        bool compiled = _compiled && !( details && details->needRecord() );
+
         // check normal non-regex cases:
-        for ( unsigned i = 0; i < _basics.size(); i++ ) {
-            const ElementMatcher& bm = _basics[i];
-            const BSONElement& m = bm._toMatch;
-            // -1=mismatch. 0=missing element. 1=match
-            int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
-            if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
-                // If missing, match cmp is opposite of $exists spec.
-                cmp = -retExistsFound(bm);
-            }
-            if ( bm._isNot )
-                cmp = -cmp;
-            if ( cmp < 0 )
-                return false;
-            if ( cmp == 0 ) {
-                /* missing is ok iff we were looking for null */
-                if ( m.type() == jstNULL || m.type() == Undefined ||
-                    ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
-                    if ( bm.negativeCompareOp() ^ bm._isNot ) {
-                        return false;
-                    }
-                }
-                else {
-                    if ( !bm._isNot ) {
-                        return false;
-                    }
-                }
+        if ( compiled ) {
+            BSONFieldIndex fields( jsobj );
+            for ( vector<MatchStep>::const_iterator i = _program.begin(); i != _program.end(); ++i ) {
+                if ( !basicMatches( *i->em, matchesStep( *i, fields, details ) ) )
+                    return false;
+            }
+        }
+        else {
+            for ( unsigned i = 0; i < _basics.size(); i++ ) {
+                const ElementMatcher& bm = _basics[i];
+                const BSONElement& m = bm._toMatch;
+                int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
+                if ( !basicMatches( bm, cmp ) )
+                    return false;
             }
         }
 
@@ -997,9 +1223,11 @@ namespace mongo {
                 return false;
         }
 
-        if ( _andMatchers.size() > 0 ) {
-            for( list< shared_ptr< Matcher > >::const_iterator i = _andMatchers.begin();
-                i != _andMatchers.end(); ++i ) {
+        const list< shared_ptr< Matcher > >& andMatchers =
+                compiled ? _residualAndMatchers : _andMatchers;
+        if ( andMatchers.size() > 0 ) {
+            for( list< shared_ptr< Matcher > >::const_iterator i = andMatchers.begin();
+                i != andMatchers.end(); ++i ) {
                 // SERVER-3192 Track field matched using details the same as for
                 // top level fields, at least for now.
                 if ( !(*i)->matches( jsobj, details ) ) {
@@ -1044,33 +1272,23 @@ namespace mongo {
 
 #ifdef MONGO_LATER_SERVER_4644
     void Matcher::visitReferences(FieldSink *pSink) const {
+        // the order the criteria are checked in decides which elemMatchKey is reported
+        bool compiled = _compiled && !( details && details->needRecord() );
+
         // check normal non-regex cases:
-        for ( unsigned i = 0; i < _basics.size(); i++ ) {
-            const ElementMatcher& bm = _basics[i];
-            const BSONElement& m = bm._toMatch;
-            // -1=mismatch. 0=missing element. 1=match
-            int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
-            if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
-                // If missing, match cmp is opposite of $exists spec.
-                cmp = -retExistsFound(bm);
-            }
-            if ( bm._isNot )
-                cmp = -cmp;
-            if ( cmp < 0 )
-                return false;
-            if ( cmp == 0 ) {
-                /* missing is ok iff we were looking for null */
-                if ( m.type() == jstNULL || m.type() == Undefined ||
-                    ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
-                    if ( bm.negativeCompareOp() ^ bm._isNot ) {
-                        return false;
-                    }
-                }
-                else {
-                    if ( !bm._isNot ) {
-                        return false;
-                    }
-                }
+        if ( compiled ) {
+            for ( vector<MatchStep>::const_iterator i = _program.begin(); i != _program.end(); ++i ) {
+                if ( !basicMatches( *i->em, matchesStep( *i, jsobj, details ) ) )
+                    return false;
+            }
+        }
+        else {
+            for ( unsigned i = 0; i < _basics.size(); i++ ) {
+                const ElementMatcher& bm = _basics[i];
+                const BSONElement& m = bm._toMatch;
+                int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
+                if ( !basicMatches( bm, cmp ) )
+                    return false;
             }
         }
 
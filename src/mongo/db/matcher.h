@@ -26,6 +26,7 @@
 
 namespace mongo {
 
+    class BSONFieldIndex;
     class Cursor;
     class CoveredIndexMatcher;
     class ElementMatcher;
@@ -120,6 +121,12 @@ namespace mongo {
         vector< shared_ptr<Matcher> > _allMatchers;
     };
 
+    /**
+     * Whether matchers compile their criteria into a program for matches(), rather than walk
+     * them as parsed.  Settable with setParameter.
+     */
+    extern bool compileMatchers;
+
     class Where; // used for $where javascript eval
     class DiskLoc;
 
@@ -278,6 +285,44 @@ namespace mongo {
 
         int valuesMatch(const BSONElement& l, const BSONElement& r, int op, const ElementMatcher& bm) const;
 
+        /**
+         * A _basics criterion of this matcher or of a flattened $and clause, compiled for
+         * matches(): its field path split up front (or its position in the index key of a key
+         * matcher) and a comparison kernel picked for the operator and the type of the value
+         * matched against.  A criterion on an array, or with an operator matching arrays, is
+         * interpreted by matchesDotted() instead.
+         */
+        struct MatchStep {
+            enum Kernel { Interpreted, Exists, Numeric, String, Generic };
+            const Matcher *owner; // of em
+            const ElementMatcher *em;
+            vector<string> path;
+            int keyPosition;      // of the field in _constrainIndexKey, or -1
+            int op;               // for $ne and $nin, the operator they negate
+            Kernel kernel;
+            int rank;             // equalities first, then $in, ranges, other operators,
+                                  // negations and interpreted criteria
+            bool operator<( const MatchStep &r ) const { return rank < r.rank; }
+        };
+
+        /** Builds _program, if compileMatchers is set. */
+        void compile();
+
+        MatchStep compileStep( const ElementMatcher &em ) const;
+
+        /** @return true if _program covers all of this matcher's criteria. */
+        bool flattenable() const;
+
+        /**
+         * @return as matchesDotted() does for the criterion of s, on the object indexed by
+         * fields, through which the steps of a program share their lookups of its fields
+         */
+        int matchesStep( const MatchStep &s, BSONFieldIndex &fields, MatchDetails *details ) const;
+
+        /** @return as matchesDotted() does for s.op */
+        int matchesStepOp( const MatchStep &s, BSONFieldIndex &fields,
+                           MatchDetails *details ) const;
+
         bool parseClause( const BSONElement &e );
         void parseExtractedClause( const BSONElement &e, list< shared_ptr< Matcher > > &matchers );
 
@@ -309,6 +354,12 @@ namespace mongo {
         list< shared_ptr< Matcher > > _orMatchers;
         list< shared_ptr< Matcher > > _norMatchers;
 
+        // the compiled criteria, ordered to fail fast, and the $and clauses not flattened into
+        // them; used unless an elemMatchKey is requested, as that depends on the order
+        bool _compiled;
+        vector<MatchStep> _program;
+        list< shared_ptr< Matcher > > _residualAndMatchers;
+
         friend class CoveredIndexMatcher;
     };
 
@@ -24,6 +24,7 @@
 #include <boost/filesystem/operations.hpp>
 
 #include "mongo/db/db.h"
+#include "mongo/db/free_record_index.h"
 #include "mongo/db/json.h"
 #include "mongo/db/mongommf.h"
 #include "mongo/db/ops/delete.h"
@@ -227,6 +228,62 @@ namespace mongo {
         }
     }
 
+    void NamespaceDetails::addDeletedRec(const char *ns, DeletedRecord *d, DiskLoc dloc) {
+        if ( !isCapped() ) {
+            endStaleDrain(ns);
+            bool held = holdDrainedRec(d, dloc);
+            FreeRecordIndex& freeRecords = NamespaceDetailsTransient::get(ns).freeRecords();
+            if ( held || freeRecords.use(this) ) {
+                // defensive code: try to make us notice if we reference a deleted record
+                Record *r = (Record *) getDur().writingPtr(d, sizeof(Record));
+                reinterpret_cast<unsigned*>( r->data() )[0] = 0xeeeeeeee;
+                if ( !held )
+                    freeRecords.add(this, dloc);
+                return;
+            }
+        }
+        addDeletedRec(d, dloc);
+    }
+
+    void NamespaceDetails::startDraining(const DiskLoc& extent) {
+        verify( !isSystemFlagSet( Flag_Draining ) );
+        getDur().writingDiskLoc( _drainingExtent ) = extent;
+        getDur().writingDiskLoc( _drainedList ).Null();
+        setSystemFlag( Flag_Draining );
+    }
+
+    bool NamespaceDetails::holdDrainedRec(DeletedRecord *d, DiskLoc dloc) {
+        if ( !isSystemFlagSet( Flag_Draining ) ||
+             _drainingExtent != DiskLoc( dloc.a(), d->extentOfs() ) )
+            return false;
+        getDur().writingDiskLoc( d->nextDeleted() ) = _drainedList;
+        getDur().writingDiskLoc( _drainedList ) = dloc;
+        return true;
+    }
+
+    void NamespaceDetails::stopDraining(const char *ns, bool putBack) {
+        verify( isSystemFlagSet( Flag_Draining ) );
+        clearSystemFlag( Flag_Draining );
+        if ( !putBack )
+            return;
+        for ( DiskLoc cur = _drainedList; !cur.isNull(); ) {
+            DeletedRecord *d = cur.drec();
+            DiskLoc next = d->nextDeleted();
+            addDeletedRec(ns, d, cur);
+            cur = next;
+        }
+    }
+
+    bool isBeingCompacted(const string& ns); // compact.cpp
+
+    void NamespaceDetails::endStaleDrain(const char *ns) {
+        if ( !isSystemFlagSet( Flag_Draining ) || isBeingCompacted( ns ) )
+            return;
+        log() << "putting back the free space held by an interrupted compact online of " << ns
+              << endl;
+        stopDraining(ns, true);
+    }
+
     /* @return the size for an allocated record quantized to 1/16th of the BucketSize
        @param allocSize    requested size to allocate
     */
@@ -254,7 +311,7 @@ namespace mongo {
     DiskLoc NamespaceDetails::allocWillBeAt(const char *ns, int lenToAlloc) {
         if ( ! isCapped() ) {
             lenToAlloc = (lenToAlloc + 3) & 0xfffffffc;
-            return __stdAlloc(lenToAlloc, true);
+            return __stdAlloc(ns, lenToAlloc, true);
         }
         return DiskLoc();
     }
@@ -264,6 +321,7 @@ namespace mongo {
         @return null diskloc if no room - allocate a new extent then
     */
     DiskLoc NamespaceDetails::alloc(const char* ns, int lenToAlloc) {
+        endStaleDrain(ns);
         {
             // align very slightly.
             lenToAlloc = (lenToAlloc + 3) & 0xfffffffc;
@@ -317,7 +375,7 @@ namespace mongo {
         newDelW->lengthWithHeaders() = left;
         newDelW->nextDeleted().Null();
 
-        addDeletedRec(newDel, newDelLoc);
+        addDeletedRec(ns, newDel, newDelLoc);
 
         return loc;
     }
@@ -325,8 +383,16 @@ namespace mongo {
     /* for non-capped collections.
        @param peekOnly just look up where and don't reserve
        returned item is out of the deleted list upon return
+       the best fit comes from the collection's FreeRecordIndex when it has one; otherwise the
+       deleted lists are searched, looking a little past the first fit
     */
-    DiskLoc NamespaceDetails::__stdAlloc(int len, bool peekOnly) {
+    DiskLoc NamespaceDetails::__stdAlloc(const char *ns, int len, bool peekOnly) {
+        {
+            FreeRecordIndex& freeRecords = NamespaceDetailsTransient::get(ns).freeRecords();
+            if ( freeRecords.use(this) )
+                return freeRecords.alloc(this, len, peekOnly);
+        }
+
         DiskLoc *prev;
         DiskLoc *bestprev = 0;
         DiskLoc bestmatch;
@@ -461,7 +527,7 @@ namespace mongo {
     /* alloc with capped table handling. */
     DiskLoc NamespaceDetails::_alloc(const char *ns, int len) {
         if ( ! isCapped() )
-            return __stdAlloc(len, false);
+            return __stdAlloc(ns, len, false);
 
         return cappedAlloc(ns,len);
     }
@@ -553,7 +619,11 @@ namespace mongo {
             *getDur().writing(&multiKeyIndexBits) &= mask;
         }
 
-        NamespaceDetailsTransient::get(thisns).clearQueryCache();
+        // an index still being built has no cached plans
+        if ( i < nIndexes ) {
+            NamespaceDetailsTransient::get(thisns).planCache().indexChanged( idx(i).keyPattern(),
+                                                                              false );
+        }
     }
 
     IndexDetails& NamespaceDetails::getNextIndexDetails(const char* thisns) {
@@ -571,7 +641,7 @@ namespace mongo {
     /* you MUST call when adding an index.  see pdfile.cpp */
     void NamespaceDetails::addIndex(const char* thisns) {
         (*getDur().writing(&nIndexes))++;
-        NamespaceDetailsTransient::get(thisns).addedIndex();
+        NamespaceDetailsTransient::get(thisns).addedIndex( idx(nIndexes-1).keyPattern() );
     }
 
     // must be called when renaming a NS to fix up extra
@@ -677,7 +747,6 @@ namespace mongo {
 
     void NamespaceDetailsTransient::reset() {
         Lock::assertWriteLocked(_ns); 
-        clearQueryCache();
         _keysComputed = false;
         _indexSpecs.clear();
     }
@@ -707,7 +776,7 @@ namespace mongo {
     // that is NOT handled here yet!  TODO
     // repair may not use nsdt though not sure.  anyway, requires work.
     NamespaceDetailsTransient::NamespaceDetailsTransient(Database *db, const string& ns) : 
-        _ns(ns), _keysComputed(false), _qcWriteCount() 
+        _ns(ns), _keysComputed(false), _freeRecords(new FreeRecordIndex()) 
     {
         dassert(db);
     }
@@ -27,8 +27,10 @@
 #include "mongo/db/mongommf.h"
 #include "mongo/db/namespace.h"
 #include "mongo/db/namespacestring.h"
+#include "mongo/db/plan_cache.h"
 #include "mongo/db/queryoptimizercursor.h"
 #include "mongo/db/querypattern.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/platform/unordered_map.h"
 #include "mongo/util/hashtab.h"
 
@@ -101,7 +103,9 @@ namespace mongo {
         int indexBuildsInProgress;            // Number of indexes currently being built
     private:
         int _userFlags;
-        char reserved[72];
+        DiskLoc _drainingExtent;              // with Flag_Draining, the extent compact online empties
+        DiskLoc _drainedList;                 // with Flag_Draining, the deleted records held in it
+        char reserved[56];
         /*-------- end data 496 bytes */
     public:
         explicit NamespaceDetails( const DiskLoc &loc, bool _capped );
@@ -189,7 +193,8 @@ namespace mongo {
                  this isn't thread safe.  TODO
         */
         enum SystemFlags {
-            Flag_HaveIdIndex = 1 << 0 // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
+            Flag_HaveIdIndex = 1 << 0, // set when we have _id index (ONLY if ensureIdIndex was called -- 0 if that has never been called)
+            Flag_Draining = 1 << 1 // set while compact online empties _drainingExtent
         };
 
         enum UserFlags {
@@ -385,6 +390,27 @@ namespace mongo {
 
         /* add a given record to the deleted chains for this NS */
         void addDeletedRec(DeletedRecord *d, DiskLoc dloc);
+        /* as above, merging it with adjacent deleted records when the collection's free records
+           are indexed (see FreeRecordIndex), or holding it if it's in the extent being drained */
+        void addDeletedRec(const char *ns, DeletedRecord *d, DiskLoc dloc);
+
+        /* While compact online empties an extent, the records freed in it are held on a list of
+           their own rather than the deleted lists, so that no new record is placed in the extent.
+           The list is on disk, and may outlive the compaction: after a crash, a restart or a
+           rename mid-drain, the next record allocated or freed in the collection puts the held
+           records back (see endStaleDrain), unless a compaction carries on first.  Requires the
+           write lock. */
+        void startDraining(const DiskLoc& extent);
+        DiskLoc drainingExtent() const {
+            return isSystemFlagSet( Flag_Draining ) ? _drainingExtent : DiskLoc();
+        }
+        /* @return true if the deleted record at dloc was held for the extent being drained */
+        bool holdDrainedRec(DeletedRecord *d, DiskLoc dloc);
+        /* ends draining, putting the held records back on the deleted lists if putBack; leave it
+           false only when the extent holding them is freed */
+        void stopDraining(const char *ns, bool putBack);
+        /* stops a drain no compaction of ns is running for, putting the held records back */
+        void endStaleDrain(const char *ns);
         void dumpDeleted(set<DiskLoc> *extents = 0);
         // Start from firstExtent by default.
         DiskLoc firstRecord( const DiskLoc &startExtent = DiskLoc() ) const;
@@ -407,7 +433,7 @@ namespace mongo {
     private:
         DiskLoc _alloc(const char *ns, int len);
         void maybeComplain( const char *ns, int len ) const;
-        DiskLoc __stdAlloc(int len, bool willBeAt);
+        DiskLoc __stdAlloc(const char *ns, int len, bool willBeAt);
         void compact(); // combine adjacent deleted records
         friend class NamespaceIndex;
         struct ExtraOld {
@@ -426,6 +452,7 @@ namespace mongo {
     }; // NamespaceDetails
 #pragma pack()
 
+    class FreeRecordIndex;
     class ParsedQuery;
     class QueryPlanSummary;
     
@@ -458,8 +485,15 @@ namespace mongo {
         NamespaceDetailsTransient(Database*,const string& ns);
     public:
         ~NamespaceDetailsTransient();
-        void addedIndex() { reset(); }
-        void deletedIndex() { reset(); }
+        /* evict the cached plans an index change affects; see PlanCache */
+        void addedIndex( const BSONObj& keyPattern ) {
+            reset();
+            _planCache.indexAdded( keyPattern );
+        }
+        void deletedIndex( const BSONObj& keyPattern ) {
+            reset();
+            _planCache.indexChanged( keyPattern, true );
+        }
 
         /**
          * reset stats for a given collection
@@ -566,10 +600,31 @@ namespace mongo {
             return spec;
         }
 
+        /* working set ---------------------------------------------------------- */
+    private:
+        AtomicInt64 _faultYields;
+        AtomicInt64 _readAheadBytes;
+    public:
+        /** a cursor on this namespace yielded to fault in a record, reading ahead readAhead bytes */
+        void noteFaultYield( long long readAhead ) {
+            _faultYields.fetchAndAdd( 1 );
+            _readAheadBytes.fetchAndAdd( readAhead );
+        }
+        void appendWorkingSetStats( BSONObjBuilder& b ) const {
+            b.appendNumber( "faultYields", _faultYields.load() );
+            b.appendNumber( "readAheadBytes", _readAheadBytes.load() );
+        }
+
+        /* free space -------------------------------------------------------------- */
+    private:
+        scoped_ptr<FreeRecordIndex> _freeRecords;
+    public:
+        /** in-memory index of the deleted records; assumed to be in write lock to change it */
+        FreeRecordIndex& freeRecords() { return *_freeRecords; }
+
         /* query cache (for query optimizer) ------------------------------------- */
     private:
-        int _qcWriteCount;
-        map<QueryPattern,CachedQueryPlan> _qcCache;
+        PlanCache _planCache;
         static NamespaceDetailsTransient& make_inlock(const string& ns);
         static CMap& get_cmap_inlock(const string& ns);
     public:
@@ -589,23 +644,24 @@ namespace mongo {
             return get_inlock(ns);
         }
 
+        /** the query plan cache; you must be in the qcMutex, or write locked, to use it */
+        PlanCache& planCache() { return _planCache; }
+
+        /* clears the unpinned plans of the query cache */
         void clearQueryCache() {
-            _qcCache.clear();
-            _qcWriteCount = 0;
+            _planCache.clear();
         }
         /* you must notify the cache if you are doing writes, as query plan utility will change */
         void notifyOfWriteOp() {
-            if ( _qcCache.empty() )
-                return;
-            if ( ++_qcWriteCount >= 100 )
-                clearQueryCache();
+            _planCache.noteWrite();
         }
         CachedQueryPlan cachedQueryPlanForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ];
+            return _planCache.get( pattern );
         }
         void registerCachedQueryPlanForPattern( const QueryPattern &pattern,
-                                               const CachedQueryPlan &cachedQueryPlan ) {
-            _qcCache[ pattern ] = cachedQueryPlan;
+                                               const CachedQueryPlan &cachedQueryPlan,
+                                               long long nrecords = 0 ) {
+            _planCache.record( pattern, cachedQueryPlan, nrecords );
         }
 
     }; /* NamespaceDetailsTransient */
@@ -29,6 +29,7 @@
 #include "mongo/db/queryoptimizer.h"
 #include "mongo/db/queryoptimizercursor.h"
 #include "mongo/db/replutil.h"
+#include "mongo/db/reply_size_hint.h"
 #include "mongo/db/scanandorder.h"
 #include "mongo/s/d_logic.h"
 #include "mongo/s/stale_exception.h"  // for SendStaleConfigException
@@ -41,6 +42,12 @@ namespace mongo {
     */
     const int MaxBytesToReturnToClientAtOnce = 4 * 1024 * 1024;
 
+    // the sizes reply buffers are allocated at; a batch is cut soon after
+    // MaxBytesToReturnToClientAtOnce, and the rare larger reply still grows its buffer
+    static ReplySizeHint queryReplySize( 512, 8 * 1024 * 1024 );
+    static ReplySizeHint getMoreReplySize( 512, 8 * 1024 * 1024 );
+    static ReplySizeHint commandReplySize( 256, 16 * 1024 * 1024 );
+
     bool runCommands(const char *ns, BSONObj& jsobj, CurOp& curop, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions) {
         try {
             return _runCommands(ns, jsobj, b, anObjBuilder, fromRepl, queryOptions);
@@ -70,7 +77,7 @@ namespace mongo {
 
     /* empty result for error conditions */
     QueryResult* emptyMoreResult(long long cursorid) {
-        BufBuilder b(32768);
+        BufBuilder b(sizeof(QueryResult));
         b.skip(sizeof(QueryResult));
         QueryResult *qr = (QueryResult *) b.buf();
         qr->cursorId = 0; // 0 indicates no more data to retrieve.
@@ -92,7 +99,7 @@ namespace mongo {
                                 bool* isCursorAuthorized ) {
         exhaust = false;
 
-        int bufSize = 512 + sizeof( QueryResult ) + MaxBytesToReturnToClientAtOnce;
+        int bufSize = getMoreReplySize.size();
 
         BufBuilder b( bufSize );
         b.skip(sizeof(QueryResult));
@@ -220,6 +227,7 @@ namespace mongo {
         qr->cursorId = cursorid;
         qr->startingFrom = start;
         qr->nReturned = n;
+        getMoreReplySize.noteReply( bufSize, b );
         b.decouple();
 
         return qr;
@@ -382,16 +390,20 @@ namespace mongo {
     ReorderBuildStrategy* ReorderBuildStrategy::make( const ParsedQuery& parsedQuery,
                                                       const shared_ptr<Cursor>& cursor,
                                                       BufBuilder& buf,
-                                                      const QueryPlanSummary& queryPlan ) {
-        auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf ) );
+                                                      const QueryPlanSummary& queryPlan,
+                                                      bool mayUseDisk ) {
+        auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf,
+                                                                      mayUseDisk ) );
         ret->init( queryPlan );
         return ret.release();
     }
 
     ReorderBuildStrategy::ReorderBuildStrategy( const ParsedQuery &parsedQuery,
                                                const shared_ptr<Cursor> &cursor,
-                                               BufBuilder &buf ) :
+                                               BufBuilder &buf,
+                                               bool mayUseDisk ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
+    _mayUseDisk( mayUseDisk ),
     _bufferedMatches() {
     }
     
@@ -417,7 +429,7 @@ namespace mongo {
     int ReorderBuildStrategy::rewriteMatches() {
         cc().curop()->debug().scanAndOrder = true;
         int ret = 0;
-        _scanAndOrder->fill( _buf, &_parsedQuery, ret );
+        _scanAndOrder->fill( _buf, ret );
         _bufferedMatches = ret;
         return ret;
     }
@@ -438,7 +450,9 @@ namespace mongo {
         return new ScanAndOrder( _parsedQuery.getSkip(),
                                 _parsedQuery.getNumToReturn(),
                                 _parsedQuery.getOrder(),
-                                *fieldRangeSet );
+                                *fieldRangeSet,
+                                &_parsedQuery,
+                                _mayUseDisk );
     }
 
     HybridBuildStrategy* HybridBuildStrategy::make( const ParsedQuery& parsedQuery,
@@ -458,8 +472,10 @@ namespace mongo {
     }
 
     void HybridBuildStrategy::init() {
+        // an out of order plan exceeding the memory limit gives way to the in order plans
+        // instead of spilling
         _reorderBuild.reset( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf,
-                                                         QueryPlanSummary() ) );
+                                                         QueryPlanSummary(), false ) );
     }
 
     bool HybridBuildStrategy::handleMatch( ResultDetails* resultDetails ) {
@@ -526,7 +542,8 @@ namespace mongo {
     _parsedQuery( parsedQuery ),
     _cursor( cursor ),
     _queryOptimizerCursor( dynamic_pointer_cast<QueryOptimizerCursor>( _cursor ) ),
-    _buf( 32768 ) { // TODO be smarter here
+    _initialBufSize( queryReplySize.size() ),
+    _buf( _initialBufSize ) {
     }
     
     void QueryResponseBuilder::init( const QueryPlanSummary &queryPlan, const BSONObj &oldPlan ) {
@@ -582,11 +599,13 @@ namespace mongo {
             }
             _builder->resetBuf();
             fillQueryResultFromObj( _buf, 0, explainInfo->bson() );
+            queryReplySize.noteReply( _initialBufSize, _buf );
             result.appendData( _buf.buf(), _buf.len() );
             _buf.decouple();
             return 1;
         }
         if ( _buf.len() > 0 ) {
+            queryReplySize.noteReply( _initialBufSize, _buf );
             result.appendData( _buf.buf(), _buf.len() );
             _buf.decouple();
         }
@@ -639,7 +658,7 @@ namespace mongo {
         if ( singlePlan ||
             !queryOptimizerPlans.mayRunInOrderPlan() ) {
             return shared_ptr<ResponseBuildStrategy>
-            ( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf, queryPlan ) );
+            ( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf, queryPlan, true ) );
         }
         return shared_ptr<ResponseBuildStrategy>
         ( HybridBuildStrategy::make( _parsedQuery, _queryOptimizerCursor, _buf ) );
@@ -946,13 +965,15 @@ namespace mongo {
         
         if ( pq.couldBeCommand() ) {
             curop.markCommand();
-            BufBuilder bb;
+            int bufSize = commandReplySize.size();
+            BufBuilder bb( bufSize );
             bb.skip(sizeof(QueryResult));
             BSONObjBuilder cmdResBuf;
             if ( runCommands(ns, jsobj, curop, bb, cmdResBuf, false, queryOptions) ) {
                 curop.debug().iscommand = true;
                 curop.debug().query = jsobj;
 
+                commandReplySize.noteReply( bufSize, bb );
                 auto_ptr< QueryResult > qr;
                 qr.reset( (QueryResult *) bb.buf() );
                 bb.decouple();
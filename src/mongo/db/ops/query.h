@@ -200,10 +200,15 @@ namespace mongo {
     /** Build strategy for a cursor returning out of order results. */
     class ReorderBuildStrategy : public ResponseBuildStrategy {
     public:
+        /**
+         * @param mayUseDisk whether a sort outgrowing its memory limit may spill to disk,
+         * rather than fail, as far as scanAndOrderMaxDiskBytes allows.
+         */
         static ReorderBuildStrategy* make( const ParsedQuery& parsedQuery,
                                            const shared_ptr<Cursor>& cursor,
                                            BufBuilder& buf,
-                                           const QueryPlanSummary& queryPlan );
+                                           const QueryPlanSummary& queryPlan,
+                                           bool mayUseDisk );
         virtual bool handleMatch( ResultDetails* resultDetails );
         /** Handle a match without performing deduping. */
         void _handleMatchNoDedup( ResultDetails* resultDetails );
@@ -212,9 +217,11 @@ namespace mongo {
     private:
         ReorderBuildStrategy( const ParsedQuery& parsedQuery,
                               const shared_ptr<Cursor>& cursor,
-                              BufBuilder& buf );
+                              BufBuilder& buf,
+                              bool mayUseDisk );
         void init( const QueryPlanSummary& queryPlan );
         ScanAndOrder *newScanAndOrder( const QueryPlanSummary &queryPlan ) const;
+        bool _mayUseDisk;
         shared_ptr<ScanAndOrder> _scanAndOrder;
         int _bufferedMatches;
     };
@@ -313,6 +320,7 @@ namespace mongo {
         const ParsedQuery &_parsedQuery;
         shared_ptr<Cursor> _cursor;
         shared_ptr<QueryOptimizerCursor> _queryOptimizerCursor;
+        int _initialBufSize;
         BufBuilder _buf;
         ShardChunkManagerPtr _chunkManager;
         shared_ptr<ExplainRecordingStrategy> _explain;
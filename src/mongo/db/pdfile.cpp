@@ -520,7 +520,7 @@ namespace mongo {
             NamespaceDetails *dw = details->writingWithoutExtra();
             dw->lastExtentSize = e->length;
         }
-        details->addDeletedRec(emptyLoc.drec(), emptyLoc);
+        details->addDeletedRec(ns, emptyLoc.drec(), emptyLoc);
     }
 
     Extent* MongoDataFile::createExtent(const char *ns, int approxSize, bool newCapped, int loops) {
@@ -972,6 +972,67 @@ namespace mongo {
         //printFreeList();
     }
 
+    /** @return the bytes of the extents on the freelist in each datafile of the current database */
+    static vector<long long> freeBytesPerFile(NamespaceDetails *freelist) {
+        vector<long long> bytes( cc().database()->numFiles(), 0 );
+        for ( DiskLoc a = freelist->firstExtent; !a.isNull(); a = a.ext()->xnext )
+            bytes[a.a()] += a.ext()->length;
+        return bytes;
+    }
+
+    int firstFreeDataFile() {
+        Database *db = cc().database();
+        int n = db->numFiles();
+        NamespaceDetails *freelist = nsdetails(db->name + FREELIST_NS);
+        if ( freelist == 0 )
+            return n;
+        vector<long long> freeBytes = freeBytesPerFile(freelist);
+        while ( n > 1 ) {
+            DataFileHeader *h = db->getFile(n - 1)->getHeader();
+            long long used = (long long) h->fileLength - DataFileHeader::HeaderSize - h->unusedLength;
+            if ( freeBytes[n - 1] != used )
+                break;
+            n--;
+        }
+        return n;
+    }
+
+    long long releaseFreeDataFiles() {
+        verify( Lock::isW() );
+        Database *db = cc().database();
+        int first = firstFreeDataFile();
+        if ( first == db->numFiles() )
+            return 0;
+
+        NamespaceDetails *freelist = nsdetails(db->name + FREELIST_NS);
+        for ( DiskLoc a = freelist->firstExtent; !a.isNull(); ) {
+            Extent *e = a.ext();
+            DiskLoc prev = e->xprev;
+            DiskLoc next = e->xnext;
+            if ( a.a() >= first ) {
+                if ( prev.isNull() )
+                    getDur().writingDiskLoc( freelist->firstExtent ) = next;
+                else
+                    getDur().writingDiskLoc( prev.ext()->xnext ) = next;
+                if ( next.isNull() )
+                    getDur().writingDiskLoc( freelist->lastExtent ) = prev;
+                else
+                    getDur().writingDiskLoc( next.ext()->xprev ) = prev;
+            }
+            a = next;
+        }
+        // the freelist's own first extent may have been among them, with deleted records in it
+        for ( int i = 0; i < Buckets; i++ ) {
+            if ( !freelist->deletedList[i].isNull() && freelist->deletedList[i].a() >= first )
+                getDur().writingDiskLoc( freelist->deletedList[i] ).Null();
+        }
+
+        // nothing may point into the files once they are gone, the journal included
+        getDur().syncDataAndTruncateJournal();
+        MongoFile::flushAll(true);
+        return db->removeFilesFrom(first);
+    }
+
     /* drop a collection/namespace */
     void dropNS(const string& nsToDrop) {
         NamespaceDetails* d = nsdetails(nsToDrop);
@@ -1090,7 +1151,7 @@ namespace mongo {
                     *getDur().writing(p) = 0;
                     //DEV memset(todelete->data, 0, todelete->netLength()); // attempt to notice invalid reuse.
                 }
-                d->addDeletedRec((DeletedRecord*)todelete, dl);
+                d->addDeletedRec(ns, (DeletedRecord*)todelete, dl);
             }
         }
     }
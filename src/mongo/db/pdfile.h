@@ -53,6 +53,16 @@ namespace mongo {
     /* low level - only drops this ns */
     void dropNS(const string& dropNs);
 
+    /* @return the first of the datafiles at the end of the current database whose extents are
+       all on the freelist; numFiles() if there is none.  File 0 is always kept. */
+    int firstFreeDataFile();
+
+    /* removes the datafiles from firstFreeDataFile() on, and any preallocated after them, taking
+       their extents off the freelist.  Requires the global write lock: the journal is synced and
+       truncated first so that it holds no writes to the removed files.
+       @return the bytes returned to the filesystem */
+    long long releaseFreeDataFiles();
+
     /* deletes this ns, indexes and cursors */
     void dropCollection( const string &name, string &errmsg, BSONObjBuilder &result );
     bool userCreateNS(const char *ns, BSONObj j, string& err, bool logForReplication, bool *deferIdIndex = 0);
@@ -320,6 +330,20 @@ namespace mongo {
         static void appendStats( BSONObjBuilder& b );
 
         static void appendWorkingSetInfo( BSONObjBuilder& b );
+
+        /**
+         * asks the OS to start reading in, asynchronously, up to bytes of the data file
+         * starting at loc.  for scans which are about to fault on loc and will then read
+         * the records that follow it on disk.  must be db locked.
+         * @return number of bytes advised
+         */
+        static long long willNeed( const DiskLoc& loc, long long bytes );
+
+        /**
+         * estimates how much of the namespace's storage is in physical memory by checking
+         * (mincore) a bounded sample of the pages of its extents
+         */
+        static void appendResidencyEstimate( NamespaceDetails* d, int scale, BSONObjBuilder& b );
     private:
         
         int _netLength() const { return _lengthWithHeaders - HeaderSize; }
@@ -43,6 +43,14 @@ namespace mongo {
          */
         virtual Value getValue() const = 0;
 
+        /*
+          Approximate number of bytes this accumulator is holding on to, so
+          that $group can tell when it needs to spill.
+
+          @returns the approximate memory usage
+         */
+        virtual size_t getMemUsage() const { return sizeof(*this); }
+
     protected:
         Accumulator();
 
@@ -67,6 +75,7 @@ namespace mongo {
         virtual Value evaluate(const Document& pDocument) const;
         virtual Value getValue() const;
         virtual const char *getOpName() const;
+        virtual size_t getMemUsage() const;
 
         /*
           Create an appending accumulator.
@@ -82,6 +91,7 @@ namespace mongo {
         typedef boost::unordered_set<Value, Value::Hash > SetType;
         mutable SetType set;
         mutable SetType::iterator itr; 
+        mutable size_t memUsage; /* of the Values in set */
         intrusive_ptr<ExpressionContext> pCtx;
     };
 
@@ -97,6 +107,7 @@ namespace mongo {
     public:
         // virtuals from Expression
         virtual Value getValue() const;
+        virtual size_t getMemUsage() const;
 
     protected:
         AccumulatorSingleValue();
@@ -205,6 +216,7 @@ namespace mongo {
         virtual Value evaluate(const Document& pDocument) const;
         virtual Value getValue() const;
         virtual const char *getOpName() const;
+        virtual size_t getMemUsage() const;
 
         /*
           Create an appending accumulator.
@@ -219,6 +231,7 @@ namespace mongo {
         AccumulatorPush(const intrusive_ptr<ExpressionContext> &pTheCtx);
 
         mutable vector<Value> vpValue;
+        mutable size_t memUsage; /* of the Values in vpValue */
         intrusive_ptr<ExpressionContext> pCtx;
     };
 
@@ -27,7 +27,8 @@ namespace mongo {
 
         if (!pCtx->getDoingMerge()) {
             if (!prhs.missing()) {
-                set.insert(prhs);
+                if (set.insert(prhs).second)
+                    memUsage += prhs.getApproximateSize();
             }
         } else {
             /*
@@ -39,7 +40,10 @@ namespace mongo {
             verify(prhs.getType() == Array);
             
             const vector<Value>& array = prhs.getArray();
-            set.insert(array.begin(), array.end());
+            for (vector<Value>::const_iterator it = array.begin(); it != array.end(); ++it) {
+                if (set.insert(*it).second)
+                    memUsage += it->getApproximateSize();
+            }
         }
 
         return Value();
@@ -55,10 +59,15 @@ namespace mongo {
         return Value::createArray(valVec);
     }
 
+    size_t AccumulatorAddToSet::getMemUsage() const {
+        return sizeof(*this) + memUsage;
+    }
+
     AccumulatorAddToSet::AccumulatorAddToSet(
         const intrusive_ptr<ExpressionContext> &pTheCtx):
         Accumulator(),
         set(),
+        memUsage(0),
         pCtx(pTheCtx) {
     }
 
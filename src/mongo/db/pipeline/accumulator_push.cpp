@@ -28,6 +28,7 @@ namespace mongo {
         if (!pCtx->getDoingMerge()) {
             if (!prhs.missing()) {
                 vpValue.push_back(prhs);
+                memUsage += prhs.getApproximateSize();
             }
         }
         else {
@@ -41,6 +42,7 @@ namespace mongo {
             
             const vector<Value>& vec = prhs.getArray();
             vpValue.insert(vpValue.end(), vec.begin(), vec.end());
+            memUsage += prhs.getApproximateSize();
         }
 
         return Value();
@@ -50,10 +52,15 @@ namespace mongo {
         return Value::createArray(vpValue);
     }
 
+    size_t AccumulatorPush::getMemUsage() const {
+        return sizeof(*this) + memUsage;
+    }
+
     AccumulatorPush::AccumulatorPush(
         const intrusive_ptr<ExpressionContext> &pTheCtx):
         Accumulator(),
         vpValue(),
+        memUsage(0),
         pCtx(pTheCtx) {
     }
 
@@ -25,6 +25,10 @@ namespace mongo {
         return pValue;
     }
 
+    size_t AccumulatorSingleValue::getMemUsage() const {
+        return sizeof(*this) + pValue.getApproximateSize() - sizeof(pValue);
+    }
+
     AccumulatorSingleValue::AccumulatorSingleValue():
         pValue(Value()) {
     }
@@ -25,6 +25,7 @@
 #include "db/pipeline/document.h"
 #include "db/pipeline/expression.h"
 #include "mongo/db/pipeline/expression_context.h"
+#include "db/pipeline/spill_runs.h"
 #include "db/pipeline/value.h"
 #include "util/string_writer.h"
 #include "mongo/db/projection.h"
@@ -714,6 +715,43 @@ namespace mongo {
         Document makeDocument(const GroupsType::iterator &rIter);
 
         GroupsType::iterator groupsIterator;
+
+        /*
+          Out-of-core grouping, used when the pipeline may spill to disk.
+
+          Once the groups outgrow aggregationSpillBytes, populate() writes
+          them out as a run of partial results sorted by _id -- the same
+          documents a shard sends the router -- and starts over.  When the
+          input is exhausted the runs are merged by _id, and the partials
+          for each _id are combined with merging accumulators, as the router
+          does.  Ties go to the earlier run, which keeps $first and $last
+          correct.
+         */
+        void spill();
+        void startMerge();
+        bool nextMergedGroup(); // false when there are no more groups
+
+        /* the context the accumulators were created with */
+        intrusive_ptr<ExpressionContext> pAccumCtx;
+
+        struct RunHead {
+            RunHead(const Document& d, size_t r): partial(d), id(d["_id"]), run(r) {}
+            Document partial;
+            Value id;
+            size_t run;
+        };
+
+        /* least _id on top, per std::make_heap */
+        static bool runHeadGreater(const RunHead& lhs, const RunHead& rhs);
+        static bool groupIdLess(const GroupsType::iterator& lhs,
+                                const GroupsType::iterator& rhs);
+
+        scoped_ptr<SpillRuns> spillRuns;
+        vector<boost::shared_ptr<SpillRuns::Reader> > runReaders;
+        vector<RunHead> mergeHeap;
+        intrusive_ptr<ExpressionContext> pMergeCtx;
+        Document mergedGroup;
+        bool haveMergedGroup;
     };
 
 
@@ -974,6 +1012,42 @@ namespace mongo {
         deque<KeyAndDoc> documents;
 
         intrusive_ptr<DocumentSourceLimit> limitSrc;
+
+        /*
+          Out-of-core sorting, used when the pipeline may spill to disk.
+
+          Once the buffered documents outgrow aggregationSpillBytes,
+          populateAll() sorts them and writes them out as a run.  When the
+          input is exhausted the runs are merged: mergeHeap holds the next
+          document of each run that still has any, least-best on top per
+          std::make_heap, so the best document is at mergeHeap.front().
+         */
+        void spill();
+        void startMerge();
+        void advanceMerge();
+
+        struct RunHead {
+            RunHead(const KeyAndDoc& kd, size_t r): item(kd), run(r) {}
+            KeyAndDoc item;
+            size_t run;
+        };
+
+        class MergeComparator {
+        public:
+            explicit MergeComparator(const DocumentSourceSort& source): _source(source) {}
+            bool operator()(const RunHead& lhs, const RunHead& rhs) const {
+                int cmp = _source.compare(lhs.item, rhs.item);
+                if (cmp)
+                    return cmp > 0;
+                return lhs.run > rhs.run;
+            }
+        private:
+            const DocumentSourceSort& _source;
+        };
+
+        scoped_ptr<SpillRuns> spillRuns;
+        vector<boost::shared_ptr<SpillRuns::Reader> > runReaders;
+        vector<RunHead> mergeHeap;
     };
     inline void swap(DocumentSourceSort::KeyAndDoc& l, DocumentSourceSort::KeyAndDoc& r) {
         l.key.swap(r.key);
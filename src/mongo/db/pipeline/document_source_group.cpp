@@ -20,6 +20,7 @@
 
 #include "db/jsobj.h"
 #include "db/pipeline/accumulator.h"
+#include "db/pipeline/doc_mem_monitor.h"
 #include "db/pipeline/document.h"
 #include "db/pipeline/expression.h"
 #include "db/pipeline/expression_context.h"
@@ -39,6 +40,9 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (spillRuns)
+            return !haveMergedGroup;
+
         return (groupsIterator == groups.end());
     }
 
@@ -48,6 +52,15 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (spillRuns) {
+            verify(haveMergedGroup);
+            if (!nextMergedGroup()) {
+                dispose();
+                return false;
+            }
+            return true;
+        }
+
         verify(groupsIterator != groups.end());
 
         ++groupsIterator;
@@ -63,6 +76,11 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (spillRuns) {
+            verify(haveMergedGroup);
+            return mergedGroup;
+        }
+
         return makeDocument(groupsIterator);
     }
 
@@ -70,6 +88,11 @@ namespace mongo {
         GroupsType().swap(groups);
         groupsIterator = groups.end();
 
+        mergeHeap.clear();
+        runReaders.clear();
+        spillRuns.reset();
+        haveMergedGroup = false;
+
         pSource->dispose();
     }
 
@@ -121,7 +144,8 @@ namespace mongo {
         groups(),
         vFieldName(),
         vpAccumulatorFactory(),
-        vpExpression() {
+        vpExpression(),
+        haveMergedGroup(false) {
     }
 
     void DocumentSourceGroup::addAccumulator(
@@ -290,6 +314,18 @@ namespace mongo {
         const size_t numAccumulators = vpAccumulatorFactory.size();
         dassert(numAccumulators == vpExpression.size());
 
+        /*
+          Without disk, track and warn about how much physical memory has
+          been used.  With it, spill the groups whenever they outgrow the
+          spill threshold.  Spilled groups are written as partial results,
+          which needs accumulators whose context can be switched to shard
+          mode without affecting the rest of the pipeline.
+        */
+        const bool mayUseDisk = pExpCtx->canSpillToDisk();
+        DocMemMonitor dmm(this);
+        long long memUsage = 0;
+        pAccumCtx = mayUseDisk ? pExpCtx->clone() : pExpCtx.get();
+
         for (bool hasNext = !pSource->eof(); hasNext; hasNext = pSource->advance()) {
             Document input  = pSource->getCurrent();
 
@@ -304,25 +340,52 @@ namespace mongo {
               Look for the _id value in the map; if it's not there, add a
               new entry with a blank accumulator.
             */
+            const size_t oldNumGroups = groups.size();
             vector<intrusive_ptr<Accumulator> >& group = groups[id];
+            long long memAdded = 0;
+            if (groups.size() > oldNumGroups)
+                memAdded += id.getApproximateSize() + sizeof(group);
+
+            if (numAccumulators != 0) { // otherwise we are basically building a set
+                if (group.empty()) {
+                    /* add the accumulators */
+                    group.reserve(numAccumulators);
+                    for (size_t i = 0; i < numAccumulators; i++) {
+                        intrusive_ptr<Accumulator> accum =
+                            (*vpAccumulatorFactory[i])(pAccumCtx);
+                        accum->addOperand(vpExpression[i]);
+                        group.push_back(accum);
+                        memAdded += accum->getMemUsage();
+                    }
+                }
 
-            if (numAccumulators == 0)
-                continue; // we are basically building a set
-
-            if (group.empty()) {
-                /* add the accumulators */
-                group.reserve(numAccumulators);
+                /* tickle all the accumulators for the group we found */
+                dassert(numAccumulators == group.size());
                 for (size_t i = 0; i < numAccumulators; i++) {
-                    intrusive_ptr<Accumulator> accum = (*vpAccumulatorFactory[i])(pExpCtx);
-                    accum->addOperand(vpExpression[i]);
-                    group.push_back(accum);
+                    const long long before = group[i]->getMemUsage();
+                    group[i]->evaluate(input);
+                    memAdded += static_cast<long long>(group[i]->getMemUsage()) - before;
                 }
             }
 
-            /* tickle all the accumulators for the group we found */
-            dassert(numAccumulators == group.size());
-            for (size_t i = 0; i < numAccumulators; i++)
-                group[i]->evaluate(input);
+            if (!mayUseDisk) {
+                if (memAdded > 0)
+                    dmm.addToTotal(memAdded);
+                continue;
+            }
+
+            memUsage += memAdded;
+            if (memUsage > aggregationSpillBytes) {
+                spill();
+                memUsage = 0;
+            }
+        }
+
+        if (spillRuns) {
+            if (!groups.empty())
+                spill();
+            startMerge();
+            haveMergedGroup = nextMergedGroup();
         }
 
         /* start the group iterator */
@@ -330,6 +393,109 @@ namespace mongo {
         populated = true;
     }
 
+    bool DocumentSourceGroup::groupIdLess(const GroupsType::iterator& lhs,
+                                          const GroupsType::iterator& rhs) {
+        return Value::compare(lhs->first, rhs->first) < 0;
+    }
+
+    void DocumentSourceGroup::spill() {
+        vector<GroupsType::iterator> sorted;
+        sorted.reserve(groups.size());
+        for (GroupsType::iterator it = groups.begin(); it != groups.end(); ++it)
+            sorted.push_back(it);
+        std::sort(sorted.begin(), sorted.end(), groupIdLess);
+
+        if (!spillRuns)
+            spillRuns.reset(new SpillRuns(pExpCtx->getTempDir()));
+
+        /* have the accumulators produce what a shard would send the router */
+        pAccumCtx->setInShard(true);
+
+        spillRuns->startRun();
+        for (size_t i = 0; i < sorted.size(); i++) {
+            BSONObjBuilder builder;
+            makeDocument(sorted[i]).toBson(&builder);
+            spillRuns->append(builder.done());
+        }
+        spillRuns->finishRun();
+
+        pAccumCtx->setInShard(pExpCtx->getInShard());
+
+        GroupsType().swap(groups);
+    }
+
+    bool DocumentSourceGroup::runHeadGreater(const RunHead& lhs, const RunHead& rhs) {
+        int cmp = Value::compare(lhs.id, rhs.id);
+        if (cmp)
+            return cmp > 0;
+        return lhs.run > rhs.run;
+    }
+
+    void DocumentSourceGroup::startMerge() {
+        /* merge the partials just as getRouterSource()'s merger would */
+        pMergeCtx = pExpCtx->clone();
+        pMergeCtx->setDoingMerge(true);
+
+        const size_t nRuns = spillRuns->numRuns();
+        runReaders.reserve(nRuns);
+        mergeHeap.reserve(nRuns);
+
+        for (size_t i = 0; i < nRuns; i++) {
+            runReaders.push_back(boost::shared_ptr<SpillRuns::Reader>(spillRuns->openRun(i)));
+            if (runReaders[i]->more())
+                mergeHeap.push_back(RunHead(Document(runReaders[i]->next()), i));
+        }
+
+        std::make_heap(mergeHeap.begin(), mergeHeap.end(), runHeadGreater);
+    }
+
+    bool DocumentSourceGroup::nextMergedGroup() {
+        if (mergeHeap.empty())
+            return false;
+
+        const size_t n = vFieldName.size();
+        vector<intrusive_ptr<Accumulator> > accums;
+        accums.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            intrusive_ptr<Accumulator> accum = (*vpAccumulatorFactory[i])(pMergeCtx);
+            accum->addOperand(ExpressionFieldPath::create(vFieldName[i]));
+            accums.push_back(accum);
+        }
+
+        const Value id = mergeHeap.front().id;
+        while (!mergeHeap.empty() && Value::compare(mergeHeap.front().id, id) == 0) {
+            std::pop_heap(mergeHeap.begin(), mergeHeap.end(), runHeadGreater);
+            RunHead& head = mergeHeap.back();
+
+            for (size_t i = 0; i < n; ++i)
+                accums[i]->evaluate(head.partial);
+
+            SpillRuns::Reader& reader = *runReaders[head.run];
+            if (reader.more()) {
+                head = RunHead(Document(reader.next()), head.run);
+                std::push_heap(mergeHeap.begin(), mergeHeap.end(), runHeadGreater);
+            }
+            else {
+                mergeHeap.pop_back();
+            }
+        }
+
+        MutableDocument out (1 + n);
+        out.addField("_id", id);
+        for (size_t i = 0; i < n; ++i) {
+            Value pValue(accums[i]->getValue());
+            if (pValue.missing()) {
+                // we return null in this case so return objects are predictable
+                out.addField(vFieldName[i], Value(BSONNULL));
+            }
+            else {
+                out.addField(vFieldName[i], pValue);
+            }
+        }
+        mergedGroup = out.freeze();
+        return true;
+    }
+
     Document DocumentSourceGroup::makeDocument(
         const GroupsType::iterator &rIter) {
         vector<intrusive_ptr<Accumulator> > *pGroup = &rIter->second;
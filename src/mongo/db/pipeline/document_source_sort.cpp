@@ -39,6 +39,9 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (spillRuns)
+            return mergeHeap.empty();
+
         return documents.empty();
     }
 
@@ -48,6 +51,12 @@ namespace mongo {
         if (!populated)
             populate();
 
+        if (spillRuns) {
+            if (!mergeHeap.empty())
+                advanceMerge();
+            return !mergeHeap.empty();
+        }
+
         if (!documents.empty())
             documents.pop_front(); // this way we release memory as we go
 
@@ -55,6 +64,11 @@ namespace mongo {
     }
 
     Document DocumentSourceSort::getCurrent() {
+        if (spillRuns) {
+            verify(!mergeHeap.empty());
+            return mergeHeap.front().item.doc;
+        }
+
         verify(!documents.empty());
         return documents.front().doc;
     }
@@ -90,6 +104,9 @@ namespace mongo {
 
     void DocumentSourceSort::dispose() {
         documents.clear();
+        mergeHeap.clear();
+        runReaders.clear();
+        spillRuns.reset();
         pSource->dispose();
     }
 
@@ -207,13 +224,37 @@ namespace mongo {
     }
 
     void DocumentSourceSort::populateAll() {
-        /* track and warn about how much physical memory has been used */
+        /*
+          Without disk, track and warn about how much physical memory has
+          been used.  With it, spill a sorted run whenever the buffered
+          documents outgrow the spill threshold.
+        */
+        const bool mayUseDisk = pExpCtx->canSpillToDisk();
         DocMemMonitor dmm(this);
+        size_t memUsage = 0;
 
         /* pull everything from the underlying source */
         for (bool hasNext = !pSource->eof(); hasNext; hasNext = pSource->advance()) {
             documents.push_back(KeyAndDoc(pSource->getCurrent(), vSortKey));
-            dmm.addToTotal(documents.back().doc.getApproximateSize());
+            const size_t size = documents.back().doc.getApproximateSize();
+
+            if (!mayUseDisk) {
+                dmm.addToTotal(size);
+                continue;
+            }
+
+            memUsage += size;
+            if (memUsage > static_cast<size_t>(aggregationSpillBytes)) {
+                spill();
+                memUsage = 0;
+            }
+        }
+
+        if (spillRuns) {
+            if (!documents.empty())
+                spill();
+            startMerge();
+            return;
         }
 
         /* sort the list */
@@ -221,6 +262,59 @@ namespace mongo {
         sort(documents.begin(), documents.end(), comparator);
     }
 
+    void DocumentSourceSort::spill() {
+        Comparator comparator(*this);
+        sort(documents.begin(), documents.end(), comparator);
+
+        if (!spillRuns)
+            spillRuns.reset(new SpillRuns(pExpCtx->getTempDir()));
+
+        spillRuns->startRun();
+        for (deque<KeyAndDoc>::const_iterator it = documents.begin(); it != documents.end(); ++it) {
+            BSONObjBuilder builder;
+            it->doc.toBson(&builder);
+            spillRuns->append(builder.done());
+        }
+        spillRuns->finishRun();
+
+        documents.clear();
+    }
+
+    void DocumentSourceSort::startMerge() {
+        const size_t nRuns = spillRuns->numRuns();
+        runReaders.reserve(nRuns);
+        mergeHeap.reserve(nRuns);
+
+        for (size_t i = 0; i < nRuns; i++) {
+            runReaders.push_back(boost::shared_ptr<SpillRuns::Reader>(spillRuns->openRun(i)));
+            if (runReaders[i]->more()) {
+                mergeHeap.push_back(RunHead(KeyAndDoc(Document(runReaders[i]->next()), vSortKey),
+                                            i));
+            }
+        }
+
+        MergeComparator comp(*this);
+        std::make_heap(mergeHeap.begin(), mergeHeap.end(), comp);
+    }
+
+    void DocumentSourceSort::advanceMerge() {
+        MergeComparator comp(*this);
+
+        // take the current best off the heap, and replace it with the next
+        // document from the same run, if there is one
+        std::pop_heap(mergeHeap.begin(), mergeHeap.end(), comp);
+
+        SpillRuns::Reader& reader = *runReaders[mergeHeap.back().run];
+        if (reader.more()) {
+            KeyAndDoc next(Document(reader.next()), vSortKey);
+            swap(mergeHeap.back().item, next);
+            std::push_heap(mergeHeap.begin(), mergeHeap.end(), comp);
+        }
+        else {
+            mergeHeap.pop_back();
+        }
+    }
+
     void DocumentSourceSort::populateOne() {
         if (pSource->eof())
             return;
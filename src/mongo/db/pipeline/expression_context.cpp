@@ -28,6 +28,7 @@ namespace mongo {
         doingMerge(false),
         inShard(false),
         inRouter(false),
+        allowDiskUse(false),
         intCheckCounter(1),
         pStatus(pS) {
     }
@@ -47,6 +48,8 @@ namespace mongo {
         newContext->setDoingMerge(getDoingMerge());
         newContext->setInShard(getInShard());
         newContext->setInRouter(getInRouter());
+        newContext->setAllowDiskUse(getAllowDiskUse());
+        newContext->setTempDir(getTempDir());
         return newContext;
     }
 
@@ -32,10 +32,25 @@ namespace mongo {
         void setDoingMerge(bool b);
         void setInShard(bool b);
         void setInRouter(bool b);
+        void setAllowDiskUse(bool b);
 
         bool getDoingMerge() const;
         bool getInShard() const;
         bool getInRouter() const;
+        bool getAllowDiskUse() const;
+
+        /**
+           Directory under which blocking stages may spill to disk.  Only
+           mongod sets this; it is empty on mongos.
+         */
+        void setTempDir(const string& dir);
+        const string& getTempDir() const;
+
+        /**
+           @returns true if blocking stages ($sort, $group) may write sorted
+             runs to disk instead of failing when they run out of memory
+         */
+        bool canSpillToDisk() const;
 
         /**
            Used by a pipeline to check for interrupts so that killOp() works.
@@ -54,6 +69,8 @@ namespace mongo {
         bool doingMerge;
         bool inShard;
         bool inRouter;
+        bool allowDiskUse;
+        string tempDir;
         unsigned intCheckCounter; // interrupt check counter
         InterruptStatus *const pStatus;
     };
@@ -88,4 +105,24 @@ namespace mongo {
         return inRouter;
     }
 
+    inline void ExpressionContext::setAllowDiskUse(bool b) {
+        allowDiskUse = b;
+    }
+
+    inline bool ExpressionContext::getAllowDiskUse() const {
+        return allowDiskUse;
+    }
+
+    inline void ExpressionContext::setTempDir(const string& dir) {
+        tempDir = dir;
+    }
+
+    inline const string& ExpressionContext::getTempDir() const {
+        return tempDir;
+    }
+
+    inline bool ExpressionContext::canSpillToDisk() const {
+        return allowDiskUse && !tempDir.empty();
+    }
+
 };
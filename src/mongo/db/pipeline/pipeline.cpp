@@ -31,6 +31,7 @@ namespace mongo {
     const char Pipeline::pipelineName[] = "pipeline";
     const char Pipeline::explainName[] = "explain";
     const char Pipeline::fromRouterName[] = "fromRouter";
+    const char Pipeline::allowDiskUseName[] = "allowDiskUse";
     const char Pipeline::splitMongodPipelineName[] = "splitMongodPipeline";
     const char Pipeline::serverPipelineName[] = "serverPipeline";
     const char Pipeline::mongosPipelineName[] = "mongosPipeline";
@@ -128,6 +129,14 @@ namespace mongo {
                 continue;
             }
 
+            /* let blocking stages spill to disk */
+            if (!strcmp(pFieldName, allowDiskUseName)) {
+                uassert(16736, str::stream() << allowDiskUseName << " must be a boolean",
+                        cmdElement.type() == Bool);
+                pCtx->setAllowDiskUse(cmdElement.Bool());
+                continue;
+            }
+
             /* check for debug options */
             if (!strcmp(pFieldName, splitMongodPipelineName)) {
                 pPipeline->splitMongodPipeline = true;
@@ -377,6 +386,10 @@ namespace mongo {
         if ((btemp = pCtx->getInRouter())) {
             pBuilder->append(fromRouterName, btemp);
         }
+
+        if ((btemp = pCtx->getAllowDiskUse())) {
+            pBuilder->append(allowDiskUseName, btemp);
+        }
     }
 
     bool Pipeline::run(BSONObjBuilder &result, string &errmsg) {
@@ -144,6 +144,7 @@ namespace mongo {
         static const char pipelineName[];
         static const char explainName[];
         static const char fromRouterName[];
+        static const char allowDiskUseName[];
         static const char splitMongodPipelineName[];
         static const char serverPipelineName[];
         static const char mongosPipelineName[];
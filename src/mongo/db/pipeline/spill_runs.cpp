@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2011 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "db/pipeline/spill_runs.h"
+
+#include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include "db/server_parameters.h"
+#include "util/mongoutils/str.h"
+
+namespace mongo {
+    using namespace mongoutils;
+
+    MONGO_EXPORT_SERVER_PARAMETER(aggregationSpillBytes, int, 100 * 1024 * 1024);
+
+    static SimpleMutex uniqueNumberMutex("aggSpillUniqueNumber");
+    static unsigned long long uniqueNumber = 0;
+
+    SpillRuns::SpillRuns(const string &tempDir):
+        writing(false),
+        bytesWritten(0) {
+        unsigned long long thisUniqueNumber;
+        {
+            SimpleMutex::scoped_lock lk(uniqueNumberMutex);
+            thisUniqueNumber = uniqueNumber++;
+        }
+
+        root = (boost::filesystem::path(tempDir) /
+                string(str::stream() << "aggspill." << time(0) << "." << thisUniqueNumber)).string();
+
+        LOG(1) << "aggregation spill root: " << root << endl;
+        boost::filesystem::create_directories(root);
+    }
+
+    SpillRuns::~SpillRuns() {
+        if (writing)
+            out.close();
+
+        try {
+            boost::filesystem::remove_all(root);
+        }
+        catch (const boost::filesystem::filesystem_error &e) {
+            warning() << "couldn't remove aggregation spill files in " << root << ": "
+                      << e.what() << endl;
+        }
+    }
+
+    void SpillRuns::startRun() {
+        verify(!writing);
+
+        string file = str::stream() << root << "/run." << runs.size();
+        out.open(file.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+        assertStreamGood(16737, "couldn't open aggregation spill file: " + file, out);
+
+        runs.push_back(file);
+        writing = true;
+    }
+
+    void SpillRuns::append(const BSONObj &obj) {
+        verify(writing);
+        out.write(obj.objdata(), obj.objsize());
+        bytesWritten += obj.objsize();
+    }
+
+    void SpillRuns::finishRun() {
+        verify(writing);
+        out.close();
+        uassert(16738, "writing aggregation spill file failed: " + runs.back(), !out.fail());
+        writing = false;
+
+        LOG(1) << "aggregation spilled run " << runs.back() << endl;
+    }
+
+    SpillRuns::Reader *SpillRuns::openRun(size_t i) const {
+        verify(i < runs.size());
+        verify(!writing || i + 1 < runs.size());
+        return new Reader(runs[i]);
+    }
+
+    SpillRuns::Reader::Reader(const string &file):
+        in(file.c_str(), ios_base::in | ios_base::binary),
+        length(boost::filesystem::file_size(file)),
+        readSoFar(0) {
+        assertStreamGood(16739, "couldn't open aggregation spill file: " + file, in);
+    }
+
+    BSONObj SpillRuns::Reader::next() {
+        int size;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        massert(16740, "reading aggregation spill file failed",
+                in.good() && size >= BSONObj().objsize());
+
+        // same layout as BSONObjExternalSorter::FileIterator: a Holder's
+        // refcount followed by the object
+        char *buf = reinterpret_cast<char*>(malloc(sizeof(unsigned) + size));
+        verify(buf);
+        memset(buf, 0, sizeof(unsigned));
+        memcpy(buf + sizeof(unsigned), &size, sizeof(int));
+        in.read(buf + sizeof(unsigned) + sizeof(int), size - sizeof(int));
+        if (!in.good()) {
+            free(buf);
+            msgasserted(16741, "reading aggregation spill file failed");
+        }
+        readSoFar += size;
+
+        return BSONObj(reinterpret_cast<BSONObj::Holder*>(buf));
+    }
+
+}
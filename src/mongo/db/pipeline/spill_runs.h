@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2011 10gen Inc.
+ *
+ * This program is free software: you can redistribute it and/or  modify
+ * it under the terms of the GNU Affero General Public License, version 3,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <fstream>
+
+#include "db/jsobj.h"
+
+namespace mongo {
+
+    /*
+      How much a blocking stage may hold in memory before it spills, when the
+      pipeline allows disk use.  Settable with setParameter.
+     */
+    extern int aggregationSpillBytes;
+
+    /*
+      Sorted runs of BSON objects written to temporary files, for the
+      blocking aggregation stages that are allowed to use disk, and for
+      in memory query sorts (ScanAndOrder) that outgrow their memory limit.
+
+      This follows BSONObjExternalSorter's runs (objects written back to
+      back under a private temp directory), but that sorter lives in mongod
+      only and sorts index keys by DiskLoc.  This is shared with mongos and
+      leaves ordering to the caller, which writes each run already sorted
+      and merges the runs back with Reader.
+
+      All files go in a private directory under the given temp dir, which is
+      removed when the SpillRuns is destroyed.
+     */
+    class SpillRuns :
+        boost::noncopyable {
+    public:
+        explicit SpillRuns(const string &tempDir);
+        ~SpillRuns();
+
+        /* begin a new run; objects are then added to it in order */
+        void startRun();
+        void append(const BSONObj &obj);
+        void finishRun();
+
+        size_t numRuns() const { return runs.size(); }
+        long long getBytesWritten() const { return bytesWritten; }
+
+        /*
+          Reads back one finished run, in the order it was written.
+         */
+        class Reader :
+            boost::noncopyable {
+        public:
+            explicit Reader(const string &file);
+
+            bool more() const { return readSoFar < length; }
+            BSONObj next();
+
+        private:
+            ifstream in;
+            unsigned long long length;
+            unsigned long long readSoFar;
+        };
+
+        /* the caller owns the returned reader */
+        Reader *openRun(size_t i) const;
+
+    private:
+        string root;
+        vector<string> runs;
+        ofstream out;
+        bool writing;
+        long long bytesWritten;
+    };
+
+}
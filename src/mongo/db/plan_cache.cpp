@@ -0,0 +1,242 @@
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/plan_cache.h"
+
+#include "mongo/base/counter.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/server_parameters.h"
+
+namespace mongo {
+
+    // a recorded plan goes stale after the larger of these many writes to its collection
+    MONGO_EXPORT_SERVER_PARAMETER( planCacheReplanMinWrites, int, 100 );
+    MONGO_EXPORT_SERVER_PARAMETER( planCacheReplanWritePercent, int, 10 );
+    // the unpinned entries a collection's plan cache keeps; 0 for no limit
+    MONGO_EXPORT_SERVER_PARAMETER( planCacheMaxEntries, int, 5000 );
+
+    static Counter64 planCacheHits;
+    static ServerStatusMetricField<Counter64> displayPlanCacheHits( "queryPlanCache.hits",
+                                                                    &planCacheHits );
+    static Counter64 planCacheMisses;
+    static ServerStatusMetricField<Counter64> displayPlanCacheMisses( "queryPlanCache.misses",
+                                                                      &planCacheMisses );
+    static Counter64 planCacheStale;
+    static ServerStatusMetricField<Counter64> displayPlanCacheStale( "queryPlanCache.stale",
+                                                                     &planCacheStale );
+    static Counter64 planCacheEvictions;
+    static ServerStatusMetricField<Counter64> displayPlanCacheEvictions(
+            "queryPlanCache.evictions", &planCacheEvictions );
+    static Counter64 planCacheReplans;
+    static ServerStatusMetricField<Counter64> displayPlanCacheReplans( "queryPlanCache.replans",
+                                                                       &planCacheReplans );
+
+    PlanCache::PlanCache() :
+        _writes( 0 ) {
+    }
+
+    bool PlanCache::_stale( const Entry& e ) const {
+        if ( e.pinned )
+            return false;
+        long long threshold = std::max( (long long) planCacheReplanMinWrites,
+                                        e.nrecords * planCacheReplanWritePercent / 100 );
+        return _writes - e.writesWhenRecorded >= threshold;
+    }
+
+    PlanCache::Entry* PlanCache::_usable( const QueryPattern& pattern, bool* stale ) {
+        Entries::iterator i = _entries.find( pattern );
+        if ( i == _entries.end() || i->second.plan.indexKey().isEmpty() )
+            return 0;
+        if ( _stale( i->second ) ) {
+            *stale = true;
+            return 0;
+        }
+        return &i->second;
+    }
+
+    CachedQueryPlan PlanCache::_lookedUp( Entry* e, bool stale ) {
+        if ( !e ) {
+            if ( stale )
+                planCacheStale.increment();
+            planCacheMisses.increment();
+            return CachedQueryPlan();
+        }
+        planCacheHits.increment();
+        e->uses++;
+        if ( !e->pinned )
+            _lru.splice( _lru.end(), _lru, e->lru );
+        return e->plan;
+    }
+
+    CachedQueryPlan PlanCache::get( const QueryPattern& pattern ) {
+        bool stale = false;
+        return _lookedUp( _usable( pattern, &stale ), stale );
+    }
+
+    CachedQueryPlan PlanCache::get( const QueryPattern& first, const QueryPattern& second ) {
+        bool stale = false;
+        Entry* e = _usable( first, &stale );
+        if ( !e )
+            e = _usable( second, &stale );
+        return _lookedUp( e, stale );
+    }
+
+    void PlanCache::record( const QueryPattern& pattern, const CachedQueryPlan& plan,
+                            long long nrecords ) {
+        if ( plan.indexKey().isEmpty() ) {
+            Entries::iterator i = _entries.find( pattern );
+            if ( i != _entries.end() && !i->second.pinned )
+                _erase( i );
+            return;
+        }
+        pair<Entries::iterator, bool> i = _entries.insert( make_pair( pattern, Entry() ) );
+        Entry& e = i.first->second;
+        if ( e.pinned )
+            return;
+        if ( i.second )
+            e.lru = _lru.insert( _lru.end(), &i.first->first );
+        else
+            _lru.splice( _lru.end(), _lru, e.lru );
+        e.plan = CachedQueryPlan( plan.indexKey().getOwned(), plan.nScanned(),
+                                  plan.planCharacter() );
+        e.writesWhenRecorded = _writes;
+        e.nrecords = nrecords;
+        e.recorded++;
+        _trim();
+    }
+
+    void PlanCache::_trim() {
+        int max = planCacheMaxEntries;
+        while ( max > 0 && _lru.size() > static_cast<size_t>( max ) )
+            _erase( _entries.find( *_lru.front() ) );
+    }
+
+    void PlanCache::_erase( Entries::iterator i ) {
+        if ( !i->second.pinned )
+            _lru.erase( i->second.lru );
+        _entries.erase( i );
+        planCacheEvictions.increment();
+    }
+
+    void PlanCache::noteRun( const QueryPattern& pattern, const BSONObj& indexKey,
+                             long long nscanned, long long n, long long micros ) {
+        Entries::iterator i = _entries.find( pattern );
+        if ( i == _entries.end() )
+            return;
+        PlanStatsMap& plans = i->second.plans;
+        PlanStatsMap::iterator j = plans.find( indexKey );
+        if ( j == plans.end() )
+            j = plans.insert( make_pair( indexKey.getOwned(), PlanStats() ) ).first;
+        PlanStats& s = j->second;
+        s.runs++;
+        s.nscanned += nscanned;
+        s.n += n;
+        s.micros += micros;
+    }
+
+    void PlanCache::pin( const QueryPattern& pattern, const BSONObj& indexKey ) {
+        pair<Entries::iterator, bool> i = _entries.insert( make_pair( pattern, Entry() ) );
+        Entry& e = i.first->second;
+        if ( !i.second && !e.pinned )
+            _lru.erase( e.lru );
+        e.plan = CachedQueryPlan( indexKey.getOwned(), 0, CandidatePlanCharacter(), true );
+        e.pinned = true;
+        e.writesWhenRecorded = _writes;
+    }
+
+    void PlanCache::remove( const QueryPattern& pattern ) {
+        Entries::iterator i = _entries.find( pattern );
+        if ( i != _entries.end() )
+            _erase( i );
+    }
+
+    void PlanCache::clear( bool pinsToo ) {
+        for( Entries::iterator i = _entries.begin(); i != _entries.end(); ) {
+            if ( pinsToo || !i->second.pinned ) {
+                _erase( i++ );
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+    void PlanCache::indexAdded( const BSONObj& keyPattern ) {
+        for( Entries::iterator i = _entries.begin(); i != _entries.end(); ) {
+            bool affected = false;
+            if ( !i->second.pinned ) {
+                BSONObjIterator k( keyPattern );
+                while( k.more() && !affected )
+                    affected = i->first.referencesField( k.next().fieldName() );
+            }
+            if ( affected ) {
+                _erase( i++ );
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+    void PlanCache::indexChanged( const BSONObj& keyPattern, bool dropped ) {
+        for( Entries::iterator i = _entries.begin(); i != _entries.end(); ) {
+            Entry& e = i->second;
+            if ( dropped )
+                e.plans.erase( keyPattern );
+            if ( e.plan.indexKey().woCompare( keyPattern ) == 0 && ( dropped || !e.pinned ) ) {
+                _erase( i++ );
+            }
+            else {
+                ++i;
+            }
+        }
+    }
+
+    void PlanCache::append( BSONArrayBuilder& b ) const {
+        for( Entries::const_iterator i = _entries.begin(); i != _entries.end(); ++i ) {
+            const Entry& e = i->second;
+            BSONObjBuilder entry( b.subobjStart() );
+            entry.appendElements( i->first.toBSON() );
+            entry.append( "index", e.plan.indexKey() );
+            entry.append( "pinned", e.pinned );
+            entry.append( "stale", _stale( e ) );
+            entry.appendNumber( "nscanned", e.plan.nScanned() );
+            entry.appendNumber( "writesSinceRecorded", _writes - e.writesWhenRecorded );
+            entry.appendNumber( "uses", e.uses );
+            entry.appendNumber( "recorded", e.recorded );
+            BSONArrayBuilder plans( entry.subarrayStart( "plans" ) );
+            for( PlanStatsMap::const_iterator j = e.plans.begin(); j != e.plans.end(); ++j ) {
+                const PlanStats& s = j->second;
+                BSONObjBuilder plan( plans.subobjStart() );
+                plan.append( "index", j->first );
+                plan.appendNumber( "runs", s.runs );
+                plan.appendNumber( "nscanned", s.nscanned );
+                plan.appendNumber( "n", s.n );
+                plan.appendNumber( "micros", s.micros );
+                plan.done();
+            }
+            plans.done();
+            entry.done();
+        }
+    }
+
+    void PlanCache::noteReplan() {
+        planCacheReplans.increment();
+    }
+
+}
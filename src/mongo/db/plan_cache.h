@@ -0,0 +1,148 @@
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/querypattern.h"
+
+namespace mongo {
+
+    /**
+     * The query plan cache of a collection: for each QueryPattern (query shape), the plan that
+     * won the last race of candidate plans for queries of that shape, and statistics of how the
+     * plans picked for it ran.
+     *
+     * An entry goes stale, rather than the whole cache being cleared after a fixed number of
+     * writes, once the collection has seen enough writes since the entry was recorded for its
+     * data to be distributed differently: planCacheReplanMinWrites, or
+     * planCacheReplanWritePercent percent of the records the collection held then if that's
+     * more.  A stale entry isn't used, so the next query of its shape races the candidate plans
+     * again, but its statistics are kept.  Index changes evict only the entries they affect: a
+     * new index those whose query or sort references one of its fields, and a dropped index or
+     * one becoming multikey those recorded for it.
+     *
+     * An entry may be pinned to a plan, which is then used for every query of its shape without
+     * racing other plans, and never goes stale, until the entry is removed or its index dropped.
+     *
+     * The unpinned entries are at most planCacheMaxEntries; past it the least recently recorded
+     * or used of them is evicted.
+     *
+     * Lives in the collection's NamespaceDetailsTransient.  Changed under
+     * NamespaceDetailsTransient::_qcMutex, or under the collection's write lock.
+     */
+    class PlanCache : boost::noncopyable {
+    public:
+        PlanCache();
+
+        /**
+         * @return the plan recorded for pattern, or an empty plan if there is none or it is
+         * stale.  Counts a hit or a miss.
+         */
+        CachedQueryPlan get( const QueryPattern& pattern );
+
+        /**
+         * As get(), the plan recorded for first, or for second if there is none; counts a single
+         * hit or miss.
+         */
+        CachedQueryPlan get( const QueryPattern& first, const QueryPattern& second );
+
+        /**
+         * Records plan as the winner for pattern in a collection of nrecords records, or forgets
+         * the recorded plan if plan is empty.  A pinned entry is left as it is.
+         */
+        void record( const QueryPattern& pattern, const CachedQueryPlan& plan,
+                     long long nrecords );
+
+        /**
+         * Notes a run of the plan over index indexKey (or { $natural : 1 }) for pattern, which
+         * scanned nscanned entries and counted n matches in micros microseconds before being
+         * picked or finishing.
+         */
+        void noteRun( const QueryPattern& pattern, const BSONObj& indexKey, long long nscanned,
+                      long long n, long long micros );
+
+        /** pins pattern to the plan over index indexKey, or { $natural : 1 } */
+        void pin( const QueryPattern& pattern, const BSONObj& indexKey );
+
+        /** forgets pattern's entry, whether pinned or not */
+        void remove( const QueryPattern& pattern );
+
+        /** forgets every entry; pinned entries too if pinsToo */
+        void clear( bool pinsToo = false );
+
+        /** counts a write to the collection */
+        void noteWrite() { ++_writes; }
+
+        /** evicts the unpinned entries whose query or sort references a field of keyPattern */
+        void indexAdded( const BSONObj& keyPattern );
+
+        /**
+         * Evicts the entries recorded for the index keyPattern, which is being dropped or has
+         * become multikey.  Entries pinned to it are evicted only if it's being dropped.
+         */
+        void indexChanged( const BSONObj& keyPattern, bool dropped );
+
+        /** appends a document per entry describing its plan, state and statistics */
+        void append( BSONArrayBuilder& b ) const;
+
+        /** counts a cached plan abandoned for a new race after scanning too much */
+        static void noteReplan();
+
+    private:
+        struct PlanStats {
+            PlanStats() : runs(), nscanned(), n(), micros() { }
+            long long runs;
+            long long nscanned;
+            long long n;
+            long long micros;
+        };
+        typedef map<BSONObj, PlanStats, BSONObjCmp> PlanStatsMap;
+        typedef list<const QueryPattern*> Lru; // least recently used first
+
+        struct Entry {
+            Entry() : pinned(), writesWhenRecorded(), nrecords(), uses(), recorded() { }
+            CachedQueryPlan plan; // empty while none is recorded
+            bool pinned;
+            long long writesWhenRecorded;
+            long long nrecords;   // the collection's records when the plan was recorded
+            long long uses;       // lookups answered with the plan
+            long long recorded;   // times a winning plan was recorded
+            PlanStatsMap plans;   // by index key
+            Lru::iterator lru;    // unless pinned
+        };
+        typedef map<QueryPattern, Entry> Entries;
+
+        bool _stale( const Entry& e ) const;
+
+        /** @return pattern's entry if its plan may be used, else null, setting stale if stale */
+        Entry* _usable( const QueryPattern& pattern, bool* stale );
+
+        /** counts a lookup that found e, or none if null, and returns e's plan */
+        CachedQueryPlan _lookedUp( Entry* e, bool stale );
+
+        /** evicts the least recently used unpinned entries past planCacheMaxEntries */
+        void _trim();
+
+        /** removes the entry at i, counting an eviction */
+        void _erase( Entries::iterator i );
+
+        Entries _entries;
+        Lru _lru;
+        long long _writes;
+    };
+
+}
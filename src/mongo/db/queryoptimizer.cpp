@@ -26,6 +26,7 @@
 #include "mongo/db/db.h"
 #include "mongo/db/intervalbtreecursor.h"
 #include "mongo/db/pagefault.h"
+#include "mongo/db/plan_cache.h"
 #include "mongo/server.h"
 
 //#define DEBUGQO(x) cout << x << endl;
@@ -362,7 +363,19 @@ doneCheckOrder:
         QueryPattern queryPattern = _frs.pattern( _order );
         CachedQueryPlan queryPlanToCache( indexKey(), nScanned, candidatePlans );
         NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns() );
-        nsdt.registerCachedQueryPlanForPattern( queryPattern, queryPlanToCache );
+        nsdt.registerCachedQueryPlanForPattern( queryPattern, queryPlanToCache,
+                                                _d ? _d->stats.nrecords : 0 );
+    }
+
+    void QueryPlan::registerRun( long long nScanned, long long nMatches, long long micros ) const {
+        if ( _utility == Impossible ) {
+            return;
+        }
+
+        SimpleMutex::scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+        QueryPattern queryPattern = _frs.pattern( _order );
+        NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns() );
+        nsdt.planCache().noteRun( queryPattern, indexKey(), nScanned, nMatches, micros );
     }
     
     void QueryPlan::checkTableScanAllowed() const {
@@ -1032,16 +1045,17 @@ doneCheckOrder:
     }
     
     bool QueryPlanGenerator::addCachedPlan( NamespaceDetails *d ) {
-        if ( _recordedPlanPolicy == Ignore ) {
-            return false;
-        }
-
         CachedQueryPlan best = QueryUtilIndexed::bestIndexForPatterns( _qps.frsp(), _qps.order() );
         BSONObj bestIndex = best.indexKey();
         if ( bestIndex.isEmpty() ) {
             return false;
         }
 
+        // A pinned plan is used even by explain, which must show the plan queries will use.
+        if ( _recordedPlanPolicy == Ignore && !best.pinned() ) {
+            return false;
+        }
+
         shared_ptr<QueryPlan> p;
         if ( str::equals( bestIndex.firstElementFieldName(), "$natural" ) ) {
             p = newPlan( d, -1 );
@@ -1171,6 +1185,7 @@ doneCheckOrder:
         _frsp( frsp ),
         _mayRecordPlan(),
         _usingCachedPlan(),
+        _usingPinnedPlan(),
         _order( order.getOwned() ),
         _oldNScanned( 0 ),
         _yieldSometimesTracker( 256, 20 ),
@@ -1188,6 +1203,7 @@ doneCheckOrder:
         DEBUGQO( "QueryPlanSet::init " << ns << "\t" << _originalQuery );
         _plans.clear();
         _usingCachedPlan = false;
+        _usingPinnedPlan = false;
 
         _generator.addInitialPlans();
     }
@@ -1202,6 +1218,7 @@ doneCheckOrder:
                                      const CachedQueryPlan &cachedPlan ) {
         verify( nPlans() == 0 );
         _usingCachedPlan = true;
+        _usingPinnedPlan = cachedPlan.pinned();
         _oldNScanned = cachedPlan.nScanned();
         _cachedPlanCharacter = cachedPlan.planCharacter();
         pushPlan( plan );
@@ -1230,6 +1247,8 @@ doneCheckOrder:
     bool QueryPlanSet::hasPossiblyExcludedPlans() const {
         return
             _usingCachedPlan &&
+            // A pinned plan is used as if it was hinted.
+            !_usingPinnedPlan &&
             ( nPlans() == 1 ) &&
             ( firstPlan()->utility() != QueryPlan::Optimal );
     }
@@ -1452,6 +1471,10 @@ doneCheckOrder:
                 runner.queryPlan().registerSelf( runner.nscanned(),
                                                  _plans.characterizeCandidatePlans() );
             }
+            if ( _plans.usingCachedPlan() || _plans.mayRecordPlan() ) {
+                runner.queryPlan().registerRun( runner.nscanned(), runner.nmatches(),
+                                                _timer.micros() );
+            }
             _done = true;
             return holder._runner;
         }
@@ -1461,6 +1484,7 @@ doneCheckOrder:
         if ( _plans.hasPossiblyExcludedPlans() &&
             runner.nscanned() > _plans.oldNScanned() * 10 ) {
             verify( _plans.nPlans() == 1 && _plans.firstPlan()->special().empty() );
+            PlanCache::noteReplan();
             holder._offset = -runner.nscanned();
             _plans.addFallbackPlans();
             QueryPlanSet::PlanVector::const_iterator i = _plans.plans().begin();
@@ -1990,26 +2014,30 @@ doneCheckOrder:
         nsdt.registerCachedQueryPlanForPattern( frsp._multiKey.pattern( order ), noCachedPlan );
     }
     
+    void QueryUtilIndexed::pinIndexForPatterns( const FieldRangeSetPair &frsp,
+                                                const BSONObj &order,
+                                                const BSONObj &indexKey ) {
+        SimpleMutex::scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+        NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( frsp.ns() );
+        nsdt.planCache().pin( frsp._singleKey.pattern( order ), indexKey );
+        nsdt.planCache().pin( frsp._multiKey.pattern( order ), indexKey );
+    }
+
+    void QueryUtilIndexed::removePlansForPatterns( const FieldRangeSetPair &frsp,
+                                                   const BSONObj &order ) {
+        SimpleMutex::scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+        NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( frsp.ns() );
+        nsdt.planCache().remove( frsp._singleKey.pattern( order ) );
+        nsdt.planCache().remove( frsp._multiKey.pattern( order ) );
+    }
+
     CachedQueryPlan QueryUtilIndexed::bestIndexForPatterns( const FieldRangeSetPair &frsp, const BSONObj &order ) {
         SimpleMutex::scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
         NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( frsp.ns() );
         // TODO Maybe it would make sense to return the index with the lowest
         // nscanned if there are two possibilities.
-        {
-            QueryPattern pattern = frsp._singleKey.pattern( order );
-            CachedQueryPlan cachedQueryPlan = nsdt.cachedQueryPlanForPattern( pattern );
-            if ( !cachedQueryPlan.indexKey().isEmpty() ) {
-                return cachedQueryPlan;
-            }
-        }
-        {
-            QueryPattern pattern = frsp._multiKey.pattern( order );
-            CachedQueryPlan cachedQueryPlan = nsdt.cachedQueryPlanForPattern( pattern );
-            if ( !cachedQueryPlan.indexKey().isEmpty() ) {
-                return cachedQueryPlan;
-            }
-        }
-        return CachedQueryPlan();
+        return nsdt.planCache().get( frsp._singleKey.pattern( order ),
+                                     frsp._multiKey.pattern( order ) );
     }
     
     bool QueryUtilIndexed::uselessOr( const OrRangeGenerator &org, NamespaceDetails *d, int hintIdx ) {
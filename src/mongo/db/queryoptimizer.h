@@ -27,6 +27,7 @@
 #include "mongo/db/querypattern.h"
 #include "mongo/db/queryutil.h"
 #include "mongo/util/elapsed_tracker.h"
+#include "mongo/util/timer.h"
 
 namespace mongo {
 
@@ -94,6 +95,11 @@ namespace mongo {
         shared_ptr<Cursor> newReverseCursor() const;
         /** Register this plan as a winner for its QueryPattern, with specified 'nscanned'. */
         void registerSelf( long long nScanned, CandidatePlanCharacter candidatePlans ) const;
+        /**
+         * Record in the plan cache statistics of a run of this plan for its QueryPattern, up to
+         * the point where the plan was picked or finished.
+         */
+        void registerRun( long long nScanned, long long nMatches, long long micros ) const;
 
         int direction() const { return _direction; }
         BSONObj indexKey() const;
@@ -290,6 +296,9 @@ namespace mongo {
          */
         long long nscanned() const;
 
+        /** @return the matches counted by this runner. */
+        int nmatches() const { return _matchCounter.count(); }
+
         /** Take any steps necessary before the db mutex is yielded. */
         void prepareToYield();
 
@@ -426,7 +435,7 @@ namespace mongo {
 
         /** Policies for utilizing recorded plans. */
         typedef enum {
-            Ignore, // Ignore the recorded plan and try all candidate plans.
+            Ignore, // Ignore the recorded plan, unless pinned, and try all candidate plans.
             UseIfInOrder, // Use the recorded plan if it is properly ordered.
             Use // Always use the recorded plan.
         } RecordedPlanPolicy;
@@ -535,6 +544,8 @@ namespace mongo {
         int oldNScanned() const { return _oldNScanned; }
         void addFallbackPlans();
         void setUsingCachedPlan( bool usingCachedPlan ) { _usingCachedPlan = usingCachedPlan; }
+        /** @return true if the plan was pinned in the plan cache. */
+        bool usingPinnedPlan() const { return _usingPinnedPlan; }
         
         //for testing
         bool modifiedKeys() const;
@@ -563,6 +574,7 @@ namespace mongo {
         PlanVector _plans;
         bool _mayRecordPlan;
         bool _usingCachedPlan;
+        bool _usingPinnedPlan;
         CandidatePlanCharacter _cachedPlanCharacter;
         BSONObj _order;
         long long _oldNScanned;
@@ -629,6 +641,7 @@ namespace mongo {
         PriorityQueue<RunnerHolder> _queue;
         shared_ptr<ExplainClauseInfo> _explainClauseInfo;
         bool _done;
+        Timer _timer;
     };
 
     /** Handles $or type queries by generating a QueryPlanSet for each $or clause. */
@@ -820,6 +833,8 @@ namespace mongo {
         virtual CoveredIndexMatcher* matcher() const { return _matcher.get(); }
 
         virtual bool capped() const { return _c->capped(); }
+
+        virtual long long willNeedAhead( long long bytes ) { return _c->willNeedAhead( bytes ); }
         
         virtual long long nscanned() { return _nscanned + _c->nscanned(); }
         
@@ -862,6 +877,14 @@ namespace mongo {
         static bool indexUseful( const FieldRangeSetPair &frsp, NamespaceDetails *d, int idxNo, const BSONObj &order );
         /** Clear any indexes recorded as the best for either the single or multi key pattern. */
         static void clearIndexesForPatterns( const FieldRangeSetPair &frsp, const BSONObj &order );
+        /**
+         * Pin the plan over indexKey, or { $natural : 1 }, for both the single and multi key
+         * pattern.
+         */
+        static void pinIndexForPatterns( const FieldRangeSetPair &frsp, const BSONObj &order,
+                                         const BSONObj &indexKey );
+        /** Forget the plans recorded or pinned for both the single and multi key pattern. */
+        static void removePlansForPatterns( const FieldRangeSetPair &frsp, const BSONObj &order );
         /** Return a recorded best index for the single or multi key pattern. */
         static CachedQueryPlan bestIndexForPatterns( const FieldRangeSetPair &frsp, const BSONObj &order );        
         static bool uselessOr( const OrRangeGenerator& org, NamespaceDetails *d, int hintIdx );
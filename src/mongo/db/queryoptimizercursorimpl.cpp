@@ -197,6 +197,11 @@ namespace mongo {
         return _takeover ? _takeover->capped() : false;
     }
 
+    long long QueryOptimizerCursorImpl::willNeedAhead( long long bytes ) {
+        // Before takeover the candidate plans' scans are interleaved.
+        return _takeover ? _takeover->willNeedAhead( bytes ) : 0;
+    }
+
     long long QueryOptimizerCursorImpl::nscanned() {
         return _takeover ? _takeover->nscanned() : _nscanned;
     }
@@ -168,6 +168,8 @@ namespace mongo {
 
         virtual bool capped() const;
 
+        virtual long long willNeedAhead( long long bytes );
+
         virtual long long nscanned();
 
         virtual CoveredIndexMatcher *matcher() const;
@@ -79,12 +79,41 @@ namespace mongo {
         return "";
     }
     
-    string QueryPattern::toString() const {
+    namespace {
+        /** @return true if a and b are the same field, or one is a dotted prefix of the other */
+        bool sameOrDottedPrefix( const StringData& a, const StringData& b ) {
+            size_t n = std::min( a.size(), b.size() );
+            if ( a.substr( 0, n ) != b.substr( 0, n ) )
+                return false;
+            if ( a.size() == b.size() )
+                return true;
+            return ( a.size() > n ? a[ n ] : b[ n ] ) == '.';
+        }
+    }
+
+    bool QueryPattern::referencesField( const StringData& field ) const {
+        for( map<string,Type>::const_iterator i = _fieldTypes.begin(); i != _fieldTypes.end(); ++i ) {
+            if ( sameOrDottedPrefix( i->first, field ) )
+                return true;
+        }
+        BSONObjIterator i( _sort );
+        while( i.more() ) {
+            if ( sameOrDottedPrefix( i.next().fieldName(), field ) )
+                return true;
+        }
+        return false;
+    }
+
+    BSONObj QueryPattern::toBSON() const {
         BSONObjBuilder b;
         for( map<string,Type>::const_iterator i = _fieldTypes.begin(); i != _fieldTypes.end(); ++i ) {
             b << i->first << typeToString( i->second );
         }
-        return BSON( "query" << b.done() << "sort" << _sort ).toString();
+        return BSON( "query" << b.done() << "sort" << _sort );
+    }
+
+    string QueryPattern::toString() const {
+        return toBSON().toString();
     }
     
     void QueryPattern::setSort( const BSONObj sort ) {
@@ -107,10 +136,11 @@ namespace mongo {
     }
     
     CachedQueryPlan::CachedQueryPlan( const BSONObj &indexKey, long long nScanned,
-                                     CandidatePlanCharacter planCharacter ) :
+                                     CandidatePlanCharacter planCharacter, bool pinned ) :
     _indexKey( indexKey ),
     _nScanned( nScanned ),
-    _planCharacter( planCharacter ) {
+    _planCharacter( planCharacter ),
+    _pinned( pinned ) {
     }
 
     
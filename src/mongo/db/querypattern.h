@@ -47,6 +47,13 @@ namespace mongo {
         bool operator==( const QueryPattern &other ) const;
         /** for testing only */
         bool operator!=( const QueryPattern &other ) const;
+        /**
+         * @return true if the query constrains, or the sort is on, field or a field that it is
+         * a dotted prefix of or that is a dotted prefix of it.
+         */
+        bool referencesField( const StringData& field ) const;
+        /** @return the pattern as { query : { <field> : <type name>, ... }, sort : <sort> } */
+        BSONObj toBSON() const;
         /** for development / debugging */
         string toString() const;
     private:
@@ -80,17 +87,21 @@ namespace mongo {
     class CachedQueryPlan {
     public:
         CachedQueryPlan() :
-        _nScanned() {
+        _nScanned(),
+        _pinned() {
         }
         CachedQueryPlan( const BSONObj &indexKey, long long nScanned,
-                        CandidatePlanCharacter planCharacter );
+                        CandidatePlanCharacter planCharacter, bool pinned = false );
         BSONObj indexKey() const { return _indexKey; }
         long long nScanned() const { return _nScanned; }
         CandidatePlanCharacter planCharacter() const { return _planCharacter; }
+        /** @return true if the plan was pinned, and must be used without racing other plans */
+        bool pinned() const { return _pinned; }
     private:
         BSONObj _indexKey;
         long long _nScanned;
         CandidatePlanCharacter _planCharacter;
+        bool _pinned;
     };
 
     inline bool QueryPattern::operator<( const QueryPattern &other ) const {
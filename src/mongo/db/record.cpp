@@ -25,6 +25,8 @@
 #include "mongo/db/commands/server_status.h"
 #include "mongo/platform/bits.h"
 #include "mongo/platform/unordered_set.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/mmap.h"
 #include "mongo/util/net/listen.h"
 #include "mongo/util/processinfo.h"
 #include "mongo/util/stack_introspect.h"
@@ -33,10 +35,13 @@ namespace mongo {
 
     RecordStats recordStats;
 
+    MONGO_EXPORT_SERVER_PARAMETER(faultReadAheadBytes, int, 1024 * 1024);
+
     void RecordStats::record( BSONObjBuilder& b ) {
         b.appendNumber( "accessesNotInMemory" , accessesNotInMemory.load() );
         b.appendNumber( "pageFaultExceptionsThrown" , pageFaultExceptionsThrown.load() );
-
+        b.appendNumber( "readAheads" , readAheads.load() );
+        b.appendNumber( "readAheadBytes" , readAheadBytes.load() );
     }
 
     void Record::appendStats( BSONObjBuilder& b ) {
@@ -435,6 +440,79 @@ namespace mongo {
         return ProcessInfo::blockCheckSupported();
     }
 
+    long long Record::willNeed( const DiskLoc& loc, long long bytes ) {
+        Database* db = cc().database();
+        if ( ! db || loc.isNull() || bytes <= 0 )
+            return 0;
+
+        // stay within the data file: the next mapping could be any other file
+        MongoDataFile* f = db->getFile( loc.a() );
+        bytes = std::min( bytes, static_cast<long long>( f->length() ) - loc.getOfs() );
+        if ( bytes <= 0 )
+            return 0;
+
+        MAdvise::willNeed( DataFileMgr::getRecord( loc ), bytes );
+
+        recordStats.readAheads.fetchAndAdd(1);
+        recordStats.readAheadBytes.fetchAndAdd(bytes);
+        db->recordStats().readAheads.fetchAndAdd(1);
+        db->recordStats().readAheadBytes.fetchAndAdd(bytes);
+        return bytes;
+    }
+
+    void Record::appendResidencyEstimate( NamespaceDetails* d, int scale, BSONObjBuilder& b ) {
+        if ( ! blockSupported ) {
+            b.append( "info", "not supported" );
+            return;
+        }
+
+        // pages are checked in slices of contiguous pages, one slice out of every 'stride',
+        // so that huge collections cost at most MaxSlices mincore calls
+        const long long SlicePages = 16;
+        const long long MaxSlices = 4096;
+        const long long pageSize = ProcessInfo::getPageSize();
+
+        Timer t;
+        long long storageSize = 0;
+        for ( DiskLoc L = d->firstExtent; ! L.isNull(); L = L.ext()->xnext )
+            storageSize += L.ext()->length;
+
+        long long totalSlices = ( storageSize / pageSize + SlicePages - 1 ) / SlicePages;
+        long long stride = std::max( 1LL, ( totalSlices + MaxSlices - 1 ) / MaxSlices );
+
+        long long sampled = 0;
+        long long resident = 0;
+        long long slice = 0;
+        vector<char> inMem;
+        for ( DiskLoc L = d->firstExtent; ! L.isNull(); L = L.ext()->xnext ) {
+            const Extent* e = L.ext();
+            const char* start = reinterpret_cast<const char*>( e );
+            const long long extentPages = e->length / pageSize;
+            for ( long long p = 0; p < extentPages; p += SlicePages, slice++ ) {
+                if ( slice % stride )
+                    continue;
+                size_t n = static_cast<size_t>( std::min( SlicePages, extentPages - p ) );
+                if ( ! ProcessInfo::pagesInMemory( start + p * pageSize, n, &inMem ) ) {
+                    b.append( "info", "mincore failed" );
+                    return;
+                }
+                sampled += n;
+                for ( size_t i = 0; i < n; i++ ) {
+                    if ( inMem[i] )
+                        resident++;
+                }
+            }
+        }
+
+        double ratio = sampled ? static_cast<double>( resident ) / sampled : 0;
+        b.appendNumber( "sampledPages", sampled );
+        b.appendNumber( "residentPages", resident );
+        b.append( "residentRatio", ratio );
+        b.appendNumber( "estimatedResidentSize",
+                        static_cast<long long>( storageSize * ratio ) / scale );
+        b.appendNumber( "computationTimeMicros", static_cast<long long>( t.micros() ) );
+    }
+
     bool Record::likelyInPhysicalMemory() const {
         return likelyInPhysicalMemory( _data );
     }
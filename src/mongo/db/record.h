@@ -28,8 +28,13 @@ namespace mongo {
 
         AtomicInt64 accessesNotInMemory;
         AtomicInt64 pageFaultExceptionsThrown;
+        AtomicInt64 readAheads;
+        AtomicInt64 readAheadBytes;
     };
 
+    /** how far past a record that is not in memory a scan asks the OS to read ahead */
+    extern int faultReadAheadBytes;
+
 
 
 }
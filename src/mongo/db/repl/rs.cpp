@@ -67,14 +67,6 @@ namespace mongo {
     
     using namespace bson;
 
-#ifdef MONGO_PLATFORM_64
-    const int ReplSetImpl::replWriterThreadCount = 16;
-    const int ReplSetImpl::replPrefetcherThreadCount = 16;
-#else
-    const int ReplSetImpl::replWriterThreadCount = 2;
-    const int ReplSetImpl::replPrefetcherThreadCount = 2;
-#endif
-
     bool replSet = false;
     ReplSet *theReplSet = 0;
 
@@ -465,8 +457,8 @@ namespace mongo {
         _maintenanceMode(0),
         mgr(0),
         ghost(0),
-        _writerPool(replWriterThreadCount),
-        _prefetcherPool(replPrefetcherThreadCount),
+        _writerPool(replset::replWriterThreadCount),
+        _prefetcherPool(replset::replPrefetcherThreadCount),
         oplogVersion(0),
         _indexPrefetchConfig(PREFETCH_ALL) {
     }
@@ -569,8 +569,6 @@ namespace mongo {
             return _indexPrefetchConfig;
         }
             
-        static const int replWriterThreadCount;
-        static const int replPrefetcherThreadCount;
         threadpool::ThreadPool& getPrefetchPool() { return _prefetcherPool; }
         threadpool::ThreadPool& getWriterPool() { return _writerPool; }
 
@@ -53,11 +53,14 @@
 #include "mongo/db/commands/fsync.h"
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/instance.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/db/namespacestring.h"
 #include "mongo/db/prefetch.h"
 #include "mongo/db/repl.h"
 #include "mongo/db/repl/bgsync.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/repl/rs_sync.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/util/fail_point_service.h"
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/stats/timer_stats.h"
@@ -76,6 +79,57 @@ namespace replset {
 
     MONGO_FP_DECLARE(rsSyncApplyStop);
 
+#ifdef MONGO_PLATFORM_64
+    int replWriterThreadCount = 16;
+    int replPrefetcherThreadCount = 16;
+#else
+    int replWriterThreadCount = 2;
+    int replPrefetcherThreadCount = 2;
+#endif
+    // Cap the batches using the limit on journal commits by default.
+    // This works out to be 100 MB (64 bit) or 50 MB (32 bit)
+    int replBatchLimitBytes = dur::UncommittedBytesLimit;
+    int replBatchLimitOperations = 5000;
+
+    namespace {
+        // An int server parameter that rejects values outside [minValue, maxValue]
+        class BoundedIntParameter : public ExportedServerParameter<int> {
+        public:
+            BoundedIntParameter(const std::string& name, int* value, int minValue, int maxValue)
+                : ExportedServerParameter<int>(ServerParameterSet::getGlobal(), name, value,
+                                               true, true),
+                  _minValue(minValue), _maxValue(maxValue) {}
+
+        protected:
+            virtual Status validate(const int& potentialNewValue) {
+                if (potentialNewValue < _minValue || potentialNewValue > _maxValue) {
+                    return Status(ErrorCodes::BadValue,
+                                  str::stream() << name() << " must be between " << _minValue
+                                                << " and " << _maxValue);
+                }
+                return Status::OK();
+            }
+
+        private:
+            const int _minValue;
+            const int _maxValue;
+        };
+
+        BoundedIntParameter replWriterThreadCountSetting("replWriterThreadCount",
+                                                         &replWriterThreadCount, 1, 256);
+        BoundedIntParameter replPrefetcherThreadCountSetting("replPrefetcherThreadCount",
+                                                             &replPrefetcherThreadCount, 1, 256);
+        // A batch must be able to hold the largest possible op, and must not outgrow what the
+        // journal can commit at once.
+        BoundedIntParameter replBatchLimitBytesSetting("replBatchLimitBytes",
+                                                       &replBatchLimitBytes,
+                                                       BSONObjMaxInternalSize,
+                                                       dur::UncommittedBytesLimit);
+        BoundedIntParameter replBatchLimitOperationsSetting("replBatchLimitOperations",
+                                                            &replBatchLimitOperations,
+                                                            1, 1000 * 1000);
+    }
+
     // Number and time of each ApplyOps worker pool round
     static TimerStats applyBatchStats;
     static ServerStatusMetricField<TimerStats> displayOpBatchesApplied(
@@ -86,6 +140,48 @@ namespace replset {
     static ServerStatusMetricField<Counter64> displayOpsApplied( "repl.apply.ops",
                                                                 &opsAppliedStats );
 
+    /**
+     * Counts applied ops by how many seconds behind the primary's optime they were when their
+     * batch finished.  Optimes have one second resolution, so the first bucket is "same second".
+     */
+    class ApplyLagHistogram {
+    public:
+        void record(long long lagSecs) {
+            int i = 0;
+            while (i < NumBounds && lagSecs >= _bounds[i])
+                i++;
+            _buckets[i].increment();
+        }
+
+        BSONObj getReport() const {
+            BSONObjBuilder b;
+            for (int i = 0; i < NumBounds; i++) {
+                b.append(string(str::stream() << "lt" << _bounds[i] << "s"),
+                         _buckets[i].get());
+            }
+            b.append(string(str::stream() << "ge" << _bounds[NumBounds - 1] << "s"),
+                     _buckets[NumBounds].get());
+            return b.obj();
+        }
+        operator BSONObj() const { return getReport(); }
+
+    private:
+        static const int NumBounds = 8;
+        static const long long _bounds[NumBounds];
+        Counter64 _buckets[NumBounds + 1];
+    };
+    const long long ApplyLagHistogram::_bounds[ApplyLagHistogram::NumBounds] =
+        { 1, 2, 5, 10, 30, 60, 300, 3600 };
+
+    static ApplyLagHistogram applyLagStats;
+    static ServerStatusMetricField<ApplyLagHistogram> displayApplyLag( "repl.apply.lag",
+                                                                      &applyLagStats );
+    // Ops that were spread across writers by _id rather than by namespace alone
+    static Counter64 opsPartitionedByIdStats;
+    static ServerStatusMetricField<Counter64> displayOpsPartitionedById(
+                                                    "repl.apply.partitionedById",
+                                                    &opsPartitionedByIdStats );
+
 
     SyncTail::SyncTail(BackgroundSyncInterface *q) :
         Sync(""), oplogVersion(0), _networkQueue(q)
@@ -97,51 +193,41 @@ namespace replset {
         return _networkQueue->peek(op);
     }
 
-    bool SyncTail::isOplogThrottled(const string ns)
-    {
+    size_t SyncTail::batchLimitBytes() {
+        return static_cast<size_t>(replBatchLimitBytes);
+    }
+
+    size_t SyncTail::batchLimitOperations() {
+        return static_cast<size_t>(replBatchLimitOperations);
+    }
+
+    void SyncTail::refreshOplogThrottle() {
         const string rsSettingNS = "local.oplogthrottle";
-        DBDirectClient cli;
-        BSONObj throttleObj, o;
-        bool flag = false;
-        if (cli.exists(rsSettingNS))
-        {
-            //log() << "[MYCODE] Checking for throttle value" << endl;
-            try
-            {
-                scoped_ptr<DBClientCursor> cursor(cli.query( rsSettingNS, Query() ));
-                while (cursor->more())
-                {
-                    o = cursor->next().getOwned();
-                    if (!ns.compare(o["_id"].String()))
-                    {
-                        flag = true;
-                        break;
-                    }
-                }
+        _throttledNamespaces.clear();
 
-                if (flag)
-                    throttleObj = o["stopped"].wrap();
-                else
-                    return false;
-            }
-            catch (DBException e)
-            {
-                log() << "[MYCODE] dbexception: findOne call failed for " << rsSettingNS << endl;
-            }
+        DBDirectClient cli;
+        if (!cli.exists(rsSettingNS))
+            return;
 
-            //log() << "[MYCODE] Throttle value: " << throttleObj.toString() << endl;
-            if (!throttleObj["stopped"].eoo())
+        try
+        {
+            scoped_ptr<DBClientCursor> cursor(cli.query( rsSettingNS, Query() ));
+            while (cursor->more())
             {
-                //log() << "[MYCODE] Checking for stopped value" << endl;
-                bool stopped = throttleObj["stopped"].Bool();
-                if (stopped)
-                {
-                    return true;
-                }
+                BSONObj o = cursor->next();
+                if (o["_id"].type() == String && o["stopped"].trueValue())
+                    _throttledNamespaces.insert(o["_id"].String());
             }
         }
+        catch (DBException& e)
+        {
+            log() << "[MYCODE] dbexception: query failed for " << rsSettingNS << endl;
+        }
+    }
 
-        return false;
+    bool SyncTail::isOplogThrottled(const string& ns) const
+    {
+        return !_throttledNamespaces.empty() && _throttledNamespaces.count(ns);
     }
 
     /* apply the log op that is in param o
@@ -280,13 +366,33 @@ namespace replset {
         }
     }
 
+    void SyncTail::prefetchOpGroup(const std::vector<BSONObj>& ops) {
+        for (std::vector<BSONObj>::const_iterator it = ops.begin();
+             it != ops.end();
+             ++it) {
+            prefetchOp(*it);
+        }
+    }
+
     // Doles out all the work to the reader pool threads and waits for them to complete
     void SyncTail::prefetchOps(const std::deque<BSONObj>& ops) {
         threadpool::ThreadPool& prefetcherPool = theReplSet->getPrefetchPool();
+        const int nReaders = replPrefetcherThreadCount;
+        prefetcherPool.growTo(nReaders);
+
+        // one task per reader rather than per op, so lowering replPrefetcherThreadCount
+        // really does lower the number of concurrent prefetches
+        std::vector< std::vector<BSONObj> > readerVectors(nReaders);
+        size_t i = 0;
         for (std::deque<BSONObj>::const_iterator it = ops.begin();
              it != ops.end();
              ++it) {
-            prefetcherPool.schedule(&prefetchOp, *it);
+            readerVectors[i++ % readerVectors.size()].push_back(*it);
+        }
+        for (size_t r = 0; r < readerVectors.size(); r++) {
+            if (!readerVectors[r].empty()) {
+                prefetcherPool.schedule(&prefetchOpGroup, boost::cref(readerVectors[r]));
+            }
         }
         prefetcherPool.join();
     }
@@ -309,26 +415,118 @@ namespace replset {
     // Doles out all the work to the writer pool threads and waits for them to complete
     void SyncTail::multiApply( std::deque<BSONObj>& ops, MultiSyncApplyFunc applyFunc ) {
 
+        refreshOplogThrottle();
+
         // Use a ThreadPool to prefetch all the operations in a batch.
         prefetchOps(ops);
         
-        std::vector< std::vector<BSONObj> > writerVectors(theReplSet->replWriterThreadCount);
+        const int nWriters = replWriterThreadCount;
+        theReplSet->getWriterPool().growTo(nWriters);
+        std::vector< std::vector<BSONObj> > writerVectors(nWriters);
         fillWriterVectors(ops, &writerVectors);
         LOG(1) << "replication batch size is " << ops.size() << endl;
-        // We must grab this because we're going to grab write locks later.
-        // We hold this mutex the entire time we're writing; it doesn't matter
-        // because all readers are blocked anyway.
-        SimpleMutex::scoped_lock fsynclk(filesLockedFsync);
+        {
+            // We must grab this because we're going to grab write locks later.
+            // We hold this mutex the entire time we're writing; it doesn't matter
+            // because all readers are blocked anyway.
+            SimpleMutex::scoped_lock fsynclk(filesLockedFsync);
+
+            // stop all readers until we're done
+            Lock::ParallelBatchWriterMode pbwm;
 
-        // stop all readers until we're done
-        Lock::ParallelBatchWriterMode pbwm;
+            applyOps(writerVectors, applyFunc);
+        }
+
+        recordApplyLag(ops);
+    }
+
+    void SyncTail::recordApplyLag(const std::deque<BSONObj>& ops) {
+        const long long now = time(0);
+        for (std::deque<BSONObj>::const_iterator it = ops.begin();
+             it != ops.end();
+             ++it) {
+            const BSONElement ts = (*it)["ts"];
+            if (ts.type() != Timestamp)
+                continue;
+            const long long lag = now - ts._opTime().getSecs();
+            applyLagStats.record(lag > 0 ? lag : 0);
+        }
+    }
+
+    namespace {
+        // The _id of the document an op writes, or EOO if the op does not name one
+        BSONElement opDocumentId(const BSONObj& op) {
+            const char* opType = op.getStringField("op");
+            if (opType[0] == 'u')
+                return op.getObjectField("o2")["_id"];
+            if (opType[0] == 'i' || opType[0] == 'd')
+                return op.getObjectField("o")["_id"];
+            return BSONElement();
+        }
+
+        uint32_t hashDocumentId(const BSONElement& id, uint32_t seed) {
+            uint32_t hash = 0;
+            if (id.isNumber()) {
+                // 1, 1.0 and NumberLong(1) are the same _id, so hash the value, not the bytes
+                double d = id.numberDouble();
+                if (d == 0)
+                    d = 0; // -0.0
+                MurmurHash3_x86_32(&d, sizeof(d), seed, &hash);
+            }
+            else {
+                MurmurHash3_x86_32(id.value(), id.valuesize(), seed, &hash);
+            }
+            return hash;
+        }
+    }
 
-        applyOps(writerVectors, applyFunc);
+    bool SyncTail::canPartitionById(const string& ns) {
+        if (ns.empty() || ns[0] == '.' || NamespaceString(ns).isSystem())
+            return false;
+        try {
+            Client::ReadContext ctx(ns);
+            NamespaceDetails* d = nsdetails(ns);
+            if (!d) {
+                // created by this batch, which can only give it an _id index
+                return true;
+            }
+            if (d->isCapped())
+                return false;
+            NamespaceDetails::IndexIterator i = d->ii();
+            while (i.more()) {
+                IndexDetails& idx = i.next();
+                if (idx.unique() && !idx.isIdIndex())
+                    return false;
+            }
+            return true;
+        }
+        catch (const DBException& e) {
+            LOG(2) << "not partitioning " << ns << " by _id: " << e.what() << endl;
+            return false;
+        }
     }
 
 
     void SyncTail::fillWriterVectors(const std::deque<BSONObj>& ops, 
                                               std::vector< std::vector<BSONObj> >* writerVectors) {
+        // Ops on one document must stay in oplog order, so they always land on one writer.
+        // A namespace is spread across writers by _id only if its collection allows it and
+        // every op on it in this batch names its document; otherwise all of its ops go to a
+        // single writer as before.
+        map<string, bool> byId;
+        if (writerVectors->size() > 1) {
+            for (std::deque<BSONObj>::const_iterator it = ops.begin();
+                 it != ops.end();
+                 ++it) {
+                const string ns = it->getStringField("ns");
+                map<string, bool>::iterator i = byId.find(ns);
+                if (i == byId.end())
+                    i = byId.insert(make_pair(ns, canPartitionById(ns))).first;
+                if (i->second && opDocumentId(*it).eoo())
+                    i->second = false;
+            }
+        }
+
         for (std::deque<BSONObj>::const_iterator it = ops.begin();
              it != ops.end();
              ++it) {
@@ -339,6 +537,12 @@ namespace replset {
             uint32_t hash = 0;
             MurmurHash3_x86_32( ns, len, 0, &hash);
 
+            map<string, bool>::const_iterator i = byId.find(ns);
+            if (i != byId.end() && i->second) {
+                hash = hashDocumentId(opDocumentId(*it), hash);
+                opsPartitionedByIdStats.increment();
+            }
+
             (*writerVectors)[hash % writerVectors->size()].push_back(*it);
         }
     }
@@ -368,7 +572,11 @@ namespace replset {
         while( ts < minValid ) {
             OpQueue ops;
 
-            while (ops.getSize() < replBatchLimitBytes) {
+            const size_t limitBytes = batchLimitBytes();
+            const size_t limitOperations = batchLimitOperations();
+            const time_t batchStart = time(0);
+
+            while (ops.getSize() < limitBytes) {
                 if (tryPopAndWaitForMore(&ops)) {
                     break;
                 }
@@ -376,9 +584,9 @@ namespace replset {
                 // apply replication batch limits
                 now = time(0);
                 if (!ops.empty()) {
-                    if (now > replBatchLimitSeconds)
+                    if (now - batchStart > replBatchLimitSeconds)
                         break;
-                    if (ops.getDeque().size() > replBatchLimitOperations)
+                    if (ops.getDeque().size() >= limitOperations)
                         break;
                 }
             }
@@ -419,6 +627,7 @@ namespace replset {
         }
 
         // create the initial oplog entry
+        refreshOplogThrottle();
         syncApply(applyGTEObj);
         _logOpObjRS(applyGTEObj);
 
@@ -451,11 +660,13 @@ namespace replset {
 
             Timer batchTimer;
             int lastTimeChecked = 0;
+            const size_t limitBytes = batchLimitBytes();
+            const size_t limitOperations = batchLimitOperations();
 
             // always fetch a few ops first
             // tryPopAndWaitForMore returns true when we need to end a batch early
             while (!tryPopAndWaitForMore(&ops) && 
-                   (ops.getSize() < replBatchLimitBytes)) {
+                   (ops.getSize() < limitBytes)) {
 
                 if (theReplSet->isPrimary()) {
                     massert(16620, "there are ops to sync, but I'm primary", ops.empty());
@@ -468,7 +679,7 @@ namespace replset {
                 if (!ops.empty()) {
                     if (now > replBatchLimitSeconds)
                         break;
-                    if (ops.getDeque().size() > replBatchLimitOperations)
+                    if (ops.getDeque().size() >= limitOperations)
                         break;
                 }
                 // occasionally check some things
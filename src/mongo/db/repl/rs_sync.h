@@ -44,6 +44,7 @@
 #pragma once
 
 #include <deque>
+#include <set>
 #include <vector>
 
 #include "mongo/db/client.h"
@@ -57,6 +58,13 @@ namespace replset {
 
     class BackgroundSyncInterface;
 
+    // Tunable through setParameter.  The thread counts may be raised or lowered at runtime: the
+    // pools grow on demand and a lower count simply splits each batch into fewer pieces.
+    extern int replWriterThreadCount;
+    extern int replPrefetcherThreadCount;
+    extern int replBatchLimitBytes;
+    extern int replBatchLimitOperations;
+
     /**
      * "Normal" replica set syncing
      */
@@ -122,16 +130,20 @@ namespace replset {
         void applyOpsToOplog(std::deque<BSONObj>* ops);
 
     protected:
-        // Cap the batches using the limit on journal commits.
-        // This works out to be 100 MB (64 bit) or 50 MB (32 bit)
-        static const unsigned int replBatchLimitBytes = dur::UncommittedBytesLimit;
         static const int replBatchLimitSeconds = 1;
-        static const unsigned int replBatchLimitOperations = 5000;
+
+        // Batch size limits, read from the server parameters once per batch
+        static size_t batchLimitBytes();
+        static size_t batchLimitOperations();
 
         // Prefetch and write a deque of operations, using the supplied function.
         // Initial Sync and Sync Tail each use a different function.
         void multiApply(std::deque<BSONObj>& ops, MultiSyncApplyFunc applyFunc);
 
+        // Reloads the namespaces listed as stopped in local.oplogthrottle.  Called once per
+        // batch by the applying thread; the writers only read the set.
+        void refreshOplogThrottle();
+
         // The version of the last op to be read
         int oplogVersion;
 
@@ -142,6 +154,8 @@ namespace replset {
         void prefetchOps(const std::deque<BSONObj>& ops);
         // Used by the thread pool readers to prefetch an op
         static void prefetchOp(const BSONObj& op);
+        // Used by the thread pool readers to prefetch their share of a batch
+        static void prefetchOpGroup(const std::vector<BSONObj>& ops);
 
         // Doles out all the work to the writer pool threads and waits for them to complete
         void applyOps(const std::vector< std::vector<BSONObj> >& writerVectors, 
@@ -151,7 +165,18 @@ namespace replset {
                                std::vector< std::vector<BSONObj> >* writerVectors);
         void handleSlaveDelay(const BSONObj& op);
         void setOplogVersion(const BSONObj& op);
-        bool isOplogThrottled(const string ns);
+        bool isOplogThrottled(const string& ns) const;
+
+        // Records how far behind the primary each op of an applied batch was
+        static void recordApplyLag(const std::deque<BSONObj>& ops);
+
+        // True if ops on ns may be spread across writers by _id: the collection must not be
+        // capped (insertion order matters) and must have no unique index other than _id
+        // (the order of writes to different documents could then matter).
+        static bool canPartitionById(const string& ns);
+
+        // Namespaces whose replicated writes are currently being skipped
+        std::set<string> _throttledNamespaces;
     };
 
     /**
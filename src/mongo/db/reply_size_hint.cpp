@@ -0,0 +1,69 @@
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "pch.h"
+
+#include "mongo/db/reply_size_hint.h"
+
+#include "mongo/base/counter.h"
+#include "mongo/db/commands/server_status.h"
+
+namespace mongo {
+
+    static Counter64 replyBufferAllocations;
+    static ServerStatusMetricField<Counter64> displayReplyBufferAllocations(
+            "replyBuffers.allocations", &replyBufferAllocations );
+    static Counter64 replyBufferRegrowths;
+    static ServerStatusMetricField<Counter64> displayReplyBufferRegrowths(
+            "replyBuffers.regrown", &replyBufferRegrowths );
+    static Counter64 replyBufferAllocatedBytes;
+    static ServerStatusMetricField<Counter64> displayReplyBufferAllocatedBytes(
+            "replyBuffers.allocatedBytes", &replyBufferAllocatedBytes );
+    static Counter64 replyBufferUsedBytes;
+    static ServerStatusMetricField<Counter64> displayReplyBufferUsedBytes(
+            "replyBuffers.usedBytes", &replyBufferUsedBytes );
+
+    ReplySizeHint::ReplySizeHint( int minSize, int maxSize ) :
+        _minSize( minSize ),
+        _maxSize( maxSize ) {
+        dassert( minSize > 0 && minSize <= maxSize );
+    }
+
+    int ReplySizeHint::size() const {
+        unsigned highWater = _highWater.loadRelaxed();
+        // a little slack, so that replies of about the usual size needn't grow
+        unsigned wanted = highWater + highWater / 8;
+        int size = _minSize;
+        while ( (unsigned)size < wanted && size < _maxSize )
+            size *= 2;
+        return size;
+    }
+
+    void ReplySizeHint::noteReply( int initialSize, const BufBuilder& b ) {
+        replyBufferAllocations.increment();
+        if ( b.getSize() > initialSize )
+            replyBufferRegrowths.increment();
+        replyBufferAllocatedBytes.increment( b.getSize() );
+        replyBufferUsedBytes.increment( b.len() );
+
+        unsigned len = b.len();
+        unsigned highWater = _highWater.loadRelaxed();
+        unsigned decayed = highWater - highWater / 16;
+        _highWater.store( std::max( len, decayed ) );
+    }
+
+}
@@ -0,0 +1,57 @@
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include "mongo/bson/util/builder.h"
+#include "mongo/platform/atomic_word.h"
+
+namespace mongo {
+
+    /**
+     * The size to allocate the reply buffers of one kind of operation at, learned from the
+     * replies recently built for it.
+     *
+     * A reply is built in a malloc()ed BufBuilder, whose buffer is then handed to the Message
+     * sent without a copy.  A fixed initial size is either mostly wasted, like 32KB for a query
+     * returning one small document, or grown by reallocating and copying the reply several
+     * times, like 512 bytes for a command with a large result.  The hint is a high-water mark of
+     * the recent replies' sizes, which drops by a sixteenth with each smaller reply, rounded up
+     * to a power of two: the size classes malloc() and BufBuilder's own growth use.
+     *
+     * Shared by the threads building replies; a racing update may lose one reply's size, which
+     * only delays adapting to it.  Every reply noted is counted in the serverStatus metrics
+     * replyBuffers.*.
+     */
+    class ReplySizeHint {
+    public:
+        /** hints sizes from minSize up to maxSize, both powers of two */
+        ReplySizeHint( int minSize, int maxSize );
+
+        /** @return the size to allocate the next reply's buffer at */
+        int size() const;
+
+        /** notes reply b, finished, whose buffer was allocated at initialSize bytes */
+        void noteReply( int initialSize, const BufBuilder& b );
+
+    private:
+        const int _minSize;
+        const int _maxSize;
+        AtomicUInt32 _highWater;
+    };
+
+}
@@ -20,13 +20,98 @@
 
 #include "pch.h"
 #include "scanandorder.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include "mongo/base/counter.h"
+#include "mongo/bson/key_string.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/matcher.h"
+#include "mongo/db/pipeline/spill_runs.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/util/mongoutils/str.h"
 
 namespace mongo {
 
+    extern string dbpath; // --dbpath parm
+
     const unsigned ScanAndOrder::MaxScanAndOrderBytes = 32 * 1024 * 1024;
 
+    // the largest limit + skip sorted with a heap of that many entries
+    MONGO_EXPORT_SERVER_PARAMETER( scanAndOrderTopKMaxLimit, int, 1000 );
+
+    MONGO_EXPORT_SERVER_PARAMETER( scanAndOrderMaxDiskBytes, int, 0 );
+
+    namespace {
+        const int NoLimit = 0x7fffffff;
+
+        const char* const TooMuchDataMessage =
+                "too much data for sort() with no index.  add an index or specify a smaller limit";
+    }
+
+    static Counter64 topKCounter;
+    static ServerStatusMetricField<Counter64> displayTopK( "operation.scanAndOrderTopK",
+                                                           &topKCounter );
+    static Counter64 spilledRunsCounter;
+    static ServerStatusMetricField<Counter64> displaySpilledRuns( "operation.scanAndOrderSpills",
+                                                                  &spilledRunsCounter );
+
+    ScanAndOrder::ScanAndOrder(int startFrom, int limit, const BSONObj &order,
+                               const FieldRangeSet &frs, const ParsedQuery *parsedQuery,
+                               bool mayUseDisk) :
+        _startFrom(startFrom),
+        _order(order, frs),
+        _mayUseDisk(mayUseDisk && scanAndOrderMaxDiskBytes > 0),
+        _maxDiskBytes(scanAndOrderMaxDiskBytes),
+        _spilledBytes(0),
+        _addedBytes(0),
+        _largestAdded(0),
+        _projection(parsedQuery ? parsedQuery->getFields() : NULL),
+        // an Ordering holds the directions of up to 32 fields
+        _encodeKeys( order.nFields() <= 32 ),
+        _ordering( Ordering::make( _encodeKeys ? order : BSONObj() ) ),
+        _approxSize(0),
+        _nextSeq(0) {
+        _limit = limit > 0 ? limit + _startFrom : NoLimit;
+        _topK = limit > 0 && _limit <= scanAndOrderTopKMaxLimit;
+        if ( _topK ) {
+            _data.reserve( _limit );
+            topKCounter.increment();
+        }
+        if ( _projection &&
+             _projection->getArrayOpType() == Projection::ARRAY_OP_POSITIONAL ) {
+            // the projection specified an array positional match operator; create a new
+            // matcher for the projected array
+            _arrayMatcher.reset( new Matcher( parsedQuery->getFilter() ) );
+            _details.reset( new MatchDetails );
+            _details->requestElemMatchKey();
+        }
+    }
+
+    ScanAndOrder::~ScanAndOrder() {
+    }
+
+    size_t ScanAndOrder::numSpilledRuns() const {
+        return _runs ? _runs->numRuns() : 0;
+    }
+
+    bool ScanAndOrder::EntryCmp::operator()( const Entry& l, const Entry& r ) const {
+        int c;
+        if ( l.keyLen && r.keyLen ) {
+            const char* lBytes = _s._keyBytes.data() + l.keyOffset;
+            const char* rBytes = _s._keyBytes.data() + r.keyOffset;
+            c = memcmp( lBytes, rBytes, std::min( l.keyLen, r.keyLen ) );
+            if ( c == 0 )
+                c = (int)l.keyLen - (int)r.keyLen;
+        }
+        else {
+            c = l.key.woCompare( r.key, _s._order._spec.keyPattern );
+        }
+        if ( c )
+            return c < 0;
+        return l.seq < r.seq;
+    }
+
     void ScanAndOrder::add(const BSONObj& o, const DiskLoc* loc) {
         verify( o.isValid() );
         BSONObj k;
@@ -45,77 +130,261 @@ namespace mongo {
         if ( k.isEmpty() ) {
             return;   
         }
-        if ( (int) _best.size() < _limit ) {
-            _add(k, o, loc);
+        if ( _topK )
+            _addTopK(k, o, loc);
+        else
+            _addBuffered(k, o, loc);
+    }
+
+    namespace {
+
+        /** Writes sorted, projected results to a query reply, skipping and limiting them. */
+        class ResultWriter {
+        public:
+            ResultWriter( BufBuilder& b, int startFrom, int limit ) :
+                _b( b ),
+                _startFrom( startFrom ),
+                _limit( limit ),
+                _n(),
+                _nFilled() {
+            }
+
+            /** @return false once no more results are wanted. */
+            bool write( const BSONObj& o ) {
+                _n++;
+                if ( _n <= _startFrom )
+                    return true;
+                _b.appendBuf( (void*) o.objdata(), o.objsize() );
+                uassert( ScanAndOrderMemoryLimitExceededAssertionCode, TooMuchDataMessage,
+                         (unsigned)_b.len() < ScanAndOrder::MaxScanAndOrderBytes );
+                _nFilled++;
+                return _nFilled < _limit;
+            }
+
+            int nFilled() const { return _nFilled; }
+
+        private:
+            BufBuilder& _b;
+            int _startFrom;
+            int _limit;
+            int _n;
+            int _nFilled;
+        };
+
+        /** The next result of a spilled run. */
+        struct RunHead {
+            BSONObj key;
+            BSONObj doc;
+            size_t run;
+        };
+
+        /** Puts the best run head on top of a heap: the lowest key, then the earliest run. */
+        class RunHeadCmp {
+        public:
+            explicit RunHeadCmp( const BSONObj& order ) : _order( order ) {}
+            bool operator()( const RunHead& l, const RunHead& r ) const {
+                int c = l.key.woCompare( r.key, _order );
+                if ( c )
+                    return c > 0;
+                return l.run > r.run;
+            }
+        private:
+            BSONObj _order;
+        };
+
+        bool readRunHead( SpillRuns::Reader& reader, size_t run, RunHead& head ) {
+            if ( !reader.more() )
+                return false;
+            head.key = reader.next();
+            head.doc = reader.next();
+            head.run = run;
+            return true;
+        }
+
+    } // namespace
+
+    void ScanAndOrder::fill( BufBuilder& b, int& nout ) {
+        ResultWriter writer( b, _startFrom, _limit );
+
+        if ( !_runs ) {
+            EntryCmp cmp( *this );
+            if ( _topK )
+                std::sort_heap( _data.begin(), _data.end(), cmp );
+            else
+                std::sort( _data.begin(), _data.end(), cmp );
+            for ( vector<Entry>::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
+                if ( !writer.write( i->doc ) )
+                    break;
+            }
+            nout = writer.nFilled();
             return;
         }
-        BestMap::iterator i;
-        verify( _best.end() != _best.begin() );
-        i = _best.end();
-        i--;
-        _addIfBetter(k, o, i, loc);
-    }
 
+        if ( !_data.empty() )
+            _spill();
 
-    void ScanAndOrder::fill( BufBuilder& b, const ParsedQuery *parsedQuery, int& nout ) const {
-        int n = 0;
-        int nFilled = 0;
-        Projection *projection = parsedQuery ? parsedQuery->getFields() : NULL;
-        scoped_ptr<Matcher> arrayMatcher;
-        scoped_ptr<MatchDetails> details;
-        if ( projection && projection->getArrayOpType() == Projection::ARRAY_OP_POSITIONAL ) {
-            // the projection specified an array positional match operator; create a new matcher
-            // for the projected array
-            arrayMatcher.reset( new Matcher( parsedQuery->getFilter() ) );
-            details.reset( new MatchDetails );
-            details->requestElemMatchKey();
-        }
-        for ( BestMap::const_iterator i = _best.begin(); i != _best.end(); i++ ) {
-            n++;
-            if ( n <= _startFrom )
-                continue;
-            const BSONObj& o = i->second;
-            massert( 16355, "positional operator specified, but no array match",
-                     ! arrayMatcher || arrayMatcher->matches( o, details.get() ) );
-            fillQueryResultFromObj( b, projection, o, details.get() );
-            nFilled++;
-            if ( nFilled >= _limit )
+        // merge the runs, each of them sorted and holding results added after the previous one's
+        const size_t nRuns = _runs->numRuns();
+        vector<boost::shared_ptr<SpillRuns::Reader> > readers;
+        vector<RunHead> heap;
+        readers.reserve( nRuns );
+        heap.reserve( nRuns );
+        for ( size_t i = 0; i < nRuns; ++i ) {
+            readers.push_back( boost::shared_ptr<SpillRuns::Reader>( _runs->openRun( i ) ) );
+            RunHead head;
+            if ( readRunHead( *readers[ i ], i, head ) )
+                heap.push_back( head );
+        }
+        RunHeadCmp cmp( _order._spec.keyPattern );
+        std::make_heap( heap.begin(), heap.end(), cmp );
+        while ( !heap.empty() ) {
+            std::pop_heap( heap.begin(), heap.end(), cmp );
+            RunHead& head = heap.back();
+            if ( !writer.write( head.doc ) )
                 break;
+            if ( !readRunHead( *readers[ head.run ], head.run, head ) )
+                heap.pop_back();
+            else
+                std::push_heap( heap.begin(), heap.end(), cmp );
         }
-        nout = nFilled;
+        nout = writer.nFilled();
     }
 
-    void ScanAndOrder::_add(const BSONObj& k, const BSONObj& o, const DiskLoc* loc) {
-        BSONObj docToReturn = o;
-        if ( loc ) {
+    void ScanAndOrder::_makeEntry(const BSONObj& k, const BSONObj& o, const DiskLoc* loc,
+                                  Entry& e) {
+        if ( _projection ) {
+            massert( 16355, "positional operator specified, but no array match",
+                     ! _arrayMatcher || _arrayMatcher->matches( o, _details.get() ) );
+            BSONObjBuilder b;
+            _projection->transform( o, b, _details.get() );
+            if ( loc )
+                b.append("$diskLoc", loc->toBSONObj());
+            e.doc = b.obj();
+        }
+        else if ( loc ) {
             BSONObjBuilder b;
             b.appendElements(o);
             b.append("$diskLoc", loc->toBSONObj());
-            docToReturn = b.obj();
+            e.doc = b.obj();
+        }
+        else {
+            e.doc = o.getOwned();
+        }
+        e.key = k.getOwned();
+        e.seq = _nextSeq++;
+        e.keyOffset = 0;
+        e.keyLen = 0;
+    }
+
+    void ScanAndOrder::_addTopK(const BSONObj& k, const BSONObj& o, const DiskLoc* loc) {
+        EntryCmp cmp( *this );
+        if ( (int) _data.size() < _limit ) {
+            Entry e;
+            _makeEntry( k, o, loc, e );
+            _validateAndUpdateApproxSize( e.key.objsize() + e.doc.objsize() );
+            _data.push_back( e );
+            std::push_heap( _data.begin(), _data.end(), cmp );
+            return;
+        }
+        // only a key better than the worst kept replaces it; later equal keys lose
+        const Entry& worst = _data.front();
+        if ( k.woCompare( worst.key, _order._spec.keyPattern ) >= 0 )
+            return;
+        Entry e;
+        _makeEntry( k, o, loc, e );
+        _validateAndUpdateApproxSize( e.key.objsize() + e.doc.objsize() -
+                                      worst.key.objsize() - worst.doc.objsize() );
+        std::pop_heap( _data.begin(), _data.end(), cmp );
+        _data.back() = e;
+        std::push_heap( _data.begin(), _data.end(), cmp );
+    }
+
+    void ScanAndOrder::_addBuffered(const BSONObj& k, const BSONObj& o, const DiskLoc* loc) {
+        Entry e;
+        _makeEntry( k, o, loc, e );
+        _checkReturnedSize( e );
+        int size = e.key.objsize() + e.doc.objsize();
+        // allows for a KeyString up to twice the size of the key
+        if ( _mayUseDisk && !_data.empty() &&
+             _approxSize + size + e.key.objsize() >= MaxScanAndOrderBytes ) {
+            _spill();
         }
-        _validateAndUpdateApproxSize( k.objsize() + docToReturn.objsize() );
-        _best.insert(make_pair(k.getOwned(),docToReturn.getOwned()));
+        // keys are encoded as they are added, as a sort compares each of them many times
+        if ( _encodeKeys ) {
+            e.keyOffset = _keyBytes.size();
+            if ( KeyString::encode( e.key, _ordering, true, _keyBytes ) ) {
+                e.keyLen = _keyBytes.size() - e.keyOffset;
+            }
+            else {
+                _keyBytes.resize( e.keyOffset );
+            }
+        }
+        _validateAndUpdateApproxSize( size + e.keyLen );
+        _data.push_back( e );
+        if ( _data.size() >= 2 * (size_t)_limit )
+            _trim();
+    }
+
+    void ScanAndOrder::_checkReturnedSize( const Entry& e ) {
+        if ( _limit != NoLimit )
+            return;
+        // at worst the largest results added are skipped
+        _addedBytes += e.doc.objsize();
+        _largestAdded = std::max( _largestAdded, e.doc.objsize() );
+        uassert( ScanAndOrderMemoryLimitExceededAssertionCode, TooMuchDataMessage,
+                 _addedBytes - (long long)_startFrom * _largestAdded <
+                 (long long)MaxScanAndOrderBytes );
     }
-    
-    void ScanAndOrder::_addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i,
-                                    const DiskLoc* loc) {
-        const BSONObj& worstBestKey = i->first;
-        int cmp = worstBestKey.woCompare(k, _order._spec.keyPattern);
-        if ( cmp > 0 ) {
-            // k is better, 'upgrade'
-            _validateAndUpdateApproxSize( -i->first.objsize() + -i->second.objsize() );
-            _best.erase(i);
-            _add(k, o, loc);
+
+    void ScanAndOrder::_trim() {
+        EntryCmp cmp( *this );
+        std::nth_element( _data.begin(), _data.begin() + _limit, _data.end(), cmp );
+        _data.resize( _limit );
+        // repack the kept entries' KeyStrings
+        string keyBytes;
+        _approxSize = 0;
+        for ( vector<Entry>::iterator i = _data.begin(); i != _data.end(); ++i ) {
+            if ( i->keyLen ) {
+                size_t offset = keyBytes.size();
+                keyBytes.append( _keyBytes, i->keyOffset, i->keyLen );
+                i->keyOffset = offset;
+            }
+            _approxSize += i->key.objsize() + i->doc.objsize() + i->keyLen;
+        }
+        _keyBytes.swap( keyBytes );
+    }
+
+    void ScanAndOrder::_spill() {
+        std::sort( _data.begin(), _data.end(), EntryCmp( *this ) );
+        // no more than the best _limit results of a run can be returned
+        size_t n = std::min( _data.size(), (size_t)_limit );
+        for ( size_t i = 0; i < n; ++i ) {
+            _spilledBytes += _data[ i ].key.objsize() + _data[ i ].doc.objsize();
+        }
+        uassert( ScanAndOrderMemoryLimitExceededAssertionCode,
+                 "too much data for sort() with no index to spill to disk.  add an index, "
+                 "specify a smaller limit or raise scanAndOrderMaxDiskBytes",
+                 _spilledBytes <= _maxDiskBytes );
+        if ( !_runs )
+            _runs.reset( new SpillRuns( ( boost::filesystem::path( dbpath ) / "_tmp" ).string() ) );
+        _runs->startRun();
+        for ( size_t i = 0; i < n; ++i ) {
+            _runs->append( _data[ i ].key );
+            _runs->append( _data[ i ].doc );
         }
+        _runs->finishRun();
+        spilledRunsCounter.increment();
+        _data.clear();
+        _keyBytes.clear();
+        _approxSize = 0;
     }
 
     void ScanAndOrder::_validateAndUpdateApproxSize( const int approxSizeDelta ) {
         // note : adjust when bson return limit adjusts. note this limit should be a bit higher.
         int newApproxSize = _approxSize + approxSizeDelta;
         verify( newApproxSize >= 0 );
-        uassert( ScanAndOrderMemoryLimitExceededAssertionCode,
-                "too much data for sort() with no index.  add an index or specify a smaller limit",
-                (unsigned)newApproxSize < MaxScanAndOrderBytes );
+        uassert( ScanAndOrderMemoryLimitExceededAssertionCode, TooMuchDataMessage,
+                 (unsigned)newApproxSize < MaxScanAndOrderBytes );
         _approxSize = newApproxSize;
     }
 
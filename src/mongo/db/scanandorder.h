@@ -73,40 +73,105 @@ namespace mongo {
         }
     }
 
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
-    class ScanAndOrder {
+    class Matcher;
+    class MatchDetails;
+    class SpillRuns;
+
+    /**
+     * The most bytes of sorted results an in memory sort may write under the dbpath's _tmp
+     * directory.  Settable with setParameter; 0, the default, keeps sorts in memory.
+     */
+    extern int scanAndOrderMaxDiskBytes;
+
+    /**
+     * Sorts query results that aren't returned in order by their index.
+     *
+     * If a limit is given and limit + skip is at most scanAndOrderTopKMaxLimit, the best results
+     * are kept in a heap of that many entries, reserved up front, whose worst result is replaced
+     * by each better one; a result is only copied once its pre-extracted sort key beats the
+     * worst one kept.  Otherwise results are buffered unsorted (trimmed to the best limit + skip
+     * whenever twice that many are held) and sorted when the scan is complete, comparing their
+     * keys' KeyStrings.  If the buffer would outgrow MaxScanAndOrderBytes, disk use is allowed
+     * and scanAndOrderMaxDiskBytes is set, it is sorted and written out as a run under the
+     * dbpath's _tmp directory, and the runs are merged when the results are filled in.
+     *
+     * Results are projected as they are added, so only the fields to be returned are held in
+     * memory or written out.
+     */
+    class ScanAndOrder : boost::noncopyable {
     public:
         static const unsigned MaxScanAndOrderBytes;
 
-        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs) :
-            _best( BSONObjCmp( order ) ),
-            _startFrom(startFrom), _order(order, frs) {
-            _limit = limit > 0 ? limit + _startFrom : 0x7fffffff;
-            _approxSize = 0;
-        }
+        /** @param parsedQuery supplies the projection of the results, if not NULL. */
+        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs,
+                     const ParsedQuery *parsedQuery = NULL, bool mayUseDisk = false);
+        ~ScanAndOrder();
 
-        int size() const { return _best.size(); }
+        /** @return the number of results held in memory. */
+        int size() const { return _data.size(); }
 
         /**
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if adding would grow memory usage
-         * to ScanAndOrder::MaxScanAndOrderBytes.
+         * to ScanAndOrder::MaxScanAndOrderBytes and results may not be spilled to disk, if the
+         * spilled results would pass scanAndOrderMaxDiskBytes, or if the results to return
+         * past the skip are sure to take MaxScanAndOrderBytes.
          */
         void add(const BSONObj &o, const DiskLoc* loc);
 
-        /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, const ParsedQuery *query, int& nout) const;
+        /**
+         * Scanning complete.  Stick the query result in b for n objects.  May be called once.
+         * @throw ScanAndOrderMemoryLimitExceededAssertionCode if the results would take
+         * MaxScanAndOrderBytes.
+         */
+        void fill(BufBuilder& b, int& nout);
 
     /** Functions for testing. */
     protected:
 
         unsigned approxSize() const { return _approxSize; }
 
+        bool usingTopK() const { return _topK; }
+
+        size_t numSpilledRuns() const;
+
     private:
 
-        void _add(const BSONObj& k, const BSONObj& o, const DiskLoc* loc);
+        /** A result, numbered in the order it was added so equal keys keep that order. */
+        struct Entry {
+            BSONObj key;
+            BSONObj doc;
+            unsigned long long seq;
+            size_t keyOffset; // of the key's KeyString in _keyBytes
+            unsigned keyLen;  // 0 if the key has no KeyString
+        };
+
+        /** Orders entries by key, then by the order they were added. */
+        class EntryCmp {
+        public:
+            explicit EntryCmp( const ScanAndOrder& s ) : _s( s ) {}
+            bool operator()( const Entry& l, const Entry& r ) const;
+        private:
+            const ScanAndOrder& _s;
+        };
+
+        void _addTopK(const BSONObj& k, const BSONObj& o, const DiskLoc* loc);
+
+        void _addBuffered(const BSONObj& k, const BSONObj& o, const DiskLoc* loc);
+
+        /** sets up e for k and the document to return for o, both owned */
+        void _makeEntry(const BSONObj& k, const BSONObj& o, const DiskLoc* loc, Entry& e);
+
+        /**
+         * @throw ScanAndOrderMemoryLimitExceededAssertionCode once all results are to be
+         * returned and those past the skip must take MaxScanAndOrderBytes.
+         */
+        void _checkReturnedSize(const Entry& e);
+
+        /** keeps the best _limit buffered entries */
+        void _trim();
 
-        void _addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i,
-                          const DiskLoc* loc);
+        /** sorts the buffered entries and writes them out as a run */
+        void _spill();
 
         /**
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if approxSize would grow too high,
@@ -114,11 +179,25 @@ namespace mongo {
          */
         void _validateAndUpdateApproxSize( const int approxSizeDelta );
 
-        BestMap _best; // key -> full object
         int _startFrom;
         int _limit;   // max to send back.
         KeyType _order;
+        bool _topK;
+        bool _mayUseDisk;
+        long long _maxDiskBytes;
+        long long _spilledBytes;
+        long long _addedBytes;  // of the results added if all are returned
+        int _largestAdded;
+        Projection* _projection;
+        scoped_ptr<Matcher> _arrayMatcher;
+        scoped_ptr<MatchDetails> _details;
+        bool _encodeKeys; // whether buffered keys get KeyStrings
+        Ordering _ordering;
         unsigned _approxSize;
+        vector<Entry> _data; // a heap with the worst entry in front if _topK
+        string _keyBytes;    // KeyStrings of the buffered keys
+        unsigned long long _nextSeq;
+        scoped_ptr<SpillRuns> _runs;
 
     };
 
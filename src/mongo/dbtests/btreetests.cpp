@@ -59,3 +59,20 @@ namespace BtreeTests1 {
 namespace BtreeTests2 {
 #include "btreetests.inl"
 }
+
+#undef TESTTWOSTEP
+#undef BtreeBucket
+#undef btree
+#undef btreemod
+#undef Continuation
+#define BtreeBucket BtreeBucket<V2>
+#define btree btree<V2>
+#define btreemod btreemod<V2>
+#define Continuation IndexInsertionContinuationImpl<V2>
+#undef testName
+#define testName "btree2"
+#undef BTVERSION
+#define BTVERSION 2
+namespace BtreeTests3 {
+#include "btreetests.inl"
+}
@@ -1635,6 +1635,82 @@
         }
     };
 
+    class DuplicateKeys : public Base {
+    public:
+        void run() {
+            BSONObj key = simpleKey( 'a', 100 );
+            Ordering o = Ordering::make( order() );
+            for( int i = 0; i < 200; ++i ) {
+                bt()->bt_insert( dl(), DiskLoc( 0, 2 + 2 * i ), key, o, true, id(), true );
+                getDur().commitIfNeeded();
+            }
+            checkValid( 200 );
+#if BTVERSION == 2
+            // the duplicates share one copy of their key, which leaves room for all of them
+            ASSERT_EQUALS( 200, bt()->nKeys() );
+            ASSERT_EQUALS( BtreeBucket::KeyOwned( key ).dataSize(), (int) bt()->getTopSize() );
+#endif
+            for( int i = 0; i < 200; i += 2 ) {
+                ASSERT( bt()->unindex( dl(), id(), key, DiskLoc( 0, 2 + 2 * i ) ) );
+                getDur().commitIfNeeded();
+            }
+            checkValid( 100 );
+        }
+    };
+
+    class MixedTypeKeys : public Base {
+    public:
+        void run() {
+            BSONArray values = BSON_ARRAY( MINKEY << BSONNULL << -1e300 << -1 << -0.5 << 0 <<
+                                           (long long)( 1LL << 60 ) << 3.5 << 4 <<
+                                           "" << "a" << "ab" << "abc" << "abcd" << "abd" <<
+                                           OID( "4f0000000000000000000001" ) << false << true <<
+                                           Date_t( 5 ) << MAXKEY );
+            Ordering o = Ordering::make( order() );
+            int n = 0;
+            BSONForEach( e, values ) {
+                BSONObjBuilder b;
+                b.appendAs( e, "a" );
+                BSONObj key = b.obj();
+                bt()->bt_insert( dl(), recordLoc(), key, o, true, id(), true );
+                ++n;
+            }
+            checkValid( n );
+            BSONForEach( e, values ) {
+                BSONObjBuilder b;
+                b.appendAs( e, "a" );
+                BSONObj key = b.obj();
+                ASSERT( present( key, 1 ) );
+                ASSERT( present( key, -1 ) );
+            }
+            // equal to stored keys, in another form
+            BSONObj negZero = BSON( "a" << -0.0 );
+            ASSERT( present( negZero, 1 ) );
+            BSONObj four = BSON( "a" << 4.0 );
+            ASSERT( present( four, 1 ) );
+            BSONObj missing = BSON( "a" << "abcc" );
+            ASSERT( !present( missing, 1 ) );
+        }
+    };
+
+    class PrefixedQueries : public Base {
+    public:
+        void run() {
+            DBDirectClient c;
+            c.ensureIndex( ns(), BSON( "b" << 1 ), false, "", false, false, BTVERSION );
+            c.ensureIndex( ns(), BSON( "c" << -1 ), false, "", false, false, BTVERSION );
+            for( int i = 0; i < 1000; ++i ) {
+                // strings sharing their first bytes, which their prefixes can't order
+                string s = str::stream() << "abc" << ( i % 100 );
+                c.insert( ns(), BSON( "b" << s << "c" << ( i % 50 ) * 0.5 ) );
+            }
+            ASSERT_EQUALS( 30U, c.count( ns(), fromjson( "{b:{$in:['abc1','abc17','abc99']}}" ) ) );
+            ASSERT_EQUALS( 110U, c.count( ns(), fromjson( "{b:{$gte:'abc5',$lt:'abc6'}}" ) ) );
+            ASSERT_EQUALS( 80U, c.count( ns(), fromjson( "{c:{$in:[0,2.5,-1,24.5,100,5]}}" ) ) );
+            ASSERT_EQUALS( 60U, c.count( ns(), fromjson( "{c:{$gt:1,$lte:2.5}}" ) ) );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( testName ) {
@@ -1720,5 +1796,8 @@
             add< DelInternalSplitPromoteLeft >();
             add< DelInternalSplitPromoteRight >();
             add< SignedZeroDuplication >();
+            add< DuplicateKeys >();
+            add< MixedTypeKeys >();
+            add< PrefixedQueries >();
         }
     } myall;
@@ -19,6 +19,7 @@
 #include "pch.h"
 
 #include "../s/chunk.h"
+#include "mongo/db/hasher.h"
 #include "mongo/db/json.h"
 
 #include "dbtests.h"
@@ -31,8 +32,7 @@ namespace mongo {
             const_cast<ShardKeyPattern&>(_key) = ShardKeyPattern( keyPattern );
         }
         void setSingleChunkForShards( const vector<BSONObj> &splitPoints ) {
-            ChunkMap &chunkMap = const_cast<ChunkMap&>( _chunkMap );
-            ChunkRangeManager &chunkRanges = const_cast<ChunkRangeManager&>( _chunkRanges );
+            ChunkTable &chunkTable = const_cast<ChunkTable&>( _chunkTable );
             set<Shard> &shards = const_cast<set<Shard>&>( _shards );
             
             vector<BSONObj> mySplitPoints( splitPoints );
@@ -46,10 +46,10 @@ namespace mongo {
                 
                 ChunkPtr chunk( new Chunk( this, mySplitPoints[ i-1 ], mySplitPoints[ i ],
                                           shard ) );
-                chunkMap[ mySplitPoints[ i ] ] = chunk;
+                chunkTable.insert( make_pair( mySplitPoints[ i ], chunk ) );
             }
             
-            chunkRanges.reloadAll( chunkMap );
+            chunkTable.seal();
         }
     };
     
@@ -229,13 +229,81 @@ namespace ChunkTests {
                 return BSON( "a" << BSON( "$in" << BSON_ARRAY( 0 << 5 << 10 ) ) <<
                              "b" << BSON( "$in" << BSON_ARRAY( 0 << 5 << 25 ) ) );
             }
-            // If we were to send this query to just the shards it actually needed to hit, it would only hit shards 0 and 2
-            // Because of the optimization from SERVER-4745, however, we'll also hit shard 1.
+            // The points of both fields multiply, so shard 1, between { a : 5 , b : 10 } and
+            // { a : 5 , b : 20 }, isn't hit.
+            virtual BSONArray expectedShardNames() const {
+                return BSON_ARRAY( "0" << "2" );
+            }
+        };
+
+        class InThenRangeMultiShard : public CompoundKeyBase {
+            virtual BSONObj query() const {
+                return BSON( "a" << BSON( "$in" << BSON_ARRAY( 0 << 5 ) ) <<
+                             "b" << GT << 21 );
+            }
+            virtual BSONArray expectedShardNames() const {
+                return BSON_ARRAY( "0" << "2" );
+            }
+        };
+
+        class PrefixEqualitySingleShard : public CompoundKeyBase {
+            virtual BSONObj query() const { return BSON( "a" << 6 ); }
+            virtual BSONArray expectedShardNames() const { return BSON_ARRAY( "2" ); }
+        };
+
+        class PrefixEqualityMultiShard : public CompoundKeyBase {
+            virtual BSONObj query() const { return BSON( "a" << 5 ); }
             virtual BSONArray expectedShardNames() const {
                 return BSON_ARRAY( "0" << "1" << "2" );
             }
         };
 
+        class HashedInMultiShard : public Base {
+            virtual BSONObj shardKey() const { return BSON( "a" << "hashed" ); }
+            virtual BSONArray splitPoints() const {
+                return BSON_ARRAY( BSON( "a" << -( 1LL << 62 ) ) << BSON( "a" << 0LL ) <<
+                                   BSON( "a" << ( 1LL << 62 ) ) );
+            }
+            virtual BSONObj query() const { return fromjson( "{a:{$in:[1,'x']}}" ); }
+            /** just the shards the two hashes fall in */
+            virtual BSONArray expectedShardNames() const {
+                set<string> names;
+                names.insert( shardFor( BSON( "a" << 1 ) ) );
+                names.insert( shardFor( BSON( "a" << "x" ) ) );
+                BSONArrayBuilder b;
+                for ( set<string>::const_iterator i = names.begin(); i != names.end(); ++i )
+                    b << *i;
+                return b.arr();
+            }
+            static string shardFor( const BSONObj& o ) {
+                long long h = BSONElementHasher::hash64( o.firstElement(),
+                                                         BSONElementHasher::DEFAULT_HASH_SEED );
+                return h < -( 1LL << 62 ) ? "0" : h < 0 ? "1" : h < ( 1LL << 62 ) ? "2" : "3";
+            }
+        };
+
+        class RoutingCacheHit : public MultiShardBase {
+        public:
+            void run() {
+                ChunkManager chunkManager;
+                chunkManager.setShardKey( shardKey() );
+                chunkManager.setSingleChunkForShards( splitPointsVector() );
+
+                BSONObj q = fromjson( "{a:{$in:['u','y']}}" );
+                set<Shard> first;
+                chunkManager.getShardsForQuery( first, q );
+                set<Shard> second;
+                chunkManager.getShardsForQuery( second, q.copy() );
+                ASSERT( first == second );
+                ASSERT_EQUALS( 2U, second.size() );
+
+                // the same values under another field name aren't the same query
+                set<Shard> other;
+                chunkManager.getShardsForQuery( other, fromjson( "{b:{$in:['u','y']}}" ) );
+                ASSERT_EQUALS( 4U, other.size() );
+            }
+        };
+
     } // namespace ChunkManagerTests
     
     class All : public Suite {
@@ -264,6 +332,11 @@ namespace ChunkTests {
             add<ChunkManagerTests::InequalityThenUnsatisfiable>();
             add<ChunkManagerTests::OrEqualityUnsatisfiableInequality>();
             add<ChunkManagerTests::InMultiShard>();
+            add<ChunkManagerTests::InThenRangeMultiShard>();
+            add<ChunkManagerTests::PrefixEqualitySingleShard>();
+            add<ChunkManagerTests::PrefixEqualityMultiShard>();
+            add<ChunkManagerTests::HashedInMultiShard>();
+            add<ChunkManagerTests::RoutingCacheHit>();
         }
     } myall;
     
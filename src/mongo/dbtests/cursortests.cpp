@@ -25,6 +25,7 @@
 #include "mongo/db/json.h"
 #include "mongo/db/queryutil.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/processinfo.h"
 
 namespace CursorTests {
 
@@ -557,6 +558,46 @@ namespace CursorTests {
                 ASSERT( !cursor->advance() );
             }
         };
+
+        /**
+         * A btree cursor reads ahead the records of the keys following its own in its bucket, up
+         * to its end key.
+         */
+        class WillNeedAhead : public Base {
+        public:
+            void run() {
+                _c.dropCollection( ns() );
+                _c.ensureIndex( ns(), BSON( "a" << 1 ) );
+                for( int i = 0; i < 100; ++i ) {
+                    _c.insert( ns(), BSON( "a" << i ) );
+                }
+                Client::ReadContext ctx( ns() );
+                const long long pageSize = ProcessInfo::getPageSize();
+                // all the keys fit in the root bucket
+                scoped_ptr<Cursor> forward( BtreeCursor::make( nsdetails( ns() ),
+                                                               nsdetails( ns() )->idx( 1 ),
+                                                               BSON( "" << 10 ),
+                                                               BSON( "" << 19 ),
+                                                               true,
+                                                               1 ) );
+                ASSERT_EQUALS( 10 * pageSize, forward->willNeedAhead( 1024 * 1024 ) );
+                ASSERT_EQUALS( 3 * pageSize, forward->willNeedAhead( 3 * pageSize ) );
+                while( forward->currKey()[ 0 ].number() < 19 ) {
+                    ASSERT( forward->advance() );
+                }
+                ASSERT_EQUALS( pageSize, forward->willNeedAhead( 1024 * 1024 ) );
+                ASSERT( !forward->advance() );
+                ASSERT_EQUALS( 0, forward->willNeedAhead( 1024 * 1024 ) );
+
+                scoped_ptr<Cursor> reverse( BtreeCursor::make( nsdetails( ns() ),
+                                                               nsdetails( ns() )->idx( 1 ),
+                                                               BSON( "" << 19 ),
+                                                               BSON( "" << 10 ),
+                                                               false,
+                                                               -1 ) );
+                ASSERT_EQUALS( 9 * pageSize, reverse->willNeedAhead( 1024 * 1024 ) );
+            }
+        };
         
     } // namespace BtreeCursor
     
@@ -795,6 +836,7 @@ namespace CursorTests {
             add<BtreeCursor::TypeBracketedUpperBoundWithoutMatcher>();
             add<BtreeCursor::TypeBracketedLowerBoundWithoutMatcher>();
             add<BtreeCursor::ReverseDirectionStartEndKeys>();
+            add<BtreeCursor::WillNeedAhead>();
             add<ClientCursor::HandleDelete>();
             add<ClientCursor::AboutToDelete>();
             add<ClientCursor::AboutToDeleteDuplicate>();
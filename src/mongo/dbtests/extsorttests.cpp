@@ -199,6 +199,41 @@ namespace ExtSortTests {
         }
     };
 
+    /** Sort 2e5 values in memory, split across several sort threads and merged back. */
+    class SortInMemoryParallel {
+    public:
+        SortInMemoryParallel() : _threads( externalSortThreads ) {
+            externalSortThreads = 4;
+        }
+        ~SortInMemoryParallel() {
+            externalSortThreads = _threads;
+        }
+        void run() {
+            const int total = 200000;
+            BSONObjExternalSorter sorter( _arbitraryIndexInterface, BSONObj() , 1024 * 1024 * 100 );
+            for ( int i=0; i<total; i++ ) {
+                sorter.add( BSON( "x" << rand() % 10000 ), DiskLoc( 5, i ), false );
+            }
+
+            sorter.sort( false );
+            ASSERT_EQUALS( 0, sorter.numFiles() );
+
+            auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+            int num=0;
+            pair<BSONObj,DiskLoc> prev( BSON( "x" << -1 ), DiskLoc() );
+            while ( i->more() ) {
+                pair<BSONObj,DiskLoc> p = i->next();
+                num++;
+                int cmp = p.first["x"].numberInt() - prev.first["x"].numberInt();
+                ASSERT( cmp > 0 || ( cmp == 0 && prev.second < p.second ) );
+                prev = p;
+            }
+            ASSERT_EQUALS( total, num );
+        }
+    private:
+        int _threads;
+    };
+
     /** Sort 1e6 values. */
     class Sort1e6 {
     public:
@@ -388,6 +423,7 @@ namespace ExtSortTests {
             add<SortByDiskLock>();
             add<Sort1e4>();
             add<Sort1e5>();
+            add<SortInMemoryParallel>();
             add<Sort1e6>();
             add<SortNull>();
             add<Sort130>();
@@ -97,6 +97,40 @@ namespace IndexUpdateTests {
         }
     };
 
+    /** addKeysToPhaseOnes() adds keys for several indexes in a single collection scan. */
+    class AddKeysToPhaseOnes : public IndexBuildBase {
+    public:
+        void run() {
+            // Add some data to the collection, with an array in 'b'.
+            int32_t nDocs = 130;
+            for( int32_t i = 0; i < nDocs; ++i ) {
+                _client.insert( _ns, BSON( "a" << i << "b" << BSON_ARRAY( i << i + 1 ) ) );
+            }
+            IndexSpec specs[ 2 ];
+            specs[ 0 ].reset( BSON( "key" << BSON( "a" << 1 ) << "ns" << _ns << "name" << "a_1" ) );
+            specs[ 1 ].reset( BSON( "key" << BSON( "b" << 1 ) << "ns" << _ns << "name" << "b_1" ) );
+            SortPhaseOne phaseOnes[ 2 ];
+            for( int i = 0; i < 2; ++i ) {
+                phaseOnes[ i ].sorter.reset
+                        ( new BSONObjExternalSorter( IndexInterface::defaultVersion(),
+                                                     specs[ i ].keyPattern ) );
+            }
+            ProgressMeterHolder pm (cc().curop()->setMessage("AddKeysToPhaseOnes",
+                                                             "AddKeysToPhaseOnes Progress",
+                                                             nDocs,
+                                                             nDocs));
+            // Add keys for both indexes.
+            addKeysToPhaseOnes( _ns, specs, phaseOnes, 2, pm.get(), true );
+            // Every document was seen once per index.
+            ASSERT_EQUALS( static_cast<uint64_t>( nDocs ), phaseOnes[ 0 ].n );
+            ASSERT_EQUALS( static_cast<uint64_t>( nDocs ), phaseOnes[ 1 ].n );
+            ASSERT_EQUALS( static_cast<uint64_t>( nDocs ), phaseOnes[ 0 ].nkeys );
+            ASSERT_EQUALS( static_cast<uint64_t>( nDocs * 2 ), phaseOnes[ 1 ].nkeys );
+            ASSERT( !phaseOnes[ 0 ].multi );
+            ASSERT( phaseOnes[ 1 ].multi );
+        }
+    };
+
     /** addKeysToPhaseOne() aborts if the current operation is killed. */
     class InterruptAddKeysToPhaseOne : public IndexBuildBase {
     public:
@@ -584,6 +618,7 @@ namespace IndexUpdateTests {
 
         void setupTests() {
             add<AddKeysToPhaseOne>();
+            add<AddKeysToPhaseOnes>();
             add<InterruptAddKeysToPhaseOne>( false );
             add<InterruptAddKeysToPhaseOne>( true );
             add<BuildBottomUp>();
@@ -27,6 +27,8 @@
 #include "../util/stringutils.h"
 #include "../util/mongoutils/checksum.h"
 #include "../db/key.h"
+#include "mongo/bson/bson_field_index.h"
+#include "mongo/bson/key_string.h"
 #include "mongo/platform/float_utils.h"
 
 namespace JsobjTests {
@@ -2065,6 +2067,192 @@ namespace JsobjTests {
         }
     };
 
+    namespace KeyStringTests {
+
+        /** keys of every type with an exact encoding, with values that compare subtly */
+        BSONArray sampleKeys() {
+            BSONArrayBuilder a;
+            a << BSON( "" << MINKEY ) << BSON( "" << MAXKEY );
+            {
+                BSONObjBuilder b;
+                b.appendUndefined( "" );
+                a << b.obj();
+            }
+            a << BSON( "" << BSONNULL );
+            a << BSON( "" << numeric_limits<double>::quiet_NaN() )
+              << BSON( "" << -numeric_limits<double>::infinity() )
+              << BSON( "" << -1e300 ) << BSON( "" << -1 ) << BSON( "" << -0.0 ) << BSON( "" << 0 )
+              << BSON( "" << 0LL ) << BSON( "" << 1e-300 ) << BSON( "" << 2.5 ) << BSON( "" << 3 )
+              << BSON( "" << ( 1LL << 53 ) ) << BSON( "" << -( 1LL << 53 ) )
+              << BSON( "" << numeric_limits<double>::infinity() );
+            const char withZero[] = "a\0b";
+            {
+                BSONObjBuilder b;
+                b.append( "", withZero, sizeof( withZero ) );
+                a << b.obj();
+            }
+            a << BSON( "" << "" ) << BSON( "" << "a" ) << BSON( "" << "ab" ) << BSON( "" << "b" );
+            {
+                BSONObjBuilder b;
+                b.appendSymbol( "", "ab" );
+                a << b.obj();
+            }
+            a << BSON( "" << BSONObj() ) << BSON( "" << BSON( "a" << 1 ) )
+              << BSON( "" << BSON( "a" << 1 << "b" << 1 ) ) << BSON( "" << BSON( "b" << 0 ) )
+              << BSON( "" << BSON( "a" << "x" ) ) << BSON( "" << BSONArray() )
+              << BSON( "" << BSON_ARRAY( 1 << 2 ) ) << BSON( "" << BSON_ARRAY( 1 << "a" ) );
+            for ( int len = 0; len < 3; len++ ) {
+                BSONObjBuilder b;
+                b.appendBinData( "", len, BinDataGeneral, "ab" );
+                a << b.obj();
+            }
+            a << BSON( "" << OID( "000000000000000000000001" ) )
+              << BSON( "" << OID( "010000000000000000000000" ) )
+              << BSON( "" << false ) << BSON( "" << true )
+              << BSON( "" << Date_t( (unsigned long long) -5LL ) ) << BSON( "" << Date_t( 5 ) );
+            {
+                BSONObjBuilder b;
+                b.appendRegex( "", "a" );
+                b.appendRegex( "", "a", "i" );
+                b.appendRegex( "", "ab" );
+                b.appendCode( "", "f" );
+                BSONObjIterator i( b.obj() );
+                while ( i.more() )
+                    a << i.next().wrap( "" );
+            }
+            return a.arr();
+        }
+
+        int sign( int x ) {
+            return x < 0 ? -1 : x > 0 ? 1 : 0;
+        }
+
+        /** compound keys of the samples, compared with every combination of directions */
+        class MatchesWoCompare {
+        public:
+            void run() {
+                vector<BSONObj> keys;
+                BSONArray samples = sampleKeys();
+                BSONForEach( x, samples ) {
+                    keys.push_back( BSON( "a" << x.Obj().firstElement() ) );
+                    keys.push_back( BSON( "a" << x.Obj().firstElement() << "b" << 1 ) );
+                    keys.push_back( BSON( "a" << 1 << "b" << x.Obj().firstElement() ) );
+                    keys.push_back( BSON( "b" << x.Obj().firstElement() ) );
+                }
+                keys.push_back( BSONObj() );
+
+                const char* orders[] = { "{a:1,b:1}", "{a:-1,b:1}", "{a:1,b:-1}", "{a:-1,b:-1}" };
+                for ( int i = 0; i < 4; i++ ) {
+                    Ordering o = Ordering::make( fromjson( orders[ i ] ) );
+                    for ( int fieldNames = 0; fieldNames < 2; fieldNames++ ) {
+                        vector<KeyString> encoded;
+                        for ( size_t k = 0; k < keys.size(); k++ ) {
+                            encoded.push_back( KeyString( keys[ k ], o, fieldNames ) );
+                            ASSERT( encoded.back().exact() );
+                        }
+                        for ( size_t l = 0; l < keys.size(); l++ ) {
+                            for ( size_t r = 0; r < keys.size(); r++ ) {
+                                int expected = sign( keys[ l ].woCompare( keys[ r ], o, fieldNames ) );
+                                if ( expected != sign( encoded[ l ].compare( encoded[ r ] ) ) ) {
+                                    log() << keys[ l ] << " vs " << keys[ r ] << " ordered by "
+                                          << orders[ i ] << endl;
+                                    ASSERT_EQUALS( expected, sign( encoded[ l ].compare( encoded[ r ] ) ) );
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // as by woCompare( r ), which considers field names
+                for ( size_t l = 0; l < keys.size(); l++ ) {
+                    for ( size_t r = 0; r < keys.size(); r++ ) {
+                        ASSERT_EQUALS( sign( keys[ l ].woCompare( keys[ r ] ) ),
+                                       sign( KeyString( keys[ l ] ).compare( KeyString( keys[ r ] ) ) ) );
+                    }
+                }
+            }
+        };
+
+        class Inexact {
+        public:
+            void run() {
+                Ordering o = Ordering::make( BSON( "a" << 1 ) );
+                BSONObjBuilder ts;
+                ts.appendTimestamp( "a", 5 );
+                ASSERT( ! KeyString( ts.obj(), o ).exact() );
+                ASSERT( ! KeyString( BSON( "a" << ( 1LL << 53 ) + 1 ), o ).exact() );
+                ASSERT( ! KeyString( BSON( "a" << BSON( "b" << -( 1LL << 60 ) ) ), o ).exact() );
+                BSONObjBuilder cws;
+                cws.appendCodeWScope( "a", "f", BSONObj() );
+                KeyString code( cws.obj(), o );
+                ASSERT( ! code.exact() );
+                ASSERT( code.bytes().empty() );
+                ASSERT( KeyString( BSON( "a" << ( 1LL << 53 ) ), o ).exact() );
+            }
+        };
+
+    } // namespace KeyStringTests
+
+    namespace BSONFieldIndexTests {
+
+        void assertSame( const BSONElement& expected, const BSONElement& actual ) {
+            if ( expected.eoo() )
+                ASSERT( actual.eoo() );
+            else
+                ASSERT( expected.rawdata() == actual.rawdata() );
+        }
+
+        /** lookups through a BSONFieldIndex find the elements a scan of its object finds */
+        class MatchesScan {
+        public:
+            void run() {
+                BSONObjBuilder b;
+                for ( int i = 0; i < 100; i++ ) {
+                    b.append( BSONObjBuilder::numStr( i ), i );
+                }
+                b.append( "5", "duplicate" );
+                b.append( "a", BSON( "b" << 1 << "c" << BSON( "d" << 2 ) ) );
+                b.append( "a.b", "dotted" );
+                b.append( "x", BSON_ARRAY( BSON( "y" << 1 ) ) );
+                b.append( "z", 3 );
+                BSONObj obj = b.obj();
+
+                const char* names[] = { "99", "0", "5", "50", "a", "a.b", "a.c.d", "a.e", "x.y",
+                                        "x.0.y", "z.w", "missing", "missing.b", "98", "1", "" };
+                int n = sizeof( names ) / sizeof( names[ 0 ] );
+                // look up in several orders, so that fields are found both by the scan and in
+                // the table
+                for ( int start = 0; start < n; start++ ) {
+                    BSONFieldIndex fields( obj );
+                    for ( int j = 0; j < n; j++ ) {
+                        const char* name = names[ ( start + j ) % n ];
+                        assertSame( obj.getField( name ), fields.getField( name ) );
+                        assertSame( obj.getFieldDotted( name ), fields.getFieldDotted( name ) );
+                        const char* expectedRest = name;
+                        const char* rest = name;
+                        assertSame( obj.getFieldDottedOrArray( expectedRest ),
+                                    fields.getFieldDottedOrArray( rest ) );
+                        ASSERT( expectedRest == rest );
+                    }
+                }
+                ASSERT_EQUALS( string( "duplicate" ),
+                               BSONFieldIndex( obj ).getField( "5" ).str() );
+            }
+        };
+
+        class Empty {
+        public:
+            void run() {
+                BSONObj empty;
+                BSONFieldIndex fields( empty );
+                ASSERT( fields.getField( "a" ).eoo() );
+                ASSERT( fields.getField( "a" ).eoo() );
+                ASSERT( fields.getFieldDotted( "a.b" ).eoo() );
+            }
+        };
+
+    } // namespace BSONFieldIndexTests
+
     class All : public Suite {
     public:
         All() : Suite( "jsobj" ) {
@@ -2166,6 +2354,10 @@ namespace JsobjTests {
             add< BSONForEachTest >();
             add< CompareOps >();
             add< HashingTest >();
+            add< KeyStringTests::MatchesWoCompare >();
+            add< KeyStringTests::Inexact >();
+            add< BSONFieldIndexTests::MatchesScan >();
+            add< BSONFieldIndexTests::Empty >();
         }
     } myall;
 
@@ -265,6 +265,73 @@ namespace MatcherTests {
         
     } // namespace Covered
     
+    /** Compiled matchers match as the interpreted ones do. */
+    class Compiled {
+    public:
+        ~Compiled() {
+            compileMatchers = true;
+        }
+        void run() {
+            const char *queries[] = {
+                "{a:1}", "{a:'x'}", "{a:{$gt:1}}", "{a:{$lte:'x'}}", "{a:{$gte:1,$lt:3}}",
+                "{'a.b':1}", "{'a.b':{$gt:0}}", "{'a.0':1}", "{a:null}", "{'a.b':null}",
+                "{a:{$ne:1}}", "{a:{$ne:null}}", "{a:{$in:[1,'x',null]}}", "{a:{$nin:[1,'x']}}",
+                "{a:{$exists:true}}", "{'a.b':{$exists:false}}", "{a:{$type:2}}",
+                "{a:{$mod:[2,0]}}", "{a:{$not:{$gt:1}}}", "{a:{$size:2}}", "{a:{$all:[1,2]}}",
+                "{a:{$elemMatch:{b:1}}}", "{a:[1,2]}", "{a:{b:1}}", "{a:/x/}",
+                "{$and:[{a:{$gte:1}},{b:'x'}]}", "{$and:[{a:1},{$or:[{b:'x'},{b:2}]}]}",
+                "{$or:[{a:1},{'a.b':1}],b:{$ne:2}}", "{$nor:[{a:1}],b:'x'}"
+            };
+            const char *docs[] = {
+                "{}", "{a:1}", "{a:1.0}", "{a:2}", "{a:-1.5}", "{a:'x'}", "{a:'xy'}", "{a:null}",
+                "{a:[1,2]}", "{a:[]}", "{a:[{b:1},{b:2}]}", "{a:{b:1}}", "{a:{b:'x'}}",
+                "{a:{b:null}}", "{a:{c:1}}", "{a:1,b:'x'}", "{a:2,b:2}", "{a:true}",
+                "{a:{'0':1}}", "{a:[[1,2]]}"
+            };
+            for( unsigned i = 0; i < sizeof( queries ) / sizeof( queries[ 0 ] ); ++i ) {
+                BSONObj query = fromjson( queries[ i ] );
+                compileMatchers = false;
+                Matcher interpreted( query );
+                compileMatchers = true;
+                Matcher compiled( query );
+                for( unsigned j = 0; j < sizeof( docs ) / sizeof( docs[ 0 ] ); ++j ) {
+                    BSONObj doc = fromjson( docs[ j ] );
+                    ASSERT_EQUALS( interpreted.matches( doc ), compiled.matches( doc ) );
+                }
+            }
+        }
+    };
+
+    /** Key matchers compiled to index key positions match as the interpreted ones do. */
+    class CompiledKeyMatch {
+    public:
+        ~CompiledKeyMatch() {
+            compileMatchers = true;
+        }
+        void run() {
+            const char *queries[] = {
+                "{a:1}", "{b:{$gt:'m'}}", "{a:{$gte:1},b:'x'}", "{a:{$in:[1,2]}}"
+            };
+            BSONObj keys[] = {
+                BSON( "" << 1 << "" << "x" ), BSON( "" << 2 << "" << "z" ),
+                BSON( "" << 1.0 << "" << "a" ), BSON( "" << "x" << "" << 1 )
+            };
+            BSONObj keyPattern = BSON( "a" << 1 << "b" << 1 );
+            for( unsigned i = 0; i < sizeof( queries ) / sizeof( queries[ 0 ] ); ++i ) {
+                BSONObj query = fromjson( queries[ i ] );
+                compileMatchers = false;
+                CoveredIndexMatcher interpreted( query, keyPattern );
+                compileMatchers = true;
+                CoveredIndexMatcher compiled( query, keyPattern );
+                ASSERT( !compiled.needRecord() );
+                for( unsigned j = 0; j < sizeof( keys ) / sizeof( keys[ 0 ] ); ++j ) {
+                    ASSERT_EQUALS( interpreted.matchesWithSingleKeyIndex( keys[ j ], DiskLoc() ),
+                                   compiled.matchesWithSingleKeyIndex( keys[ j ], DiskLoc() ) );
+                }
+            }
+        }
+    };
+
     class TimingBase {
     public:
         long time( const BSONObj& patt , const BSONObj& obj ) {
@@ -403,6 +470,8 @@ namespace MatcherTests {
             add<MixedNumericIN>();
             add<Size>();
             add<MixedNumericEmbedded>();
+            add<Compiled>();
+            add<CompiledKeyMatch>();
             add<ElemMatchKey>();
             add<Covered::ElemMatchKeyUnindexed>();
             add<Covered::ElemMatchKeyIndexed>();
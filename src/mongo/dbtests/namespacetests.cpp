@@ -23,7 +23,9 @@
 
 #include "../db/db.h"
 #include "../db/json.h"
+#include "mongo/db/free_record_index.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/server_parameters.h"
 
 #include "dbtests.h"
 
@@ -46,7 +48,7 @@ namespace NamespaceTests {
             }
         protected:
             void create( bool sparse = false ) {
-                NamespaceDetailsTransient::get( ns() ).deletedIndex();
+                NamespaceDetailsTransient::get( ns() ).deletedIndex( key() );
                 BSONObjBuilder builder;
                 builder.append( "ns", ns() );
                 builder.append( "name", "testIndex" );
@@ -1162,6 +1164,120 @@ namespace NamespaceTests {
             }
         };
 
+        class FreeSpaceBase : public Base {
+        protected:
+            virtual string spec() const {
+                return "{\"size\":8192,\"$nExtents\":1,\"autoIndexId\":false}";
+            }
+            DiskLoc insert( int size ) {
+                BSONObjBuilder b;
+                b.append( "a", string( size, 'a' ) );
+                BSONObj o = b.obj();
+                DiskLoc loc = theDataFileMgr.insert( ns(), o.objdata(), o.objsize() );
+                ASSERT( !loc.isNull() );
+                return loc;
+            }
+            void remove( const DiskLoc& loc ) {
+                theDataFileMgr.deleteRecord( ns(), loc.rec(), loc );
+            }
+            BSONObj freeSpace() const {
+                FreeRecordIndex& freeRecords = nsdt().freeRecords();
+                ASSERT( freeRecords.current( nsd() ) );
+                BSONObjBuilder b;
+                freeRecords.appendStats( b );
+                BSONObj stats = b.obj();
+
+                // the index agrees with the deleted lists on disk
+                BSONObjBuilder lists;
+                FreeRecordIndex::appendListStats( nsd(), lists );
+                BSONObj listStats = lists.obj();
+                ASSERT_EQUALS( listStats["records"].numberLong(), stats["records"].numberLong() );
+                ASSERT_EQUALS( listStats["bytes"].numberLong(), stats["bytes"].numberLong() );
+                ASSERT_EQUALS( listStats["largest"].numberLong(), stats["largest"].numberLong() );
+                return stats;
+            }
+        };
+
+        /** Deleted records are merged with the deleted records next to them. */
+        class CoalesceDeleted : public FreeSpaceBase {
+        public:
+            void run() {
+                create();
+                ASSERT_EQUALS( 1, freeSpace()["records"].numberLong() );
+                long long extentFree = freeSpace()["largest"].numberLong();
+
+                DiskLoc l[ 3 ];
+                for ( int i = 0; i < 3; ++i )
+                    l[ i ] = insert( 300 );
+                ASSERT_EQUALS( 1, freeSpace()["records"].numberLong() );
+
+                remove( l[ 1 ] );
+                ASSERT_EQUALS( 2, freeSpace()["records"].numberLong() );
+                remove( l[ 0 ] );
+                ASSERT_EQUALS( 2, freeSpace()["records"].numberLong() );
+                remove( l[ 2 ] );
+
+                // the records and the rest of the extent are one free record again
+                BSONObj stats = freeSpace();
+                ASSERT_EQUALS( 1, stats["records"].numberLong() );
+                ASSERT_EQUALS( extentFree, stats["largest"].numberLong() );
+                ASSERT_EQUALS( 0.0, stats["fragmentation"].numberDouble() );
+                ASSERT_EQUALS( 3, stats["coalesced"].numberLong() );
+                ASSERT( l[ 0 ] == nsd()->deletedList[ NamespaceDetails::bucket( extentFree ) ] );
+            }
+        };
+
+        /** A record goes to the smallest deleted record it fits in. */
+        class BestFitDeleted : public FreeSpaceBase {
+        public:
+            void run() {
+                create();
+                DiskLoc small = insert( 300 );
+                insert( 10 );
+                DiskLoc large = insert( 400 );
+                insert( 10 );
+                remove( small );
+                remove( large );
+                ASSERT_EQUALS( 3, freeSpace()["records"].numberLong() );
+
+                ASSERT( small == insert( 290 ) );
+                ASSERT_EQUALS( 2, freeSpace()["records"].numberLong() );
+                ASSERT( large == insert( 390 ) );
+                ASSERT_EQUALS( 1, freeSpace()["records"].numberLong() );
+            }
+        };
+
+        /**
+         * The records freed in an extent being drained are held off the deleted lists, on disk,
+         * until draining ends.
+         */
+        class HoldDrainedDeleted : public FreeSpaceBase {
+        public:
+            void run() {
+                create();
+                DiskLoc l[ 3 ];
+                for ( int i = 0; i < 3; ++i )
+                    l[ i ] = insert( 300 );
+                long long freeBefore = freeSpace()["bytes"].numberLong();
+
+                nsd()->startDraining( nsd()->firstExtent );
+                remove( l[ 0 ] );
+                remove( l[ 2 ] );
+                ASSERT_EQUALS( 1, freeSpace()["records"].numberLong() );
+                ASSERT_EQUALS( freeBefore, freeSpace()["bytes"].numberLong() );
+
+                // dropping the in-memory state of the collection loses nothing
+                NamespaceDetailsTransient::resetCollection( ns() );
+                ASSERT( nsd()->firstExtent == nsd()->drainingExtent() );
+                ASSERT( l[ 0 ] != insert( 300 ) );
+                remove( l[ 1 ] );
+
+                nsd()->stopDraining( ns(), true );
+                ASSERT( nsd()->drainingExtent().isNull() );
+                ASSERT_EQUALS( 2, freeSpace()["records"].numberLong() );
+            }
+        };
+
         /* test  NamespaceDetails::cappedTruncateAfter(const char *ns, DiskLoc loc)
         */
         class TruncateCapped : public Base {
@@ -1302,10 +1418,11 @@ namespace NamespaceTests {
                 ASSERT_EQUALS( indexKey,
                               nsdt().cachedQueryPlanForPattern( _pattern ).indexKey() );
             }
-            void registerIndexKey( const BSONObj &indexKey ) {
+            void registerIndexKey( const BSONObj &indexKey, long long nrecords = 0 ) {
                 nsdt().registerCachedQueryPlanForPattern
                         ( _pattern,
-                         CachedQueryPlan( indexKey, 1, CandidatePlanCharacter( true, false ) ) );                
+                         CachedQueryPlan( indexKey, 1, CandidatePlanCharacter( true, false ) ),
+                         nrecords );
             }
             FieldRangeSet _fieldRangeSet;
             QueryPattern _pattern;
@@ -1385,7 +1502,124 @@ namespace NamespaceTests {
                 assertCachedIndexKey( BSONObj() );
             }
         };                                                                                         
-        
+
+        /** A cached plan goes stale after a number of writes scaled by the collection's size. */
+        class StaleAfterWrites : public NamespaceDetailsTests::CachedPlanBase {
+        public:
+            void run() {
+                // The larger of 100 writes and 10% of 5000 records.
+                registerIndexKey( BSON( "a" << 1 ), 5000 );
+                for( int i = 0; i < 499; ++i ) {
+                    nsdt().notifyOfWriteOp();
+                }
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                nsdt().notifyOfWriteOp();
+                assertCachedIndexKey( BSONObj() );
+
+                // Recording the plan again makes it fresh.
+                registerIndexKey( BSON( "a" << 1 ) );
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                for( int i = 0; i < 100; ++i ) {
+                    nsdt().notifyOfWriteOp();
+                }
+                assertCachedIndexKey( BSONObj() );
+            }
+        };
+
+        /** A new index evicts only the plans of query shapes referencing its fields. */
+        class AddedIndex : public NamespaceDetailsTests::CachedPlanBase {
+        public:
+            void run() {
+                FieldRangeSet frs( ns(), BSON( "b" << 1 ), true, true );
+                QueryPattern bPattern( frs, BSONObj() );
+                registerIndexKey( BSON( "a" << 1 ) );
+                nsdt().registerCachedQueryPlanForPattern
+                        ( bPattern, CachedQueryPlan( BSON( "b" << 1 ), 1,
+                                                     CandidatePlanCharacter( true, false ) ) );
+
+                nsdt().addedIndex( BSON( "c" << 1 ) );
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                ASSERT_EQUALS( BSON( "b" << 1 ),
+                               nsdt().cachedQueryPlanForPattern( bPattern ).indexKey() );
+
+                nsdt().addedIndex( BSON( "b.x" << 1 << "c" << 1 ) );
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                ASSERT_EQUALS( BSONObj(), nsdt().cachedQueryPlanForPattern( bPattern ).indexKey() );
+
+                nsdt().deletedIndex( BSON( "c" << 1 ) );
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                nsdt().deletedIndex( BSON( "a" << 1 ) );
+                assertCachedIndexKey( BSONObj() );
+            }
+        };
+
+        /** A pinned plan is kept until its shape is removed or its index dropped. */
+        class PinnedPlan : public NamespaceDetailsTests::CachedPlanBase {
+        public:
+            void run() {
+                nsdt().planCache().pin( _pattern, BSON( "b" << 1 ) );
+                ASSERT( nsdt().cachedQueryPlanForPattern( _pattern ).pinned() );
+
+                // Neither winning plans, writes, index changes nor clearing replace it.
+                registerIndexKey( BSON( "a" << 1 ) );
+                for( int i = 0; i < 1000; ++i ) {
+                    nsdt().notifyOfWriteOp();
+                }
+                nsdt().addedIndex( BSON( "a" << 1 ) );
+                nsdt().planCache().indexChanged( BSON( "b" << 1 ), false );
+                nsdt().clearQueryCache();
+                assertCachedIndexKey( BSON( "b" << 1 ) );
+
+                nsdt().deletedIndex( BSON( "b" << 1 ) );
+                assertCachedIndexKey( BSONObj() );
+
+                nsdt().planCache().pin( _pattern, BSON( "b" << 1 ) );
+                nsdt().planCache().remove( _pattern );
+                assertCachedIndexKey( BSONObj() );
+            }
+        };
+
+        /** Past planCacheMaxEntries the least recently used unpinned plan is evicted. */
+        class MaxEntries : public NamespaceDetailsTests::CachedPlanBase {
+        public:
+            MaxEntries() :
+                _maxEntries( ServerParameterSet::getGlobal()->getMap().find
+                                     ( "planCacheMaxEntries" )->second ) {
+                BSONObjBuilder b;
+                _maxEntries->append( b, "" );
+                _saved = b.obj().firstElement().numberInt();
+                ASSERT_OK( _maxEntries->setFromString( "2" ) );
+            }
+            ~MaxEntries() {
+                _maxEntries->setFromString( BSONObjBuilder::numStr( _saved ) );
+            }
+            void run() {
+                FieldRangeSet bFrs( ns(), BSON( "b" << 1 ), true, true );
+                QueryPattern bPattern( bFrs, BSONObj() );
+                FieldRangeSet cFrs( ns(), BSON( "c" << 1 ), true, true );
+                QueryPattern cPattern( cFrs, BSONObj() );
+                FieldRangeSet dFrs( ns(), BSON( "d" << 1 ), true, true );
+                QueryPattern dPattern( dFrs, BSONObj() );
+                CachedQueryPlan plan( BSON( "x" << 1 ), 1, CandidatePlanCharacter( true, false ) );
+
+                nsdt().planCache().pin( dPattern, BSON( "d" << 1 ) );
+                registerIndexKey( BSON( "a" << 1 ) );
+                nsdt().registerCachedQueryPlanForPattern( bPattern, plan );
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                nsdt().registerCachedQueryPlanForPattern( cPattern, plan );
+
+                // b was used least recently; the pinned plan doesn't count
+                ASSERT_EQUALS( BSONObj(), nsdt().cachedQueryPlanForPattern( bPattern ).indexKey() );
+                assertCachedIndexKey( BSON( "a" << 1 ) );
+                ASSERT_EQUALS( BSON( "x" << 1 ),
+                               nsdt().cachedQueryPlanForPattern( cPattern ).indexKey() );
+                ASSERT( nsdt().cachedQueryPlanForPattern( dPattern ).pinned() );
+            }
+        private:
+            ServerParameter* _maxEntries;
+            int _saved;
+        };
+
     } // namespace NamespaceDetailsTransientTests
                                                                                  
     class All : public Suite {
@@ -1438,6 +1672,9 @@ namespace NamespaceTests {
             add< NamespaceDetailsTests::QuantizeMinMaxBound >();
             add< NamespaceDetailsTests::QuantizeFixedBuckets >();
             add< NamespaceDetailsTests::QuantizeRecordBoundary >();
+            add< NamespaceDetailsTests::CoalesceDeleted >();
+            add< NamespaceDetailsTests::BestFitDeleted >();
+            add< NamespaceDetailsTests::HoldDrainedDeleted >();
             add< NamespaceDetailsTests::TwoExtent >();
             add< NamespaceDetailsTests::TruncateCapped >();
             add< NamespaceDetailsTests::Migrate >();
@@ -1446,6 +1683,10 @@ namespace NamespaceTests {
             add< NamespaceDetailsTests::Size >();
             add< NamespaceDetailsTests::SetIndexIsMultikey >();
             add< NamespaceDetailsTransientTests::ClearQueryCache >();
+            add< NamespaceDetailsTransientTests::StaleAfterWrites >();
+            add< NamespaceDetailsTransientTests::AddedIndex >();
+            add< NamespaceDetailsTransientTests::PinnedPlan >();
+            add< NamespaceDetailsTransientTests::MaxEntries >();
         }
     } myall;
 } // namespace NamespaceTests
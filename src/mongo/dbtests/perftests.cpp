@@ -38,9 +38,12 @@
 #include "../util/checksum.h"
 #include "../util/version.h"
 #include "../db/key.h"
+#include "../bson/key_string.h"
 #include "../util/compress.h"
 #include "../util/concurrency/qlock.h"
 #include "../util/fail_point.h"
+#include "../platform/random.h"
+#include "../s/chunk.h"
 #include <boost/filesystem/operations.hpp>
 
 using namespace bson;
@@ -490,6 +493,163 @@ namespace PerfTests {
 
     unsigned long long aaa;
 
+    /**
+     * compares compound keys whose first field is of mixed types, by woCompare or, in
+     * KeyStringCompare, as the KeyStrings encoded from them
+     */
+    class KeyWoCompare : public B {
+    public:
+        Ordering order;
+        vector<BSONObj> keys;
+        vector<KeyString> encoded;
+        unsigned i;
+        string name() { return "Key-woCompare"; }
+        virtual int howLongMillis() { return 2000; }
+        virtual bool showDurStats() { return false; }
+        KeyWoCompare() : order( Ordering::make( BSON( "a" << 1 << "b" << -1 << "c" << 1 ) ) ), i(0) {
+            PseudoRandom rand(17);
+            for( int n = 0; n < 1024; n++ ) {
+                BSONObjBuilder b;
+                int v = rand.nextInt32( 100 );
+                switch( rand.nextInt32( 4 ) ) {
+                case 0: b.append( "a", v ); break;
+                case 1: b.append( "a", v / 4.0 ); break;
+                case 2: b.append( "a", str::stream() << "user" << v ); break;
+                default: b.appendDate( "a", Date_t( v ) ); break;
+                }
+                b.append( "b", str::stream() << "name" << rand.nextInt32( 10 ) );
+                b.append( "c", (long long) rand.nextInt32( 1 << 30 ) );
+                keys.push_back( b.obj() );
+                encoded.push_back( KeyString( keys.back(), order ) );
+            }
+        }
+        void timed() {
+            unsigned j = i++ % keys.size();
+            if( keys[j].woCompare( keys[( j + 1 ) % keys.size()], order ) < 0 )
+                aaa++;
+        }
+    };
+
+    class KeyStringCompare : public KeyWoCompare {
+    public:
+        string name() { return "Key-KeyString-compare"; }
+        void timed() {
+            unsigned j = i++ % keys.size();
+            if( encoded[j].compare( encoded[( j + 1 ) % keys.size()] ) < 0 )
+                aaa++;
+        }
+    };
+
+    /**
+     * mongos routing of hashed shard key points over 100k chunks, through the
+     * ChunkTable or, for comparison, the ChunkMap tree.
+     */
+    class ChunkRouting : public B {
+    public:
+        ChunkMap chunks;
+        ChunkTable table;
+        vector<BSONObj> points;
+        unsigned i;
+        string name() { return "ChunkRouting"; }
+        virtual int howLongMillis() { return 2000; }
+        virtual bool showDurStats() { return false; }
+        ChunkRouting() : i(0) {
+            PseudoRandom rand(17);
+            BSONObj min = BSON( "x" << MINKEY );
+            for( int n = 0; n < 100000; n++ ) {
+                BSONObj max = n == 99999 ? BSON( "x" << MAXKEY ) :
+                    BSON( "x" << (long long)( ( n - 50000 ) * ( numeric_limits<long long>::max() / 50000 ) ) );
+                ChunkPtr c( new Chunk( NULL, min, max, Shard() ) );
+                chunks[max] = c;
+                table.insert( make_pair( max, c ) );
+                min = max;
+            }
+            table.seal();
+            for( int n = 0; n < 4096; n++ )
+                points.push_back( BSON( "x" << (long long) rand.nextInt64() ) );
+        }
+        void timed() {
+            if( table.findIntersectingChunk( points[i++ % points.size()] ) )
+                aaa++;
+        }
+    };
+
+    class ChunkMapRouting : public ChunkRouting {
+    public:
+        string name() { return "ChunkMapRouting"; }
+        void timed() {
+            if( chunks.upper_bound( points[i++ % points.size()] ) != chunks.end() )
+                aaa++;
+        }
+    };
+
+    /** a reload which splits one of 100k chunks, applied to a copy of the old table */
+    class ChunkTableSplit : public ChunkRouting {
+    public:
+        string name() { return "ChunkTableSplit"; }
+        void timed() {
+            ChunkTable reloaded( table );
+            // the chunks at either end have MinKey or MaxKey bounds
+            size_t pos = reloaded.upper_bound( points[i++ % points.size()] );
+            pos = max( (size_t)1, min( pos, reloaded.size() - 2 ) );
+            ChunkPtr c = reloaded.at( pos );
+            BSONObj mid = BSON( "x" << c->getMin().firstElement().numberLong() / 2 +
+                                       c->getMax().firstElement().numberLong() / 2 );
+            reloaded.erase( pos, pos + 1 );
+            reloaded.insert( make_pair( mid, ChunkPtr( new Chunk( NULL, c->getMin(), mid, Shard() ) ) ) );
+            reloaded.insert( make_pair( c->getMax(), ChunkPtr( new Chunk( NULL, mid, c->getMax(), Shard() ) ) ) );
+            reloaded.seal();
+            aaa += reloaded.size();
+        }
+    };
+
+    /**
+     * routing of points of a compound string and number shard key over 100k chunks, through the
+     * KeyStrings of the ChunkTable or, for comparison, the ChunkMap tree.
+     */
+    class CompoundChunkRouting : public B {
+    public:
+        ChunkMap chunks;
+        ChunkTable table;
+        vector<BSONObj> points;
+        unsigned i;
+        string name() { return "CompoundChunkRouting"; }
+        virtual int howLongMillis() { return 2000; }
+        virtual bool showDurStats() { return false; }
+        static BSONObj key( int user, int n ) {
+            char buf[32];
+            sprintf( buf, "user%06d", user );
+            return BSON( "u" << buf << "n" << n );
+        }
+        CompoundChunkRouting() : i(0) {
+            PseudoRandom rand(17);
+            BSONObj min = BSON( "u" << MINKEY << "n" << MINKEY );
+            for( int n = 0; n < 100000; n++ ) {
+                BSONObj max = n == 99999 ? BSON( "u" << MAXKEY << "n" << MAXKEY ) : key( n / 4, n % 4 * 1000 );
+                ChunkPtr c( new Chunk( NULL, min, max, Shard() ) );
+                chunks[max] = c;
+                table.insert( make_pair( max, c ) );
+                min = max;
+            }
+            table.seal();
+            for( int n = 0; n < 4096; n++ )
+                points.push_back( key( rand.nextInt32( 25000 ), rand.nextInt32( 4000 ) ) );
+        }
+        void timed() {
+            if( table.findIntersectingChunk( points[i++ % points.size()] ) )
+                aaa++;
+        }
+    };
+
+    class CompoundChunkMapRouting : public CompoundChunkRouting {
+    public:
+        string name() { return "CompoundChunkMapRouting"; }
+        void timed() {
+            if( chunks.upper_bound( points[i++ % points.size()] ) != chunks.end() )
+                aaa++;
+        }
+    };
+
     class Timer : public B {
     public:
         string name() { return "Timer"; }
@@ -1078,6 +1238,85 @@ namespace PerfTests {
         }
     };
 
+    /**
+     * point lookups in an index of 100k numbers, by index version.  in v2 buckets most of the
+     * comparisons of a lookup are made on key prefixes.
+     */
+    template< int V >
+    class IndexLookup : public B {
+    public:
+        virtual int howLongMillis() { return 3000; }
+        virtual bool showDurStats() { return false; }
+        string name() { return str::stream() << "index-lookup-v" << V; }
+        void prep() {
+            for( int i = 0; i < 100000; i++ )
+                client().insert( ns(), BSON( "k" << ( i * 7919 ) % 100000 << "d" << i % 16 ) );
+            client().ensureIndex( ns(), BSON( "k" << 1 ), false, "", true, false, V );
+            client().ensureIndex( ns(), BSON( "d" << 1 ), false, "", true, false, V );
+        }
+        void timed() {
+            client().findOne( ns(), QUERY( "k" << rand() % 100000 ) );
+        }
+    };
+
+    /** covered scans of 16 heavily duplicated keys; in v2 buckets duplicates share their data */
+    template< int V >
+    class IndexDupScan : public IndexLookup<V> {
+    public:
+        string name() { return str::stream() << "index-dup-scan-v" << V; }
+        void timed() {
+            this->client().count( this->ns(), BSON( "d" << rand() % 16 ) );
+        }
+    };
+
+    /**
+     * Queries returning a batch of small documents, reporting the reply buffers allocated and
+     * regrown per query and the share of their bytes the replies used.
+     */
+    class QueryReplyBuffers : public B {
+    public:
+        QueryReplyBuffers() : _queries() { }
+        virtual int howLongMillis() { return 2000; }
+        virtual bool showDurStats() { return false; }
+        string name() { return "query-reply-buffers"; }
+        void prep() {
+            for( int i = 0; i < 1000; i++ )
+                client().insert( ns(), BSON( "k" << i << "s" << "a short string value" ) );
+            client().ensureIndex( ns(), BSON( "k" << 1 ) );
+            _before = replyBuffers();
+        }
+        void timed() {
+            int k = rand() % 950;
+            auto_ptr<DBClientCursor> c =
+                    client().query( ns(), QUERY( "k" << GTE << k << LT << k + 50 ) );
+            while( c->more() )
+                c->next();
+            ++_queries;
+        }
+        void post() {
+            BSONObj after = replyBuffers();
+            double n = _queries;
+            double allocated = after["allocatedBytes"].numberLong() -
+                    _before["allocatedBytes"].numberLong();
+            double used = after["usedBytes"].numberLong() - _before["usedBytes"].numberLong();
+            cout << "stats " << setw(42) << left << "query-reply-buffers per query" << ' '
+                 << "allocations: " << fixed << setprecision(2)
+                 << ( after["allocations"].numberLong() - _before["allocations"].numberLong() ) / n
+                 << " regrown: "
+                 << ( after["regrown"].numberLong() - _before["regrown"].numberLong() ) / n
+                 << " bytes used: " << setprecision(0) << ( allocated ? 100 * used / allocated : 0 )
+                 << '%' << endl;
+        }
+    private:
+        BSONObj replyBuffers() {
+            BSONObj info;
+            verify( client().runCommand( "admin", BSON( "serverStatus" << 1 ), info ) );
+            return info["metrics"]["replyBuffers"].Obj().getOwned();
+        }
+        long long _queries;
+        BSONObj _before;
+    };
+
     template <typename T>
     class MoreIndexes : public T {
     public:
@@ -1235,6 +1474,13 @@ namespace PerfTests {
                 add< CTM >();
                 add< CTMicros >();
                 add< KeyTest >();
+                add< KeyWoCompare >();
+                add< KeyStringCompare >();
+                add< ChunkRouting >();
+                add< ChunkMapRouting >();
+                add< ChunkTableSplit >();
+                add< CompoundChunkRouting >();
+                add< CompoundChunkMapRouting >();
                 add< Bldr >();
                 add< StkBldr >();
                 add< BSONIter >();
@@ -1248,6 +1494,11 @@ namespace PerfTests {
                 add< Update1 >();
                 add< MoreIndexes<Update1> >();
                 add< InsertBig >();
+                add< IndexLookup<1> >();
+                add< IndexLookup<2> >();
+                add< IndexDupScan<1> >();
+                add< IndexDupScan<2> >();
+                add< QueryReplyBuffers >();
                 add< FailPointTest<false, false> >();
                 add< FailPointTest<true, false> >();
                 add< FailPointTest<true, true> >();
@@ -28,6 +28,7 @@
 #include "mongo/db/kill_current_op.h"
 #include "mongo/db/lasterror.h"
 #include "mongo/db/oplog.h"
+#include "mongo/db/reply_size_hint.h"
 #include "mongo/db/scanandorder.h"
 #include "mongo/util/timer.h"
 
@@ -1594,22 +1595,40 @@ namespace QueryTests {
         
         class TestableScanAndOrder : public ScanAndOrder {
         public:
-            TestableScanAndOrder(int startFrom, int limit, BSONObj order, const FieldRangeSet &frs)
-            : ScanAndOrder( startFrom, limit, order, frs ) {
+            TestableScanAndOrder(int startFrom, int limit, BSONObj order, const FieldRangeSet &frs,
+                                 bool mayUseDisk = false, const ParsedQuery *parsedQuery = 0)
+            : ScanAndOrder( startFrom, limit, order, frs, parsedQuery, mayUseDisk ) {
             }
             unsigned approxSize() const { return ScanAndOrder::approxSize(); }
+            bool usingTopK() const { return ScanAndOrder::usingTopK(); }
+            size_t numSpilledRuns() const { return ScanAndOrder::numSpilledRuns(); }
         };
         typedef TestableScanAndOrder Testable;
         
         class Base {
         protected:
-            void assertNumFilled( int expected, const Testable &t ) {
+            void assertNumFilled( int expected, Testable &t ) {
                 ASSERT_EQUALS( expected, t.size() );
                 BufBuilder bb;
                 int nout;
-                t.fill( bb, 0, nout );
+                t.fill( bb, nout );
                 ASSERT_EQUALS( expected, nout );                
             }
+            /** @return the documents filled in by t */
+            vector<BSONObj> filled( Testable &t ) {
+                BufBuilder bb;
+                int nout;
+                t.fill( bb, nout );
+                vector<BSONObj> ret;
+                const char *p = bb.buf();
+                for( int i = 0; i < nout; ++i ) {
+                    BSONObj o( p );
+                    ret.push_back( o.getOwned() );
+                    p += o.objsize();
+                }
+                ASSERT_EQUALS( bb.len(), p - bb.buf() );
+                return ret;
+            }
         };
         
         class Unlimited : public Base {
@@ -1654,9 +1673,151 @@ namespace QueryTests {
                 assertNumFilled( 1, t );
             }
         };
+
+        /** A small limit keeps a heap of the best results, equal keys in the order added. */
+        class TopK : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                Testable t( 2, 3, BSON( "a" << -1 ), frs );
+                ASSERT( t.usingTopK() );
+                for( int i = 0; i < 100; ++i ) {
+                    t.add( BSON( "a" << ( i * 37 ) % 20 << "i" << i ), 0 );
+                }
+                ASSERT_EQUALS( 5, t.size() );
+                vector<BSONObj> docs = filled( t );
+                ASSERT_EQUALS( 3U, docs.size() );
+                // a is 19 for i 7, 27, 47, 67 and 87
+                ASSERT_EQUALS( BSON( "a" << 19 << "i" << 47 ), docs[ 0 ] );
+                ASSERT_EQUALS( BSON( "a" << 19 << "i" << 67 ), docs[ 1 ] );
+                ASSERT_EQUALS( BSON( "a" << 19 << "i" << 87 ), docs[ 2 ] );
+            }
+        };
+
+        /** A limit too large for a heap buffers the results, trimming them to the limit. */
+        class LargeLimit : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                Testable t( 0, 2000, BSON( "a" << 1 ), frs );
+                ASSERT( !t.usingTopK() );
+                for( int i = 0; i < 10000; ++i ) {
+                    t.add( BSON( "a" << ( i * 7919 ) % 10000 ), 0 );
+                    ASSERT( t.size() < 4000 );
+                }
+                vector<BSONObj> docs = filled( t );
+                ASSERT_EQUALS( 2000U, docs.size() );
+                for( int i = 0; i < 2000; ++i ) {
+                    ASSERT_EQUALS( i, docs[ i ][ "a" ].numberInt() );
+                }
+            }
+        };
+
+        /** Results are projected as they are added, so only the returned fields are held. */
+        class Projected : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                ParsedQuery parsedQuery( "unittests.querytests.ScanAndOrderProjected", 0, 0, 0,
+                                         BSONObj(), BSON( "_id" << 0 << "a" << 1 ) );
+                Testable t( 0, 0, BSON( "a" << 1 ), frs, false, &parsedQuery );
+                string big( 30 * 1024, 'x' );
+                for( int i = 0; i < 2000; ++i ) {
+                    t.add( BSON( "_id" << i << "a" << ( i * 7919 ) % 2000 << "big" << big ), 0 );
+                }
+                ASSERT( t.approxSize() < 1024 * 1024 );
+                vector<BSONObj> docs = filled( t );
+                ASSERT_EQUALS( 2000U, docs.size() );
+                for( int i = 0; i < 2000; ++i ) {
+                    ASSERT_EQUALS( BSON( "a" << i ), docs[ i ] );
+                }
+            }
+        };
+
+        /**
+         * Results outgrowing the memory limit are spilled to disk, if that's allowed, up to
+         * scanAndOrderMaxDiskBytes.
+         */
+        class Spill : public Base {
+        public:
+            Spill() : _maxDiskBytes( scanAndOrderMaxDiskBytes ) {
+            }
+            ~Spill() {
+                scanAndOrderMaxDiskBytes = _maxDiskBytes;
+            }
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                string big( 30 * 1024, 'x' );
+
+                scanAndOrderMaxDiskBytes = 0;
+                Testable notEnabled( 1400, 100, BSON( "a" << 1 ), frs, true );
+                ASSERT_THROWS( add( notEnabled, big ), UserException );
+                ASSERT_EQUALS( 0U, notEnabled.numSpilledRuns() );
+
+                scanAndOrderMaxDiskBytes = 256 * 1024 * 1024;
+                Testable noDisk( 1400, 100, BSON( "a" << 1 ), frs );
+                ASSERT_THROWS( add( noDisk, big ), UserException );
+
+                Testable t( 1400, 100, BSON( "a" << 1 ), frs, true );
+                add( t, big );
+                ASSERT( t.numSpilledRuns() > 0 );
+                vector<BSONObj> docs = filled( t );
+                ASSERT_EQUALS( 100U, docs.size() );
+                for( int i = 0; i < 100; ++i ) {
+                    ASSERT_EQUALS( 1400 + i, docs[ i ][ "a" ].numberInt() );
+                }
+
+                // results that can't fit in a reply fail as they are added
+                Testable unlimited( 0, 0, BSON( "a" << 1 ), frs, true );
+                ASSERT_THROWS( add( unlimited, big ), UserException );
+
+                // as do results outgrowing the disk limit
+                scanAndOrderMaxDiskBytes = 16 * 1024 * 1024;
+                Testable capped( 1400, 100, BSON( "a" << 1 ), frs, true );
+                ASSERT_THROWS( add( capped, big ), UserException );
+            }
+        private:
+            void add( Testable &t, const string &big ) {
+                for( int i = 0; i < 2000; ++i ) {
+                    t.add( BSON( "a" << ( i * 7919 ) % 2000 << "big" << big ), 0 );
+                }
+            }
+            int _maxDiskBytes;
+        };
         
     } // namespace ScanAndOrderTests
 
+    /** Reply buffers are sized after the recent replies, growing at once and shrinking slowly. */
+    class ReplySizes {
+    public:
+        void run() {
+            ReplySizeHint hint( 512, 64 * 1024 );
+            ASSERT_EQUALS( 512, hint.size() );
+
+            note( hint, 10000 );
+            ASSERT_EQUALS( 16 * 1024, hint.size() );
+
+            // one small reply doesn't shrink the buffers, many do
+            note( hint, 100 );
+            ASSERT_EQUALS( 16 * 1024, hint.size() );
+            for( int i = 0; i < 200; ++i ) {
+                note( hint, 100 );
+            }
+            ASSERT_EQUALS( 512, hint.size() );
+
+            // never past the maximum
+            note( hint, 1024 * 1024 );
+            ASSERT_EQUALS( 64 * 1024, hint.size() );
+        }
+    private:
+        void note( ReplySizeHint &hint, int len ) {
+            int initialSize = hint.size();
+            BufBuilder b( initialSize );
+            b.skip( len );
+            hint.noteReply( initialSize, b );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "query" ) {
@@ -1728,6 +1889,11 @@ namespace QueryTests {
             
             add< ScanAndOrderTests::Unlimited >();
             add< ScanAndOrderTests::LimitOne >();
+            add< ScanAndOrderTests::TopK >();
+            add< ScanAndOrderTests::LargeLimit >();
+            add< ScanAndOrderTests::Projected >();
+            add< ScanAndOrderTests::Spill >();
+            add< ReplySizes >();
         }
     } myall;
 
@@ -22,6 +22,7 @@
 
 #include "mongo/client/dbclientmockcursor.h"
 #include "mongo/client/parallel.h"
+#include "mongo/platform/random.h"
 #include "mongo/s/chunk_diff.h"
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/type_chunk.h"
@@ -626,6 +627,166 @@ namespace ShardingTests {
         ChunkDiffUnitTestInverse() : ChunkDiffUnitTest( true ) {}
     };
 
+    /**
+     * Checks ChunkTable against the ChunkMap it stands in for, for numeric and general keys, and
+     * that changing a copy of a table, as a reload does, leaves the original as it was.
+     */
+    class ChunkTableTest {
+    public:
+        void run() {
+            PseudoRandom rand( 12345 );
+
+            ChunkMap longChunks = makeChunks( 1000, NumberLong, rand );
+            ChunkTable longTable = makeTable( longChunks );
+            ASSERT( longTable.isNumeric() );
+            ASSERT( longTable.depth() > 1 );
+            checkRouting( longChunks, longTable, rand );
+
+            ChunkMap doubleChunks = makeChunks( 1000, NumberDouble, rand );
+            ChunkTable doubleTable = makeTable( doubleChunks );
+            ASSERT( doubleTable.isNumeric() );
+            checkRouting( doubleChunks, doubleTable, rand );
+
+            ChunkMap stringChunks = makeChunks( 1000, String, rand );
+            ChunkTable stringTable = makeTable( stringChunks );
+            ASSERT( ! stringTable.isNumeric() );
+            checkRouting( stringChunks, stringTable, rand );
+
+            ChunkMap compoundChunks = makeChunks( 1000, Object, rand );
+            ChunkTable compoundTable = makeTable( compoundChunks );
+            ASSERT( ! compoundTable.isNumeric() );
+            checkRouting( compoundChunks, compoundTable, rand );
+
+            // split chunks of a copy, as a reload from an older manager does
+            for ( int i = 0; i < 10; i++ ) {
+                ChunkMap::iterator it = longChunks.begin();
+                advance( it, 1 + rand.nextInt32( longChunks.size() - 2 ) );
+                ChunkPtr c = it->second;
+                long long lo = c->getMin().firstElement().numberLong();
+                long long hi = c->getMax().firstElement().numberLong();
+                if ( hi - lo < 2 )
+                    continue;
+                BSONObj split = BSON( "x" << (long long)( lo + ( hi - lo ) / 2 ) );
+
+                ChunkMap splitChunks = longChunks;
+                splitChunks.erase( c->getMax() );
+                ChunkPtr left( new Chunk( NULL, c->getMin(), split, Shard( "left", "left" ) ) );
+                ChunkPtr right( new Chunk( NULL, split, c->getMax(), Shard( "right", "right" ) ) );
+                splitChunks[ left->getMax() ] = left;
+                splitChunks[ right->getMax() ] = right;
+
+                ChunkTable splitTable = longTable;
+                size_t pos = splitTable.lower_bound( c->getMax() );
+                ASSERT( splitTable.at( pos ) == c );
+                splitTable.erase( pos, pos + 1 );
+                splitTable.insert( make_pair( left->getMax(), left ) );
+                splitTable.insert( make_pair( right->getMax(), right ) );
+                splitTable.seal();
+
+                ASSERT( splitTable.isNumeric() );
+                ASSERT_EQUALS( splitChunks.size(), splitTable.size() );
+                checkRouting( splitChunks, splitTable, rand );
+                checkOrder( splitChunks, splitTable );
+
+                // the old table is untouched
+                ASSERT_EQUALS( longChunks.size(), longTable.size() );
+                checkPoint( longChunks, longTable, split );
+                checkOrder( longChunks, longTable );
+
+                set<Shard> shards;
+                ASSERT( splitTable.getShardsForRange( shards, c->getMin(), c->getMax(), 10 ) );
+                ASSERT_EQUALS( 3U, shards.size() );
+
+                longChunks.swap( splitChunks );
+                longTable = splitTable;
+            }
+
+            // ranges past every chunk have none to route to
+            set<Shard> shards;
+            ASSERT( ! longTable.getShardsForRange( shards, BSON( "x" << MAXKEY ), BSON( "x" << MAXKEY ), 10 ) );
+            ASSERT( longTable.getShardsForRange( shards, BSON( "x" << MINKEY ), BSON( "x" << MAXKEY ), 10 ) );
+            ASSERT_EQUALS( 3U, shards.size() );
+        }
+
+    private:
+        static BSONObj bound( BSONType type, long long v ) {
+            if ( type == NumberLong )
+                return BSON( "x" << v );
+            if ( type == NumberDouble )
+                return BSON( "x" << v / 4.0 );
+            if ( type == Object )
+                return BSON( "x" << bound( String, v >> 10 ).firstElement() << "y" << v );
+            // zero padded, so that strings sort as the numbers do
+            char buf[32];
+            sprintf( buf, "%020lld", v + ( 1LL << 42 ) );
+            return BSON( "x" << buf );
+        }
+
+        static ChunkMap makeChunks( int n, BSONType type, PseudoRandom& rand ) {
+            ChunkMap chunks;
+            BSONObj min = BSON( "x" << MINKEY );
+            long long v = -( 1LL << 40 );
+            for ( int i = 0; i < n; i++ ) {
+                v += 1 + rand.nextInt32( 1 << 20 );
+                BSONObj max = i == n - 1 ? BSON( "x" << MAXKEY ) : bound( type, v );
+                chunks[ max ] = ChunkPtr( new Chunk( NULL, min, max, Shard() ) );
+                min = max;
+            }
+            return chunks;
+        }
+
+        static ChunkTable makeTable( const ChunkMap& chunks ) {
+            ChunkTable table;
+            for ( ChunkMap::const_iterator it = chunks.begin(); it != chunks.end(); ++it )
+                table.insert( *it );
+            table.seal();
+            return table;
+        }
+
+        static void checkOrder( const ChunkMap& chunks, const ChunkTable& table ) {
+            ChunkTable::Iterator t( table );
+            for ( ChunkMap::const_iterator it = chunks.begin(); it != chunks.end(); ++it ) {
+                ASSERT( t.more() );
+                ASSERT( it->second == t.next() );
+            }
+            ASSERT( ! t.more() );
+        }
+
+        static void checkPoint( const ChunkMap& chunks, const ChunkTable& table, const BSONObj& point ) {
+            ChunkMap::const_iterator it = chunks.upper_bound( point );
+            ChunkPtr expected = it == chunks.end() ? ChunkPtr() : it->second;
+            ASSERT( expected.get() == table.findIntersectingChunk( point ).get() );
+            ASSERT_EQUALS( (size_t) distance( chunks.begin(), it ), table.upper_bound( point ) );
+        }
+
+        static void checkRouting( const ChunkMap& chunks, const ChunkTable& table, PseudoRandom& rand ) {
+            // every bound, its neighbours, and random points of every numeric type
+            for ( ChunkMap::const_iterator it = chunks.begin(); it != chunks.end(); ++it ) {
+                checkPoint( chunks, table, it->first );
+                BSONElement e = it->first.firstElement();
+                if ( e.isNumber() ) {
+                    checkPoint( chunks, table, BSON( "x" << e.numberLong() - 1 ) );
+                    checkPoint( chunks, table, BSON( "x" << e.numberLong() + 1 ) );
+                    checkPoint( chunks, table, BSON( "x" << e.numberDouble() - 0.5 ) );
+                }
+            }
+            for ( int i = 0; i < 1000; i++ ) {
+                long long v = rand.nextInt64() >> 22;
+                checkPoint( chunks, table, BSON( "x" << v ) );
+                checkPoint( chunks, table, BSON( "x" << (int)v ) );
+                checkPoint( chunks, table, BSON( "x" << v / 4.0 ) );
+                checkPoint( chunks, table, bound( String, v ) );
+                checkPoint( chunks, table, bound( Object, v ) );
+                // without a KeyString, routed on BSON comparisons
+                BSONObjBuilder b;
+                b.appendTimestamp( "x", v );
+                checkPoint( chunks, table, b.obj() );
+            }
+            checkPoint( chunks, table, BSON( "x" << MINKEY ) );
+            checkPoint( chunks, table, BSON( "x" << MAXKEY ) );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "sharding" ) {
@@ -638,6 +799,7 @@ namespace ShardingTests {
             add< ChunkManagerLoadBasicTest >();
             add< ChunkDiffUnitTestNormal >();
             add< ChunkDiffUnitTestInverse >();
+            add< ChunkTableTest >();
         }
     } myall;
 
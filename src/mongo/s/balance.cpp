@@ -18,10 +18,15 @@
 
 #include "mongo/s/balance.h"
 
+#include <boost/thread.hpp>
+
+#include "mongo/client/connpool.h"
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/client/distlock.h"
 #include "mongo/db/cmdline.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/s/chunk.h"
 #include "mongo/s/config.h"
 #include "mongo/s/grid.h"
@@ -38,78 +43,468 @@ namespace mongo {
 
     Balancer balancer;
 
+    // Whether to also balance measured load once chunk counts are even.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerLoadAware, bool, false);
+
+    // How quickly old traffic stops counting towards a chunk's load.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerLoadHalfLifeSecs, int, 300);
+
+    // Cap on chunks moved for load alone, since each one costs a full migration.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerLoadMigrationsPerHour, int, 10);
+
+    // Migrations a round may run at once, each between its own donor and recipient.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerMaxConcurrentMigrations, int, 4);
+
+    // Pause before a round that follows one which moved chunks.
+    MONGO_EXPORT_SERVER_PARAMETER(balancerMinRoundIntervalMillis, int, 1000);
+
     Balancer::Balancer() : _balancedLastTime(0), _policy( new BalancerPolicy() ) {}
 
     Balancer::~Balancer() {
     }
 
-    int Balancer::_moveChunks(const vector<CandidateChunkPtr>* candidateChunks,
-                              bool secondaryThrottle,
-                              bool waitForDelete)
-    {
-        int movedCount = 0;
+    int Balancer::_loadMovesLeft() {
+        time_t hourAgo = time(0) - 3600;
+        while ( ! _loadMoveTimes.empty() && _loadMoveTimes.front() < hourAgo )
+            _loadMoveTimes.pop_front();
+        return max( 0, balancerLoadMigrationsPerHour - (int)_loadMoveTimes.size() );
+    }
 
-        for ( vector<CandidateChunkPtr>::const_iterator it = candidateChunks->begin(); it != candidateChunks->end(); ++it ) {
-            const CandidateChunk& chunkInfo = *it->get();
+    void Balancer::LoadTracker::sampleCluster( DBClientBase& conn, const vector<Shard>& shards ) {
+        // every mongos pings each balancing round, whether or not its balancer is active
+        const long long RouterPingTimeoutMillis = 5 * 60 * 1000;
+        _routers.clear();
+        try {
+            BSONObjBuilder pingedSince;
+            pingedSince.appendDate( "$gt", jsTime() - RouterPingTimeoutMillis );
+            auto_ptr<DBClientCursor> cursor =
+                conn.query( MongosType::ConfigNS,
+                            QUERY( MongosType::ping() << pingedSince.obj() ) );
+            while ( cursor->more() )
+                _routers.push_back( cursor->nextSafe()[MongosType::name()].String() );
+        }
+        catch ( DBException& e ) {
+            warning() << "couldn't list the mongoses to sample load from: " << e.what() << endl;
+        }
 
-            DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
-            verify( cfg );
+        _shardTotals.clear();
+        for ( vector<Shard>::const_iterator i = shards.begin(); i != shards.end(); ++i ) {
+            try {
+                BSONObj res = i->runCommand( "admin" , "top" );
+                _shardTotals[i->getName()] = res.getObjectField( "totals" ).getOwned();
+            }
+            catch ( DBException& e ) {
+                // without it we only go by what this mongos saw
+                LOG(1) << "couldn't get top from " << i->getName() << ": " << e.what() << endl;
+            }
+        }
+    }
 
-            ChunkManagerPtr cm = cfg->getChunkManager( chunkInfo.ns );
-            verify( cm );
+    long long Balancer::LoadTracker::_shardOpsSince( const string& shard, const string& ns ) {
+        map<string,BSONObj>::const_iterator i = _shardTotals.find( shard );
+        if ( i == _shardTotals.end() )
+            return 0;
+
+        BSONElement count = i->second.getObjectField( ns.c_str() ).getObjectField( "total" )["count"];
+        if ( ! count.isNumber() )
+            return 0;
+
+        long long now = count.numberLong();
+        long long& last = _shardOpsSeen[shard][ns];
+        // a restarted shard counts from 0 again
+        long long delta = now >= last ? now - last : now;
+        bool first = last == 0;
+        last = now;
+        return first ? 0 : delta;
+    }
 
-            ChunkPtr c = cm->findIntersectingChunk( chunkInfo.chunk.min );
-            if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
-                // likely a split happened somewhere
-                cm = cfg->getChunkManager( chunkInfo.ns , true /* reload */);
-                verify( cm );
+    bool Balancer::LoadTracker::_sampleRouter( const string& host,
+                                               const string& ns,
+                                               const ChunkManager& cm,
+                                               const RouterCounters* last,
+                                               RouterCounters* cur,
+                                               map<BSONObj,ChunkLoad>* routed ) {
+        try {
+            BSONObj res;
+            scoped_ptr<ScopedDbConnection> conn(
+                    ScopedDbConnection::getInternalScopedDbConnection( host, 30 ) );
+            bool ok = conn->get()->runCommand( "admin", BSON( "chunkLoad" << ns ), res );
+            conn->done();
+            if ( ! ok ) {
+                LOG(1) << "couldn't get chunk load from mongos " << host << ": " << res << endl;
+                return false;
+            }
+
+            // a mongos with an older version of the collection counts for other chunks
+            if ( res["epoch"].type() != jstOID || res["epoch"].OID() != cm.getVersion().epoch() )
+                return false;
 
-                c = cm->findIntersectingChunk( chunkInfo.chunk.min );
-                if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
-                    log() << "chunk mismatch after reload, ignoring will retry issue " << chunkInfo.chunk.toString() << endl;
+            cur->serverID = res["serverID"].OID();
+            bool restarted = last && last->serverID != cur->serverID;
+
+            BSONObjIterator i( res.getObjectField( "chunks" ) );
+            while ( i.more() ) {
+                BSONObj chunk = i.next().Obj();
+                BSONObj min = chunk["min"].Obj().getOwned();
+                Counters& counters = cur->counters[min];
+                counters.counterId = chunk["counterId"].numberLong();
+                counters.ops = chunk["ops"].numberLong();
+                counters.bytes = chunk["bytes"].numberLong();
+
+                // the first counts of a mongos are only a baseline
+                if ( ! last )
                     continue;
+
+                // counts that started since the last sample all count
+                Counters before;
+                map<BSONObj,Counters>::const_iterator prev = last->counters.find( min );
+                if ( ! restarted && prev != last->counters.end() &&
+                     prev->second.counterId == counters.counterId ) {
+                    before = prev->second;
                 }
+
+                // a mongos that hasn't seen the latest splits charges the lower chunk
+                ChunkLoad& r = (*routed)[cm.findIntersectingChunk( min )->getMin()];
+                r.ops += counters.ops - before.ops;
+                r.bytes += counters.bytes - before.bytes;
             }
+            return true;
+        }
+        catch ( DBException& e ) {
+            LOG(1) << "couldn't get chunk load from mongos " << host << ": " << e.what() << endl;
+            return false;
+        }
+    }
 
-            BSONObj res;
-            if (c->moveAndCommit(Shard::make(chunkInfo.to),
-                                 Chunk::MaxChunkSize,
-                                 secondaryThrottle,
-                                 waitForDelete,
-                                 res)) {
-                movedCount++;
+    const ChunkLoadMap& Balancer::LoadTracker::sampleCollection( const string& ns,
+                                                                 const ChunkManager& cm ) {
+        CollectionLoad& coll = _collections[ns];
+
+        long long now = curTimeMillis64();
+        double secs = coll.lastSampleMillis ? ( now - coll.lastSampleMillis ) / 1000.0 : 0;
+        coll.lastSampleMillis = now;
+
+        // what every mongos routed to each chunk since the last sample
+        map<BSONObj,ChunkLoad> rates;
+        map<string, vector<BSONObj> > chunksByShard;
+
+        ChunkMap chunks = cm.getChunkMap();
+        for ( ChunkMap::const_iterator i = chunks.begin(); i != chunks.end(); ++i ) {
+            const Chunk& c = *i->second;
+            rates[c.getMin()] = ChunkLoad();
+            chunksByShard[c.getShard().getName()].push_back( c.getMin() );
+        }
+
+        map<string,RouterCounters> routers;
+        for ( vector<string>::const_iterator i = _routers.begin(); i != _routers.end(); ++i ) {
+            map<string,RouterCounters>::const_iterator last = coll.routers.find( *i );
+            RouterCounters cur;
+            if ( _sampleRouter( *i,
+                                ns,
+                                cm,
+                                last == coll.routers.end() ? NULL : &last->second,
+                                &cur,
+                                &rates ) ) {
+                routers[*i] = cur;
+            }
+        }
+        // a mongos gone quiet counts as new when it is back
+        coll.routers.swap( routers );
+
+        map<string,double> routedOps;
+        for ( map<string, vector<BSONObj> >::const_iterator i = chunksByShard.begin();
+              i != chunksByShard.end();
+              ++i ) {
+            for ( unsigned j = 0; j < i->second.size(); j++ )
+                routedOps[i->first] += rates[i->second[j]].ops;
+        }
+
+        if ( secs <= 0 ) {
+            // first look at this collection; the counters are only a baseline
+            for ( map<string, vector<BSONObj> >::const_iterator i = chunksByShard.begin();
+                  i != chunksByShard.end();
+                  ++i ) {
+                _shardOpsSince( i->first, ns );
+            }
+            coll.loads.clear();
+            return coll.loads;
+        }
+
+        // scale up to what each shard counted from every mongos
+        for ( map<string, vector<BSONObj> >::const_iterator i = chunksByShard.begin();
+              i != chunksByShard.end();
+              ++i ) {
+            double shardOps = _shardOpsSince( i->first, ns );
+            double seen = routedOps[i->first];
+            if ( shardOps <= seen )
                 continue;
+
+            const vector<BSONObj>& mins = i->second;
+            for ( unsigned j = 0; j < mins.size(); j++ ) {
+                ChunkLoad& r = rates[mins[j]];
+                if ( seen > 0 )
+                    r.ops *= shardOps / seen;
+                else
+                    r.ops = shardOps / mins.size();
             }
+        }
 
-            // the move requires acquiring the collection metadata's lock, which can fail
-            log() << "balancer move failed: " << res << " from: " << chunkInfo.from << " to: " << chunkInfo.to
-                  << " chunk: " << chunkInfo.chunk << endl;
+        double decay = pow( 0.5, secs / max( 1, balancerLoadHalfLifeSecs ) );
 
-            if ( res["chunkTooBig"].trueValue() ) {
-                // reload just to be safe
-                cm = cfg->getChunkManager( chunkInfo.ns );
-                verify( cm );
-                c = cm->findIntersectingChunk( chunkInfo.chunk.min );
-                
-                log() << "forcing a split because migrate failed for size reasons" << endl;
-                
-                res = BSONObj();
-                c->singleSplit( true , res );
-                log() << "forced split results: " << res << endl;
-                
-                if ( ! res["ok"].trueValue() ) {
-                    log() << "marking chunk as jumbo: " << c->toString() << endl;
-                    c->markAsJumbo();
-                    // we increment moveCount so we do another round right away
-                    movedCount++;
+        ChunkLoadMap loads;
+        for ( map<BSONObj,ChunkLoad>::const_iterator i = rates.begin(); i != rates.end(); ++i ) {
+            // a chunk split off keeps its min, so the lower half inherits the old rate
+            ChunkLoad old;
+            ChunkLoadMap::const_iterator prev = coll.loads.find( i->first );
+            if ( prev != coll.loads.end() )
+                old = prev->second;
+
+            loads[i->first] = ChunkLoad( old.ops * decay + ( i->second.ops / secs ) * ( 1 - decay ),
+                                         old.bytes * decay + ( i->second.bytes / secs ) * ( 1 - decay ) );
+        }
+        coll.loads.swap( loads );
+
+        return coll.loads;
+    }
+
+    namespace {
+
+        /**
+         * Migrations finished in the last hour, for the "balancer" serverStatus section.
+         */
+        class MigrationStats {
+        public:
+            MigrationStats() : _mutex( "balancerMigrationStats" ), _started( time(0) ),
+                               _active( 0 ), _succeeded( 0 ), _failed( 0 ) {}
+
+            void started() {
+                SimpleMutex::scoped_lock lk( _mutex );
+                _active++;
+            }
+
+            void finished( bool ok, long long bytes ) {
+                SimpleMutex::scoped_lock lk( _mutex );
+                _active--;
+                if ( ! ok ) {
+                    _failed++;
+                    return;
+                }
+                _succeeded++;
+                _lastHour.push_back( make_pair( time(0), bytes ) );
+                _prune();
+            }
+
+            BSONObj toBSON() {
+                SimpleMutex::scoped_lock lk( _mutex );
+                _prune();
+                long long bytes = 0;
+                for ( deque< pair<time_t,long long> >::const_iterator i = _lastHour.begin();
+                      i != _lastHour.end();
+                      ++i )
+                    bytes += i->second;
+                long long window = max( 1LL, min( 3600LL, (long long)( time(0) - _started ) ) );
+
+                BSONObjBuilder b;
+                b.append( "active" , _active );
+                b.appendNumber( "succeeded" , _succeeded );
+                b.appendNumber( "failed" , _failed );
+                b.appendNumber( "chunksMovedLastHour" , (long long)_lastHour.size() );
+                b.appendNumber( "bytesMovedLastHour" , bytes );
+                b.append( "bytesPerSecond" , (double)bytes / window );
+                return b.obj();
+            }
+
+        private:
+            void _prune() {
+                time_t hourAgo = time(0) - 3600;
+                while ( ! _lastHour.empty() && _lastHour.front().first < hourAgo )
+                    _lastHour.pop_front();
+            }
+
+            SimpleMutex _mutex;
+            time_t _started;
+            int _active;
+            long long _succeeded;
+            long long _failed;
+            deque< pair<time_t,long long> > _lastHour; // finish time and bytes cloned
+        } migrationStats;
+
+        class BalancerServerStatusSection : public ServerStatusSection {
+        public:
+            BalancerServerStatusSection() : ServerStatusSection( "balancer" ) {}
+            virtual bool includeByDefault() const { return true; }
+            virtual BSONObj generateSection( const BSONElement& configElement ) const {
+                BSONObjBuilder b;
+                b.append( "migrations" , migrationStats.toBSON() );
+                b.append( "maxConcurrentMigrations" , balancerMaxConcurrentMigrations );
+                return b.obj();
+            }
+        } balancerServerStatusSection;
+
+    }
+
+    /** one candidate of a round, moved on its own thread by _moveChunks */
+    struct Balancer::Migration {
+        Migration( const CandidateChunk& c ) :
+            chunk( c ), started( false ), done( false ), moved( false ) {}
+
+        const CandidateChunk& chunk;
+        bool started;
+        bool done;      // finished, but its shards not yet free for another migration
+        bool moved;
+    };
+
+    void Balancer::_runMigration( Migration* m,
+                                  bool secondaryThrottle,
+                                  bool waitForDelete,
+                                  mongo::mutex* roundMutex,
+                                  boost::condition* finished ) {
+        bool moved = false;
+        long long bytes = 0;
+        try {
+            moved = _moveOneChunk( m->chunk, secondaryThrottle, waitForDelete, &bytes );
+        }
+        catch ( std::exception& e ) {
+            log() << "balancer move of " << m->chunk.chunk.toString() << " from: "
+                  << m->chunk.from << " to: " << m->chunk.to << " failed: " << e.what() << endl;
+        }
+        migrationStats.finished( moved, bytes );
+
+        scoped_lock lk( *roundMutex );
+        m->moved = moved;
+        m->done = true;
+        finished->notify_all();
+    }
+
+    int Balancer::_moveChunks(const vector<CandidateChunkPtr>* candidateChunks,
+                              bool secondaryThrottle,
+                              bool waitForDelete)
+    {
+        // Every candidate is from a different collection, and a shard can only donate one chunk
+        // and receive one chunk at a time, so migrations run together as long as their donors
+        // and recipients differ.
+        vector< shared_ptr<Migration> > migrations;
+        for ( vector<CandidateChunkPtr>::const_iterator it = candidateChunks->begin(); it != candidateChunks->end(); ++it )
+            migrations.push_back( shared_ptr<Migration>( new Migration( *it->get() ) ) );
+
+        mongo::mutex roundMutex( "balancerRound" );
+        boost::condition finished;
+        boost::thread_group threads;
+        set<string> donating;
+        set<string> receiving;
+        size_t running = 0;
+        size_t remaining = migrations.size();
+
+        {
+            scoped_lock lk( roundMutex );
+            while ( remaining > 0 ) {
+                for ( size_t i = 0; i < migrations.size(); i++ ) {
+                    Migration& m = *migrations[i];
+                    if ( m.done && m.started ) {
+                        // free its shards for the next one
+                        donating.erase( m.chunk.from );
+                        receiving.erase( m.chunk.to );
+                        m.started = false;
+                        running--;
+                        remaining--;
+                    }
+                }
+
+                size_t maxRunning = max( 1, balancerMaxConcurrentMigrations );
+                for ( size_t i = 0; i < migrations.size() && running < maxRunning; i++ ) {
+                    Migration& m = *migrations[i];
+                    if ( m.started || m.done )
+                        continue;
+                    if ( donating.count( m.chunk.from ) || receiving.count( m.chunk.to ) )
+                        continue;
+
+                    donating.insert( m.chunk.from );
+                    receiving.insert( m.chunk.to );
+                    m.started = true;
+                    running++;
+                    migrationStats.started();
+                    threads.create_thread( boost::bind( &Balancer::_runMigration, this, &m,
+                                                        secondaryThrottle, waitForDelete,
+                                                        &roundMutex, &finished ) );
                 }
 
+                if ( remaining > 0 )
+                    finished.wait( lk.boost() );
             }
         }
+        threads.join_all();
+
+        int movedCount = 0;
+        for ( size_t i = 0; i < migrations.size(); i++ ) {
+            const Migration& m = *migrations[i];
+            if ( m.moved && m.chunk.forLoad )
+                _loadMoveTimes.push_back( time(0) );
+            else if ( m.moved )
+                movedCount++;
+        }
 
         return movedCount;
     }
 
+    bool Balancer::_moveOneChunk( const CandidateChunk& chunkInfo,
+                                  bool secondaryThrottle,
+                                  bool waitForDelete,
+                                  long long* bytesMoved ) {
+        DBConfigPtr cfg = grid.getDBConfig( chunkInfo.ns );
+        verify( cfg );
+
+        ChunkManagerPtr cm = cfg->getChunkManager( chunkInfo.ns );
+        verify( cm );
+
+        ChunkPtr c = cm->findIntersectingChunk( chunkInfo.chunk.min );
+        if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
+            // likely a split happened somewhere
+            cm = cfg->getChunkManager( chunkInfo.ns , true /* reload */);
+            verify( cm );
+
+            c = cm->findIntersectingChunk( chunkInfo.chunk.min );
+            if ( c->getMin().woCompare( chunkInfo.chunk.min ) || c->getMax().woCompare( chunkInfo.chunk.max ) ) {
+                log() << "chunk mismatch after reload, ignoring will retry issue " << chunkInfo.chunk.toString() << endl;
+                return false;
+            }
+        }
+
+        BSONObj res;
+        if (c->moveAndCommit(Shard::make(chunkInfo.to),
+                             Chunk::MaxChunkSize,
+                             secondaryThrottle,
+                             waitForDelete,
+                             res)) {
+            *bytesMoved = res.getObjectField( "counts" )["clonedBytes"].numberLong();
+            return true;
+        }
+
+        // the move requires acquiring the collection metadata's lock, which can fail
+        log() << "balancer move failed: " << res << " from: " << chunkInfo.from << " to: " << chunkInfo.to
+              << " chunk: " << chunkInfo.chunk << endl;
+
+        if ( res["chunkTooBig"].trueValue() ) {
+            // reload just to be safe
+            cm = cfg->getChunkManager( chunkInfo.ns );
+            verify( cm );
+            c = cm->findIntersectingChunk( chunkInfo.chunk.min );
+
+            log() << "forcing a split because migrate failed for size reasons" << endl;
+
+            res = BSONObj();
+            c->singleSplit( true , res );
+            log() << "forced split results: " << res << endl;
+
+            if ( ! res["ok"].trueValue() ) {
+                log() << "marking chunk as jumbo: " << c->toString() << endl;
+                c->markAsJumbo();
+            }
+
+        }
+
+        return false;
+    }
+
     void Balancer::_ping( DBClientBase& conn, bool waiting ) {
         WriteConcern w = conn.getWriteConcern();
         conn.setWriteConcern( W_NONE );
@@ -237,6 +632,12 @@ namespace mongo {
 
         OCCASIONALLY warnOnMultiVersion( shardInfo );
 
+        // keep sampling load even when the budget is spent, so rates are current once it isn't
+        bool loadAware = balancerLoadAware;
+        if ( loadAware )
+            _loadTracker.sampleCluster( conn, allShards );
+        int loadMovesLeft = loadAware ? _loadMovesLeft() : 0;
+
         //
         // 3. For each collection, check if the balancing policy recommends moving anything around.
         //
@@ -334,7 +735,14 @@ namespace mongo {
                 continue;
             }
 
+            if ( loadAware ) {
+                const ChunkLoadMap& loads = _loadTracker.sampleCollection( ns, *cm );
+                if ( loadMovesLeft > 0 && ! loads.empty() )
+                    status.setChunkLoads( &loads );
+            }
+
             CandidateChunk* p = _policy->balance( ns, status, _balancedLastTime );
+            if ( p && p->forLoad ) loadMovesLeft--;
             if ( p ) candidateChunks->push_back( CandidateChunkPtr( p ) );
         }
     }
@@ -476,7 +884,11 @@ namespace mongo {
                 
                 conn.done();
 
-                sleepsecs( _balancedLastTime ? sleepTime / 6 : sleepTime );
+                // while there is still imbalance to work off, start the next round soon
+                if ( _balancedLastTime )
+                    sleepmillis( max( balancerMinRoundIntervalMillis, 0 ) );
+                else
+                    sleepsecs( sleepTime );
             }
             catch ( std::exception& e ) {
                 log() << "caught exception while doing balance: " << e.what() << endl;
@@ -26,6 +26,10 @@
 
 namespace mongo {
 
+    class Chunk;
+    class ChunkManager;
+    class Shard;
+
     /**
      * The balancer is a background task that tries to keep the number of chunks across all servers of the cluster even. Although
      * every mongos will have one balancer running, only one of them will be active at the any given point in time. The balancer
@@ -33,7 +37,12 @@ namespace mongo {
      *
      * The balancer does act continuously but in "rounds". At a given round, it would decide if there is an imbalance by
      * checking the difference in chunks between the most and least loaded shards. It would issue a request for a chunk
-     * migration per round, if it found so.
+     * migration per collection per round, if it found so, running those with distinct shards concurrently. Rounds follow
+     * each other without a pause for as long as they keep moving chunks.
+     *
+     * With balancerLoadAware set, once chunk counts are even it also moves chunks off shards that
+     * take a disproportionate share of a collection's measured traffic, up to
+     * balancerLoadMigrationsPerHour such moves.
      */
     class Balancer : public BackgroundJob {
     public:
@@ -56,9 +65,81 @@ namespace mongo {
         // time the Balancer started running
         time_t _started;
 
-        // number of moved chunks in last round
+        // number of moved chunks in last round, not counting moves made for load
         int _balancedLastTime;
 
+        // when each load driven move of the last hour finished, oldest first
+        deque<time_t> _loadMoveTimes;
+
+        /**
+         * Turns the per chunk op counts every mongos keeps, and each shard's per collection op
+         * counts from 'top', into decayed per chunk rates for the load aware policy.
+         *
+         * Each mongos that pinged the config servers lately reports its counts with chunkLoad.
+         * Counts start from 0 again when a mongos restarts, which shows as a new serverID, and
+         * when it loads a chunk again, which shows as a new counterId for the chunk.  Reads
+         * that span chunks are only in the shards' counts, so each shard's chunk rates are
+         * scaled up to what the shard itself counted, in the same proportions.
+         */
+        class LoadTracker {
+        public:
+            /**
+             * reads every shard's 'top' and finds the live mongoses; call once per round, before
+             * sampleCollection
+             */
+            void sampleCluster( DBClientBase& conn, const vector<Shard>& shards );
+
+            /** @return the decayed loads of the collection's chunks, keyed by chunk min */
+            const ChunkLoadMap& sampleCollection( const string& ns, const ChunkManager& cm );
+
+        private:
+            /** @return ops the shard counted for 'ns' since the last call for that pair */
+            long long _shardOpsSince( const string& shard, const string& ns );
+
+            struct Counters {
+                Counters() : counterId( 0 ), ops( 0 ), bytes( 0 ) {}
+                long long counterId;
+                long long ops;
+                long long bytes;
+            };
+
+            /** what one mongos reported for a collection, by its chunks' mins */
+            struct RouterCounters {
+                OID serverID;
+                map<BSONObj,Counters> counters;
+            };
+
+            /**
+             * Reads what the mongos at 'host' routed to the collection's chunks into 'cur', and
+             * adds what it routed since 'last', if not NULL, to 'routed' by the chunks of cm.
+             * @return false if the mongos couldn't tell
+             */
+            bool _sampleRouter( const string& host,
+                                const string& ns,
+                                const ChunkManager& cm,
+                                const RouterCounters* last,
+                                RouterCounters* cur,
+                                map<BSONObj,ChunkLoad>* routed );
+
+            struct CollectionLoad {
+                CollectionLoad() : lastSampleMillis( 0 ) {}
+                long long lastSampleMillis;
+                map<string,RouterCounters> routers; // by mongos host
+                ChunkLoadMap loads;
+            };
+
+            map<string,CollectionLoad> _collections;
+
+            // mongoses to ask for their counts this round
+            vector<string> _routers;
+
+            // latest 'top' totals by shard, and the per collection counts we last used
+            map<string,BSONObj> _shardTotals;
+            map<string, map<string,long long> > _shardOpsSeen;
+        };
+
+        LoadTracker _loadTracker;
+
         // decide which chunks to move; owned here.
         scoped_ptr<BalancerPolicy> _policy;
         
@@ -80,18 +161,40 @@ namespace mongo {
          */
         void _doBalanceRound( DBClientBase& conn, vector<CandidateChunkPtr>* candidateChunks );
 
+        struct Migration;
+
         /**
-         * Issues chunk migration request, one at a time.
+         * Issues chunk migration requests, up to balancerMaxConcurrentMigrations at a time as
+         * long as no two share a donor or a recipient.
          *
          * @param candidateChunks possible chunks to move
          * @param secondaryThrottle wait for secondaries to catch up before pushing more deletes
          * @param waitForDelete wait for deletes to complete after each chunk move
-         * @return number of chunks effectively moved
+         * @return number of chunks effectively moved, not counting moves made for load; those
+         *         are recorded against the load migration budget instead
          */
         int _moveChunks(const vector<CandidateChunkPtr>* candidateChunks,
                         bool secondaryThrottle,
                         bool waitForDelete);
 
+        /** body of the thread that runs one migration for _moveChunks */
+        void _runMigration( Migration* m,
+                            bool secondaryThrottle,
+                            bool waitForDelete,
+                            mongo::mutex* roundMutex,
+                            boost::condition* finished );
+
+        /**
+         * Moves one candidate chunk, splitting or marking it jumbo if it turns out too big.
+         *
+         * @param bytesMoved set to the bytes the recipient cloned, when known
+         * @return true if the chunk moved
+         */
+        bool _moveOneChunk( const CandidateChunk& chunkInfo,
+                            bool secondaryThrottle,
+                            bool waitForDelete,
+                            long long* bytesMoved );
+
         /**
          * Marks this balancer as being live on the config server(s).
          *
@@ -104,6 +207,9 @@ namespace mongo {
          */
         bool _checkOIDs();
 
+        /** @return how many more load driven moves the hourly budget allows right now */
+        int _loadMovesLeft();
+
     };
 
     extern Balancer balancer;
@@ -32,7 +32,7 @@ namespace mongo {
 
     DistributionStatus::DistributionStatus( const ShardInfoMap& shardInfo,
                                             const ShardToChunksMap& shardToChunksMap )
-        : _shardInfo( shardInfo ), _shardChunks( shardToChunksMap ) {
+        : _shardInfo( shardInfo ), _shardChunks( shardToChunksMap ), _chunkLoads( NULL ) {
 
         for ( ShardInfoMap::const_iterator i = _shardInfo.begin(); i != _shardInfo.end(); ++i ) {
             _shards.insert( i->first );
@@ -72,6 +72,29 @@ namespace mongo {
         return total;
     }
 
+    double DistributionStatus::chunkLoad( const BSONObj& chunk ) const {
+        if ( ! _chunkLoads )
+            return 0;
+
+        ChunkLoadMap::const_iterator i = _chunkLoads->find( chunk[ChunkType::min()].Obj() );
+        if ( i == _chunkLoads->end() )
+            return 0;
+        return i->second.score();
+    }
+
+    double DistributionStatus::shardLoadWithTag( const string& shard, const string& tag ) const {
+        ShardToChunksMap::const_iterator i = _shardChunks.find( shard );
+        if ( i == _shardChunks.end() )
+            return 0;
+
+        double total = 0;
+        for ( unsigned j=0; j<i->second.size(); j++ )
+            if ( tag == getTagForChunk( i->second[j] ) )
+                total += chunkLoad( i->second[j] );
+
+        return total;
+    }
+
     string DistributionStatus::getBestReceieverShard( const string& tag ) const {
         string best;
         unsigned minChunks = numeric_limits<unsigned>::max();
@@ -361,6 +384,7 @@ namespace mongo {
 
             const vector<BSONObj>& chunks = distribution.getChunks( from );
             unsigned numJumboChunks = 0;
+            int chosen = -1;
             for ( unsigned j = 0; j < chunks.size(); j++ ) {
                 if ( distribution.getTagForChunk( chunks[j] ) != tag )
                     continue;
@@ -370,10 +394,21 @@ namespace mongo {
                     continue;
                 }
 
-                log() << " ns: " << ns << " going to move " << chunks[j]
+                // any chunk evens the counts; with load known, move the one that disturbs
+                // load the least
+                if ( chosen < 0 ||
+                     distribution.chunkLoad( chunks[j] ) < distribution.chunkLoad( chunks[chosen] ) )
+                    chosen = j;
+
+                if ( ! distribution.hasLoad() )
+                    break;
+            }
+
+            if ( chosen >= 0 ) {
+                log() << " ns: " << ns << " going to move " << chunks[chosen]
                       << " from: " << from << " to: " << to << " tag [" << tag << "]"
                       << endl;
-                return new MigrateInfo( ns, to, from, chunks[j] );
+                return new MigrateInfo( ns, to, from, chunks[chosen] );
             }
 
             if ( numJumboChunks ) {
@@ -387,10 +422,184 @@ namespace mongo {
             verify( false ); // should be impossible
         }
 
+        // 4) chunk counts are even enough; spread measured load within each tag
+
+        if ( distribution.hasLoad() ) {
+            // a load move must not trip step 3 on the next round, which runs with the loose
+            // threshold as long as the balancer passes in only the moves step 3 asked for
+            int loadThreshold = 8;
+            if ( distribution.totalChunks() < 20 )
+                loadThreshold = 2;
+            else if ( distribution.totalChunks() < 80 )
+                loadThreshold = 4;
+
+            for ( unsigned i=0; i<tags.size(); i++ ) {
+                MigrateInfo* m = _balanceLoad( ns, distribution, tags[i], loadThreshold );
+                if ( m )
+                    return m;
+            }
+        }
+
         // Everything is balanced here!
         return NULL;
     }
 
+    const double BalancerPolicy::LoadImbalanceThreshold = 0.2;
+
+    BSONObj BalancerPolicy::_bestChunkForGap( const DistributionStatus& distribution,
+                                              const string& tag,
+                                              const string& shard,
+                                              double gap,
+                                              double mustBeat ) {
+        double bestResidual = mustBeat;
+        BSONObj best;
+
+        const vector<BSONObj>& chunks = distribution.getChunks( shard );
+        for ( unsigned j = 0; j < chunks.size(); j++ ) {
+            if ( distribution.getTagForChunk( chunks[j] ) != tag )
+                continue;
+
+            double load = distribution.chunkLoad( chunks[j] );
+            if ( load <= 0 )
+                continue;
+
+            double residual = fabs( gap - 2 * load );
+            if ( residual >= bestResidual )
+                continue;
+
+            if ( _isJumbo( chunks[j] ) )
+                continue;
+
+            best = chunks[j];
+            bestResidual = residual;
+        }
+
+        return best;
+    }
+
+    MigrateInfo* BalancerPolicy::_makeRoomForLoad( const string& ns,
+                                                   const DistributionStatus& distribution,
+                                                   const string& tag,
+                                                   int threshold,
+                                                   const string& hot,
+                                                   const string& cool,
+                                                   double gap ) {
+        // Swap in two moves: the coldest chunk on 'cool' goes to 'hot' now, and a hot chunk
+        // follows next round.  Only worth it if that second move then leaves both shards below
+        // where 'hot' is now; otherwise the two could trade chunks forever.
+
+        int hotChunks = distribution.numberOfChunksInShardWithTag( hot, tag );
+        int coolChunks = distribution.numberOfChunksInShardWithTag( cool, tag );
+        const ShardInfo& hotInfo = distribution.shardInfo( hot );
+        if ( ( hotChunks + 1 ) - ( coolChunks - 1 ) >= threshold ||
+             hotInfo.isSizeMaxed() || hotInfo.isDraining() ) {
+            LOG(1) << "not moving load from " << hot << " to " << cool << " for tag [" << tag
+                   << "], it would unbalance chunk counts " << hotChunks << " / " << coolChunks
+                   << endl;
+            return NULL;
+        }
+
+        BSONObj coldest;
+        double coldestLoad = numeric_limits<double>::max();
+        const vector<BSONObj>& chunks = distribution.getChunks( cool );
+        for ( unsigned j = 0; j < chunks.size(); j++ ) {
+            if ( distribution.getTagForChunk( chunks[j] ) != tag )
+                continue;
+
+            double load = distribution.chunkLoad( chunks[j] );
+            if ( load >= coldestLoad || _isJumbo( chunks[j] ) )
+                continue;
+
+            coldest = chunks[j];
+            coldestLoad = load;
+        }
+
+        if ( coldest.isEmpty() )
+            return NULL;
+
+        // after the swap the gap grows by twice the cold chunk; the follow up must beat the gap
+        // as it is now, which also means it can't be the cold chunk coming straight back
+        if ( _bestChunkForGap( distribution, tag, hot, gap + 2 * coldestLoad, gap ).isEmpty() )
+            return NULL;
+
+        log() << " ns: " << ns << " going to move " << coldest
+              << " from: " << cool << " to: " << hot << " tag [" << tag << "]"
+              << " to make room for load, chunk load " << coldestLoad << endl;
+
+        MigrateInfo* m = new MigrateInfo( ns, hot, cool, coldest.getOwned() );
+        m->forLoad = true;
+        return m;
+    }
+
+    MigrateInfo* BalancerPolicy::_balanceLoad( const string& ns,
+                                               const DistributionStatus& distribution,
+                                               const string& tag,
+                                               int threshold ) {
+        string hot;
+        string cool;
+        double hotLoad = -1;
+        double coolLoad = numeric_limits<double>::max();
+        double total = 0;
+        int numShards = 0;
+
+        const set<string>& shards = distribution.shards();
+        for ( set<string>::const_iterator i = shards.begin(); i != shards.end(); ++i ) {
+            const ShardInfo& info = distribution.shardInfo( *i );
+            if ( ! info.hasTag( tag ) )
+                continue;
+
+            double load = distribution.shardLoadWithTag( *i, tag );
+            total += load;
+            numShards++;
+
+            if ( ! info.hasOpsQueued() && load > hotLoad ) {
+                hot = *i;
+                hotLoad = load;
+            }
+
+            if ( ! info.isSizeMaxed() && ! info.isDraining() && ! info.hasOpsQueued() &&
+                 load < coolLoad ) {
+                cool = *i;
+                coolLoad = load;
+            }
+        }
+
+        if ( numShards < 2 || hot.empty() || cool.empty() || hot == cool )
+            return NULL;
+
+        double mean = total / numShards;
+        if ( hotLoad <= 0 || hotLoad <= mean * ( 1 + LoadImbalanceThreshold ) )
+            return NULL;
+
+        double gap = hotLoad - coolLoad;
+
+        // load moves must not leave chunk counts far enough apart for step 3 to undo them
+        int hotChunks = distribution.numberOfChunksInShardWithTag( hot, tag );
+        int coolChunks = distribution.numberOfChunksInShardWithTag( cool, tag );
+        if ( ( coolChunks + 1 ) - ( hotChunks - 1 ) >= threshold )
+            return _makeRoomForLoad( ns, distribution, tag, threshold, hot, cool, gap );
+
+        // the pair ends up even if the chunk carries half the gap between them; a chunk
+        // carrying more than the whole gap would only move the hot spot
+        BSONObj best = _bestChunkForGap( distribution, tag, hot, gap, gap );
+
+        if ( best.isEmpty() ) {
+            LOG(1) << "no chunk on " << hot << " would even out its load with " << cool
+                   << " for tag [" << tag << "]" << endl;
+            return NULL;
+        }
+
+        log() << " ns: " << ns << " going to move " << best
+              << " from: " << hot << " (load " << hotLoad << ")"
+              << " to: " << cool << " (load " << coolLoad << ")"
+              << " tag [" << tag << "] for load, chunk load " << distribution.chunkLoad( best )
+              << endl;
+
+        MigrateInfo* m = new MigrateInfo( ns, cool, hot, best.getOwned() );
+        m->forLoad = true;
+        return m;
+    }
+
 
     ShardInfo::ShardInfo( long long maxSize, long long currSize,
                           bool draining, bool opsQueued,
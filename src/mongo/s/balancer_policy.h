@@ -106,14 +106,33 @@ namespace mongo {
         const string from;
         const ChunkInfo chunk;
 
+        // true if the move is to spread load rather than chunks; these count against the
+        // balancer's load migration budget
+        bool forLoad;
+
         MigrateInfo( const string& a_ns , const string& a_to , const string& a_from , const BSONObj& a_chunk )
-            : ns( a_ns ) , to( a_to ) , from( a_from ), chunk( a_chunk ) {}
+            : ns( a_ns ) , to( a_to ) , from( a_from ), chunk( a_chunk ), forLoad( false ) {}
+
+
+    };
+
+    /**
+     * Measured traffic of one chunk, as decayed per second rates.
+     */
+    struct ChunkLoad {
+        ChunkLoad() : ops( 0 ), bytes( 0 ) {}
+        ChunkLoad( double a_ops, double a_bytes ) : ops( a_ops ), bytes( a_bytes ) {}
 
+        /** a single figure to compare chunks by: ops, with every 16KB written counting as one */
+        double score() const { return ops + bytes / ( 16 * 1024 ); }
 
+        double ops;
+        double bytes;
     };
 
     typedef map< string,ShardInfo > ShardInfoMap;
     typedef map< string,vector<BSONObj> > ShardToChunksMap;
+    typedef map< BSONObj,ChunkLoad > ChunkLoadMap; // keyed by chunk min
 
     class DistributionStatus : boost::noncopyable {
     public:
@@ -167,6 +186,19 @@ namespace mongo {
 
         /** @return the ShardInfo for the shard */
         const ShardInfo& shardInfo( const string& shard ) const;
+
+        // ---- load, only known when the balancer measured it and may still act on it
+
+        /** 'loads' must outlive this; chunks missing from it have no load */
+        void setChunkLoads( const ChunkLoadMap* loads ) { _chunkLoads = loads; }
+
+        bool hasLoad() const { return _chunkLoads != NULL; }
+
+        /** @return the load score of the chunk */
+        double chunkLoad( const BSONObj& chunk ) const;
+
+        /** @return the summed load score of the shard's chunks with the given tag */
+        double shardLoadWithTag( const string& shard, const string& tag ) const;
         
         /** writes all state to log() */
         void dump() const;
@@ -177,6 +209,7 @@ namespace mongo {
         map<BSONObj,TagRange> _tagRanges;
         set<string> _allTags;
         set<string> _shards;
+        const ChunkLoadMap* _chunkLoads;
     };
 
     class BalancerPolicy {
@@ -189,7 +222,8 @@ namespace mongo {
          *
          * @param ns is the collections namepace.
          * @param DistributionStatus holds all the info about the current state of the cluster/namespace
-         * @param balancedLastTime is the number of chunks effectively moved in the last round.
+         * @param balancedLastTime is the number of chunks effectively moved in the last round,
+         *        not counting moves made for load.
          * @returns NULL or MigrateInfo of the best move to make towards balacing the collection.
          *          caller owns the MigrateInfo instance
          */
@@ -197,8 +231,46 @@ namespace mongo {
                                      const DistributionStatus& distribution,
                                      int balancedLastTime );
 
+        /**
+         * Once chunk counts are within the threshold, a shard whose load is this much above the
+         * average for a tag sheds a chunk.  0.2 means 20% above.
+         */
+        static const double LoadImbalanceThreshold;
+
     private:
         static bool _isJumbo( const BSONObj& chunk );
+
+        /**
+         * Picks a move from the hottest to the coolest shard for the tag, or returns NULL.
+         * Prefers the chunk that brings the two closest to even, and never leaves the chunk
+         * counts further apart than 'threshold'.
+         */
+        static MigrateInfo* _balanceLoad( const string& ns,
+                                          const DistributionStatus& distribution,
+                                          const string& tag,
+                                          int threshold );
+
+        /**
+         * When 'cool' has too many chunks to take a hot one, moves its coldest chunk to 'hot'
+         * instead, if that opens the way to a move that leaves both below 'hot' today.
+         */
+        static MigrateInfo* _makeRoomForLoad( const string& ns,
+                                              const DistributionStatus& distribution,
+                                              const string& tag,
+                                              int threshold,
+                                              const string& hot,
+                                              const string& cool,
+                                              double gap );
+
+        /**
+         * @return the chunk on 'shard' that, moved across a load gap of 'gap', leaves the
+         * smallest gap, as long as that is under 'mustBeat'; or an empty object
+         */
+        static BSONObj _bestChunkForGap( const DistributionStatus& distribution,
+                                         const string& tag,
+                                         const string& shard,
+                                         double gap,
+                                         double mustBeat );
     };
 
 
@@ -519,5 +519,128 @@ namespace mongo {
                 }
             }
         }
+
+        /** @return the hottest shard's load over the average shard's */
+        double loadSkew( const ShardToChunksMap& chunks, const ChunkLoadMap& loads ) {
+            double total = 0;
+            double hottest = 0;
+            for ( ShardToChunksMap::const_iterator i = chunks.begin(); i != chunks.end(); ++i ) {
+                double shardLoad = 0;
+                for ( unsigned j = 0; j < i->second.size(); j++ ) {
+                    ChunkLoadMap::const_iterator l =
+                            loads.find( i->second[j][ChunkType::min()].Obj() );
+                    if ( l != loads.end() )
+                        shardLoad += l->second.score();
+                }
+                total += shardLoad;
+                hottest = max( hottest, shardLoad );
+            }
+            return hottest / ( total / chunks.size() );
+        }
+
+        /**
+         * Runs the policy against a load trace until it stops moving chunks.
+         * @return the skew it leaves, after checking it did no harm to chunk counts
+         */
+        double simulateLoad( ShardToChunksMap& chunks, const ChunkLoadMap& loads, int* moves ) {
+            ShardInfoMap shards;
+            for ( ShardToChunksMap::const_iterator i = chunks.begin(); i != chunks.end(); ++i )
+                shards[i->first] = ShardInfo( 0, 0, false, false );
+
+            *moves = 0;
+            for ( ; *moves < 100; ++*moves ) {
+                DistributionStatus d( shards, chunks );
+                d.setChunkLoads( &loads );
+                // load moves don't count towards balancedLastTime
+                MigrateInfo* m = BalancerPolicy::balance( "ns", d, 0 );
+                if ( ! m )
+                    break;
+                moveChunk( chunks, m );
+                delete m;
+            }
+
+            unsigned most = 0;
+            unsigned least = numeric_limits<unsigned>::max();
+            for ( ShardToChunksMap::const_iterator i = chunks.begin(); i != chunks.end(); ++i ) {
+                most = max( most, (unsigned)i->second.size() );
+                least = min( least, (unsigned)i->second.size() );
+            }
+            // 40 chunks balance with a threshold of 4
+            ASSERT( most - least < 4 );
+
+            return loadSkew( chunks, loads );
+        }
+
+        /** 4 shards of 10 chunks each, keyed 0 to 39 */
+        void addEvenShards( ShardToChunksMap& chunks ) {
+            for ( int i = 0; i < 4; i++ )
+                addShard( chunks, 10, i == 3 );
+        }
+
+        TEST( BalancerPolicyTests, LoadSimulation ) {
+            // Zipf-like traces, hot keys together and scattered, and one shard that is evenly
+            // hot.  Chunk counts start even, so the count policy alone moves nothing.
+            vector<ChunkLoadMap> traces;
+
+            ShardToChunksMap layout;
+            addEvenShards( layout );
+            vector<BSONObj> mins;
+            for ( ShardToChunksMap::const_iterator i = layout.begin(); i != layout.end(); ++i )
+                for ( unsigned j = 0; j < i->second.size(); j++ )
+                    mins.push_back( i->second[j][ChunkType::min()].Obj().getOwned() );
+
+            {
+                ChunkLoadMap zipf;
+                for ( unsigned i = 0; i < mins.size(); i++ )
+                    zipf[mins[i]] = ChunkLoad( 1000 / pow( i + 1.0, 1.1 ), 0 );
+                traces.push_back( zipf );
+            }
+
+            PseudoRandom rng( 1337 );
+            for ( int t = 0; t < 5; t++ ) {
+                vector<BSONObj> shuffled = mins;
+                for ( unsigned i = shuffled.size() - 1; i > 0; i-- )
+                    swap( shuffled[i], shuffled[rng.nextInt32( i + 1 )] );
+
+                ChunkLoadMap scattered;
+                for ( unsigned i = 0; i < shuffled.size(); i++ )
+                    scattered[shuffled[i]] = ChunkLoad( 1000 / pow( i + 1.0, 1.1 ), 0 );
+                traces.push_back( scattered );
+            }
+
+            {
+                // the first shard's chunks take all the writes
+                ChunkLoadMap oneHotShard;
+                for ( unsigned i = 0; i < mins.size(); i++ )
+                    oneHotShard[mins[i]] = ChunkLoad( 1, i < 10 ? 100 * 16 * 1024 : 0 );
+                traces.push_back( oneHotShard );
+            }
+
+            for ( unsigned t = 0; t < traces.size(); t++ ) {
+                ShardToChunksMap chunks;
+                addEvenShards( chunks );
+
+                double before = loadSkew( chunks, traces[t] );
+
+                {
+                    ShardInfoMap shards;
+                    for ( ShardToChunksMap::const_iterator i = chunks.begin(); i != chunks.end(); ++i )
+                        shards[i->first] = ShardInfo( 0, 0, false, false );
+                    DistributionStatus d( shards, chunks );
+                    ASSERT( ! BalancerPolicy::balance( "ns", d, 0 ) );
+                }
+
+                int moves;
+                double after = simulateLoad( chunks, traces[t], &moves );
+
+                log() << "load trace " << t << " skew before: " << before << " after: " << after
+                      << " in " << moves << " moves" << endl;
+
+                // the hottest chunk in these traces is about 1.2 times an even share by itself
+                ASSERT( moves < 100 );
+                ASSERT( after <= before );
+                ASSERT( after < 1.35 );
+            }
+        }
     }
 }
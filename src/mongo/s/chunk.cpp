@@ -20,9 +20,12 @@
 
 #include "mongo/s/chunk.h"
 
+#include "mongo/base/counter.h"
 #include "mongo/client/connpool.h"
 #include "mongo/client/dbclientcursor.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/platform/random.h"
 #include "mongo/s/chunk_diff.h"
 #include "mongo/s/chunk_version.h"
@@ -57,7 +60,9 @@ namespace mongo {
     bool Chunk::ShouldAutoSplit = true;
 
     Chunk::Chunk(const ChunkManager * manager, BSONObj from)
-        : _manager(manager), _lastmod(0, OID()), _dataWritten(mkDataWritten())
+        : _lineage(manager ? manager->_lineage : shared_ptr<ChunkManagerLineage>()),
+          _lastmod(0, OID()), _dataWritten(mkDataWritten()),
+          _loadCounterId(nextLoadCounterId())
     {
         string ns = from.getStringField(ChunkType::ns().c_str());
         _shard.reset(from.getStringField(ChunkType::shard().c_str()));
@@ -71,7 +76,7 @@ namespace mongo {
         _jumbo = from[ChunkType::jumbo()].trueValue();
 
         uassert( 10170 ,  "Chunk needs a ns" , ! ns.empty() );
-        uassert( 13327 ,  "Chunk ns must match server ns" , ns == _manager->getns() );
+        uassert( 13327 ,  "Chunk ns must match server ns" , ns == getns() );
 
         uassert( 10171 ,  "Chunk needs a server" , _shard.ok() );
 
@@ -80,46 +85,48 @@ namespace mongo {
     }
 
     Chunk::Chunk(const ChunkManager * info , const BSONObj& min, const BSONObj& max, const Shard& shard, ChunkVersion lastmod)
-        : _manager(info), _min(min), _max(max), _shard(shard), _lastmod(lastmod), _jumbo(false), _dataWritten(mkDataWritten())
+        : _lineage(info ? info->_lineage : shared_ptr<ChunkManagerLineage>()),
+          _min(min), _max(max), _shard(shard), _lastmod(lastmod), _jumbo(false), _dataWritten(mkDataWritten()),
+          _loadCounterId(nextLoadCounterId())
     {}
 
+    unsigned long long Chunk::nextLoadCounterId() {
+        static AtomicUInt64 lastId;
+        return lastId.addAndFetch( 1 );
+    }
+
     int Chunk::mkDataWritten() {
         PseudoRandom r(static_cast<int64_t>(time(0)));
-        return r.nextInt32( MaxChunkSize / ChunkManager::SplitHeuristics::splitTestFactor );
+        return r.nextInt32( MaxChunkSize / ChunkManagerLineage::SplitHeuristics::splitTestFactor );
     }
 
     string Chunk::getns() const {
-        verify( _manager );
-        return _manager->getns();
+        verify( _lineage );
+        return _lineage->getns();
     }
 
     bool Chunk::containsPoint( const BSONObj& point ) const {
         return getMin().woCompare( point ) <= 0 && point.woCompare( getMax() ) < 0;
     }
 
-    bool ChunkRange::containsPoint( const BSONObj& point ) const {
-        // same as Chunk method
-        return getMin().woCompare( point ) <= 0 && point.woCompare( getMax() ) < 0;
-    }
-
     bool Chunk::minIsInf() const {
-        return _manager->getShardKey().globalMin().woCompare( getMin() ) == 0;
+        return _lineage->getShardKey().globalMin().woCompare( getMin() ) == 0;
     }
 
     bool Chunk::maxIsInf() const {
-        return _manager->getShardKey().globalMax().woCompare( getMax() ) == 0;
+        return _lineage->getShardKey().globalMax().woCompare( getMax() ) == 0;
     }
 
     BSONObj Chunk::_getExtremeKey( int sort ) const {
         Query q;
         if ( sort == 1 ) {
-            q.sort( _manager->getShardKey().key() );
+            q.sort( _lineage->getShardKey().key() );
         }
         else {
             // need to invert shard key pattern to sort backwards
             // TODO: make a helper in ShardKeyPattern?
 
-            BSONObj k = _manager->getShardKey().key();
+            BSONObj k = _lineage->getShardKey().key();
             BSONObjBuilder r;
 
             BSONObjIterator i(k);
@@ -134,11 +141,11 @@ namespace mongo {
         // find the extreme key
         scoped_ptr<ScopedDbConnection> conn(
                 ScopedDbConnection::getInternalScopedDbConnection(getShard().getConnString()));
-        BSONObj end = conn->get()->findOne(_manager->getns(), q);
+        BSONObj end = conn->get()->findOne(_lineage->getns(), q);
         conn->done();
         if ( end.isEmpty() )
             return BSONObj();
-        return _manager->getShardKey().extractKey( end );
+        return _lineage->getShardKey().extractKey( end );
     }
 
     void Chunk::pickMedianKey( BSONObj& medianKey ) const {
@@ -147,8 +154,8 @@ namespace mongo {
                 ScopedDbConnection::getInternalScopedDbConnection( getShard().getConnString() ) );
         BSONObj result;
         BSONObjBuilder cmd;
-        cmd.append( "splitVector" , _manager->getns() );
-        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "splitVector" , _lineage->getns() );
+        cmd.append( "keyPattern" , _lineage->getShardKey().key() );
         cmd.append( "min" , getMin() );
         cmd.append( "max" , getMax() );
         cmd.appendBool( "force" , true );
@@ -175,8 +182,8 @@ namespace mongo {
                 ScopedDbConnection::getInternalScopedDbConnection( getShard().getConnString() ) );
         BSONObj result;
         BSONObjBuilder cmd;
-        cmd.append( "splitVector" , _manager->getns() );
-        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "splitVector" , _lineage->getns() );
+        cmd.append( "keyPattern" , _lineage->getShardKey().key() );
         cmd.append( "min" , getMin() );
         cmd.append( "max" , getMax() );
         cmd.append( "maxChunkSizeBytes" , chunkSize );
@@ -207,7 +214,7 @@ namespace mongo {
         if ( ! force ) {
             vector<BSONObj> candidates;
             const int maxPoints = 2;
-            pickSplitVector( candidates , getManager()->getCurrentDesiredChunkSize() , maxPoints , MaxObjectPerChunk );
+            pickSplitVector( candidates , _lineage->getCurrentDesiredChunkSize() , maxPoints , MaxObjectPerChunk );
             if ( candidates.size() <= 1 ) {
                 // no split points means there isn't enough data to split on
                 // 1 split point means we have between half the chunk size to full chunk size
@@ -268,7 +275,7 @@ namespace mongo {
     bool Chunk::multiSplit( const vector<BSONObj>& m , BSONObj& res ) const {
         const size_t maxSplitPoints = 8192;
 
-        uassert( 10165 , "can't split as shard doesn't have a manager" , _manager );
+        uassert( 10165 , "can't split as shard doesn't have a manager" , _lineage );
         uassert( 13332 , "need a split key to split chunk" , !m.empty() );
         uassert( 13333 , "can't split a chunk in that many parts", m.size() < maxSplitPoints );
         uassert( 13003 , "can't split a chunk with only one distinct value" , _min.woCompare(_max) );
@@ -277,8 +284,8 @@ namespace mongo {
                 ScopedDbConnection::getInternalScopedDbConnection( getShard().getConnString() ) );
 
         BSONObjBuilder cmd;
-        cmd.append( "splitChunk" , _manager->getns() );
-        cmd.append( "keyPattern" , _manager->getShardKey().key() );
+        cmd.append( "splitChunk" , _lineage->getns() );
+        cmd.append( "keyPattern" , _lineage->getShardKey().key() );
         cmd.append( "min" , getMin() );
         cmd.append( "max" , getMax() );
         cmd.append( "from" , getShard().getName() );
@@ -292,7 +299,7 @@ namespace mongo {
             conn->done();
 
             // Mark the minor version for *eventual* reload
-            _manager->markMinorForReload( this->_lastmod );
+            _lineage->_splitHeuristics.markMinorForReload( getns(), this->_lastmod );
 
             return false;
         }
@@ -300,7 +307,7 @@ namespace mongo {
         conn->done();
         
         // force reload of config
-        _manager->reload();
+        _lineage->reload();
 
         return true;
     }
@@ -313,7 +320,7 @@ namespace mongo {
     {
         uassert( 10167 ,  "can't move shard to its current location!" , getShard() != to );
 
-        log() << "moving chunk ns: " << _manager->getns() << " moving ( " << toString() << ") " << _shard.toString() << " -> " << to.toString() << endl;
+        log() << "moving chunk ns: " << _lineage->getns() << " moving ( " << toString() << ") " << _shard.toString() << " -> " << to.toString() << endl;
 
         Shard from = _shard;
 
@@ -321,7 +328,7 @@ namespace mongo {
                 ScopedDbConnection::getInternalScopedDbConnection( from.getConnString() ) );
 
         bool worked = fromconn->get()->runCommand( "admin" ,
-                                                   BSON( "moveChunk" << _manager->getns() <<
+                                                   BSON( "moveChunk" << _lineage->getns() <<
                                                          "from" << from.getAddress().toString() <<
                                                          "to" << to.getAddress().toString() <<
                                                          // NEEDED FOR 2.0 COMPATIBILITY
@@ -345,7 +352,7 @@ namespace mongo {
         // if succeeded, needs to reload to pick up the new location
         // if failed, mongos may be stale
         // reload is excessive here as the failure could be simply because collection metadata is taken
-        _manager->reload();
+        _lineage->reload();
 
         return worked;
     }
@@ -355,19 +362,19 @@ namespace mongo {
 
         try {
             _dataWritten += dataWritten;
-            int splitThreshold = getManager()->getCurrentDesiredChunkSize();
+            int splitThreshold = _lineage->getCurrentDesiredChunkSize();
             if ( minIsInf() || maxIsInf() ) {
                 splitThreshold = (int) ((double)splitThreshold * .9);
             }
 
-            if ( _dataWritten < splitThreshold / ChunkManager::SplitHeuristics::splitTestFactor )
+            if ( _dataWritten < splitThreshold / ChunkManagerLineage::SplitHeuristics::splitTestFactor )
                 return false;
             
-            if ( ! getManager()->_splitHeuristics._splitTickets.tryAcquire() ) {
-                LOG(1) << "won't auto split because not enough tickets: " << getManager()->getns() << endl;
+            if ( ! _lineage->_splitHeuristics._splitTickets.tryAcquire() ) {
+                LOG(1) << "won't auto split because not enough tickets: " << _lineage->getns() << endl;
                 return false;
             }
-            TicketHolderReleaser releaser( &(getManager()->_splitHeuristics._splitTickets) );
+            TicketHolderReleaser releaser( &(_lineage->_splitHeuristics._splitTickets) );
 
             // this is a bit ugly
             // we need it so that mongos blocks for the writes to actually be committed
@@ -393,9 +400,9 @@ namespace mongo {
                 _dataWritten = 0; // we're splitting, so should wait a bit
             }
 
-            bool shouldBalance = grid.shouldBalance( _manager->getns() );
+            bool shouldBalance = grid.shouldBalance( _lineage->getns() );
 
-            log() << "autosplitted " << _manager->getns() << " shard: " << toString()
+            log() << "autosplitted " << _lineage->getns() << " shard: " << toString()
                   << " on: " << splitPoint << " (splitThreshold " << splitThreshold << ")"
 #ifdef _DEBUG
                   << " size: " << getPhysicalSize() // slow - but can be useful when debugging
@@ -419,7 +426,7 @@ namespace mongo {
                     return true; // we did split even if we didn't migrate
                 }
 
-                ChunkManagerPtr cm = _manager->reload(false/*just reloaded in mulitsplit*/);
+                ChunkManagerPtr cm = _lineage->reload(false/*just reloaded in mulitsplit*/);
                 ChunkPtr toMove = cm->findIntersectingChunk(min);
 
                 if ( ! (toMove->getMin() == min && toMove->getMax() == max) ){
@@ -439,7 +446,7 @@ namespace mongo {
                                                 res ) );
                 
                 // update our config
-                _manager->reload();
+                _lineage->reload();
             }
 
             return true;
@@ -452,7 +459,7 @@ namespace mongo {
             _dataWritten = mkDataWritten();
 
             // if the collection lock is taken (e.g. we're migrating), it is fine for the split to fail.
-            warning() << "could not autosplit collection " << _manager->getns() << causedBy( e ) << endl;
+            warning() << "could not autosplit collection " << _lineage->getns() << causedBy( e ) << endl;
             return false;
         }
     }
@@ -463,8 +470,8 @@ namespace mongo {
 
         BSONObj result;
         uassert( 10169 ,  "datasize failed!" , conn->get()->runCommand( "admin" ,
-                 BSON( "datasize" << _manager->getns()
-                       << "keyPattern" << _manager->getShardKey().key()
+                 BSON( "datasize" << _lineage->getns()
+                       << "keyPattern" << _lineage->getShardKey().key()
                        << "min" << getMin()
                        << "max" << getMax()
                        << "maxSize" << ( MaxChunkSize + 1 )
@@ -488,7 +495,7 @@ namespace mongo {
 
     void Chunk::serialize(BSONObjBuilder& to,ChunkVersion myLastMod) {
 
-        to.append( "_id" , genID( _manager->getns() , _min ) );
+        to.append( "_id" , genID( _lineage->getns() , _min ) );
 
         if ( myLastMod.isSet() ) {
             myLastMod.addToBSON(to, ChunkType::DEPRECATED_lastmod());
@@ -500,7 +507,7 @@ namespace mongo {
             verify(0);
         }
 
-        to << ChunkType::ns(_manager->getns());
+        to << ChunkType::ns(_lineage->getns());
         to << ChunkType::min(_min);
         to << ChunkType::max(_max);
         to << ChunkType::shard(_shard.getName());
@@ -521,7 +528,7 @@ namespace mongo {
 
     string Chunk::toString() const {
         stringstream ss;
-        ss << ChunkType::ns() << ":" << _manager->getns() <<
+        ss << ChunkType::ns() << ":" << _lineage->getns() <<
               ChunkType::shard()   << ": " << _shard.toString() <<
               ChunkType::DEPRECATED_lastmod() << ": " << _lastmod.toString() <<
               ChunkType::min()     << ": " << _min <<
@@ -530,7 +537,7 @@ namespace mongo {
     }
 
     ShardKeyPattern Chunk::skey() const {
-        return _manager->getShardKey();
+        return _lineage->getShardKey();
     }
 
     void Chunk::markAsJumbo() const {
@@ -599,7 +606,7 @@ namespace mongo {
         _ns( ns ),
         _key( pattern ),
         _unique( unique ),
-        _chunkRanges(),
+        _lineage( new ChunkManagerLineage( ns, pattern ) ),
         _mutex("ChunkManager"),
         _sequenceNumber(++NextSequenceNumber)
     {
@@ -618,7 +625,7 @@ namespace mongo {
                                                         collDoc[CollectionType::keyPattern()].Obj().getOwned() :
                                                         BSONObj()),
         _unique(collDoc[CollectionType::unique()].trueValue()),
-        _chunkRanges(),
+        _lineage( new ChunkManagerLineage( _ns, _key ) ),
         _mutex("ChunkManager"),
         // The shard versioning mechanism hinges on keeping track of the number of times we reloaded ChunkManager's.
         // Increasing this number here will prompt checkShardVersion() to refresh the connection-level versions to
@@ -640,7 +647,8 @@ namespace mongo {
         _ns( oldManager->getns() ),
         _key( oldManager->getShardKey() ),
         _unique( oldManager->isUnique() ),
-        _chunkRanges(),
+        // the chunks kept from oldManager must stay valid in this one
+        _lineage( oldManager->_lineage ),
         _mutex("ChunkManager"),
         _sequenceNumber(++NextSequenceNumber)
     {
@@ -655,12 +663,13 @@ namespace mongo {
 
         int tries = 3;
         while (tries--) {
-            ChunkMap chunkMap;
+            ChunkTable chunks;
             set<Shard> shards;
             ShardVersionMap shardVersions;
+            vector<ChunkPtr> changed;
             Timer t;
 
-            bool success = _load( config, chunkMap, shards, shardVersions, _oldManager );
+            bool success = _load( config, chunks, shards, shardVersions, _oldManager, &changed );
 
             if( success ){
                 {
@@ -670,18 +679,25 @@ namespace mongo {
                           << " version: " << _version.toString()
                           << " based on: " <<
                            ( _oldManager.get() ? _oldManager->getVersion().toString() : "(empty)" )
+                          << " changed chunks: " << changed.size()
                           << endl;
                 }
 
+                // A table built on the old manager's was valid apart from the changes, so
+                // only the changes need checking
                 // TODO: Merge into diff code above, so we validate in one place
-                if (_isValid(chunkMap)) {
+                bool checkAll = ! _oldManager || chunks.size() < 10 || changed.size() * 4 > chunks.size();
+                DEV checkAll = true;
+                if (_isValid(chunks, changed, checkAll)) {
+                    chunks.seal();
+
                     // These variables are const for thread-safety. Since the
                     // constructor can only be called from one thread, we don't have
                     // to worry about that here.
-                    const_cast<ChunkMap&>(_chunkMap).swap(chunkMap);
+                    const_cast<ChunkTable&>(_chunkTable) = chunks;
                     const_cast<set<Shard>&>(_shards).swap(shards);
                     const_cast<ShardVersionMap&>(_shardVersions).swap(shardVersions);
-                    const_cast<ChunkRangeManager&>(_chunkRanges).reloadAll(_chunkMap);
+                    _lineage->setNumChunks( _chunkTable.size() );
 
                     // Once we load data, clear reference to old manager
                     _oldManager.reset();
@@ -690,8 +706,9 @@ namespace mongo {
                 }
             }
 
-            if (_chunkMap.size() < 10) {
-                _printChunks();
+            if (chunks.size() < 10) {
+                for ( ChunkTable::Iterator it( chunks ); it.more(); )
+                    log() << *it.next() << endl;
             }
             
             warning() << "ChunkManager loaded an invalid config for " << _ns
@@ -709,11 +726,13 @@ namespace mongo {
      * This is an adapter so we can use config diffs - mongos and mongod do them slightly
      * differently
      *
-     * The mongos adapter here tracks all shards, and stores ranges by (max, Chunk) in the map.
+     * The mongos adapter here tracks all shards, and stores ranges by (max, Chunk) in a
+     * ChunkTable, so that the chunks which didn't change are shared with the old manager's table.
      */
-    class CMConfigDiffTracker : public ConfigDiffTracker<ChunkPtr,Shard> {
+    class CMConfigDiffTracker : public ConfigDiffTracker<ChunkPtr,Shard,ChunkTable> {
     public:
-        CMConfigDiffTracker( ChunkManager* manager ) : _manager( manager ) {}
+        CMConfigDiffTracker( ChunkManager* manager, vector<ChunkPtr>* changed ) :
+            _manager( manager ), _changed( changed ) {}
 
         virtual bool isTracked( const BSONObj& chunkDoc ) const {
             // Mongos tracks all shards
@@ -728,6 +747,7 @@ namespace mongo {
 
         virtual pair<BSONObj,ChunkPtr> rangeFor( const BSONObj& chunkDoc, const BSONObj& min, const BSONObj& max ) const {
             ChunkPtr c( new Chunk( _manager, chunkDoc ) );
+            _changed->push_back( c );
             return make_pair( max, c );
         }
 
@@ -740,14 +760,16 @@ namespace mongo {
         }
 
         ChunkManager* _manager;
+        vector<ChunkPtr>* _changed;
 
     };
 
     bool ChunkManager::_load( const string& config,
-                              ChunkMap& chunkMap,
+                              ChunkTable& chunks,
                               set<Shard>& shards,
                               ShardVersionMap& shardVersions,
-                              ChunkManagerPtr oldManager)
+                              ChunkManagerPtr oldManager,
+                              vector<ChunkPtr>* changed)
     {
 
         // Reset the max version, but not the epoch, when we aren't loading from the oldManager
@@ -763,36 +785,21 @@ namespace mongo {
             // Load a copy of the old versions
             shardVersions = oldManager->_shardVersions;
 
-            // Load a copy of the chunk map, replacing the chunk manager with our own
-            const ChunkMap& oldChunkMap = oldManager->getChunkMap();
-
-            // Could be v.expensive
-            // TODO: If chunks were immutable and didn't reference the manager, we could do more
-            // interesting things here
-            for( ChunkMap::const_iterator it = oldChunkMap.begin(); it != oldChunkMap.end(); it++ ){
-
-                ChunkPtr oldC = it->second;
-                ChunkPtr c( new Chunk( this, oldC->getMin(),
-                                             oldC->getMax(),
-                                             oldC->getShard(),
-                                             oldC->getLastmod() ) );
-
-                c->setBytesWritten( oldC->getBytesWritten() );
-
-                chunkMap.insert( make_pair( oldC->getMax(), c ) );
-            }
+            // Share the old chunks, which belong to our lineage too; the diff only copies the
+            // parts of the table it changes
+            chunks = oldManager->_chunkTable;
 
             // Also get any minor versions stored for reload
-            oldManager->getMarkedMinorVersions( minorVersions );
+            _lineage->_splitHeuristics.takeMarkedMinorVersions( minorVersions );
 
             LOG(2) << "loading chunk manager for collection " << _ns
                    << " using old chunk manager w/ version " << _version.toString()
-                   << " and " << oldChunkMap.size() << " chunks" << endl;
+                   << " and " << chunks.size() << " chunks" << endl;
         }
 
         // Attach a diff tracker for the versioned chunk data
-        CMConfigDiffTracker differ( this );
-        differ.attach( _ns, chunkMap, _version, shardVersions );
+        CMConfigDiffTracker differ( this, changed );
+        differ.attach( _ns, chunks, _version, shardVersions );
 
         // Diff tracker should *always* find at least one chunk if collection exists
         int diffsApplied = differ.calculateConfigDiff( config, minorVersions );
@@ -815,7 +822,7 @@ namespace mongo {
                       << ", previous version was " << _version << endl;
 
             // Set all our data to empty
-            chunkMap.clear();
+            chunks.clear();
             shardVersions.clear();
             _version = ChunkVersion( 0, OID() );
 
@@ -839,7 +846,7 @@ namespace mongo {
             }
 
             // Set all our data to empty to be extra safe
-            chunkMap.clear();
+            chunks.clear();
             shardVersions.clear();
             _version = ChunkVersion( 0, OID() );
 
@@ -849,18 +856,18 @@ namespace mongo {
     }
 
     ChunkManagerPtr ChunkManager::reload(bool force) const {
-        return grid.getDBConfig(getns())->getChunkManager(getns(), force);
+        return _lineage->reload(force);
     }
 
     void ChunkManager::markMinorForReload( ChunkVersion majorVersion ) const {
-        _splitHeuristics.markMinorForReload( getns(), majorVersion );
+        _lineage->_splitHeuristics.markMinorForReload( getns(), majorVersion );
     }
 
-    void ChunkManager::getMarkedMinorVersions( set<ChunkVersion>& minorVersions ) const {
-        _splitHeuristics.getMarkedMinorVersions( minorVersions );
+    ChunkManagerPtr ChunkManagerLineage::reload(bool force) const {
+        return grid.getDBConfig(_ns)->getChunkManager(_ns, force);
     }
 
-    void ChunkManager::SplitHeuristics::markMinorForReload( const string& ns, ChunkVersion majorVersion ) {
+    void ChunkManagerLineage::SplitHeuristics::markMinorForReload( const string& ns, ChunkVersion majorVersion ) {
 
         // When we get a stale minor version, it means that some *other* mongos has just split a
         // chunk into a number of smaller parts, so we shouldn't need reload the data needed to
@@ -898,33 +905,62 @@ namespace mongo {
             grid.getDBConfig( ns )->getChunkManagerIfExists( ns, true, true );
     }
 
-    void ChunkManager::SplitHeuristics::getMarkedMinorVersions( set<ChunkVersion>& minorVersions ) {
+    void ChunkManagerLineage::SplitHeuristics::takeMarkedMinorVersions( set<ChunkVersion>& minorVersions ) {
         scoped_lock lk( _staleMinorSetMutex );
         for( set<ChunkVersion>::iterator it = _staleMinorSet.begin(); it != _staleMinorSet.end(); it++ ){
             minorVersions.insert( *it );
         }
+        _staleMinorSet.clear();
     }
 
-    bool ChunkManager::_isValid(const ChunkMap& chunkMap) {
+    bool ChunkManager::_isValid(const ChunkTable& chunks, const vector<ChunkPtr>& changed, bool all) {
 #define ENSURE(x) do { if(!(x)) { log() << "ChunkManager::_isValid failed: " #x << endl; return false; } } while(0)
 
-        if (chunkMap.empty())
+        if (chunks.empty())
             return true;
 
         // Check endpoints
-        ENSURE(allOfType(MinKey, chunkMap.begin()->second->getMin()));
-        ENSURE(allOfType(MaxKey, boost::prior(chunkMap.end())->second->getMax()));
+        ENSURE(allOfType(MinKey, chunks.at(0)->getMin()));
+        ENSURE(allOfType(MaxKey, chunks.at(chunks.size() - 1)->getMax()));
 
         // Make sure there are no gaps or overlaps
-        for (ChunkMap::const_iterator it=boost::next(chunkMap.begin()), end=chunkMap.end(); it != end; ++it) {
-            ChunkMap::const_iterator last = boost::prior(it);
+        if (all) {
+            ChunkTable::Iterator it(chunks);
+            ChunkPtr last = it.next();
+            while (it.more()) {
+                ChunkPtr c = it.next();
+
+                if (!(c->getMin() == last->getMax())) {
+                    PRINT(c->toString());
+                    PRINT(c->getMin());
+                    PRINT(last->getMax());
+                }
+                ENSURE(c->getMin() == last->getMax());
+                last = c;
+            }
 
-            if (!(it->second->getMin() == last->second->getMax())) {
-                PRINT(it->second->toString());
-                PRINT(it->second->getMin());
-                PRINT(last->second->getMax());
+            return true;
+        }
+
+        // The rest of the table was valid before the changes, so gaps or overlaps can only
+        // be next to a changed chunk (or where a changed chunk was and isn't any longer)
+        for (vector<ChunkPtr>::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+            const ChunkPtr& c = *it;
+            size_t pos = chunks.lower_bound(c->getMax());
+            ENSURE(pos < chunks.size() && chunks.at(pos) == c);
+
+            if (pos > 0) {
+                ChunkPtr prev = chunks.at(pos - 1);
+                if (!(c->getMin() == prev->getMax())) {
+                    PRINT(c->toString());
+                    PRINT(c->getMin());
+                    PRINT(prev->getMax());
+                }
+                ENSURE(c->getMin() == prev->getMax());
             }
-            ENSURE(it->second->getMin() == last->second->getMax());
+
+            if (pos + 1 < chunks.size())
+                ENSURE(chunks.at(pos + 1)->getMin() == c->getMax());
         }
 
         return true;
@@ -933,9 +969,18 @@ namespace mongo {
     }
 
     void ChunkManager::_printChunks() const {
-        for (ChunkMap::const_iterator it=_chunkMap.begin(), end=_chunkMap.end(); it != end; ++it) {
-            log() << *it->second << endl;
+        for (ChunkTable::Iterator it(_chunkTable); it.more(); ) {
+            log() << *it.next() << endl;
+        }
+    }
+
+    ChunkMap ChunkManager::getChunkMap() const {
+        ChunkMap chunkMap;
+        for (ChunkTable::Iterator it(_chunkTable); it.more(); ) {
+            ChunkPtr c = it.next();
+            chunkMap.insert(chunkMap.end(), make_pair(c->getMax(), c));
         }
+        return chunkMap;
     }
 
     bool ChunkManager::hasShardKey( const BSONObj& obj ) const {
@@ -948,7 +993,7 @@ namespace mongo {
                                                 vector<BSONObj>* splitPoints,
                                                 vector<Shard>* shards ) const
     {
-        verify( _chunkMap.size() == 0 );
+        verify( _chunkTable.empty() );
 
         unsigned long long numObjects = 0;
         Chunk c(this, _key.globalMin(), _key.globalMax(), primary);
@@ -1057,15 +1102,7 @@ namespace mongo {
 
     ChunkPtr ChunkManager::findIntersectingChunk( const BSONObj& point ) const {
         {
-            BSONObj foo;
-            ChunkPtr c;
-            {
-                ChunkMap::const_iterator it = _chunkMap.upper_bound( point );
-                if (it != _chunkMap.end()) {
-                    foo = it->first;
-                    c = it->second;
-                }
-            }
+            ChunkPtr c = _chunkTable.findIntersectingChunk( point );
 
             if ( c ) {
                 if ( c->containsPoint( point ) ){
@@ -1073,7 +1110,6 @@ namespace mongo {
                     return c;
                 }
 
-                PRINT(foo);
                 PRINT(*c);
                 PRINT( point );
 
@@ -1092,8 +1128,8 @@ namespace mongo {
     }
 
     ChunkPtr ChunkManager::findChunkOnServer( const Shard& shard ) const {
-        for ( ChunkMap::const_iterator i=_chunkMap.begin(); i!=_chunkMap.end(); ++i ) {
-            ChunkPtr c = i->second;
+        for ( ChunkTable::Iterator i( _chunkTable ); i.more(); ) {
+            ChunkPtr c = i.next();
             if ( c->getShard() == shard )
                 return c;
         }
@@ -1101,7 +1137,76 @@ namespace mongo {
         return ChunkPtr();
     }
 
+    MONGO_EXPORT_SERVER_PARAMETER(queryRoutingCacheSize, int, 1000);
+
+    // queries larger than this are routed each time
+    static const int MaxCachedQuerySize = 1024;
+
+    static Counter64 queriesTargeted;
+    static ServerStatusMetricField<Counter64> displayQueriesTargeted( "routing.targeted",
+                                                                     &queriesTargeted );
+    static Counter64 queriesPartial;
+    static ServerStatusMetricField<Counter64> displayQueriesPartial( "routing.partial",
+                                                                    &queriesPartial );
+    static Counter64 queriesBroadcast;
+    static ServerStatusMetricField<Counter64> displayQueriesBroadcast( "routing.broadcast",
+                                                                      &queriesBroadcast );
+    static Counter64 routingCacheHits;
+    static ServerStatusMetricField<Counter64> displayRoutingCacheHits( "routing.cacheHits",
+                                                                      &routingCacheHits );
+
+    bool QueryRoutingCache::get( const BSONObj& query, Entry* entry ) const {
+        if ( query.objsize() > MaxCachedQuerySize )
+            return false;
+        scoped_lock lk( _mutex );
+        map<string,Entry>::const_iterator i =
+                _entries.find( string( query.objdata(), query.objsize() ) );
+        if ( i == _entries.end() )
+            return false;
+        *entry = i->second;
+        return true;
+    }
+
+    void QueryRoutingCache::put( const BSONObj& query, const Entry& entry ) {
+        if ( query.objsize() > MaxCachedQuerySize || queryRoutingCacheSize <= 0 )
+            return;
+        scoped_lock lk( _mutex );
+        if ( _entries.size() >= (size_t)queryRoutingCacheSize )
+            _entries.clear();
+        _entries[ string( query.objdata(), query.objsize() ) ] = entry;
+    }
+
     void ChunkManager::getShardsForQuery( set<Shard>& shards , const BSONObj& query ) const {
+        QueryRoutingCache::Entry routing;
+        if ( _routingCache.get( query, &routing ) ) {
+            routingCacheHits.increment();
+
+            // a single shard key value belongs to exactly one chunk, so charge it the read
+            for ( vector<ChunkPtr>::const_iterator i = routing.pointChunks.begin();
+                  i != routing.pointChunks.end();
+                  ++i ) {
+                (*i)->noteOp( 0 );
+            }
+        }
+        else {
+            _getShardsForQuery( query, &routing );
+            _routingCache.put( query, routing );
+        }
+
+        if ( routing.shards.size() == 1 )
+            queriesTargeted.increment();
+        else if ( routing.shards.size() < _shards.size() )
+            queriesPartial.increment();
+        else
+            queriesBroadcast.increment();
+
+        shards.insert( routing.shards.begin(), routing.shards.end() );
+    }
+
+    void ChunkManager::_getShardsForQuery( const BSONObj& query,
+                                           QueryRoutingCache::Entry* routing ) const {
+        set<Shard>& shards = routing->shards;
+
         // TODO Determine if the third argument to OrRangeGenerator() is necessary, see SERVER-5165.
         OrRangeGenerator org(_ns.c_str(), query, false);
 
@@ -1133,6 +1238,13 @@ namespace mongo {
                 BoundList ranges = _key.keyBounds( frsp->getSingleKeyFRS() );
                 for ( BoundList::const_iterator it=ranges.begin(); it != ranges.end(); ++it ){
 
+                    // a single shard key value belongs to exactly one chunk, so charge it the read
+                    if ( it->first.woCompare( it->second ) == 0 ) {
+                        ChunkPtr c = findIntersectingChunk( it->first );
+                        c->noteOp( 0 );
+                        routing->pointChunks.push_back( c );
+                    }
+
                     getShardsForRange( shards, it->first /*min*/, it->second /*max*/ );
 
                     // once we know we need to visit all shards no need to keep looping
@@ -1150,8 +1262,8 @@ namespace mongo {
         // returned.  For now, we satisfy that assumption by adding a shard with no matches rather
         // than return an empty set of shards.
         if ( shards.empty() ) {
-            massert( 16068, "no chunk ranges available", !_chunkRanges.ranges().empty() );
-            shards.insert( _chunkRanges.ranges().begin()->second->getShard() );
+            massert( 16068, "no chunk ranges available", !_chunkTable.empty() );
+            shards.insert( _chunkTable.at( 0 )->getShard() );
         }
     }
 
@@ -1159,19 +1271,10 @@ namespace mongo {
                                           const BSONObj& min,
                                           const BSONObj& max ) const {
 
-        ChunkRangeMap::const_iterator it = _chunkRanges.upper_bound(min);
-        ChunkRangeMap::const_iterator end = _chunkRanges.upper_bound(max);
-
-        massert( 13507 , str::stream() << "no chunks found between bounds " << min << " and " << max , it != _chunkRanges.ranges().end() );
-
-        if( end != _chunkRanges.ranges().end() ) ++end;
-
-        for( ; it != end; ++it ){
-            shards.insert(it->second->getShard());
+        // stops once we know we need to visit all shards
+        bool found = _chunkTable.getShardsForRange( shards, min, max, _shards.size() );
 
-            // once we know we need to visit all shards no need to keep looping
-            if (shards.size() == _shards.size()) break;
-        }
+        massert( 13507 , str::stream() << "no chunks found between bounds " << min << " and " << max , found );
     }
 
     void ChunkManager::getAllShards( set<Shard>& all ) const {
@@ -1225,8 +1328,8 @@ namespace mongo {
         LOG(1) << "ChunkManager::drop : " << _ns << endl;
 
         // lock all shards so no one can do a split/migrate
-        for ( ChunkMap::const_iterator i=_chunkMap.begin(); i!=_chunkMap.end(); ++i ) {
-            ChunkPtr c = i->second;
+        for ( ChunkTable::Iterator i( _chunkTable ); i.more(); ) {
+            ChunkPtr c = i.next();
             seen.insert( c->getShard() );
         }
 
@@ -1311,91 +1414,20 @@ namespace mongo {
     string ChunkManager::toString() const {
         stringstream ss;
         ss << "ChunkManager: " << _ns << " key:" << _key.toString() << '\n';
-        for ( ChunkMap::const_iterator i=_chunkMap.begin(); i!=_chunkMap.end(); ++i ) {
-            const ChunkPtr c = i->second;
+        for ( ChunkTable::Iterator i( _chunkTable ); i.more(); ) {
+            const ChunkPtr c = i.next();
             ss << "\t" << c->toString() << '\n';
         }
         return ss.str();
     }
 
-    void ChunkRangeManager::assertValid() const {
-        if (_ranges.empty())
-            return;
-
-        try {
-            // No Nulls
-            for (ChunkRangeMap::const_iterator it=_ranges.begin(), end=_ranges.end(); it != end; ++it) {
-                verify(it->second);
-            }
-
-            // Check endpoints
-            verify(allOfType(MinKey, _ranges.begin()->second->getMin()));
-            verify(allOfType(MaxKey, boost::prior(_ranges.end())->second->getMax()));
-
-            // Make sure there are no gaps or overlaps
-            for (ChunkRangeMap::const_iterator it=boost::next(_ranges.begin()), end=_ranges.end(); it != end; ++it) {
-                ChunkRangeMap::const_iterator last = boost::prior(it);
-                verify(it->second->getMin() == last->second->getMax());
-            }
-
-            // Check Map keys
-            for (ChunkRangeMap::const_iterator it=_ranges.begin(), end=_ranges.end(); it != end; ++it) {
-                verify(it->first == it->second->getMax());
-            }
-
-            // Make sure we match the original chunks
-            const ChunkMap chunks = _ranges.begin()->second->getManager()->_chunkMap;
-            for ( ChunkMap::const_iterator i=chunks.begin(); i!=chunks.end(); ++i ) {
-                const ChunkPtr chunk = i->second;
-
-                ChunkRangeMap::const_iterator min = _ranges.upper_bound(chunk->getMin());
-                ChunkRangeMap::const_iterator max = _ranges.lower_bound(chunk->getMax());
-
-                verify(min != _ranges.end());
-                verify(max != _ranges.end());
-                verify(min == max);
-                verify(min->second->getShard() == chunk->getShard());
-                verify(min->second->containsPoint( chunk->getMin() ));
-                verify(min->second->containsPoint( chunk->getMax() ) || (min->second->getMax() == chunk->getMax()));
-            }
-
-        }
-        catch (...) {
-            LOG( LL_ERROR ) << "\t invalid ChunkRangeMap! printing ranges:" << endl;
-
-            for (ChunkRangeMap::const_iterator it=_ranges.begin(), end=_ranges.end(); it != end; ++it)
-                cout << it->first << ": " << *it->second << endl;
-
-            throw;
-        }
-    }
-
-    void ChunkRangeManager::reloadAll(const ChunkMap& chunks) {
-        _ranges.clear();
-        _insertRange(chunks.begin(), chunks.end());
-
-        DEV assertValid();
-    }
-
-    void ChunkRangeManager::_insertRange(ChunkMap::const_iterator begin, const ChunkMap::const_iterator end) {
-        while (begin != end) {
-            ChunkMap::const_iterator first = begin;
-            Shard shard = first->second->getShard();
-            while (begin != end && (begin->second->getShard() == shard))
-                ++begin;
-
-            shared_ptr<ChunkRange> cr (new ChunkRange(first, begin));
-            _ranges[cr->getMax()] = cr;
-        }
-    }
-
-    int ChunkManager::getCurrentDesiredChunkSize() const {
+    int ChunkManagerLineage::getCurrentDesiredChunkSize() const {
         // split faster in early chunks helps spread out an initial load better
         const int minChunkSize = 1 << 20;  // 1 MBytes
 
         int splitThreshold = Chunk::MaxChunkSize;
 
-        int nc = numChunks();
+        int nc = _numChunks.get();
 
         if ( nc <= 1 ) {
             return 1024;
@@ -1416,7 +1448,6 @@ namespace mongo {
     /** This is for testing only, just setting up minimal basic defaults. */
     ChunkManager::ChunkManager() :
     _unique(),
-    _chunkRanges(),
     _mutex( "ChunkManager" ),
     _sequenceNumber()
     {}
@@ -20,6 +20,8 @@
 
 #include "mongo/bson/util/atomic_int.h"
 #include "mongo/client/distlock.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/s/chunk_table.h"
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/shard.h"
 #include "mongo/s/shardkey.h"
@@ -29,15 +31,14 @@ namespace mongo {
 
     class DBConfig;
     class Chunk;
-    class ChunkRange;
     class ChunkManager;
+    class ChunkManagerLineage;
     class ChunkObjUnitTest;
 
     typedef shared_ptr<const Chunk> ChunkPtr;
 
-    // key is max for each Chunk or ChunkRange
+    // key is max for each Chunk
     typedef map<BSONObj,ChunkPtr,BSONObjCmp> ChunkMap;
-    typedef map<BSONObj,shared_ptr<ChunkRange>,BSONObjCmp> ChunkRangeMap;
 
     typedef shared_ptr<const ChunkManager> ChunkManagerPtr;
 
@@ -109,6 +110,30 @@ namespace mongo {
          */
         bool splitIfShould( long dataWritten ) const;
 
+        //
+        // load tracking support
+        //
+
+        /**
+         * Counts one operation routed to this chunk by this mongos: each write targeted at it,
+         * whether or not the client allows autosplits, and each read of a single shard key
+         * value.  The counts only ever grow; the balancer collects them from every mongos with
+         * chunkLoad and turns them into rates.
+         */
+        void noteOp( long long bytes ) const {
+            _opsRouted.fetchAndAdd( 1 );
+            _bytesRouted.fetchAndAdd( bytes );
+        }
+
+        unsigned long long getOpsRouted() const { return _opsRouted.load(); }
+        unsigned long long getBytesRouted() const { return _bytesRouted.load(); }
+
+        /**
+         * @return an id, unique within this mongos process, for this chunk's counts.  A chunk
+         * loaded again starts counting from 0 under a new id.
+         */
+        unsigned long long getLoadCounterId() const { return _loadCounterId; }
+
         /**
          * Splits this chunk at a non-specificed split key to be chosen by the mongod holding this chunk.
          *
@@ -211,14 +236,13 @@ namespace mongo {
 
         string getns() const;
         Shard getShard() const { return _shard; }
-        const ChunkManager* getManager() const { return _manager; }
-        
 
     private:
 
         // main shard info
-        
-        const ChunkManager * _manager;
+
+        // shared by every ChunkManager this chunk is in
+        const shared_ptr<ChunkManagerLineage> _lineage;
 
         BSONObj _min;
         BSONObj _max;
@@ -230,6 +254,10 @@ namespace mongo {
 
         mutable long _dataWritten;
 
+        mutable AtomicUInt64 _opsRouted;
+        mutable AtomicUInt64 _bytesRouted;
+        const unsigned long long _loadCounterId;
+
         // methods, etc..
 
         /** Returns the highest or lowest existing value in the shard-key space.
@@ -246,81 +274,33 @@ namespace mongo {
         /** initializes _dataWritten with a random value so that a mongos restart wouldn't cause delay in splitting */
         static int mkDataWritten();
 
-        ShardKeyPattern skey() const;
-    };
-
-    class ChunkRange {
-    public:
-        const ChunkManager* getManager() const { return _manager; }
-        Shard getShard() const { return _shard; }
-
-        const BSONObj& getMin() const { return _min; }
-        const BSONObj& getMax() const { return _max; }
+        /** @return a new id for a chunk's load counts */
+        static unsigned long long nextLoadCounterId();
 
-        // clones of Chunk methods
-        // Returns true if this ChunkRange contains the given point, and false otherwise
-        //
-        // Note: this function takes an extracted *key*, not an original document
-        // (the point may be computed by, say, hashing a given field or projecting
-        //  to a subset of fields).
-        bool containsPoint( const BSONObj& point ) const;
-
-        ChunkRange(ChunkMap::const_iterator begin, const ChunkMap::const_iterator end)
-            : _manager(begin->second->getManager())
-            , _shard(begin->second->getShard())
-            , _min(begin->second->getMin())
-            , _max(boost::prior(end)->second->getMax()) {
-            verify( begin != end );
-
-            DEV while (begin != end) {
-                verify(begin->second->getManager() == _manager);
-                verify(begin->second->getShard() == _shard);
-                ++begin;
-            }
-        }
-
-        // Merge min and max (must be adjacent ranges)
-        ChunkRange(const ChunkRange& min, const ChunkRange& max)
-            : _manager(min.getManager())
-            , _shard(min.getShard())
-            , _min(min.getMin())
-            , _max(max.getMax()) {
-            verify(min.getShard() == max.getShard());
-            verify(min.getManager() == max.getManager());
-            verify(min.getMax() == max.getMin());
-        }
-
-        friend ostream& operator<<(ostream& out, const ChunkRange& cr) {
-            return (out << "ChunkRange(min=" << cr._min << ", max=" << cr._max << ", shard=" << cr._shard <<")");
-        }
-
-    private:
-        const ChunkManager* _manager;
-        const Shard _shard;
-        const BSONObj _min;
-        const BSONObj _max;
+        ShardKeyPattern skey() const;
     };
 
-
-    class ChunkRangeManager {
+    /**
+     * The shards a ChunkManager routed recent queries to, by the exact bytes of the query.  A
+     * manager's chunks never change, so the entries never go stale; the cache is emptied when it
+     * reaches queryRoutingCacheSize entries.
+     */
+    class QueryRoutingCache : boost::noncopyable {
     public:
-        const ChunkRangeMap& ranges() const { return _ranges; }
-
-        void clear() { _ranges.clear(); }
-
-        void reloadAll(const ChunkMap& chunks);
+        struct Entry {
+            set<Shard> shards;
+            vector<ChunkPtr> pointChunks; // those a single shard key value was routed to
+        };
 
-        // Slow operation -- wrap with DEV
-        void assertValid() const;
+        QueryRoutingCache() : _mutex( "QueryRoutingCache" ) {}
 
-        ChunkRangeMap::const_iterator upper_bound(const BSONObj& o) const { return _ranges.upper_bound(o); }
-        ChunkRangeMap::const_iterator lower_bound(const BSONObj& o) const { return _ranges.lower_bound(o); }
+        /** @return true and sets entry if query was routed before */
+        bool get( const BSONObj& query, Entry* entry ) const;
+        void put( const BSONObj& query, const Entry& entry );
 
     private:
-        // assumes nothing in this range exists in _ranges
-        void _insertRange(ChunkMap::const_iterator begin, const ChunkMap::const_iterator end);
-
-        ChunkRangeMap _ranges;
+        mutable mongo::mutex _mutex;
+        map<string,Entry> _entries;
     };
 
     /* config.sharding
@@ -381,7 +361,7 @@ namespace mongo {
         // Methods to use once loaded / created
         //
 
-        int numChunks() const { return _chunkMap.size(); }
+        int numChunks() const { return _chunkTable.size(); }
 
         /** Given a document, returns the chunk which contains that document.
          *  This works by extracting the shard key part of the given document, then
@@ -404,12 +384,18 @@ namespace mongo {
 
         ChunkPtr findChunkOnServer( const Shard& shard ) const;
 
+        /**
+         * Adds the shards holding the chunks query may match: exact ranges for equalities and $in
+         * on the shard key or a prefix of it, hashed points for a hashed key.  Counts each query
+         * as targeted (one shard), partial or broadcast (all the collection's shards).
+         */
         void getShardsForQuery( set<Shard>& shards , const BSONObj& query ) const;
         void getAllShards( set<Shard>& all ) const;
         /** @param shards set to the shards covered by the interval [min, max], see SERVER-4791 */
         void getShardsForRange( set<Shard>& shards, const BSONObj& min, const BSONObj& max ) const;
 
-        ChunkMap getChunkMap() const { return _chunkMap; }
+        /** a copy of the chunks, O(n): for routing, use the methods above */
+        ChunkMap getChunkMap() const;
 
         /**
          * Returns true if, for this shard, the chunks are identical in both chunk managers
@@ -434,21 +420,24 @@ namespace mongo {
 
         void _printChunks() const;
 
-        int getCurrentDesiredChunkSize() const;
-
         ChunkManagerPtr reload(bool force=true) const; // doesn't modify self!
 
         void markMinorForReload( ChunkVersion majorVersion ) const;
-        void getMarkedMinorVersions( set<ChunkVersion>& minorVersions ) const;
 
     private:
 
         // helpers for loading
 
         // returns true if load was consistent
-        bool _load( const string& config, ChunkMap& chunks, set<Shard>& shards,
-                                    ShardVersionMap& shardVersions, ChunkManagerPtr oldManager);
-        static bool _isValid(const ChunkMap& chunks);
+        // changed is set to the chunks that were read, which are all that differ from oldManager's
+        bool _load( const string& config, ChunkTable& chunks, set<Shard>& shards,
+                                    ShardVersionMap& shardVersions, ChunkManagerPtr oldManager,
+                                    vector<ChunkPtr>* changed );
+
+        // checks there are no gaps or overlaps around the changed chunks, or anywhere if all
+        static bool _isValid(const ChunkTable& chunks, const vector<ChunkPtr>& changed, bool all);
+
+        void _getShardsForQuery( const BSONObj& query, QueryRoutingCache::Entry* routing ) const;
 
         // end helpers
 
@@ -457,8 +446,8 @@ namespace mongo {
         const ShardKeyPattern _key;
         const bool _unique;
 
-        const ChunkMap _chunkMap;
-        const ChunkRangeManager _chunkRanges;
+        const ChunkTable _chunkTable;
+        const shared_ptr<ChunkManagerLineage> _lineage;
 
         const set<Shard> _shards;
 
@@ -473,8 +462,39 @@ namespace mongo {
 
         mutable mutex _mutex; // only used with _nsLock
 
+        mutable QueryRoutingCache _routingCache;
+
         const unsigned long long _sequenceNumber;
 
+        friend class Chunk;
+        static AtomicUInt NextSequenceNumber;
+        
+        /** Just for testing */
+        friend class TestableChunkManager;
+        ChunkManager();
+    };
+
+    /**
+     * What a collection's chunks need from the ChunkManager that loaded them and which doesn't
+     * change as the collection is reloaded.  A manager loaded from an older one shares its
+     * lineage, and so can keep every chunk the reload didn't change.
+     */
+    class ChunkManagerLineage : boost::noncopyable {
+    public:
+        ChunkManagerLineage( const string& ns, const ShardKeyPattern& key ) :
+            _ns( ns ), _key( key ) {}
+
+        const string& getns() const { return _ns; }
+        const ShardKeyPattern& getShardKey() const { return _key; }
+
+        /** @return the collection's current ChunkManager, reloading it as ChunkManager::reload */
+        ChunkManagerPtr reload( bool force = true ) const;
+
+        /** the number of chunks in the most recently loaded manager */
+        void setNumChunks( int numChunks ) { _numChunks.set( numChunks ); }
+
+        int getCurrentDesiredChunkSize() const;
+
         //
         // Split Heuristic info
         //
@@ -489,7 +509,9 @@ namespace mongo {
                 _staleMinorCount( 0 ) {}
 
             void markMinorForReload( const string& ns, ChunkVersion majorVersion );
-            void getMarkedMinorVersions( set<ChunkVersion>& minorVersions );
+
+            // hands the marked versions to the next load, which will look for their minor changes
+            void takeMarkedMinorVersions( set<ChunkVersion>& minorVersions );
 
             TicketHolder _splitTickets;
 
@@ -520,13 +542,11 @@ namespace mongo {
         // End split heuristics
         //
 
-        friend class Chunk;
-        friend class ChunkRangeManager; // only needed for CRM::assertValid()
-        static AtomicUInt NextSequenceNumber;
-        
-        /** Just for testing */
-        friend class TestableChunkManager;
-        ChunkManager();
+    private:
+        const string _ns;
+        const ShardKeyPattern _key;
+
+        AtomicUInt _numChunks;
     };
 
     // like BSONObjCmp. for use as an STL comparison functor
@@ -541,13 +561,6 @@ namespace mongo {
             return operator()(*l, *r);
         }
 
-        // Also support ChunkRanges
-        bool operator()( const ChunkRange &l, const ChunkRange &r ) const {
-            return _cmp(l.getMin(), r.getMin());
-        }
-        bool operator()( const shared_ptr<ChunkRange> l, const shared_ptr<ChunkRange> r ) const {
-            return operator()(*l, *r);
-        }
     private:
         BSONObjCmp _cmp;
     };
@@ -561,7 +574,7 @@ namespace mongo {
         Chunk _c;
     };
     */
-    inline string Chunk::genID() const { return genID(_manager->getns(), _min); }
+    inline string Chunk::genID() const { return genID(getns(), _min); }
 
     bool setShardVersion( DBClientBase & conn,
                           const string& ns,
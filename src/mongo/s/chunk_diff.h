@@ -66,8 +66,13 @@ namespace mongo {
      * implementation, because the logic is identical, or the chunk data, because that would be
      * slow for big clusters, so this is the alternative for now.
      * TODO: Standardize between mongos and mongod and convert template parameters to types.
+     *
+     * RangeMapType need only provide the std::map members used here, so mongos can keep its
+     * chunks in a ChunkTable.
      */
-    template < class ValType, class ShardType >
+    template < class ValType,
+               class ShardType,
+               class RangeMapType = std::map<BSONObj, ValType, BSONObjCmp> >
     class ConfigDiffTracker {
     public:
 
@@ -76,7 +81,7 @@ namespace mongo {
         //
 
         // RangeMap stores ranges indexed by max or  min key
-        typedef typename std::map<BSONObj, ValType, BSONObjCmp> RangeMap;
+        typedef RangeMapType RangeMap;
 
         // RangeOverlap is a pair of iterators defining a subset of ranges
         typedef typename std::pair< typename RangeMap::iterator, typename RangeMap::iterator> RangeOverlap;
@@ -0,0 +1,561 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/s/chunk_table.h"
+
+#include <limits>
+
+#include "mongo/bson/key_string.h"
+#include "mongo/platform/float_utils.h"
+#include "mongo/s/chunk.h"
+
+namespace mongo {
+
+    namespace {
+
+        // entries a node holds before it is split in two
+        const size_t MaxEntries = 64;
+
+        // The kind of bounds below MaxKey under a node.  AnyKeys is for a node with none, which
+        // any numeric point may be routed through.
+        enum KeyType { AnyKeys, LongKeys, DoubleKeys, GeneralKeys };
+
+        KeyType keyTypeOf( const BSONObj& max ) {
+            if ( max.nFields() != 1 )
+                return GeneralKeys;
+
+            BSONElement e = max.firstElement();
+            switch ( e.type() ) {
+            case MaxKey:
+                return AnyKeys;
+            case NumberLong:
+                return LongKeys;
+            case NumberInt:
+                return DoubleKeys;
+            case NumberDouble:
+                return isNaN( e._numberDouble() ) ? GeneralKeys : DoubleKeys;
+            default:
+                return GeneralKeys;
+            }
+        }
+
+        KeyType combine( KeyType a, KeyType b ) {
+            if ( a == AnyKeys )
+                return b;
+            if ( b == AnyKeys )
+                return a;
+            return a == b ? a : GeneralKeys;
+        }
+
+        struct NumberAtMost {
+            template < class T >
+            bool operator()( T bound, T point ) const { return bound <= point; }
+        };
+
+        struct KeyAtMost {
+            bool operator()( const BSONObj& bound, const BSONObj& key ) const {
+                return bound.woCompare( key ) <= 0;
+            }
+        };
+
+        struct KeyBelow {
+            bool operator()( const BSONObj& bound, const BSONObj& key ) const {
+                return bound.woCompare( key ) < 0;
+            }
+        };
+
+        struct EncodedAtMost {
+            bool operator()( const KeyString& bound, const KeyString& key ) const {
+                return bound.compare( key ) <= 0;
+            }
+        };
+
+        /**
+         * @return the index of the first of the n bounds for which before( bound, key ) is false,
+         * where it is true for a prefix of them.  The range is halved without branching on the
+         * comparison.
+         */
+        template < class T, class Before >
+        size_t partitionPoint( const T* bounds, size_t n, const T& key, Before before ) {
+            if ( n == 0 )
+                return 0;
+
+            const T* base = bounds;
+            while ( n > 1 ) {
+                size_t half = n / 2;
+                base = before( base[half], key ) ? base + half : base;
+                n -= half;
+            }
+            return ( base - bounds ) + ( before( *base, key ) ? 1 : 0 );
+        }
+
+    }
+
+    struct ChunkTable::Node {
+        explicit Node( bool isLeaf ) :
+            leaf( isLeaf ), sealed( false ), count( 0 ), keys( GeneralKeys ), encoded( false ) {}
+
+        bool leaf;
+        bool sealed;
+
+        // chunks at or under this node
+        size_t count;
+
+        // the max of each chunk in a leaf, or the last max under each child
+        vector<BSONObj> maxes;
+        vector<ChunkPtr> chunks;
+        vector<NodePtr> children;
+
+        //
+        // set by seal()
+        //
+
+        KeyType keys;
+
+        // maxes as numbers, with MaxKey as the largest number, when keys allows
+        vector<long long> longMaxes;
+        vector<double> doubleMaxes;
+
+        // whether every max under this node has an exact KeyString, and this node's if so
+        bool encoded;
+        vector<KeyString> encodedMaxes;
+
+        // holding the chunks at or under this node, in order
+        vector<Shard> shards;
+    };
+
+    namespace {
+
+        typedef ChunkTable::Node Node;
+        typedef ChunkTable::NodePtr NodePtr;
+
+        /** @return p's node, first copying it if another table shares it */
+        Node* writable( NodePtr& p ) {
+            if ( p.use_count() > 1 )
+                p.reset( new Node( *p ) );
+            p->sealed = false;
+            return p.get();
+        }
+
+        /** moves the back half of n's entries into a new node, which is returned */
+        NodePtr splitNode( Node* n ) {
+            size_t half = n->maxes.size() / 2;
+
+            NodePtr right( new Node( n->leaf ) );
+            right->maxes.assign( n->maxes.begin() + half, n->maxes.end() );
+            n->maxes.resize( half );
+
+            if ( n->leaf ) {
+                right->chunks.assign( n->chunks.begin() + half, n->chunks.end() );
+                n->chunks.resize( half );
+                right->count = right->chunks.size();
+            }
+            else {
+                right->children.assign( n->children.begin() + half, n->children.end() );
+                n->children.resize( half );
+                for ( size_t i = 0; i < right->children.size(); i++ )
+                    right->count += right->children[i]->count;
+            }
+
+            n->count -= right->count;
+            return right;
+        }
+
+        /** @return the new sibling to follow p if p had to be split */
+        NodePtr insertInto( NodePtr& p, const BSONObj& max, const ChunkPtr& chunk ) {
+            Node* n = writable( p );
+            n->count++;
+
+            size_t i = partitionPoint( &n->maxes[0], n->maxes.size(), max, KeyBelow() );
+            if ( n->leaf ) {
+                n->maxes.insert( n->maxes.begin() + i, max );
+                n->chunks.insert( n->chunks.begin() + i, chunk );
+            }
+            else {
+                // past the last max, the last child takes it
+                if ( i == n->children.size() )
+                    i--;
+
+                NodePtr split = insertInto( n->children[i], max, chunk );
+                n->maxes[i] = n->children[i]->maxes.back();
+                if ( split ) {
+                    n->maxes.insert( n->maxes.begin() + i + 1, split->maxes.back() );
+                    n->children.insert( n->children.begin() + i + 1, split );
+                }
+            }
+
+            if ( n->maxes.size() <= MaxEntries )
+                return NodePtr();
+            return splitNode( n );
+        }
+
+        /** removes the chunks at positions [first, last) under p, which aren't all of them */
+        void eraseFrom( NodePtr& p, size_t first, size_t last ) {
+            Node* n = writable( p );
+
+            if ( n->leaf ) {
+                n->maxes.erase( n->maxes.begin() + first, n->maxes.begin() + last );
+                n->chunks.erase( n->chunks.begin() + first, n->chunks.begin() + last );
+                n->count -= last - first;
+                return;
+            }
+
+            vector<BSONObj> maxes;
+            vector<NodePtr> children;
+            size_t count = 0;
+            size_t offset = 0;
+            for ( size_t i = 0; i < n->children.size(); i++ ) {
+                NodePtr& child = n->children[i];
+                size_t begin = offset;
+                size_t end = offset + child->count;
+                offset = end;
+
+                size_t lo = max( first, begin );
+                size_t hi = min( last, end );
+                if ( lo < hi ) {
+                    if ( lo == begin && hi == end )
+                        continue;
+                    eraseFrom( child, lo - begin, hi - begin );
+                }
+
+                maxes.push_back( child->maxes.back() );
+                children.push_back( child );
+                count += child->count;
+            }
+
+            n->maxes.swap( maxes );
+            n->children.swap( children );
+            n->count = count;
+        }
+
+        void sealNode( Node* n ) {
+            if ( n->sealed )
+                return;
+
+            KeyType keys = AnyKeys;
+            if ( n->leaf ) {
+                for ( size_t i = 0; i < n->maxes.size(); i++ )
+                    keys = combine( keys, keyTypeOf( n->maxes[i] ) );
+            }
+            else {
+                for ( size_t i = 0; i < n->children.size(); i++ ) {
+                    sealNode( n->children[i].get() );
+                    keys = combine( keys, n->children[i]->keys );
+                }
+            }
+            n->keys = keys;
+
+            n->longMaxes.clear();
+            n->doubleMaxes.clear();
+            for ( size_t i = 0; i < n->maxes.size(); i++ ) {
+                BSONElement e = n->maxes[i].firstElement();
+                bool top = e.type() == MaxKey;
+                if ( keys == AnyKeys || keys == LongKeys )
+                    n->longMaxes.push_back( top ? numeric_limits<long long>::max() : e._numberLong() );
+                if ( keys == AnyKeys || keys == DoubleKeys )
+                    n->doubleMaxes.push_back( top ? numeric_limits<double>::infinity() : e.numberDouble() );
+            }
+
+            // bounds of general keys are compared as KeyStrings, when they all have one
+            bool encoded = keys == GeneralKeys || keys == AnyKeys;
+            for ( size_t i = 0; encoded && ! n->leaf && i < n->children.size(); i++ )
+                encoded = n->children[i]->encoded;
+            n->encodedMaxes.clear();
+            for ( size_t i = 0; encoded && i < n->maxes.size(); i++ ) {
+                n->encodedMaxes.push_back( KeyString( n->maxes[i] ) );
+                encoded = n->encodedMaxes.back().exact();
+            }
+            if ( ! encoded )
+                n->encodedMaxes.clear();
+            n->encoded = encoded;
+
+            set<Shard> shards;
+            if ( n->leaf ) {
+                for ( size_t i = 0; i < n->chunks.size(); i++ )
+                    shards.insert( n->chunks[i]->getShard() );
+            }
+            else {
+                for ( size_t i = 0; i < n->children.size(); i++ ) {
+                    const vector<Shard>& childShards = n->children[i]->shards;
+                    shards.insert( childShards.begin(), childShards.end() );
+                }
+            }
+            n->shards.assign( shards.begin(), shards.end() );
+
+            n->sealed = true;
+        }
+
+        /**
+         * Routes a point through bounds normalized to T.  A point above every bound is below
+         * MaxKey, the last max in the table, so it belongs to the last chunk.
+         */
+        template < class T >
+        ChunkPtr findNumeric( const Node* n, T point, vector<T> Node::* bounds ) {
+            while ( true ) {
+                const vector<T>& b = n->*bounds;
+                size_t i = partitionPoint( &b[0], b.size(), point, NumberAtMost() );
+                if ( i == b.size() )
+                    i--;
+                if ( n->leaf )
+                    return n->chunks[i];
+                n = n->children[i].get();
+            }
+        }
+
+        /**
+         * Routes an encoded point the general way: a point above every bound has no chunk.
+         */
+        ChunkPtr findEncoded( const Node* n, const KeyString& point ) {
+            while ( true ) {
+                const vector<KeyString>& b = n->encodedMaxes;
+                size_t i = partitionPoint( &b[0], b.size(), point, EncodedAtMost() );
+                if ( i == b.size() )
+                    return ChunkPtr();
+                if ( n->leaf )
+                    return n->chunks[i];
+                n = n->children[i].get();
+            }
+        }
+
+        /**
+         * @return the position of the first chunk under n whose bound, of those in the member
+         * bounds of the nodes, before( bound, key ) is false for.
+         */
+        template < class T, class Before >
+        size_t positionOf( const Node* n, vector<T> Node::* bounds, const T& key, Before before ) {
+            size_t pos = 0;
+            while ( n ) {
+                const vector<T>& b = n->*bounds;
+                size_t i = partitionPoint( &b[0], b.size(), key, before );
+                if ( n->leaf )
+                    return pos + i;
+                if ( i == n->children.size() )
+                    return pos + n->count;
+                for ( size_t j = 0; j < i; j++ )
+                    pos += n->children[j]->count;
+                n = n->children[i].get();
+            }
+            return pos;
+        }
+
+        void collectShards( const Node* n,
+                            size_t offset,
+                            size_t first,
+                            size_t last,
+                            set<Shard>& shards,
+                            size_t numShards ) {
+            if ( first <= offset && offset + n->count - 1 <= last ) {
+                shards.insert( n->shards.begin(), n->shards.end() );
+                return;
+            }
+
+            if ( n->leaf ) {
+                size_t end = min( last + 1, offset + n->count );
+                for ( size_t i = max( first, offset ); i < end; i++ )
+                    shards.insert( n->chunks[i - offset]->getShard() );
+                return;
+            }
+
+            for ( size_t i = 0; i < n->children.size() && offset <= last; i++ ) {
+                const Node* child = n->children[i].get();
+                if ( offset + child->count > first ) {
+                    collectShards( child, offset, first, last, shards, numShards );
+                    if ( shards.size() >= numShards )
+                        return;
+                }
+                offset += child->count;
+            }
+        }
+
+    }
+
+    ChunkTable::iterator ChunkTable::lower_bound( const BSONObj& key ) const {
+        return positionOf( _root.get(), &Node::maxes, key, KeyBelow() );
+    }
+
+    ChunkTable::iterator ChunkTable::upper_bound( const BSONObj& key ) const {
+        // a sealed root has sealed nodes under it, whose encodings are current
+        if ( _root && _root->sealed && _root->encoded ) {
+            KeyString point( key );
+            if ( point.exact() )
+                return positionOf( _root.get(), &Node::encodedMaxes, point, EncodedAtMost() );
+        }
+        return positionOf( _root.get(), &Node::maxes, key, KeyAtMost() );
+    }
+
+    void ChunkTable::erase( iterator first, iterator last ) {
+        last = min( last, size() );
+        if ( first >= last )
+            return;
+
+        if ( first == 0 && last == size() ) {
+            _root.reset();
+            return;
+        }
+
+        eraseFrom( _root, first, last );
+
+        // erasing may leave a chain of single children at the top
+        while ( ! _root->leaf && _root->children.size() == 1 ) {
+            NodePtr child = _root->children[0];
+            _root = child;
+        }
+    }
+
+    void ChunkTable::insert( const pair<BSONObj, ChunkPtr>& chunk ) {
+        const BSONObj& max = chunk.first;
+
+        if ( ! _root ) {
+            _root.reset( new Node( true ) );
+            _root->maxes.push_back( max );
+            _root->chunks.push_back( chunk.second );
+            _root->count = 1;
+            return;
+        }
+
+        // like map::insert, keep the chunk already there
+        size_t pos = lower_bound( max );
+        if ( pos < size() && at( pos )->getMax().woCompare( max ) == 0 )
+            return;
+
+        NodePtr split = insertInto( _root, max, chunk.second );
+        if ( split ) {
+            NodePtr root( new Node( false ) );
+            root->maxes.push_back( _root->maxes.back() );
+            root->maxes.push_back( split->maxes.back() );
+            root->children.push_back( _root );
+            root->children.push_back( split );
+            root->count = _root->count + split->count;
+            _root = root;
+        }
+    }
+
+    void ChunkTable::seal() {
+        if ( _root )
+            sealNode( _root.get() );
+    }
+
+    size_t ChunkTable::size() const {
+        return _root ? _root->count : 0;
+    }
+
+    ChunkPtr ChunkTable::at( size_t i ) const {
+        verify( i < size() );
+
+        const Node* n = _root.get();
+        while ( ! n->leaf ) {
+            size_t j = 0;
+            while ( i >= n->children[j]->count ) {
+                i -= n->children[j]->count;
+                j++;
+            }
+            n = n->children[j].get();
+        }
+        return n->chunks[i];
+    }
+
+    ChunkPtr ChunkTable::findIntersectingChunk( const BSONObj& point ) const {
+        const Node* n = _root.get();
+        if ( ! n )
+            return ChunkPtr();
+        dassert( n->sealed );
+
+        if ( isNumeric() && point.nFields() == 1 ) {
+            // points of other types order against the bounds by type, so go the general way
+            BSONElement e = point.firstElement();
+            if ( e.type() == NumberLong && n->keys != DoubleKeys )
+                return findNumeric( n, e._numberLong(), &Node::longMaxes );
+            if ( e.isNumber() && n->keys != LongKeys && ! isNaN( e.numberDouble() ) )
+                return findNumeric( n, e.numberDouble(), &Node::doubleMaxes );
+        }
+
+        if ( n->encoded ) {
+            KeyString encoded( point );
+            if ( encoded.exact() )
+                return findEncoded( n, encoded );
+        }
+
+        while ( true ) {
+            size_t i = partitionPoint( &n->maxes[0], n->maxes.size(), point, KeyAtMost() );
+            if ( i == n->maxes.size() )
+                return ChunkPtr();
+            if ( n->leaf )
+                return n->chunks[i];
+            n = n->children[i].get();
+        }
+    }
+
+    bool ChunkTable::getShardsForRange( set<Shard>& shards,
+                                        const BSONObj& min,
+                                        const BSONObj& max,
+                                        size_t numShards ) const {
+        size_t first = upper_bound( min );
+        if ( first >= size() )
+            return false;
+
+        // through the chunk containing max, if any
+        size_t last = std::min( upper_bound( max ), size() - 1 );
+        if ( first <= last )
+            collectShards( _root.get(), 0, first, last, shards, numShards );
+        return true;
+    }
+
+    bool ChunkTable::isNumeric() const {
+        // the last max must be MaxKey for a point above every other bound to have a chunk
+        return _root &&
+               _root->keys != GeneralKeys &&
+               _root->maxes.back().firstElement().type() == MaxKey;
+    }
+
+    int ChunkTable::depth() const {
+        int depth = 0;
+        for ( const Node* n = _root.get(); n; n = n->leaf ? NULL : n->children[0].get() )
+            depth++;
+        return depth;
+    }
+
+    ChunkTable::Iterator::Iterator( const ChunkTable& table ) : _root( table._root ) {
+        if ( _root ) {
+            _path.push_back( make_pair( _root.get(), 0 ) );
+            _descend();
+        }
+    }
+
+    void ChunkTable::Iterator::_descend() {
+        while ( ! _path.back().first->leaf ) {
+            const Node* n = _path.back().first;
+            _path.push_back( make_pair( n->children[_path.back().second].get(), 0 ) );
+        }
+    }
+
+    ChunkPtr ChunkTable::Iterator::next() {
+        ChunkPtr chunk = _path.back().first->chunks[_path.back().second];
+
+        while ( ! _path.empty() ) {
+            pair<const Node*, size_t>& top = _path.back();
+            if ( ++top.second < top.first->maxes.size() ) {
+                _descend();
+                break;
+            }
+            _path.pop_back();
+        }
+
+        return chunk;
+    }
+
+}
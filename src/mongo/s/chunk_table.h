@@ -0,0 +1,128 @@
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+#include "mongo/s/shard.h"
+
+namespace mongo {
+
+    class Chunk;
+    typedef shared_ptr<const Chunk> ChunkPtr;
+
+    /**
+     * The chunks of a collection in order of their max key, kept in a persistent B+tree.
+     *
+     * Copies of a ChunkTable share all of their nodes, and a change to one copies only the nodes
+     * on the path to the change, so a reloaded ChunkManager applies a diff of k chunks to its
+     * predecessor's table in O(k log n) and leaves the predecessor intact for the threads still
+     * routing through it.
+     *
+     * Every node keeps the max keys of its entries in one array, searched without branching on
+     * the comparison.  When the shard key has a single field and every bound below MaxKey is a
+     * NumberLong (as with hashed keys), or every one is a NumberInt or NumberDouble, the nodes also
+     * keep the bounds as plain integers or doubles, so that routing a point of that type needs no
+     * BSON comparisons.  Otherwise, when every bound has an exact KeyString, the nodes keep the
+     * bounds encoded, and points are routed with memcmp().  Every node also knows which shards
+     * hold its chunks, so finding the shards for a range of keys doesn't visit each chunk in it.
+     *
+     * The table is changed through the std::map-like subset ConfigDiffTracker uses, with
+     * positions (the number of chunks before a place in the table) standing in for iterators.
+     * Nodes are not merged as chunks are erased, since diffs replace the chunks they erase.
+     * After a change, seal() must be called before the table is read or shared with another
+     * thread.
+     */
+    class ChunkTable {
+    public:
+        // defined in chunk_table.cpp
+        struct Node;
+        typedef shared_ptr<Node> NodePtr;
+
+        ChunkTable() {}
+
+        //
+        // changes, in the form ConfigDiffTracker expects
+        //
+
+        typedef size_t iterator;
+
+        /** @return the position of the first chunk whose max is >= key */
+        iterator lower_bound( const BSONObj& key ) const;
+
+        /** @return the position of the first chunk whose max is > key */
+        iterator upper_bound( const BSONObj& key ) const;
+
+        /** removes the chunks at positions [first, last) */
+        void erase( iterator first, iterator last );
+
+        /** adds chunk with its max key, unless a chunk with that max is already in the table */
+        void insert( const pair<BSONObj, ChunkPtr>& chunk );
+
+        void clear() { _root.reset(); }
+
+        /** brings the routing information up to date after changes */
+        void seal();
+
+        //
+        // reads
+        //
+
+        size_t size() const;
+        bool empty() const { return size() == 0; }
+
+        /** @return the chunk at position i, which must be < size() */
+        ChunkPtr at( size_t i ) const;
+
+        /** @return the chunk whose range contains point, or an empty pointer if none does */
+        ChunkPtr findIntersectingChunk( const BSONObj& point ) const;
+
+        /**
+         * Adds to shards those holding the chunks from the one containing min through the one
+         * containing max, stopping early once there are numShards of them.
+         *
+         * @return false if no chunk ends after min
+         */
+        bool getShardsForRange( set<Shard>& shards,
+                                const BSONObj& min,
+                                const BSONObj& max,
+                                size_t numShards ) const;
+
+        /** true if points of the shard key's own type are routed on normalized numbers */
+        bool isNumeric() const;
+
+        /** for tests: the number of levels of nodes */
+        int depth() const;
+
+        /** Visits the chunks in order of their max key. */
+        class Iterator {
+        public:
+            explicit Iterator( const ChunkTable& table );
+            bool more() const { return ! _path.empty(); }
+            ChunkPtr next();
+
+        private:
+            void _descend();
+
+            NodePtr _root; // keeps the nodes alive
+            vector< pair<const Node*, size_t> > _path;
+        };
+
+    private:
+        NodePtr _root;
+    };
+
+}
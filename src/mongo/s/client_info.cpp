@@ -163,6 +163,14 @@ namespace mongo {
         return res;
     }
 
+    BSONObj ClientInfo::waitForWriteBack( const BSONObj& gle ) {
+        vector<WBInfo> writebacks;
+        _addWriteBack( writebacks, gle, true );
+
+        vector<BSONObj> v = _handleWriteBacks( writebacks , false );
+        return v.empty() ? BSONObj() : v[0];
+    }
+
     void ClientInfo::disableForCommand() {
         set<string> * temp = _cur;
         _cur = _prev;
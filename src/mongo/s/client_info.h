@@ -95,6 +95,14 @@ namespace mongo {
                            string& errmsg,
                            bool fromWriteBackListener = false );
 
+        /**
+         * Waits for the writeback named in a getLastError result taken directly from a shard,
+         * as getLastError does for the results it gathers.
+         * @return the getLastError result of the written back operation, or an empty object if
+         *     gle names no writeback
+         */
+        BSONObj waitForWriteBack( const BSONObj& gle );
+
         /** @return if its ok to auto split from this client */
         bool autoSplitOk() const { return _autoSplitOk && Chunk::ShouldAutoSplit; }
 
@@ -63,6 +63,7 @@
 #include "mongo/s/d_logic.h"
 #include "mongo/s/field_parser.h"
 #include "mongo/s/grid.h"
+#include "mongo/s/server.h"
 #include "mongo/db/oplogreader.h"
 #include "mongo/s/strategy.h"
 #include "mongo/s/type_chunk.h"
@@ -2430,6 +2431,53 @@ namespace mongo {
             }
         } getShardVersionCmd;
 
+        class ChunkLoadCmd : public GridAdminCmd {
+        public:
+            ChunkLoadCmd() : GridAdminCmd( "chunkLoad" ) {}
+            virtual void help( stringstream& help ) const {
+                help << "internal.  the ops and bytes this mongos routed to each chunk of a"
+                     << " collection, for the balancer\n"
+                     << " example: { chunkLoad : 'alleyinsider.foo' } ";
+            }
+            virtual void addRequiredPrivileges(const std::string& dbname,
+                                               const BSONObj& cmdObj,
+                                               std::vector<Privilege>* out) {
+                ActionSet actions;
+                actions.addAction(ActionType::top);
+                out->push_back(Privilege(AuthorizationManager::CLUSTER_RESOURCE_NAME, actions));
+            }
+            bool run(const string& , BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool) {
+                string ns = cmdObj.firstElement().valuestrsafe();
+                if ( ns.size() == 0 ) {
+                    errmsg = "need to specify fully namespace";
+                    return false;
+                }
+
+                // a restarted mongos counts from 0 again
+                result.append( "serverID", serverID );
+
+                DBConfigPtr config = grid.getDBConfig( ns, false );
+                ChunkManagerPtr cm;
+                if ( config && config->isSharded( ns ) )
+                    cm = config->getChunkManagerIfExists( ns );
+                if ( ! cm )
+                    return true;
+
+                result.append( "epoch", cm->getVersion().epoch() );
+                BSONArrayBuilder chunks( result.subarrayStart( "chunks" ) );
+                ChunkMap chunkMap = cm->getChunkMap();
+                for ( ChunkMap::const_iterator i = chunkMap.begin(); i != chunkMap.end(); ++i ) {
+                    const Chunk& c = *i->second;
+                    chunks.append( BSON( "min" << c.getMin() <<
+                                         "counterId" << (long long)c.getLoadCounterId() <<
+                                         "ops" << (long long)c.getOpsRouted() <<
+                                         "bytes" << (long long)c.getBytesRouted() ) );
+                }
+                chunks.done();
+                return true;
+            }
+        } chunkLoadCmd;
+
         class SplitCollectionCmd : public GridAdminCmd {
         public:
             SplitCollectionCmd() : GridAdminCmd( "split" ) {}
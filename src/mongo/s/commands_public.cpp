@@ -839,6 +839,8 @@ namespace mongo {
                 }
 
                 if (ok) {
+                    chunk->noteOp( cmdObj.getObjectField("update").objsize() );
+
                     // check whether split is necessary (using update object for size heuristic)
                     ClientInfo *client = ClientInfo::get();
                         
@@ -381,17 +381,31 @@ namespace mongo {
         }
 
         // we are not locked now, and want to load a new ChunkManager
-        
-        auto_ptr<ChunkManager> temp;
 
         {
-            scoped_lock lll ( _hitConfigServerLock );
-            
-            if ( ! newest.isEmpty() && ! forceReload ) {
+            scoped_lock lk( _lock );
+
+            // A load already running may have read the config server before the change we're
+            // after, so wait for one that begins after now.  Every thread arriving during a load
+            // waits for the same next one.
+            ReloadState& state = _reloads[ns];
+            unsigned long long target = state.started + 1;
+            if ( forceReload && state.loading )
+                state.forceNext = true;
+
+            while ( state.loading && state.finished < target )
+                _reloadDone.wait( lk.boost() );
+
+            if ( state.finished >= target ) {
+                CollectionInfo& ci = _collections[ns];
+                uassert( 16745 , str::stream() << "not sharded after waiting for reload : " << ns , ci.isSharded() );
+                return ci.getCM();
+            }
+
+            if ( ! newest.isEmpty() && ! forceReload && ! state.forceNext ) {
                 // if we have a target we're going for
                 // see if we've hit already
-                
-                scoped_lock lk( _lock );
+
                 CollectionInfo& ci = _collections[ns];
                 if ( ci.isSharded() && ci.getCM() ) {
 
@@ -406,21 +420,50 @@ namespace mongo {
                         return ci.getCM();
                     }
                 }
-                
+
             }
-            
+
+            // we're the loader; build on the newest manager, which may be a waited-for load's
+            if ( _collections[ns].getCM() )
+                oldManager = _collections[ns].getCM();
+            forceReload = forceReload || state.forceNext;
+            state.forceNext = false;
+            state.loading = true;
+            state.started++;
+        }
+
+        auto_ptr<ChunkManager> temp;
+
+        try {
             temp.reset( new ChunkManager( oldManager ) );
             temp->loadExistingRanges( configServer.getPrimary().getConnString() );
 
             if ( temp->numChunks() == 0 ) {
                 // maybe we're not sharded any more
                 reload(); // this is a full reload
-                return getChunkManager( ns , false );
             }
         }
+        catch ( ... ) {
+            // let a waiting thread try instead
+            scoped_lock lk( _lock );
+            _reloads[ns].loading = false;
+            _reloadDone.notify_all();
+            throw;
+        }
 
         scoped_lock lk( _lock );
-        
+
+        ReloadState& state = _reloads[ns];
+        state.loading = false;
+        state.finished = state.started;
+        _reloadDone.notify_all();
+
+        if ( temp->numChunks() == 0 ) {
+            CollectionInfo& ci = _collections[ns];
+            uassert( 10181 ,  (string)"not sharded:" + ns , ci.isSharded() );
+            return ci.getCM();
+        }
+
         CollectionInfo& ci = _collections[ns];
         uassert( 14822 ,  (string)"state changed in the middle: " + ns , ci.isSharded() );
 
@@ -119,14 +119,23 @@ namespace mongo {
 
         typedef map<string,CollectionInfo> Collections;
 
+        // Chunk manager loads of one collection, which run one at a time
+        struct ReloadState {
+            ReloadState() : loading( false ), forceNext( false ), started( 0 ), finished( 0 ) {}
+
+            bool loading;
+            bool forceNext; // whether a waiting thread wanted a forced reload
+            unsigned long long started;  // loads begun
+            unsigned long long finished; // number of the last load to succeed
+        };
+
     public:
 
         DBConfig( string name )
             : _name( name ) ,
               _primary("config","") ,
               _shardingEnabled(false),
-              _lock("DBConfig") ,
-              _hitConfigServerLock( "DBConfig::_hitConfigServerLock" ) {
+              _lock("DBConfig") {
             verify( name.size() );
         }
         virtual ~DBConfig() {}
@@ -228,7 +237,11 @@ namespace mongo {
         Collections _collections;
 
         mutable mongo::mutex _lock; // TODO: change to r/w lock ??
-        mutable mongo::mutex _hitConfigServerLock;
+
+        // protected by _lock; threads wanting a reload wait on _reloadDone for one which began
+        // after they asked, so those arriving together share a single query of the config server
+        map<string,ReloadState> _reloads;
+        boost::condition _reloadDone;
     };
 
     class ConfigServer : public DBConfig {
@@ -29,7 +29,9 @@
 #include "mongo/db/auth/privilege.h"
 #include "mongo/client/connpool.h"
 #include "mongo/db/commands.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/util/concurrency/task.h"
 #include "mongo/util/net/listen.h"
 
@@ -50,11 +52,8 @@ namespace mongo {
 
         _id = 0;
 
-        if ( q.queryOptions & QueryOption_NoCursorTimeout ) {
-            _lastAccessMillis = 0;
-        }
-        else
-            _lastAccessMillis = Listener::getElapsedTimeMillis();
+        _noTimeout = q.queryOptions & QueryOption_NoCursorTimeout;
+        _lastAccessMillis = Listener::getElapsedTimeMillis();
     }
 
     ShardedClientCursor::~ShardedClientCursor() {
@@ -76,12 +75,11 @@ namespace mongo {
     }
 
     void ShardedClientCursor::accessed() {
-        if ( _lastAccessMillis > 0 )
-            _lastAccessMillis = Listener::getElapsedTimeMillis();
+        _lastAccessMillis = Listener::getElapsedTimeMillis();
     }
 
     long long ShardedClientCursor::idleTime( long long now ) {
-        if ( _lastAccessMillis == 0 )
+        if ( _noTimeout )
             return 0;
         return now - _lastAccessMillis;
     }
@@ -146,6 +144,10 @@ namespace mongo {
         _totalSent += docCount;
         _done = ! hasMore;
 
+        // a cursor waiting in the cache for the next getMore mustn't hold pooled connections
+        if ( hasMore )
+            _cursor->collectPrefetched();
+
         return hasMore;
     }
 
@@ -153,85 +155,131 @@ namespace mongo {
 
     long long CursorCache::TIMEOUT = 600000;
 
+    MONGO_EXPORT_SERVER_PARAMETER(cursorCacheMaxBytes, int, 512 * 1024 * 1024);
+
     unsigned getCCRandomSeed() {
         scoped_ptr<SecureRandom> sr( SecureRandom::create() );
         return sr->nextInt64();
     }
 
     CursorCache::CursorCache()
-        :_mutex( "CursorCache" ),
+        :_randomMutex( "CursorCache::random" ),
          _random( getCCRandomSeed() ),
-         _shardedTotal(0) {
+         _evictMutex( "CursorCache::evict" ) {
     }
 
     CursorCache::~CursorCache() {
         // TODO: delete old cursors?
+        size_t sharded = 0;
+        size_t refs = 0;
+        for ( int i = 0; i < NumStripes; i++ ) {
+            sharded += _stripes[i].cursors.size();
+            refs += _stripes[i].refs.size();
+            verify( _stripes[i].refs.size() == _stripes[i].refsNS.size() );
+        }
+
         bool print = logLevel > 0;
-        if ( _cursors.size() || _refs.size() )
+        if ( sharded || refs )
             print = true;
-        verify(_refs.size() == _refsNS.size());
         
         if ( print ) 
             cout << " CursorCache at shutdown - "
-                 << " sharded: " << _cursors.size()
-                 << " passthrough: " << _refs.size()
+                 << " sharded: " << sharded
+                 << " passthrough: " << refs
                  << endl;
     }
 
     ShardedClientCursorPtr CursorCache::get( long long id ) const {
         LOG(_myLogLevel) << "CursorCache::get id: " << id << endl;
-        scoped_lock lk( _mutex );
-        MapSharded::const_iterator i = _cursors.find( id );
-        if ( i == _cursors.end() ) {
+        Stripe& stripe = _stripe( id );
+        scoped_lock lk( stripe.mutex );
+        MapSharded::const_iterator i = stripe.cursors.find( id );
+        if ( i == stripe.cursors.end() ) {
             OCCASIONALLY log() << "Sharded CursorCache missing cursor id: " << id << endl;
             return ShardedClientCursorPtr();
         }
-        i->second->accessed();
-        return i->second;
+        i->second.cursor->accessed();
+        return i->second.cursor;
     }
 
     void CursorCache::store( ShardedClientCursorPtr cursor ) {
         LOG(_myLogLevel) << "CursorCache::store cursor " << " id: " << cursor->getId() << endl;
         verify( cursor->getId() );
-        scoped_lock lk( _mutex );
-        _cursors[cursor->getId()] = cursor;
-        _shardedTotal++;
+        long long bytes = cursor->bufferedBytes();
+        {
+            Stripe& stripe = _stripe( cursor->getId() );
+            scoped_lock lk( stripe.mutex );
+            CachedCursor& cached = stripe.cursors[cursor->getId()];
+            _bytesBuffered.fetchAndAdd( bytes - cached.bytes );
+            cached.cursor = cursor;
+            cached.bytes = bytes;
+        }
+        _shardedTotal.fetchAndAdd( 1 );
+        _enforceMaxBytes();
+    }
+
+    void CursorCache::update( ShardedClientCursorPtr cursor ) {
+        long long bytes = cursor->bufferedBytes();
+        {
+            Stripe& stripe = _stripe( cursor->getId() );
+            scoped_lock lk( stripe.mutex );
+            MapSharded::iterator i = stripe.cursors.find( cursor->getId() );
+            if ( i == stripe.cursors.end() || i->second.cursor != cursor ) {
+                // killed while it was used
+                return;
+            }
+            cursor->accessed();
+            _bytesBuffered.fetchAndAdd( bytes - i->second.bytes );
+            i->second.bytes = bytes;
+        }
+        _enforceMaxBytes();
     }
+
     void CursorCache::remove( long long id ) {
         verify( id );
-        scoped_lock lk( _mutex );
-        _cursors.erase( id );
+        ShardedClientCursorPtr dead; // killed after unlocking
+        Stripe& stripe = _stripe( id );
+        scoped_lock lk( stripe.mutex );
+        MapSharded::iterator i = stripe.cursors.find( id );
+        if ( i == stripe.cursors.end() )
+            return;
+        _bytesBuffered.fetchAndAdd( -i->second.bytes );
+        dead = i->second.cursor;
+        stripe.cursors.erase( i );
     }
     
     void CursorCache::storeRef(const std::string& server, long long id, const std::string& ns) {
         LOG(_myLogLevel) << "CursorCache::storeRef server: " << server << " id: " << id << endl;
         verify( id );
-        scoped_lock lk( _mutex );
-        _refs[id] = server;
-        _refsNS[id] = ns;
+        Stripe& stripe = _stripe( id );
+        scoped_lock lk( stripe.mutex );
+        stripe.refs[id] = server;
+        stripe.refsNS[id] = ns;
     }
 
     string CursorCache::getRef( long long id ) const {
         verify( id );
-        scoped_lock lk( _mutex );
-        MapNormal::const_iterator i = _refs.find( id );
+        Stripe& stripe = _stripe( id );
+        scoped_lock lk( stripe.mutex );
+        MapNormal::const_iterator i = stripe.refs.find( id );
 
-        LOG(_myLogLevel) << "CursorCache::getRef id: " << id << " out: " << ( i == _refs.end() ? " NONE " : i->second ) << endl;
+        LOG(_myLogLevel) << "CursorCache::getRef id: " << id << " out: " << ( i == stripe.refs.end() ? " NONE " : i->second ) << endl;
 
-        if ( i == _refs.end() )
+        if ( i == stripe.refs.end() )
             return "";
         return i->second;
     }
 
     std::string CursorCache::getRefNS(long long id) const {
         verify(id);
-        scoped_lock lk(_mutex);
-        MapNormal::const_iterator i = _refsNS.find(id);
+        Stripe& stripe = _stripe( id );
+        scoped_lock lk( stripe.mutex );
+        MapNormal::const_iterator i = stripe.refsNS.find(id);
 
         LOG(_myLogLevel) << "CursorCache::getRefNs id: " << id
-                << " out: " << ( i == _refsNS.end() ? " NONE " : i->second ) << std::endl;
+                << " out: " << ( i == stripe.refsNS.end() ? " NONE " : i->second ) << std::endl;
 
-        if ( i == _refsNS.end() )
+        if ( i == stripe.refsNS.end() )
             return "";
         return i->second;
     }
@@ -239,10 +287,12 @@ namespace mongo {
 
     long long CursorCache::genId() {
         while ( true ) {
-            scoped_lock lk( _mutex );
-
-            long long x = Listener::getElapsedTimeMillis() << 32;
-            x |= _random.nextInt32();
+            long long x;
+            {
+                scoped_lock lk( _randomMutex );
+                x = Listener::getElapsedTimeMillis() << 32;
+                x |= _random.nextInt32();
+            }
 
             if ( x == 0 )
                 continue;
@@ -250,12 +300,15 @@ namespace mongo {
             if ( x < 0 )
                 x *= -1;
 
-            MapSharded::iterator i = _cursors.find( x );
-            if ( i != _cursors.end() )
+            Stripe& stripe = _stripe( x );
+            scoped_lock lk( stripe.mutex );
+
+            MapSharded::iterator i = stripe.cursors.find( x );
+            if ( i != stripe.cursors.end() )
                 continue;
 
-            MapNormal::iterator j = _refs.find( x );
-            if ( j != _refs.end() )
+            MapNormal::iterator j = stripe.refs.find( x );
+            if ( j != stripe.refs.end() )
                 continue;
 
             return x;
@@ -288,31 +341,35 @@ namespace mongo {
             }
 
             string server;
+            ShardedClientCursorPtr dead; // killed after unlocking
             {
-                scoped_lock lk( _mutex );
+                Stripe& stripe = _stripe( id );
+                scoped_lock lk( stripe.mutex );
 
-                MapSharded::iterator i = _cursors.find( id );
-                if ( i != _cursors.end() ) {
-                    if (authManager->checkAuthorization(i->second->getNS(),
+                MapSharded::iterator i = stripe.cursors.find( id );
+                if ( i != stripe.cursors.end() ) {
+                    if (authManager->checkAuthorization(i->second.cursor->getNS(),
                                                         ActionType::killCursors)) {
-                        _cursors.erase( i );
+                        _bytesBuffered.fetchAndAdd( -i->second.bytes );
+                        dead = i->second.cursor;
+                        stripe.cursors.erase( i );
                     }
                     continue;
                 }
 
-                MapNormal::iterator refsIt = _refs.find(id);
-                MapNormal::iterator refsNSIt = _refsNS.find(id);
-                if (refsIt == _refs.end()) {
+                MapNormal::iterator refsIt = stripe.refs.find(id);
+                MapNormal::iterator refsNSIt = stripe.refsNS.find(id);
+                if (refsIt == stripe.refs.end()) {
                     LOG( LL_WARNING ) << "can't find cursor: " << id << endl;
                     continue;
                 }
-                verify(refsNSIt != _refsNS.end());
+                verify(refsNSIt != stripe.refsNS.end());
                 if (!authManager->checkAuthorization(refsNSIt->second, ActionType::killCursors)) {
                     continue;
                 }
                 server = refsIt->second;
-                _refs.erase(refsIt);
-                _refsNS.erase(refsNSIt);
+                stripe.refs.erase(refsIt);
+                stripe.refsNS.erase(refsNSIt);
             }
 
             LOG(_myLogLevel) << "CursorCache::found gotKillCursors id: " << id << " server: " << server << endl;
@@ -326,27 +383,110 @@ namespace mongo {
     }
 
     void CursorCache::appendInfo( BSONObjBuilder& result ) const {
-        scoped_lock lk( _mutex );
-        result.append( "sharded" , (int)_cursors.size() );
-        result.appendNumber( "shardedEver" , _shardedTotal );
-        result.append( "refs" , (int)_refs.size() );
-        result.append( "totalOpen" , (int)(_cursors.size() + _refs.size() ) );
+        int sharded = 0;
+        int pinned = 0;
+        int refs = 0;
+        for ( int i = 0; i < NumStripes; i++ ) {
+            scoped_lock lk( _stripes[i].mutex );
+            sharded += _stripes[i].cursors.size();
+            refs += _stripes[i].refs.size();
+            for ( MapSharded::const_iterator j = _stripes[i].cursors.begin();
+                  j != _stripes[i].cursors.end();
+                  ++j ) {
+                if ( ! j->second.cursor.unique() )
+                    pinned++;
+            }
+        }
+
+        result.append( "sharded" , sharded );
+        result.appendNumber( "shardedEver" , _shardedTotal.load() );
+        result.append( "refs" , refs );
+        result.append( "totalOpen" , sharded + refs );
+        result.append( "pinned" , pinned );
+        result.appendNumber( "bytesBuffered" , _bytesBuffered.load() );
+        result.appendNumber( "maxBytes" , cursorCacheMaxBytes );
+        result.appendNumber( "timedOut" , _timedOut.load() );
+        result.appendNumber( "evictedForMemory" , _evicted.load() );
     }
 
     void CursorCache::doTimeouts() {
         long long now = Listener::getElapsedTimeMillis();
-        scoped_lock lk( _mutex );
-        for ( MapSharded::iterator i=_cursors.begin(); i!=_cursors.end(); ++i ) {
-            // Note: cursors with no timeout will always have an idleTime of 0
-            long long idleFor = i->second->idleTime( now );
-            if ( idleFor < TIMEOUT ) {
-                continue;
+        vector<ShardedClientCursorPtr> dead; // killed after unlocking
+        for ( int s = 0; s < NumStripes; s++ ) {
+            Stripe& stripe = _stripes[s];
+            scoped_lock lk( stripe.mutex );
+            for ( MapSharded::iterator i=stripe.cursors.begin(); i!=stripe.cursors.end(); ) {
+                // Note: cursors with no timeout will always have an idleTime of 0
+                long long idleFor = i->second.cursor->idleTime( now );
+                if ( idleFor < TIMEOUT ) {
+                    ++i;
+                    continue;
+                }
+                log() << "killing old cursor " << i->second.cursor->getId() << " idle for: " << idleFor << "ms" << endl; // TODO: make LOG(1)
+                _bytesBuffered.fetchAndAdd( -i->second.bytes );
+                _timedOut.fetchAndAdd( 1 );
+                dead.push_back( i->second.cursor );
+                stripe.cursors.erase( i++ );
             }
-            log() << "killing old cursor " << i->second->getId() << " idle for: " << idleFor << "ms" << endl; // TODO: make LOG(1)
-            _cursors.erase( i );
-            i = _cursors.begin(); // possible 2nd entry will get skipped, will get on next pass
-            if ( i == _cursors.end() )
-                break;
+        }
+    }
+
+    namespace {
+        struct EvictionCandidate {
+            bool noTimeout;
+            long long lastAccess;
+            long long id;
+
+            bool operator<( const EvictionCandidate& other ) const {
+                if ( noTimeout != other.noTimeout )
+                    return ! noTimeout;
+                return lastAccess < other.lastAccess;
+            }
+        };
+    }
+
+    void CursorCache::_enforceMaxBytes() {
+        if ( cursorCacheMaxBytes <= 0 || _bytesBuffered.load() <= cursorCacheMaxBytes )
+            return;
+
+        scoped_lock evictLk( _evictMutex );
+
+        vector<EvictionCandidate> candidates;
+        for ( int s = 0; s < NumStripes; s++ ) {
+            scoped_lock lk( _stripes[s].mutex );
+            for ( MapSharded::const_iterator i = _stripes[s].cursors.begin();
+                  i != _stripes[s].cursors.end();
+                  ++i ) {
+                if ( ! i->second.cursor.unique() || i->second.bytes == 0 )
+                    continue;
+                EvictionCandidate c;
+                c.noTimeout = i->second.cursor->noTimeout();
+                c.lastAccess = i->second.cursor->lastAccess();
+                c.id = i->first;
+                candidates.push_back( c );
+            }
+        }
+        std::sort( candidates.begin(), candidates.end() );
+
+        vector<ShardedClientCursorPtr> dead; // killed after unlocking
+        for ( vector<EvictionCandidate>::const_iterator c = candidates.begin();
+              c != candidates.end() && _bytesBuffered.load() > cursorCacheMaxBytes;
+              ++c ) {
+            Stripe& stripe = _stripe( c->id );
+            scoped_lock lk( stripe.mutex );
+            MapSharded::iterator i = stripe.cursors.find( c->id );
+            if ( i == stripe.cursors.end() || ! i->second.cursor.unique() )
+                continue;
+
+            log() << "killing cursor " << c->id << " holding " << i->second.bytes
+                  << " bytes, as cursors hold " << _bytesBuffered.load()
+                  << " bytes, more than cursorCacheMaxBytes (" << cursorCacheMaxBytes << ")"
+                  << endl;
+
+            _bytesBuffered.fetchAndAdd( -i->second.bytes );
+            _evicted.fetchAndAdd( 1 );
+            dead.push_back( i->second.cursor );
+            stripe.cursors.erase( i );
         }
     }
 
@@ -389,4 +529,18 @@ namespace mongo {
         }
     } cmdCursorInfo;
 
+    class CursorServerStats : public ServerStatusSection {
+    public:
+
+        CursorServerStats() : ServerStatusSection( "cursors" ){}
+        virtual bool includeByDefault() const { return true; }
+
+        BSONObj generateSection(const BSONElement& configElement) const {
+            BSONObjBuilder b;
+            cursorCache.appendInfo( b );
+            return b.obj();
+        }
+
+    } cursorServerStats;
+
 }
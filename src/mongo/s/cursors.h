@@ -25,6 +25,7 @@
 #include "mongo/client/parallel.h"
 #include "mongo/db/dbmessage.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/platform/random.h"
 #include "mongo/s/request.h"
 
@@ -64,9 +65,16 @@ namespace mongo {
         bool sendNextBatch( Request& r, int ntoreturn, BufBuilder& buffer, int& docCount );
 
         void accessed();
-        /** @return idle time in ms */
+        /** @return idle time in ms, 0 if the cursor doesn't time out */
         long long idleTime( long long now );
 
+        /** @return the time the cursor was last used, in elapsed millis since startup */
+        long long lastAccess() const { return _lastAccessMillis; }
+        bool noTimeout() const { return _noTimeout; }
+
+        /** @return the bytes of the shard batches the cursor holds */
+        long long bufferedBytes() { return _cursor->bufferedBytes(); }
+
         std::string getNS() { return _cursor->getNS(); }
 
         // The default initial buffer size for sending responses.
@@ -83,18 +91,39 @@ namespace mongo {
         bool _done;
 
         long long _id;
-        long long _lastAccessMillis; // 0 means no timeout
+        long long _lastAccessMillis;
+        bool _noTimeout;
 
     };
 
     typedef boost::shared_ptr<ShardedClientCursor> ShardedClientCursorPtr;
 
+    /** the most bytes the sharded cursors may hold in shard batches, 0 for no limit */
+    extern int cursorCacheMaxBytes;
+
+    /**
+     * The sharded cursors of this mongos, and the shards of the cursors it passes through.
+     *
+     * Cursors are spread over stripes by id, each with its own lock, so that requests for
+     * different cursors don't wait for each other.  The cache accounts for the bytes each sharded
+     * cursor holds in shard batches as of when it was last stored or updated.  Past
+     * cursorCacheMaxBytes, the cursors no request is using are killed least recently used first,
+     * those which may time out before those which may not.
+     *
+     * A cursor is in use while anything other than the cache holds a pointer to it.
+     */
     class CursorCache {
     public:
 
         static long long TIMEOUT;
 
-        typedef map<long long,ShardedClientCursorPtr> MapSharded;
+        struct CachedCursor {
+            CachedCursor() : bytes( 0 ) {}
+            ShardedClientCursorPtr cursor;
+            long long bytes;
+        };
+
+        typedef map<long long,CachedCursor> MapSharded;
         typedef map<long long,string> MapNormal;
 
         CursorCache();
@@ -102,6 +131,8 @@ namespace mongo {
 
         ShardedClientCursorPtr get( long long id ) const;
         void store( ShardedClientCursorPtr cursor );
+        /** marks the cursor used and accounts for the batches it now holds */
+        void update( ShardedClientCursorPtr cursor );
         void remove( long long id );
 
         void storeRef(const std::string& server, long long id, const std::string& ns);
@@ -120,15 +151,37 @@ namespace mongo {
         void doTimeouts();
         void startTimeoutThread();
     private:
-        mutable mongo::mutex _mutex;
+        struct Stripe : boost::noncopyable {
+            Stripe() : mutex( "CursorCache::Stripe" ) {}
+
+            mutable mongo::mutex mutex;
+
+            MapSharded cursors;
+            MapNormal refs; // Maps cursor ID to shard name
+            MapNormal refsNS; // Maps cursor ID to namespace
+        };
+
+        static const int NumStripes = 16;
 
+        Stripe& _stripe( long long id ) const {
+            return _stripes[ (unsigned long long)id % NumStripes ];
+        }
+
+        /** kills unused cursors until the bytes buffered are within cursorCacheMaxBytes */
+        void _enforceMaxBytes();
+
+        mutable Stripe _stripes[NumStripes];
+
+        mongo::mutex _randomMutex;
         PseudoRandom _random;
 
-        MapSharded _cursors;
-        MapNormal _refs; // Maps cursor ID to shard name
-        MapNormal _refsNS; // Maps cursor ID to namespace
-        
-        long long _shardedTotal;
+        // one eviction pass at a time
+        mongo::mutex _evictMutex;
+
+        AtomicInt64 _shardedTotal;
+        AtomicInt64 _bytesBuffered;
+        AtomicInt64 _timedOut;
+        AtomicInt64 _evicted;
 
         static const int _myLogLevel;
     };
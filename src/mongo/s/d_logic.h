@@ -252,4 +252,10 @@ namespace mongo {
     void logOpForSharding( const char * opstr , const char * ns , const BSONObj& obj , BSONObj * patt );
     void aboutToDeleteForSharding( const Database* db , const DiskLoc& dl );
 
+    /**
+     * @return true if a chunk of ns is being migrated off this shard.  Records of ns must not
+     * move meanwhile, as the migration copies them by their DiskLocs.
+     */
+    bool isMigratingFrom( const string& ns );
+
 }
@@ -611,6 +611,17 @@ namespace mongo {
                         
                         Record* r = dl.rec();
                         if ( ! r->likelyInPhysicalMemory() ) {
+                            // _cloneLocs is in disk order, so have the OS read ahead up to the
+                            // furthest location we are about to copy from the same file
+                            long long span = 0;
+                            for ( set<DiskLoc>::iterator j = i; j != _cloneLocs.end(); ++j ) {
+                                if ( j->a() != dl.a() ||
+                                     j->getOfs() - dl.getOfs() >= faultReadAheadBytes )
+                                    break;
+                                span = j->getOfs() - dl.getOfs();
+                            }
+                            Record::willNeed( dl, span + ProcessInfo::getPageSize() );
+
                             fileLock.reset( new LockMongoFilesShared() );
                             recordToTouch = r;
                             break;
@@ -699,6 +710,11 @@ namespace mongo {
         }
 
         bool isActive() const { return _getActive(); }
+
+        bool isActiveFor( const string& ns ) const {
+            scoped_lock l(_mutex);
+            return _active && _ns == ns;
+        }
         
         void doRemove( OldDataCleanup& cleanup ) {
 
@@ -829,6 +845,10 @@ namespace mongo {
         migrateFromStatus.logOp( opstr , ns , obj , patt );
     }
 
+    bool isMigratingFrom( const string& ns ) {
+        return migrateFromStatus.isActiveFor( ns );
+    }
+
     void aboutToDeleteForSharding( const Database* db, const NamespaceDetails* nsd, const DiskLoc& dl ) {
         if ( nsd->isCapped() )
             return;
@@ -1220,8 +1240,12 @@ namespace mongo {
                     return false;
                 }
 
-                if ( res["state"].String() == "steady" )
+                if ( res["state"].String() == "steady" ) {
+                    // lets the balancer account for how much it moves
+                    if ( res["counts"].type() == Object )
+                        result.append( res["counts"] );
                     break;
+                }
 
                 if ( migrateFromStatus.mbUsed() > (500 * 1024 * 1024) ) {
                     // this is too much memory for us to use for this
@@ -23,6 +23,7 @@
 #include <string>
 #include <vector>
 
+#include "mongo/base/counter.h"
 #include "mongo/db/auth/action_set.h"
 #include "mongo/db/auth/action_type.h"
 #include "mongo/db/auth/authorization_manager.h"
@@ -32,6 +33,8 @@
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/stats/timer_stats.h"
 #include "mongo/platform/random.h"
 #include "mongo/util/net/listen.h"
 #include "mongo/util/queue.h"
@@ -41,11 +44,36 @@ using namespace std;
 
 namespace mongo {
 
+    MONGO_EXPORT_SERVER_PARAMETER(writeBackQueueMaxBytes, int, 256 * 1024 * 1024);
+    // short, since the write waiting for room holds its database's write lock
+    MONGO_EXPORT_SERVER_PARAMETER(writeBackQueueFullTimeoutSecs, int, 5);
+
+    static Counter64 writeBacksQueued;
+    static ServerStatusMetricField<Counter64> displayWriteBacksQueued( "writeBacks.queued",
+                                                                      &writeBacksQueued );
+    static Counter64 writeBacksRejected;
+    static ServerStatusMetricField<Counter64> displayWriteBacksRejected( "writeBacks.queueFull",
+                                                                        &writeBacksRejected );
+    // time from queuing a writeback to handing it to its mongos
+    static TimerStats writeBackQueueTime;
+    static ServerStatusMetricField<TimerStats> displayWriteBackQueueTime( "writeBacks.queueTime",
+                                                                          &writeBackQueueTime );
+
+    static size_t writeBackSize( const BSONObj& op ) {
+        return op.objsize();
+    }
+
     // ---------- WriteBackManager class ----------
 
     // TODO init at mongod startup
     WriteBackManager writeBackManager;
 
+    WriteBackManager::QueueInfo::QueueInfo( size_t maxBytes )
+        : queue( maxBytes, &writeBackSize ),
+          lastCall( 0 ),
+          orderLock( "WriteBackManager::QueueInfo id ordering" ) {
+    }
+
     WriteBackManager::WriteBackManager() : _writebackQueueLock("sharding:writebackQueueLock") {
     }
 
@@ -53,15 +81,23 @@ namespace mongo {
     }
 
     OID WriteBackManager::queueWriteBack( const string& remote , BSONObjBuilder& b ) {
-        static mongo::mutex writebackIDOrdering( "WriteBackManager::queueWriteBack id ordering" );
-        
-        scoped_lock lk( writebackIDOrdering );
+        shared_ptr<QueueInfo> q = getWritebackQueue( remote );
+
+        scoped_lock lk( q->orderLock );
 
         OID writebackID;
         writebackID.initSequential();
         b.append( "id", writebackID );
+        b.appendDate( "queuedAt", jsTime() );
         
-        getWritebackQueue( remote )->queue.push( b.obj() );
+        if ( ! q->queue.blockingPush( b.obj(), writeBackQueueFullTimeoutSecs ) ) {
+            writeBacksRejected.increment();
+            uasserted( 16748, str::stream() << "writeback queue for " << remote << " still full "
+                                            << "after " << writeBackQueueFullTimeoutSecs
+                                            << " secs (" << q->queue.size() << " bytes in "
+                                            << q->queue.count() << " ops)" );
+        }
+        writeBacksQueued.increment();
 
         return writebackID;
     }
@@ -70,7 +106,7 @@ namespace mongo {
         scoped_lock lk ( _writebackQueueLock );
         shared_ptr<QueueInfo>& q = _writebackQueues[remote];
         if ( ! q )
-            q.reset( new QueueInfo() );
+            q.reset( new QueueInfo( max( writeBackQueueMaxBytes, BSONObjMaxInternalSize ) ) );
         q->lastCall = Listener::getElapsedTimeMillis();
         return q;
     }
@@ -89,6 +125,7 @@ namespace mongo {
     void WriteBackManager::appendStats( BSONObjBuilder& b ) const {
         BSONObjBuilder sub;
         long long totalQueued = 0;
+        long long totalBytes = 0;
         long long now = Listener::getElapsedTimeMillis();
         {
             scoped_lock lk( _writebackQueueLock );
@@ -96,16 +133,20 @@ namespace mongo {
                 const shared_ptr<QueueInfo> queue = it->second;
 
                 BSONObjBuilder t( sub.subobjStart( it->first ) );
-                t.appendNumber( "n" , queue->queue.size() );
+                t.appendNumber( "n" , queue->queue.count() );
+                t.appendNumber( "bytes" , (long long)queue->queue.size() );
+                t.appendNumber( "maxBytes" , (long long)queue->queue.maxSize() );
                 t.appendNumber( "minutesSinceLastCall" , ( now - queue->lastCall ) / ( 1000 * 60 ) );
                 t.done();
 
-                totalQueued += queue->queue.size();
+                totalQueued += queue->queue.count();
+                totalBytes += queue->queue.size();
             }
         }
 
         b.appendBool( "hasOpsQueued" , totalQueued > 0 );
         b.appendNumber( "totalOpsQueued" , totalQueued );
+        b.appendNumber( "totalBytesQueued" , totalBytes );
         b.append( "queues" , sub.obj() );
     }
 
@@ -121,7 +162,7 @@ namespace mongo {
                 continue;
 
             log() << "deleting queue from: " << it->first
-                  << " of size: " << queue->queue.size()
+                  << " of size: " << queue->queue.count()
                   << " after " << sinceMinutes << " inactivity"
                   << " (normal if any mongos has restarted)"
                   << endl;
@@ -172,12 +213,40 @@ namespace mongo {
             // get the command issuer's (a mongos) serverID
             const OID id = e.__oid();
 
+            // a mongos that can take several writebacks at once says how many
+            int batchSize = cmdObj["batchSize"].numberInt();
+
+            shared_ptr<WriteBackManager::QueueInfo> q = writeBackManager.getWritebackQueue(id.str());
+
             // the command issuer is blocked awaiting a response
             // we want to do return at least at every 5 minutes so sockets don't timeout
             BSONObj z;
-            if ( writeBackManager.getWritebackQueue(id.str())->queue.blockingPop( z, 5 * 60 /* 5 minutes */ ) ) {
+            if ( q->queue.blockingPop( z, 5 * 60 /* 5 minutes */ ) ) {
                 LOG(1) << "WriteBackCommand got : " << z << endl;
-                result.append( "data" , z );
+                _handedOut( z );
+
+                if ( batchSize <= 0 ) {
+                    result.append( "data" , z );
+                }
+                else {
+                    BSONArrayBuilder batch( result.subarrayStart( "batch" ) );
+                    batch.append( z );
+
+                    // Whatever else is queued comes along, within the size of a user object.
+                    // This is the only consumer of the queue, so what we peek is what we pop.
+                    int bytes = z.objsize();
+                    BSONObj next;
+                    for ( int n = 1; n < batchSize && q->queue.peek( next ); n++ ) {
+                        if ( bytes + next.objsize() > BSONObjMaxUserSize )
+                            break;
+                        if ( ! q->queue.tryPop( next ) )
+                            break;
+                        _handedOut( next );
+                        batch.append( next );
+                        bytes += next.objsize();
+                    }
+                    batch.done();
+                }
             }
             else {
                 result.appendBool( "noop" , true );
@@ -196,6 +265,13 @@ namespace mongo {
 
             return true;
         }
+
+    private:
+        static void _handedOut( const BSONObj& op ) {
+            BSONElement queuedAt = op["queuedAt"];
+            if ( queuedAt.type() == Date )
+                writeBackQueueTime.recordMillis( jsTime() - queuedAt.date() );
+        }
     } writeBackCommand;
 
     class WriteBacksQueuedCommand : public Command {
@@ -232,4 +308,14 @@ namespace mongo {
         }
     } writeBacksQueuedSSM;
 
+    class WriteBackBytesQueuedSSM : public ServerStatusMetric {
+    public:
+        WriteBackBytesQueuedSSM() : ServerStatusMetric("writeBacks.bytesQueued"){}
+        virtual void appendAtLeaf( BSONObjBuilder& b ) const {
+            BSONObjBuilder stats;
+            writeBackManager.appendStats( stats );
+            b.appendAs( stats.obj()["totalBytesQueued"], _leafName );
+        }
+    } writeBackBytesQueuedSSM;
+
 }  // namespace mongo
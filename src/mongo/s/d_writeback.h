@@ -26,10 +26,21 @@
 
 namespace mongo {
 
+    /** bytes of writebacks a queue may hold before writes that need one wait for room */
+    extern int writeBackQueueMaxBytes;
+
+    /** how long a write waits for room in a full writeback queue before it fails */
+    extern int writeBackQueueFullTimeoutSecs;
+
     /*
      * The WriteBackManager keeps one queue of pending operations per mongos. The operations get here
      * if they were directed to a chunk that is no longer in this mongod server. The operations are
-     * "written back" to the mongos server per its request (command 'writebacklisten').
+     * "written back" to the mongos server per its request (command 'writebacklisten'), in batches
+     * if the mongos asks for them.
+     *
+     * Each queue holds at most writeBackQueueMaxBytes of operations (as of its creation), so a
+     * mongos that falls behind slows down the stale writes meant for it instead of growing the
+     * queue without bound.
      *
      * The class is thread safe.
      */
@@ -38,10 +49,14 @@ namespace mongo {
 
         class QueueInfo : boost::noncopyable {
         public:
-            QueueInfo(){}
+            QueueInfo( size_t maxBytes );
 
+            // sized by the bytes of the queued operations
             BlockingQueue<BSONObj> queue;
             long long lastCall;   // this is elapsed millis since startup
+
+            // held while an operation is given its id and queued, so ids ascend through the queue
+            mongo::mutex orderLock;
         };
 
         // a map from mongos's serverIDs to queues of "rejected" operations
@@ -58,7 +73,8 @@ namespace mongo {
          * @param op the operation itself
          *
          * Enqueues operation 'op' in server 'remote's queue. The operation will be written back to
-         * remote at a later stage.
+         * remote at a later stage.  Waits for room if the queue is full, and throws if there is
+         * still none after writeBackQueueFullTimeoutSecs.
          *
          * @return the writebackId generated
          */
@@ -59,6 +59,7 @@ namespace mongo {
                        and isn't needed since all connections will be closed anyway */
                     if ( inShutdown() ) {
                         if( versionManager.isVersionableCB( ss->avail ) ) versionManager.resetShardVersionCB( ss->avail );
+                        shardConnectionPool.decrementEgress( addr , ss->avail );
                         delete ss->avail;
                     }
                     else
@@ -106,6 +107,7 @@ namespace mongo {
                 }
 
                 if (!isConnGood) {
+                    shardConnectionPool.decrementEgress( addr , s->avail );
                     delete s->avail;
                     s->avail = NULL;
                 }
@@ -190,6 +192,7 @@ namespace mongo {
         void clearPool() {
             for(HostMap::iterator iter = _hosts.begin(); iter != _hosts.end(); ++iter) {
                 if (iter->second->avail != NULL) {
+                    shardConnectionPool.decrementEgress( iter->first , iter->second->avail );
                     delete iter->second->avail;
                 }
             }
@@ -272,6 +275,7 @@ namespace mongo {
                 ClientConnections::threadInstance()->done(_addr, _conn);
             }
             else {
+                shardConnectionPool.decrementEgress( _addr , _conn );
                 delete _conn;
             }
 
@@ -19,6 +19,7 @@
 #include "pch.h"
 #include "chunk.h"
 #include "../db/jsobj.h"
+#include "mongo/bson/bson_field_index.h"
 #include "mongo/db/json.h"
 #include "../util/startup_test.h"
 #include "../util/timer.h"
@@ -43,12 +44,13 @@ namespace mongo {
     }
 
     bool ShardKeyPattern::hasShardKey( const BSONObj& obj ) const {
-        /* this is written s.t. if obj has lots of fields, if the shard key fields are early,
-           it is fast.  so a bit more work to try to be semi-fast.
+        /* obj's fields are looked up through a BSONFieldIndex, so that if obj has lots of
+           fields, a compound key's fields cost a single scan of them rather than one each.
            */
 
+        BSONFieldIndex fields( obj );
         for(set<string>::const_iterator it = patternfields.begin(); it != patternfields.end(); ++it) {
-            BSONElement e = obj.getFieldDotted(it->c_str());
+            BSONElement e = fields.getFieldDotted(*it);
             if(e.eoo() || e.type() == Array || (e.type() == Object && e.embeddedObject().firstElementFieldName()[0] == '$')) {
                 // cant use getGtLtOp here as it returns Equality for unknown $ops and we want to reject them
                 return false;
@@ -53,7 +53,9 @@
 #include "mongo/db/auth/authorization_manager.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/index.h"
+#include "mongo/db/lasterror.h"
 #include "mongo/db/namespacestring.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/s/client_info.h"
 #include "mongo/s/chunk.h"
 #include "mongo/s/chunk_version.h"
@@ -67,6 +69,10 @@
 
 namespace mongo {
 
+    // Whether continue-on-error inserts to sharded collections are sent to all of their shards at
+    // once, with the errors reported per document, or group by group as ordered inserts are.
+    MONGO_EXPORT_SERVER_PARAMETER(pipelineUnorderedInserts, bool, true);
+
     class ShardStrategy : public Strategy {
 
         bool _isSystemIndexes( const char* ns ) {
@@ -264,7 +270,7 @@ namespace mongo {
 
                 if ( hasMore ) {
                     // still more data
-                    cursor->accessed();
+                    cursorCache.update( cursor );
                 }
                 else {
                     // we've exhausted the cursor
@@ -510,6 +516,7 @@ namespace mongo {
                     o = group->manager->getShardKey().moveToFront(o);
                     group->inserts.push_back(o);
                     group->chunkData[chunk] += objSize;
+                    chunk->noteOp( objSize );
                 }
                 else {
 
@@ -551,12 +558,380 @@ namespace mongo {
             _insert(ns, d, flags, r);
         }
 
+        /**
+         * The documents of a continue-on-error insert bound for one shard, in the order the
+         * client sent them.
+         */
+        struct ShardInsertBatch {
+            vector<BSONObj> docs;
+            vector<int> indexes; // of each document in the client's message
+            map<ChunkPtr, int> chunkData;
+        };
+
+        /** one insert message sent to a shard, with the getLastError sent right behind it */
+        struct SentInsert {
+            SentInsert( size_t batch, size_t begin, size_t end ) :
+                batch( batch ), begin( begin ), end( end ) {}
+
+            size_t batch;
+            size_t begin; // range of the batch's documents
+            size_t end;
+            shared_ptr<DBClientCursor> gle;
+        };
+
+        /** an error for the writeErrors of a bulk insert, positioned by document index */
+        struct InsertError {
+            InsertError( int position, int code, const string& msg, const BSONObj& entry ) :
+                position( position ), code( code ), msg( msg ), entry( entry ) {}
+
+            bool operator<( const InsertError& other ) const {
+                return position < other.position;
+            }
+
+            int position;
+            int code;
+            string msg;
+            BSONObj entry;
+        };
+
+        static const int maxInsertErrorIndexes = 1000;
+
+        /**
+         * Records the error a shard reported for some of a batch's documents.  The shard only
+         * reports the last error in each insert message, so the error carries the indexes of all
+         * of the documents in the message, and is positioned at the last of them.
+         */
+        void _addShardInsertError( vector<InsertError>& errors,
+                                   const Shard& shard,
+                                   const ShardInsertBatch& batch,
+                                   size_t begin,
+                                   size_t end,
+                                   int code,
+                                   const string& msg ) {
+            BSONObjBuilder b;
+            b.append( "code", code );
+            b.append( "errmsg", msg );
+            b.append( "shard", shard.getName() );
+            b.append( "n", (int)( end - begin ) );
+            BSONArrayBuilder indexes( b.subarrayStart( "indexes" ) );
+            for ( size_t i = begin; i < end && i - begin < (size_t)maxInsertErrorIndexes; i++ )
+                indexes.append( batch.indexes[i] );
+            indexes.done();
+
+            errors.push_back( InsertError( batch.indexes[end - 1], code, msg, b.obj() ) );
+        }
+
+        /**
+         * Sends each shard its batch, as a pipeline of insert messages of at most half the
+         * maximum user object size (so the writeback listener can resend them), each followed by
+         * a getLastError.  Every shard is sent all of its documents before any reply is read, so
+         * the shards insert concurrently and mongos waits about as long as the slowest of them.
+         *
+         * Throws a StaleConfigException, before anything is sent, if a shard's version can't be
+         * set.
+         */
+        void _sendInsertBatches( const string& ns,
+                                 int flags,
+                                 const ChunkManagerPtr& manager,
+                                 const vector<Shard>& shards,
+                                 const vector<ShardInsertBatch>& batches,
+                                 vector<InsertError>& errors,
+                                 Request& r ) {
+
+            vector< shared_ptr<ShardConnection> > conns;
+            try {
+                for ( size_t i = 0; i < shards.size(); i++ ) {
+                    conns.push_back( shared_ptr<ShardConnection>(
+                            new ShardConnection( shards[i], ns, manager ) ) );
+                    // Will throw SCE if we need to reset our version before sending.
+                    conns.back()->setVersion();
+                }
+            }
+            catch ( StaleConfigException& ) {
+                for ( size_t i = 0; i < conns.size(); i++ )
+                    conns[i]->done();
+                throw;
+            }
+
+            vector<bool> broken( batches.size(), false );
+            vector<SentInsert> sent;
+
+            // round-robin over the shards, so that they all start work as early as possible
+            vector<size_t> next( batches.size(), 0 );
+            bool more = true;
+            while ( more ) {
+                more = false;
+                for ( size_t b = 0; b < batches.size(); b++ ) {
+                    const ShardInsertBatch& batch = batches[b];
+                    size_t begin = next[b];
+                    if ( broken[b] || begin == batch.docs.size() )
+                        continue;
+
+                    size_t end = begin;
+                    int bytes = 0;
+                    while ( end < batch.docs.size() ) {
+                        int objSize = batch.docs[end].objsize();
+                        if ( end > begin && bytes + objSize > BSONObjMaxUserSize / 2 )
+                            break;
+                        bytes += objSize;
+                        end++;
+                    }
+
+                    LOG(5) << "inserting " << ( end - begin ) << " documents to shard "
+                           << shards[b] << " at version "
+                           << manager->getVersion().toString() << endl;
+
+                    SentInsert s( b, begin, end );
+                    try {
+                        vector<BSONObj> docs( batch.docs.begin() + begin,
+                                              batch.docs.begin() + end );
+                        (*conns[b])->insert( ns, docs, flags );
+
+                        s.gle.reset( new DBClientCursor( conns[b]->get(), "admin.$cmd",
+                                                         BSON( "getlasterror" << 1 ),
+                                                         -1, 0, NULL, 0, 0 ) );
+                        s.gle->initLazy();
+                        sent.push_back( s );
+                    }
+                    catch ( DBException& e ) {
+                        // Network error on send.  The documents not yet acknowledged may or may
+                        // not have been inserted.
+                        warning() << "error sending insert to shard " << shards[b]
+                                  << causedBy( e ) << endl;
+                        broken[b] = true;
+                        _addShardInsertError( errors, shards[b], batch, begin,
+                                              batch.docs.size(), e.getCode(), e.what() );
+                        continue;
+                    }
+
+                    next[b] = end;
+                    if ( end < batch.docs.size() )
+                        more = true;
+                }
+            }
+
+            ClientInfo* ci = r.getClientInfo();
+
+            for ( size_t i = 0; i < sent.size(); i++ ) {
+                SentInsert& s = sent[i];
+                const ShardInsertBatch& batch = batches[s.batch];
+                const Shard& shard = shards[s.batch];
+
+                if ( broken[s.batch] ) {
+                    // the earlier error covers these documents
+                    continue;
+                }
+
+                BSONObj gle;
+                try {
+                    bool retry = false;
+                    if ( ! s.gle->initLazyFinish( retry ) || ! s.gle->more() ) {
+                        uasserted( 16747, str::stream() << "no getLastError reply from shard "
+                                                        << shard.toString() );
+                    }
+                    gle = s.gle->nextSafe().getOwned();
+                }
+                catch ( DBException& e ) {
+                    warning() << "error getting last error for insert from shard " << shard
+                              << causedBy( e ) << endl;
+                    broken[s.batch] = true;
+                    _addShardInsertError( errors, shard, batch, s.begin, batch.docs.size(),
+                                          e.getCode(), e.what() );
+                    continue;
+                }
+
+                // A shard that turned out to be stale writes the inserts back to us, and only
+                // the result of the written back inserts says whether they failed.
+                BSONObj written = ci->waitForWriteBack( gle );
+                if ( ! written.isEmpty() )
+                    gle = written;
+
+                string err = DBClientWithCommands::getLastErrorString( gle );
+                if ( err.size() ) {
+                    int code = gle["code"].numberInt();
+                    _addShardInsertError( errors, shard, batch, s.begin, s.end,
+                                          code ? code : 16460, err );
+                }
+            }
+
+            for ( size_t b = 0; b < conns.size(); b++ ) {
+                if ( broken[b] )
+                    conns[b]->kill();
+                else
+                    conns[b]->done();
+            }
+
+            // we've gathered every shard's errors and writebacks ourselves
+            ci->clearSinceLastGetError();
+
+            if ( r.getClientInfo()->autoSplitOk() ) {
+                for ( size_t b = 0; b < batches.size(); b++ ) {
+                    for ( map<ChunkPtr, int>::const_iterator it = batches[b].chunkData.begin();
+                          it != batches[b].chunkData.end(); ++it ) {
+                        it->first->splitIfShould( it->second );
+                    }
+                }
+            }
+        }
+
+        /**
+         * Continue-on-error inserts to a sharded collection.
+         *
+         * The documents are grouped by shard over the whole message rather than into runs of
+         * consecutive documents, and every shard is sent its documents before waiting on any of
+         * them.  As with a mongod, the error reported is the last one, but all of them are
+         * listed in writeErrors by the indexes of their documents.
+         */
+        void _insertUnordered(const string& ns, DbMessage& d, int flags, Request& r) {
+
+            vector<BSONObj> docs;
+            while ( d.moreJSObjs() )
+                docs.push_back( d.nextJsObj() );
+
+            vector<InsertError> errors;
+            bool reloadedConfig = false;
+            int retries = 0;
+            bool sent = false;
+
+            while ( ! sent ) {
+
+                uassert( 16055, str::stream() << "too many retries during insert", retries < 30 );
+
+                ChunkManagerPtr manager;
+                ShardPtr primary;
+                grid.getDBConfig(ns)->getChunkManagerOrPrimary(ns, manager, primary);
+
+                vector<Shard> shards;
+                vector<ShardInsertBatch> batches;
+                map<Shard, size_t> batchForShard;
+                vector<InsertError> localErrors;
+                bool retarget = false;
+
+                for ( size_t i = 0; i < docs.size(); i++ ) {
+                    BSONObj o = docs[i];
+
+                    if ( manager && ! manager->hasShardKey( o ) ) {
+
+                        bool bad = true;
+
+                        // If _id is part of shard key pattern, but item doesn't already have one,
+                        // add autogenerated _id and see if we now have a shard key.
+                        if ( manager->getShardKey().partOfShardKey( "_id" ) && ! o.hasField( "_id" ) ) {
+                            BSONObjBuilder b;
+                            b.appendOID( "_id", 0, true );
+                            b.appendElements( o );
+                            o = b.obj();
+                            bad = ! manager->hasShardKey( o );
+                        }
+
+                        if ( bad && ! reloadedConfig ) {
+                            // As for ordered inserts, reload once in case the shard key changed
+                            warning() << "shard key mismatch for insert " << o
+                                      << ", expected values for " << manager->getShardKey()
+                                      << ", reloading config data to ensure not stale" << endl;
+
+                            grid.getDBConfig(ns)->getChunkManagerIfExists(ns, true);
+                            reloadedConfig = true;
+                            retarget = true;
+                            break;
+                        }
+
+                        if ( bad ) {
+                            string msg = str::stream()
+                                    << "tried to insert object with no valid shard key for "
+                                    << manager->getShardKey().toString() << " : " << o.toString();
+                            localErrors.push_back( InsertError( i, 8011, msg,
+                                    BSON( "index" << (int)i << "code" << 8011 << "errmsg" << msg ) ) );
+                            continue;
+                        }
+                    }
+
+                    // Make sure our objSize is not greater than maximum, otherwise WBL won't work
+                    verify( o.objsize() <= BSONObjMaxUserSize );
+
+                    ChunkPtr chunk;
+                    Shard shard;
+                    if ( manager ) {
+                        chunk = manager->findChunkForDoc( o );
+                        shard = chunk->getShard();
+                        o = manager->getShardKey().moveToFront( o );
+                    }
+                    else {
+                        // unsharded since we last looked
+                        shard = *primary;
+                    }
+
+                    map<Shard, size_t>::iterator it = batchForShard.find( shard );
+                    if ( it == batchForShard.end() ) {
+                        it = batchForShard.insert( make_pair( shard, batches.size() ) ).first;
+                        shards.push_back( shard );
+                        batches.push_back( ShardInsertBatch() );
+                    }
+
+                    ShardInsertBatch& batch = batches[it->second];
+                    batch.docs.push_back( o );
+                    batch.indexes.push_back( i );
+                    if ( chunk ) {
+                        batch.chunkData[chunk] += o.objsize();
+                        chunk->noteOp( o.objsize() );
+                    }
+                }
+
+                if ( retarget )
+                    continue;
+
+                if ( ! localErrors.empty() ) {
+                    // Sleep to avoid DOS'ing config server when we have invalid inserts
+                    _sleepForVerifiedLocalError();
+                }
+
+                try {
+                    if ( ! batches.empty() ) {
+                        _sendInsertBatches( ns, flags, manager, shards, batches, errors, r );
+                    }
+                    sent = true;
+                }
+                catch ( StaleConfigException& e ) {
+                    // Nothing was sent, so all of the documents are targeted again
+                    _handleRetries( "insert", retries, ns, docs[0], e, r );
+                    retries++;
+                    continue;
+                }
+
+                errors.insert( errors.end(), localErrors.begin(), localErrors.end() );
+            }
+
+            if ( errors.empty() )
+                return;
+
+            std::stable_sort( errors.begin(), errors.end() );
+
+            BSONArrayBuilder writeErrors;
+            for ( size_t i = 0; i < errors.size() && i < (size_t)maxInsertErrorIndexes; i++ )
+                writeErrors.append( errors[i].entry );
+
+            const InsertError& last = errors.back();
+            warning() << "error inserting " << docs.size() << " documents to " << ns
+                      << ", " << errors.size() << " errors, last" << causedBy( last.msg ) << endl;
+
+            lastError.getSafe()->raiseWriteErrors( last.code, last.msg.c_str(),
+                                                   writeErrors.arr() );
+        }
+
         void _insert(const string& ns, DbMessage& d, int flags, Request& r) // TODO: remove
         {
             uassert( 16056, str::stream() << "shutting down server during insert", ! inShutdown() );
 
             bool continueOnError = flags & InsertOption_ContinueOnError;
 
+            // Inserts written back to us go group by group, since the writeback listener gathers
+            // their errors itself.
+            if ( continueOnError && ! ( flags & WriteOption_FromWriteback ) &&
+                    pipelineUnorderedInserts && grid.getDBConfig(ns)->isSharded(ns) ) {
+                _insertUnordered( ns, d, flags, r );
+                return;
+            }
+
             // Sanity check, probably not needed but for safety
             int retries = 0;
 
@@ -1141,8 +1516,11 @@ namespace mongo {
                 uasserted(16732, errMsg);
             }
 
-            if( chunk && r.getClientInfo()->autoSplitOk() )
-                chunk->splitIfShould( d.msg().header()->dataLen() );
+            if( chunk ) {
+                chunk->noteOp( d.msg().header()->dataLen() );
+                if( r.getClientInfo()->autoSplitOk() )
+                    chunk->splitIfShould( d.msg().header()->dataLen() );
+            }
         }
 
 
@@ -20,7 +20,12 @@
 
 #include "writeback_listener.h"
 
+#include "mongo/base/counter.h"
 #include "mongo/db/auth/authorization_manager.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/stats/timer_stats.h"
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/client_info.h"
 #include "mongo/s/config.h"
@@ -40,7 +45,23 @@ namespace mongo {
     map<WriteBackListener::ConnectionIdent,WriteBackListener::WBStatus> WriteBackListener::_seenWritebacks;
     mongo::mutex WriteBackListener::_seenWritebacksLock("WriteBackListener::seen");
 
-    WriteBackListener::WriteBackListener( const string& addr ) : _addr( addr ) {
+    // writebacks asked for per writebacklisten call; 0 takes them one at a time
+    MONGO_EXPORT_SERVER_PARAMETER(writeBackBatchSize, int, 100);
+    // threads per listener replaying writebacks from different connections
+    MONGO_EXPORT_SERVER_PARAMETER(writeBackReplayThreads, int, 4);
+
+    static Counter64 writeBacksReplayed;
+    static ServerStatusMetricField<Counter64> displayWriteBacksReplayed( "writeBacks.replayed",
+                                                                        &writeBacksReplayed );
+    static Counter64 writeBacksCoalesced;
+    static ServerStatusMetricField<Counter64> displayWriteBacksCoalesced( "writeBacks.coalesced",
+                                                                         &writeBacksCoalesced );
+    static TimerStats writeBackDrainTime;
+    static ServerStatusMetricField<TimerStats> displayWriteBackDrainTime( "writeBacks.batchDrain",
+                                                                          &writeBackDrainTime );
+
+    WriteBackListener::WriteBackListener( const string& addr )
+        : _addr( addr ), _replayPool( max( writeBackReplayThreads, 1 ) ) {
         _name = str::stream() << "WriteBackListener-" << addr;
         log() << "creating WriteBackListener for: " << addr << " serverID: " << serverID << endl;
     }
@@ -166,6 +187,8 @@ namespace mongo {
                 {
                     BSONObjBuilder cmd;
                     cmd.appendOID( "writebacklisten" , &serverID ); // Command will block for data
+                    if ( writeBackBatchSize > 0 )
+                        cmd.append( "batchSize" , writeBackBatchSize );
                     if ( ! conn->get()->runCommand( "admin" , cmd.obj() , result ) ) {
                         result = result.getOwned();
                         log() <<  "writebacklisten command failed!  "  << result << endl;
@@ -178,8 +201,32 @@ namespace mongo {
 
                 LOG(1) << "writebacklisten result: " << result << endl;
 
-                BSONObj data = result.getObjectField( "data" );
-                if ( data.getBoolField( "writeBack" ) ) {
+                vector<BSONObj> batch;
+                if ( result["batch"].type() == Array ) {
+                    BSONObjIterator i( result["batch"].embeddedObject() );
+                    while ( i.more() )
+                        batch.push_back( i.next().Obj().getOwned() );
+                }
+                else if ( result.getObjectField( "data" ).getBoolField( "writeBack" ) ) {
+                    batch.push_back( result.getObjectField( "data" ).getOwned() );
+                }
+                else if ( result["noop"].trueValue() ) {
+                    // no-op
+                }
+                else {
+                    log() << "unknown writeBack result: " << result << endl;
+                }
+
+                Timer drainTimer;
+                map<ConnectionIdent,ReplayGroup> groups;
+
+                for ( vector<BSONObj>::const_iterator it = batch.begin(); it != batch.end(); ++it ) {
+                    const BSONObj& data = *it;
+                    if ( ! data.getBoolField( "writeBack" ) ) {
+                        log() << "unknown writeBack in batch: " << data << endl;
+                        continue;
+                    }
+
                     string ns = data["ns"].valuestrsafe();
 
                     ConnectionIdent cid( "" , 0 );
@@ -206,7 +253,7 @@ namespace mongo {
                     // TODO: Refactor the sharded strategy to correctly handle all sharding state changes itself,
                     // we can't rely on WBL to do this for us b/c anything could reset our state in-between.
                     // We should always reload here for efficiency when possible, but staleness is also caught in the
-                    // loop below.
+                    // loop in _replay().
                     //
 
                     ChunkManagerPtr manager;
@@ -281,128 +328,38 @@ namespace mongo {
                         db->reload();
                     }
 
-                    // do request and then call getLastError
-                    // we have to call getLastError so we can return the right fields to the user if they decide to call getLastError
-
-                    BSONObj gle;
-                    int attempts = 0;
-                    while ( true ) {
-                        attempts++;
-
-                        try {
-
-                            Request r( msg , 0 );
-                            r.init();
-
-                            r.d().reservedField() |= Reserved_FromWriteback;
-
-                            ClientInfo * ci = r.getClientInfo();
-                            if (!noauth) {
-                                ci->getAuthorizationManager()->grantInternalAuthorization(
-                                        "_writebackListener");
-                            }
-                            ci->noAutoSplit();
-
-                            r.process( attempts );
-
-                            ci->newRequest(); // this so we flip prev and cur shards
-
-                            BSONObjBuilder b;
-                            string errmsg;
-                            if ( ! ci->getLastError( "admin",
-                                                     BSON( "getLastError" << 1 ),
-                                                     b,
-                                                     errmsg,
-                                                     true ) )
-                            {
-                                b.appendBool( "commandFailed" , true );
-                                if( ! b.hasField( "errmsg" ) ){
-
-                                    b.append( "errmsg", errmsg );
-                                    gle = b.obj();
-                                }
-                                else if( errmsg.size() > 0 ){
-
-                                    // Rebuild GLE object with errmsg
-                                    // TODO: Make this less clumsy by improving GLE interface
-                                    gle = b.obj();
-
-                                    if( gle["errmsg"].type() == String ){
-
-                                        BSONObj gleNoErrmsg =
-                                                gle.filterFieldsUndotted( BSON( "errmsg" << 1 ),
-                                                                          false );
-                                        BSONObjBuilder bb;
-                                        bb.appendElements( gleNoErrmsg );
-                                        bb.append( "errmsg", gle["errmsg"].String() +
-                                                             " ::and:: " +
-                                                             errmsg );
-                                        gle = bb.obj().getOwned();
-                                    }
-                                }
-                            }
-                            else{
-                                gle = b.obj();
-                            }
-
-                            if ( gle["code"].numberInt() == 9517 ) {
-
-                                log() << "new version change detected, "
-                                      << lastNeededCount << " writebacks processed previously" << endl;
-
-                                lastNeededVersion.reset();
-                                lastNeededCount = 1;
-
-                                log() << "writeback failed because of stale config, retrying attempts: " << attempts << endl;
-                                LOG(1) << "writeback error : " << gle << endl;
-
-                                //
-                                // Bringing this in line with the similar retry logic elsewhere
-                                //
-                                // TODO: Reloading the chunk manager may not help if we dropped a
-                                // collection, but we don't actually have that info in the writeback
-                                // error
-                                //
-
-                                if( attempts <= 2 ){
-                                    db->getChunkManagerIfExists( ns, true );
-                                }
-                                else{
-                                    versionManager.forceRemoteCheckShardVersionCB( ns );
-                                    sleepsecs( attempts - 1 );
-                                }
-
-                                uassert( 15884, str::stream()
-                                         << "Could not reload chunk manager after "
-                                         << attempts << " attempts.", attempts <= 4 );
-
-                                continue;
-                            }
-
-                            ci->clearSinceLastGetError();
-                        }
-                        catch ( DBException& e ) {
-                            error() << "error processing writeback: " << e << endl;
-                            BSONObjBuilder b;
-                            e.getInfo().append( b, "err", "code" );
-                            gle = b.obj();
-                        }
+                    _addToGroup( groups, cid, wid, ns, data );
+                }
+
+                if ( ! groups.empty() ) {
+
+                    //
+                    // Each connection's writebacks are replayed in order, and the connections
+                    // concurrently.  The batch is done before the next one is asked for, so a
+                    // connection's writebacks never race each other across batches.
+                    //
+
+                    unsigned staleBefore = _staleReplays.get();
 
-                        break;
+                    for ( map<ConnectionIdent,ReplayGroup>::const_iterator it = groups.begin();
+                          it != groups.end();
+                          ++it ) {
+                        _replayPool.schedule( &WriteBackListener::_replayGroup, this, &it->second );
                     }
+                    _replayPool.join();
 
-                    {
-                        scoped_lock lk( _seenWritebacksLock );
-                        WBStatus& s = _seenWritebacks[cid];
-                        s.id = wid;
-                        s.gle = gle;
+                    if ( _staleReplays.get() != staleBefore ) {
+                        log() << "new version change detected, "
+                              << lastNeededCount << " writebacks processed previously" << endl;
+
+                        lastNeededVersion.reset();
+                        lastNeededCount = 1;
                     }
-                }
-                else if ( result["noop"].trueValue() ) {
-                    // no-op
-                }
-                else {
-                    log() << "unknown writeBack result: " << result << endl;
+
+                    writeBackDrainTime.recordMillis( drainTimer.millis() );
+                    LOG(1) << "replayed " << batch.size() << " writebacks from "
+                           << groups.size() << " connections in " << drainTimer.millis() << "ms"
+                           << endl;
                 }
 
                 secsToSleep = 0;
@@ -434,4 +391,213 @@ namespace mongo {
 
     }
 
+    /* static */
+    void WriteBackListener::_addToGroup( map<ConnectionIdent,ReplayGroup>& groups,
+                                         const ConnectionIdent& cid,
+                                         const OID& wid,
+                                         const string& ns,
+                                         const BSONObj& data ) {
+
+        Replay replay( ns, cid );
+        replay.wid = wid;
+        replay.writebacks.push_back( data );
+
+        //
+        // An insert can be coalesced with its neighbors if an error in it couldn't have stopped
+        // the rest of it: it has a single document, or continues on error.
+        //
+
+        int len;
+        Message msg( (void*)data["msg"].binData( len ) , false );
+        if ( msg.operation() == dbInsert ) {
+            DbMessage d( msg );
+            int docs = 0;
+            while ( d.moreJSObjs() ) {
+                replay.bytes += d.nextJsObj().objsize();
+                docs++;
+            }
+            replay.coalescable = docs == 1 ||
+                                 ( d.reservedField() & InsertOption_ContinueOnError );
+        }
+
+        ReplayGroup& group = groups[cid];
+        if ( ! group.empty() ) {
+            Replay& last = group.back();
+            if ( replay.coalescable && last.coalescable && last.ns == ns &&
+                 last.bytes + replay.bytes <= BSONObjMaxUserSize ) {
+
+                last.writebacks.push_back( data );
+                last.wid = wid;
+                last.bytes += replay.bytes;
+                writeBacksCoalesced.increment();
+                return;
+            }
+        }
+        group.push_back( replay );
+    }
+
+    void WriteBackListener::_replayGroup( const ReplayGroup* group ) {
+        for ( ReplayGroup::const_iterator it = group->begin(); it != group->end(); ++it ) {
+
+            BSONObj gle;
+            try {
+                gle = _replay( *it );
+            }
+            catch ( std::exception& e ) {
+                error() << "error replaying writeback: " << e.what() << endl;
+                gle = BSON( "err" << e.what() );
+            }
+
+            {
+                scoped_lock lk( _seenWritebacksLock );
+                WBStatus& s = _seenWritebacks[it->cid];
+                s.id = it->wid;
+                s.gle = gle;
+            }
+
+            writeBacksReplayed.increment( it->writebacks.size() );
+        }
+    }
+
+    BSONObj WriteBackListener::_replay( const Replay& replay ) {
+
+        const string& ns = replay.ns;
+
+        Message msg;
+        if ( replay.writebacks.size() == 1 ) {
+            int len;
+            msg.setData( (MsgData*)replay.writebacks[0]["msg"].binData( len ), false );
+        }
+        else {
+            // one continue-on-error insert of all the documents, in order
+            BufBuilder b;
+            b.appendNum( (int)InsertOption_ContinueOnError );
+            b.appendStr( ns );
+            for ( vector<BSONObj>::const_iterator it = replay.writebacks.begin();
+                  it != replay.writebacks.end();
+                  ++it ) {
+                int len;
+                Message part( (void*)(*it)["msg"].binData( len ) , false );
+                DbMessage d( part );
+                while ( d.moreJSObjs() ) {
+                    BSONObj doc = d.nextJsObj();
+                    b.appendBuf( doc.objdata(), doc.objsize() );
+                }
+            }
+            msg.setData( dbInsert, b.buf(), b.len() );
+            msg.header()->id = nextMessageId();
+            msg.header()->responseTo = 0;
+        }
+
+        DBConfigPtr db = grid.getDBConfig( ns );
+
+        // do request and then call getLastError
+        // we have to call getLastError so we can return the right fields to the user if they decide to call getLastError
+
+        BSONObj gle;
+        int attempts = 0;
+        while ( true ) {
+            attempts++;
+
+            try {
+
+                Request r( msg , 0 );
+                r.init();
+
+                r.d().reservedField() |= Reserved_FromWriteback;
+
+                ClientInfo * ci = r.getClientInfo();
+                if (!noauth) {
+                    ci->getAuthorizationManager()->grantInternalAuthorization(
+                            "_writebackListener");
+                }
+                ci->noAutoSplit();
+
+                r.process( attempts );
+
+                ci->newRequest(); // this so we flip prev and cur shards
+
+                BSONObjBuilder b;
+                string errmsg;
+                if ( ! ci->getLastError( "admin",
+                                         BSON( "getLastError" << 1 ),
+                                         b,
+                                         errmsg,
+                                         true ) )
+                {
+                    b.appendBool( "commandFailed" , true );
+                    if( ! b.hasField( "errmsg" ) ){
+
+                        b.append( "errmsg", errmsg );
+                        gle = b.obj();
+                    }
+                    else if( errmsg.size() > 0 ){
+
+                        // Rebuild GLE object with errmsg
+                        // TODO: Make this less clumsy by improving GLE interface
+                        gle = b.obj();
+
+                        if( gle["errmsg"].type() == String ){
+
+                            BSONObj gleNoErrmsg =
+                                    gle.filterFieldsUndotted( BSON( "errmsg" << 1 ),
+                                                              false );
+                            BSONObjBuilder bb;
+                            bb.appendElements( gleNoErrmsg );
+                            bb.append( "errmsg", gle["errmsg"].String() +
+                                                 " ::and:: " +
+                                                 errmsg );
+                            gle = bb.obj().getOwned();
+                        }
+                    }
+                }
+                else{
+                    gle = b.obj();
+                }
+
+                if ( gle["code"].numberInt() == 9517 ) {
+
+                    _staleReplays++;
+
+                    log() << "writeback failed because of stale config, retrying attempts: " << attempts << endl;
+                    LOG(1) << "writeback error : " << gle << endl;
+
+                    //
+                    // Bringing this in line with the similar retry logic elsewhere
+                    //
+                    // TODO: Reloading the chunk manager may not help if we dropped a
+                    // collection, but we don't actually have that info in the writeback
+                    // error
+                    //
+
+                    if( attempts <= 2 ){
+                        db->getChunkManagerIfExists( ns, true );
+                    }
+                    else{
+                        versionManager.forceRemoteCheckShardVersionCB( ns );
+                        sleepsecs( attempts - 1 );
+                    }
+
+                    uassert( 15884, str::stream()
+                             << "Could not reload chunk manager after "
+                             << attempts << " attempts.", attempts <= 4 );
+
+                    continue;
+                }
+
+                ci->clearSinceLastGetError();
+            }
+            catch ( DBException& e ) {
+                error() << "error processing writeback: " << e << endl;
+                BSONObjBuilder b;
+                e.getInfo().append( b, "err", "code" );
+                gle = b.obj();
+            }
+
+            break;
+        }
+
+        return gle;
+    }
+
 }  // namespace mongo
@@ -24,6 +24,7 @@
 #include "mongo/platform/unordered_set.h"
 #include "../client/connpool.h"
 #include "../util/background.h"
+#include "../util/concurrency/thread_pool.h"
 #include "../db/client.h"
 
 namespace mongo {
@@ -35,6 +36,11 @@ namespace mongo {
      *
      * Runs (instantiated) on mongos.
      * Currently, there is one writebacklistener per shard.
+     *
+     * The listener takes the writebacks queued for this mongos in batches.  Writebacks from the
+     * same connection are replayed in the order they were queued, with consecutive inserts into
+     * one namespace that could not stop each other (single documents, or continue-on-error)
+     * coalesced into one insert; writebacks from different connections are replayed concurrently.
      */
     class WriteBackListener : public BackgroundJob {
     public:
@@ -70,9 +76,41 @@ namespace mongo {
         void run();
 
     private:
+        /** one writeback to replay, or several coalesced inserts */
+        struct Replay {
+            Replay( const string& n, const ConnectionIdent& c )
+                : ns( n ), cid( c ), coalescable( false ), bytes( 0 ) {}
+
+            string ns;
+            ConnectionIdent cid;
+            OID wid; // of the last writeback replayed
+            vector<BSONObj> writebacks; // owned, in the order they were queued
+            bool coalescable;
+            int bytes; // of documents, when coalescable
+        };
+        typedef vector<Replay> ReplayGroup;
+
+        /** adds the writeback in data to its connection's group, coalescing it if possible */
+        static void _addToGroup( map<ConnectionIdent,ReplayGroup>& groups,
+                                 const ConnectionIdent& cid,
+                                 const OID& wid,
+                                 const string& ns,
+                                 const BSONObj& data );
+
+        /** replays a connection's writebacks in order; runs in _replayPool */
+        void _replayGroup( const ReplayGroup* group );
+
+        /** @return the getLastError of replaying one writeback or coalesced insert */
+        BSONObj _replay( const Replay& replay );
+
         string _addr;
         string _name;
 
+        ThreadPool _replayPool;
+
+        // set by a replay that found its version stale, so later batches don't skip reloading
+        AtomicUInt _staleReplays;
+
         static mongo::mutex _cacheLock; // protects _cache
         static unordered_map<string,WriteBackListener*> _cache; // server to listener
         static unordered_set<string> _seenSets; // cache of set urls we've seen - note this is ever expanding for order, case, changes
@@ -18,14 +18,17 @@
 
 #include "../pch.h"
 #include "mongo/base/initializer.h"
+#include "mongo/bson/bson_validate.h"
 #include "mongo/client/dbclientcursor.h"
 #include "../util/mmap.h"
 #include "../util/text.h"
+#include "../util/timer.h"
 #include "tool.h"
 
 #include <boost/program_options.hpp>
 
 #include <fcntl.h>
+#include <fstream>
 
 using namespace mongo;
 
@@ -40,6 +43,8 @@ public:
     BSONDump() : BSONTool( "bsondump", NONE ) {
         add_options()
         ("type" , po::value<string>()->default_value("json") , "type of output: json,debug" )
+        ("benchmark" , "instead of printing the objects, report how fast they are validated and "
+         "traversed in memory, in GB/s" )
         ;
         add_hidden_options()
         ("file" , po::value<string>() , ".bson file" )
@@ -72,10 +77,95 @@ public:
             return 1;
         }
 
+        if ( hasParam( "benchmark" ) )
+            return benchmark( root );
+
         processFile( root );
         return 0;
     }
 
+    /** @return the total size of o's elements, nested ones included, as BSONElement::size() */
+    static long long traverse( const BSONObj& o ) {
+        long long total = 0;
+        BSONObjIterator i( o );
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            total += e.size();
+            if ( e.isABSONObj() )
+                total += traverse( e.Obj() );
+        }
+        return total;
+    }
+
+    /**
+     * Reads the whole file into memory and times passes of validateBSON(), and of a traversal
+     * of every element, over its objects, so that the rates exclude disk and output.
+     */
+    int benchmark( const boost::filesystem::path& file ) {
+        string data;
+        {
+            ifstream in( file.string().c_str(), ios::in | ios::binary );
+            if ( !in ) {
+                cerr << "error opening file: " << file.string() << endl;
+                return 1;
+            }
+            stringstream ss;
+            ss << in.rdbuf();
+            data = ss.str();
+        }
+
+        vector<BSONObj> objs;
+        for ( size_t pos = 0; pos < data.size(); ) {
+            if ( data.size() - pos < 5 ) {
+                cerr << "trailing bytes at offset " << pos << endl;
+                return 1;
+            }
+            BSONObj o( data.data() + pos );
+            if ( o.objsize() < 5 || (size_t)o.objsize() > data.size() - pos ) {
+                cerr << "invalid object size " << o.objsize() << " at offset " << pos << endl;
+                return 1;
+            }
+            objs.push_back( o );
+            pos += o.objsize();
+        }
+        if ( objs.empty() ) {
+            cerr << "no objects in " << file.string() << endl;
+            return 1;
+        }
+
+        // run each for at least a second, so that small files give stable rates too
+        long long passes = 0;
+        Timer validateTimer;
+        do {
+            for ( vector<BSONObj>::const_iterator i = objs.begin(); i != objs.end(); ++i ) {
+                Status status = validateBSON( i->objdata(), i->objsize() );
+                if ( !status.isOK() ) {
+                    cerr << "invalid object at offset " << i->objdata() - data.data() << ": "
+                         << status.reason() << endl;
+                    return 1;
+                }
+            }
+            ++passes;
+        } while ( validateTimer.micros() < 1000000 );
+        double validateRate = (double)data.size() * passes / validateTimer.micros() / 1000;
+
+        long long traversePasses = 0;
+        long long traversed = 0; // printed, so that the traversals aren't optimized away
+        Timer traverseTimer;
+        do {
+            for ( vector<BSONObj>::const_iterator i = objs.begin(); i != objs.end(); ++i )
+                traversed += traverse( *i );
+            ++traversePasses;
+        } while ( traverseTimer.micros() < 1000000 );
+        double traverseRate = (double)data.size() * traversePasses / traverseTimer.micros() / 1000;
+
+        cout << objs.size() << " objects, " << data.size() << " bytes" << endl;
+        cout << "validate: " << setprecision( 3 ) << validateRate << " GB/s" << endl;
+        cout << "traverse: " << setprecision( 3 ) << traverseRate << " GB/s ("
+             << traversed / traversePasses << " per pass)" << endl;
+        return 0;
+    }
+
     bool debug( const BSONObj& o , int depth=0) {
         string prefix = "";
         for ( int i=0; i<depth; i++ ) {
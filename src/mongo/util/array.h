@@ -62,6 +62,11 @@ namespace mongo {
             return _size;
         }
 
+        /** the elements in use, for algorithms that want random access iterators */
+        T* data() {
+            return _data;
+        }
+
         bool hasSpace() {
             return _size < _capacity;
         }
@@ -111,6 +111,26 @@ namespace mongo {
             }
         }
 
+        void ThreadPool::growTo(int nThreads) {
+            scoped_lock lock(_mutex);
+            while (_nThreads < nThreads) {
+                Worker* worker = new Worker(*this);
+                _nThreads++;
+                if (!_tasks.empty()) {
+                    worker->set_task(_tasks.front());
+                    _tasks.pop_front();
+                }
+                else {
+                    _freeWorkers.push_front(worker);
+                }
+            }
+        }
+
+        int ThreadPool::nThreads() {
+            scoped_lock lock(_mutex);
+            return _nThreads;
+        }
+
         void ThreadPool::schedule(Task task) {
             scoped_lock lock(_mutex);
 
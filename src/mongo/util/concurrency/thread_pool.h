@@ -62,6 +62,11 @@ namespace mongo {
 
             int tasks_remaining() { return _tasksRemaining; }
 
+            // adds workers until the pool has at least nThreads of them; never shrinks
+            void growTo(int nThreads);
+
+            int nThreads();
+
         private:
             mongo::mutex _mutex;
             boost::condition _condition;
@@ -69,7 +74,7 @@ namespace mongo {
             std::list<Worker*> _freeWorkers; //used as LIFO stack (always front)
             std::list<Task> _tasks; //used as FIFO queue (push_back, pop_front)
             int _tasksRemaining; // in queue + currently processing
-            int _nThreads; // only used for sanity checking. could be removed in the future.
+            int _nThreads; // number of workers owned by the pool, free or busy
 
             // should only be called by a worker from the worker's thread
             void task_done(Worker* worker);
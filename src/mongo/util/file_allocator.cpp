@@ -34,6 +34,7 @@
 #   include <io.h>
 #endif
 
+#include "mongo/db/jsobj.h"
 #include "mongo/util/time_support.h"
 #include "mongo/util/timer.h"
 #include "mongo/util/mongoutils/str.h"
@@ -74,13 +75,35 @@ namespace mongo {
         return parent;
     }
 
+    /**
+     * files of one database are allocated one after another, so the key is the file name
+     * without its number: dbpath/foo.3 -> dbpath/foo
+     */
+    static string databaseOf( const string &name ) {
+        size_t dot = name.rfind( '.' );
+        return dot == string::npos ? name : name.substr( 0, dot );
+    }
+
     FileAllocator::FileAllocator()
-        : _pendingMutex("FileAllocator"), _failed() {
+        : _pendingMutex("FileAllocator"), _numThreads(0),
+          _numAllocated(0), _numReserved(0), _allocMillis(0), _maxAllocMillis(0),
+          _numStalls(0), _stallMillis(0), _failed() {
     }
 
 
-    void FileAllocator::start() {
-        boost::thread t( boost::bind( &FileAllocator::run , this ) );
+    void FileAllocator::start( int numThreads ) {
+        if ( numThreads < 1 )
+            numThreads = 1;
+        {
+            // initialize unique temporary file name counter
+            // TODO: SERVER-6055 -- Unify temporary file name selection
+            SimpleMutex::scoped_lock lk(_uniqueNumberMutex);
+            _uniqueNumber = curTimeMicros64();
+        }
+        _numThreads = numThreads;
+        for ( int i = 0; i < numThreads; i++ ) {
+            boost::thread t( boost::bind( &FileAllocator::run , this ) );
+        }
     }
 
     void FileAllocator::requestAllocation( const string &name, long &size ) {
@@ -106,21 +129,22 @@ namespace mongo {
                 return;
         }
         checkFailure();
+
+        // the file was not preallocated in time: the caller stalls until it is
+        Timer t;
         _pendingSize[ name ] = size;
-        if ( _pending.size() == 0 )
-            _pending.push_back( name );
-        else if ( _pending.front() != name ) {
+        if ( _active.count( name ) == 0 ) {
+            // the threads pick the first eligible file, so this one goes next
             _pending.remove( name );
-            list< string >::iterator i = _pending.begin();
-            ++i;
-            _pending.insert( i, name );
+            _pending.push_front( name );
         }
         _pendingUpdated.notify_all();
         while( inProgress( name ) ) {
             checkFailure();
             _pendingUpdated.wait( lk.boost() );
         }
-
+        _numStalls++;
+        _stallMillis += t.millis();
     }
 
     void FileAllocator::waitUntilFinished() const {
@@ -152,22 +176,29 @@ namespace mongo {
 #endif
     }
 
-    void FileAllocator::ensureLength(int fd , long size) {
+    bool FileAllocator::ensureLength(int fd , long size) {
 #if !defined(_WIN32)
         if (useSparseFiles(fd)) {
             LOG(1) << "using ftruncate to create a sparse file" << endl;
             int ret = ftruncate(fd, size);
             uassert(16063, "ftruncate failed: " + errnoWithDescription(), ret == 0);
-            return;
+            return true;
         }
 #endif
 
 #if defined(__linux__)
-        int ret = posix_fallocate(fd,0,size);
-        if ( ret == 0 )
-            return;
-
-        log() << "FileAllocator: posix_fallocate failed: " << errnoWithDescription( ret ) << " falling back" << endl;
+        // unlike posix_fallocate, fallocate fails with EOPNOTSUPP rather than silently
+        // emulating the reservation one block at a time when the filesystem lacks support
+        if ( fallocate(fd, 0, 0, size) == 0 )
+            return true;
+
+        int err = errno;
+        if ( err == EOPNOTSUPP || err == ENOSYS ) {
+            LOG(1) << "FileAllocator: fallocate not supported, filling with zeroes" << endl;
+        }
+        else {
+            log() << "FileAllocator: fallocate failed: " << errnoWithDescription( err ) << " falling back" << endl;
+        }
 #endif
 
         off_t filelen = lseek( fd, 0, SEEK_END );
@@ -200,12 +231,35 @@ namespace mongo {
                 left -= written;
             }
         }
+        return false;
     }
 
     bool FileAllocator::hasFailed() const {
         return _failed;
     }
 
+    void FileAllocator::appendStats( BSONObjBuilder& b ) const {
+        scoped_lock lk( _pendingMutex );
+        b.append( "threads" , _numThreads );
+        b.appendNumber( "pending" , (long long)_pending.size() );
+        b.appendNumber( "active" , (long long)_active.size() );
+        {
+            BSONObjBuilder bb( b.subobjStart( "allocations" ) );
+            bb.appendNumber( "num" , _numAllocated );
+            bb.appendNumber( "reserved" , _numReserved );
+            bb.appendNumber( "zeroFilled" , _numAllocated - _numReserved );
+            bb.appendNumber( "totalMillis" , _allocMillis );
+            bb.appendNumber( "maxMillis" , _maxAllocMillis );
+            bb.done();
+        }
+        {
+            BSONObjBuilder bb( b.subobjStart( "stalls" ) );
+            bb.appendNumber( "num" , _numStalls );
+            bb.appendNumber( "totalMillis" , _stallMillis );
+            bb.done();
+        }
+    }
+
     void FileAllocator::checkFailure() {
         if (_failed) {
             // we want to log the problem (diskfull.js expects it) but we do not want to dump a stack tracke
@@ -229,6 +283,28 @@ namespace mongo {
         return false;
     }
 
+    // caller must hold _pendingMutex lock.
+    bool FileAllocator::startNext( string* name ) {
+        for( list< string >::const_iterator i = _pending.begin(); i != _pending.end(); ++i ) {
+            if ( _active.count( *i ) )
+                continue;
+            string db = databaseOf( *i );
+            if ( _activeDatabases.count( db ) )
+                continue;
+            _active.insert( *i );
+            _activeDatabases.insert( db );
+            *name = *i;
+            return true;
+        }
+        return false;
+    }
+
+    // caller must hold _pendingMutex lock.
+    void FileAllocator::finishActive( const string &name ) {
+        _active.erase( name );
+        _activeDatabases.erase( databaseOf( name ) );
+    }
+
     string FileAllocator::makeTempFileName( boost::filesystem::path root ) {
         while( 1 ) {
             boost::filesystem::path p = root / "_tmp";
@@ -252,108 +328,106 @@ namespace mongo {
 
     void FileAllocator::run( FileAllocator * fa ) {
         setThreadName( "FileAllocator" );
-        {
-            // initialize unique temporary file name counter
-            // TODO: SERVER-6055 -- Unify temporary file name selection
-            SimpleMutex::scoped_lock lk(_uniqueNumberMutex);
-            _uniqueNumber = curTimeMicros64();
-        }
         while( 1 ) {
+            string name;
+            long size;
             {
                 scoped_lock lk( fa->_pendingMutex );
-                if ( fa->_pending.size() == 0 )
+                while ( !fa->startNext( &name ) )
                     fa->_pendingUpdated.wait( lk.boost() );
+                size = fa->_pendingSize[ name ];
             }
-            while( 1 ) {
-                string name;
-                long size;
-                {
-                    scoped_lock lk( fa->_pendingMutex );
-                    if ( fa->_pending.size() == 0 )
-                        break;
-                    name = fa->_pending.front();
-                    size = fa->_pendingSize[ name ];
-                }
 
-                string tmp;
-                long fd = 0;
-                try {
-                    log() << "allocating new datafile " << name << ", filling with zeroes..." << endl;
-                    
-                    boost::filesystem::path parent = ensureParentDirCreated(name);
-                    tmp = fa->makeTempFileName( parent );
-                    ensureParentDirCreated(tmp);
+            string tmp;
+            long fd = 0;
+            try {
+                log() << "allocating new datafile " << name << ", filling with zeroes..." << endl;
+                
+                boost::filesystem::path parent = ensureParentDirCreated(name);
+                tmp = fa->makeTempFileName( parent );
+                ensureParentDirCreated(tmp);
 
 #if defined(_WIN32)
-                    fd = _open( tmp.c_str(), _O_RDWR | _O_CREAT | O_NOATIME, _S_IREAD | _S_IWRITE );
+                fd = _open( tmp.c_str(), _O_RDWR | _O_CREAT | O_NOATIME, _S_IREAD | _S_IWRITE );
 #else
-                    fd = open(tmp.c_str(), O_CREAT | O_RDWR | O_NOATIME, S_IRUSR | S_IWUSR);
+                fd = open(tmp.c_str(), O_CREAT | O_RDWR | O_NOATIME, S_IRUSR | S_IWUSR);
 #endif
-                    if ( fd < 0 ) {
-                        log() << "FileAllocator: couldn't create " << name << " (" << tmp << ") " << errnoWithDescription() << endl;
-                        uasserted(10439, "");
-                    }
+                if ( fd < 0 ) {
+                    log() << "FileAllocator: couldn't create " << name << " (" << tmp << ") " << errnoWithDescription() << endl;
+                    uasserted(10439, "");
+                }
 
 #if defined(POSIX_FADV_DONTNEED)
-                    if( posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED) ) {
-                        log() << "warning: posix_fadvise fails " << name << " (" << tmp << ") " << errnoWithDescription() << endl;
-                    }
+                if( posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED) ) {
+                    log() << "warning: posix_fadvise fails " << name << " (" << tmp << ") " << errnoWithDescription() << endl;
+                }
 #endif
 
-                    Timer t;
+                Timer t;
+
+                /* make sure the file is the full desired length */
+                bool reserved = ensureLength( fd , size );
 
-                    /* make sure the file is the full desired length */
-                    ensureLength( fd , size );
+                close( fd );
+                fd = 0;
 
+                if( rename(tmp.c_str(), name.c_str()) ) {
+                    const string& errStr = errnoWithDescription();
+                    const string& errMessage = str::stream()
+                            << "error: couldn't rename " << tmp
+                            << " to " << name << ' ' << errStr;
+                    msgasserted(13653, errMessage);
+                }
+                flushMyDirectory(name);
+
+                long long millis = t.millis();
+                log() << "done allocating datafile " << name << ", "
+                      << "size: " << size/1024/1024 << "MB, "
+                      << " took " << ((double)millis)/1000.0 << " secs"
+                      << endl;
+
+                scoped_lock lk( fa->_pendingMutex );
+                fa->_numAllocated++;
+                if ( reserved )
+                    fa->_numReserved++;
+                fa->_allocMillis += millis;
+                if ( millis > fa->_maxAllocMillis )
+                    fa->_maxAllocMillis = millis;
+
+                // no longer in a failed state. allow new writers.
+                fa->_failed = false;
+            }
+            catch ( const std::exception& e ) {
+                log() << "error: failed to allocate new file: " << name
+                      << " size: " << size << ' ' << e.what()
+                      << ".  will try again in 10 seconds" << endl;
+                if ( fd > 0 )
                     close( fd );
-                    fd = 0;
-
-                    if( rename(tmp.c_str(), name.c_str()) ) {
-                        const string& errStr = errnoWithDescription();
-                        const string& errMessage = str::stream()
-                                << "error: couldn't rename " << tmp
-                                << " to " << name << ' ' << errStr;
-                        msgasserted(13653, errMessage);
-                    }
-                    flushMyDirectory(name);
-
-                    log() << "done allocating datafile " << name << ", "
-                          << "size: " << size/1024/1024 << "MB, "
-                          << " took " << ((double)t.millis())/1000.0 << " secs"
-                          << endl;
-
-                    // no longer in a failed state. allow new writers.
-                    fa->_failed = false;
+                try {
+                    if ( ! tmp.empty() )
+                        boost::filesystem::remove( tmp );
+                    boost::filesystem::remove( name );
+                } catch ( const std::exception& e ) {
+                    log() << "error removing files: " << e.what() << endl;
                 }
-                catch ( const std::exception& e ) {
-                    log() << "error: failed to allocate new file: " << name
-                          << " size: " << size << ' ' << e.what()
-                          << ".  will try again in 10 seconds" << endl;
-                    if ( fd > 0 )
-                        close( fd );
-                    try {
-                        if ( ! tmp.empty() )
-                            boost::filesystem::remove( tmp );
-                        boost::filesystem::remove( name );
-                    } catch ( const std::exception& e ) {
-                        log() << "error removing files: " << e.what() << endl;
-                    }
+                {
                     scoped_lock lk( fa->_pendingMutex );
                     fa->_failed = true;
-                    // not erasing from pending
+                    // not erasing from pending, the next pass retries it
+                    fa->finishActive( name );
                     fa->_pendingUpdated.notify_all();
-                    
-                    
-                    sleepsecs(10);
-                    continue;
                 }
 
-                {
-                    scoped_lock lk( fa->_pendingMutex );
-                    fa->_pendingSize.erase( name );
-                    fa->_pending.pop_front();
-                    fa->_pendingUpdated.notify_all();
-                }
+                sleepsecs(10);
+                continue;
+            }
+
+            {
+                scoped_lock lk( fa->_pendingMutex );
+                fa->_pendingSize.erase( name );
+                fa->_pending.remove( name );
+                fa->finishActive( name );
+                fa->_pendingUpdated.notify_all();
             }
         }
     }
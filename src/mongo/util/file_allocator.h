@@ -35,7 +35,11 @@ namespace mongo {
          * size specified per file will be used.
         */
     public:
-        void start();
+        /**
+         * Starts the allocator threads.  Files belonging to different databases are
+         * allocated in parallel, at most one at a time per database.
+         */
+        void start( int numThreads = 1 );
 
         /**
          * May be called if file exists. If file exists, or its allocation has
@@ -54,7 +58,17 @@ namespace mongo {
         
         bool hasFailed() const;
 
-        static void ensureLength(int fd, long size);
+        /**
+         * Appends allocation counters to b: files allocated and time spent doing so, and how
+         * often (and for how long) callers of allocateAsap() had to wait for a file.
+         */
+        void appendStats( BSONObjBuilder& b ) const;
+
+        /**
+         * Makes sure the file is size bytes long.
+         * @return true if the space was reserved without writing zeroes (sparse file or fallocate)
+         */
+        static bool ensureLength(int fd, long size);
 
         /** @return the singleton */
         static FileAllocator * get();
@@ -72,6 +86,13 @@ namespace mongo {
         // caller must hold pendingMutex_ lock.
         bool inProgress( const string &name ) const;
 
+        // caller must hold pendingMutex_ lock.  Picks the first pending file whose database
+        // has no allocation running and marks it active.  Returns false if there is none.
+        bool startNext( string* name );
+
+        // caller must hold pendingMutex_ lock.
+        void finishActive( const string &name );
+
         /** called from the worked thread */
         static void run( FileAllocator * fa );
 
@@ -84,6 +105,20 @@ namespace mongo {
         std::list< string > _pending;
         mutable map< string, long > _pendingSize;
 
+        // files being allocated right now, and the databases they belong to
+        set< string > _active;
+        set< string > _activeDatabases;
+
+        int _numThreads;
+
+        // counters for appendStats(), guarded by _pendingMutex
+        long long _numAllocated;
+        long long _numReserved; // allocations which did not need a zero fill
+        long long _allocMillis;
+        long long _maxAllocMillis;
+        long long _numStalls;
+        long long _stallMillis;
+
         // unique number for temporary files
         static unsigned long long _uniqueNumber;
 
@@ -31,6 +31,9 @@ namespace mongo {
         enum Advice { Sequential=1 , Random=2 };
         MAdvise(void *p, unsigned len, Advice a); 
         ~MAdvise(); // destructor resets the range to MADV_NORMAL
+
+        /** asks the OS to start reading in the range asynchronously.  only a hint, nothing to undo */
+        static void willNeed(const void *p, size_t len);
     };
 
     // lock order: lock dbMutex before this if you lock both
@@ -67,6 +67,7 @@ namespace mongo {
 #if defined(__sunos__)
     MAdvise::MAdvise(void *,unsigned, Advice) { }
     MAdvise::~MAdvise() { }
+    void MAdvise::willNeed(const void *, size_t) { }
 #else
     MAdvise::MAdvise(void *p, unsigned len, Advice a) {
         
@@ -89,6 +90,14 @@ namespace mongo {
     MAdvise::~MAdvise() { 
         madvise(_p,_len,MADV_NORMAL);
     }
+
+    void MAdvise::willNeed(const void *p, size_t len) {
+        void *start = (void*)((long)p & ~(g_minOSPageSizeBytes-1));
+        len += (unsigned long long)p - (unsigned long long)start;
+        if ( madvise(start, len, MADV_WILLNEED) ) {
+            LOG(1) << "madvise(MADV_WILLNEED) failed: " << errnoWithDescription() << endl;
+        }
+    }
 #endif
 
     void* MemoryMappedFile::map(const char *filename, unsigned long long &length, int options) {
@@ -69,6 +69,28 @@ namespace mongo {
             _cvNoLongerEmpty.notify_one();
         }
 
+        /**
+         * Like push, but gives up if the queue is still full after maxSecondsToWait.  An item
+         * too big for the queue is let in once the queue is empty.
+         * @return false if t wasn't queued
+         */
+        bool blockingPush( T const& t, int maxSecondsToWait ) {
+            boost::xtime xt;
+            boost::xtime_get(&xt, MONGO_BOOST_TIME_UTC);
+            xt.sec += maxSecondsToWait;
+
+            scoped_lock l( _lock );
+            size_t tSize = _getSize(t);
+            while ( _currentSize > 0 && _currentSize + tSize >= _maxSize ) {
+                if ( ! _cvNoLongerFull.timed_wait( l.boost() , xt ) )
+                    return false;
+            }
+            _queue.push( t );
+            _currentSize += tSize;
+            _cvNoLongerEmpty.notify_one();
+            return true;
+        }
+
         bool empty() const {
             scoped_lock l( _lock );
             return _queue.empty();